@@ -1,5 +1,9 @@
 #version 330 core
 
+// Variant keywords (see ShaderVariants), picking where the base color comes
+// from: USE_VIRTUAL_TEXTURE, USE_TEXTURE_ARRAY or USE_TEXTURE, otherwise
+// material.diffuse
+
 // Output color
 out vec4 FragColor;
 
@@ -18,54 +22,108 @@ struct Material {
     // Texture samplers
     sampler2D diffuse_map;
     sampler2D specular_map;
-    bool use_texture;
+    // Base color layer with USE_TEXTURE_ARRAY (see TextureArrayPacker)
+    sampler2DArray diffuse_array;
+    int layer;
 };
 
-// Light properties
-struct Light {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// Streamed texture (see VirtualTexture): page_table has one texel per tile and
+// a mip level per pyramid level, each pointing at a tile in physical_cache
+struct VirtualTexture {
+    sampler2D page_table;
+    sampler2D physical_cache;
+    vec2 size;          // Level 0 texels, padded to whole tiles
+    vec2 uv_scale;      // Part of the padded level the image covers
+    float max_level;
+    float tile_size;    // Texels per tile without borders
+    float tile_border;
+    float lod_bias;
 };
 
+// Per-frame constants shared by every program (see FrameUniforms)
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+} frame;
+
 uniform Material material;
-uniform Light light;
-uniform vec3 viewPos;
+uniform VirtualTexture virtual_texture;
+
+// Pyramid level a texture lookup at uv would pick
+float virtual_texture_level(vec2 uv) {
+    vec2 texel = uv * virtual_texture.uv_scale * virtual_texture.size;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float rho = max(dot(dx, dx), dot(dy, dy));
+    return clamp(0.5 * log2(max(rho, 1e-8)) + virtual_texture.lod_bias, 0.0, virtual_texture.max_level);
+}
+
+// Bilinear sample of one pyramid level, or of the nearest resident ancestor
+// while that level's tile is still loading
+vec4 sample_virtual_level(vec2 uv, float level) {
+    vec2 level_size = max(floor(virtual_texture.size / exp2(level)), vec2(1.0));
+    ivec2 page = ivec2(uv * level_size / virtual_texture.tile_size);
+    vec3 entry = texelFetch(virtual_texture.page_table, page, int(level)).rgb * 255.0;
+
+    vec2 mapped_size = max(floor(virtual_texture.size / exp2(entry.b)), vec2(1.0));
+    vec2 texel = min(uv * mapped_size, mapped_size - 0.5);
+    vec2 in_tile = texel - floor(texel / virtual_texture.tile_size) * virtual_texture.tile_size;
+    float stored = virtual_texture.tile_size + 2.0 * virtual_texture.tile_border;
+    vec2 physical = entry.rg * stored + virtual_texture.tile_border + in_tile;
+    return texture(virtual_texture.physical_cache, physical / vec2(textureSize(virtual_texture.physical_cache, 0)));
+}
+
+// Trilinear sample of the virtual texture, repeating like diffuse_map
+vec4 sample_virtual_texture(vec2 uv) {
+    float level = virtual_texture_level(uv);
+    vec2 wrapped = fract(uv) * virtual_texture.uv_scale;
+    float fine = floor(level);
+    vec4 color = sample_virtual_level(wrapped, fine);
+    if (fine < virtual_texture.max_level) {
+        color = mix(color, sample_virtual_level(wrapped, fine + 1.0), level - fine);
+    }
+    return color;
+}
 
 void main() {
     // Get base color from texture or material
-    vec3 base_color;
-    if (material.use_texture) {
-        base_color = texture(material.diffuse_map, TexCoord).rgb;
-    } else {
-        base_color = material.diffuse;
-    }
+#if defined(USE_VIRTUAL_TEXTURE)
+    vec3 base_color = sample_virtual_texture(TexCoord).rgb;
+#elif defined(USE_TEXTURE_ARRAY)
+    vec3 base_color = texture(material.diffuse_array, vec3(TexCoord, float(material.layer))).rgb;
+#elif defined(USE_TEXTURE)
+    vec3 base_color = texture(material.diffuse_map, TexCoord).rgb;
+#else
+    vec3 base_color = material.diffuse;
+#endif
 
     // Ambient lighting
-    vec3 ambient = light.ambient * material.ambient * base_color;
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * frame.lightColor.rgb * material.ambient * base_color;
 
     // Diffuse lighting
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 lightDir = normalize(frame.lightPosition.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * base_color;
+    vec3 diffuse = frame.lightColor.rgb * diff * base_color;
 
     // Specular lighting (Blinn-Phong)
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(frame.cameraPosition.xyz - FragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(norm, halfwayDir), 0.0), material.shininess);
 
 
 
 
-    vec3 specular_color;
-    if (material.use_texture) {
-        specular_color = texture(material.specular_map, TexCoord).rgb;
-    } else {
-        specular_color = material.specular;
-    }
-    vec3 specular = light.specular * spec * specular_color;
+#ifdef USE_TEXTURE
+    vec3 specular_color = texture(material.specular_map, TexCoord).rgb;
+#else
+    vec3 specular_color = material.specular;
+#endif
+    vec3 specular = frame.lightColor.rgb * spec * specular_color;
 
     // Combine results
     vec3 result = ambient + diffuse + specular;
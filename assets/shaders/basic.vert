@@ -10,22 +10,47 @@ out vec3 FragPos;    // World position of fragment
 out vec3 Normal;     // Normal vector
 out vec2 TexCoord;   // Texture coordinate
 
+// Per-frame constants shared by every program (see FrameUniforms)
+layout (std140) uniform Frame {
+    mat4 view;           // World to camera
+    mat4 projection;     // Camera to screen
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+} frame;
+
 // Transformation matrices
 uniform mat4 model;      // Model matrix (object to world)
-uniform mat4 view;       // View matrix (world to camera)
-uniform mat4 projection; // Projection matrix (camera to screen)
+
+// Vertex decoding (see Mesh::apply_vertex_decode)
+uniform vec3 positionOffset; // Bounds minimum for quantized positions, zero otherwise
+uniform vec3 positionScale;  // Bounds extent for quantized positions, one otherwise
+uniform bool octNormals;     // Normal arrives octahedral encoded in aNormal.xy
+
+// Unfold an octahedral encoded unit vector
+vec3 oct_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main() {
+    // Decode the vertex format
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 normal = octNormals ? oct_decode(aNormal.xy) : aNormal;
+
     // Calculate world position
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(model * vec4(position, 1.0));
 
     // Transform normal to world space
     // Note: We use the normal matrix to handle non-uniform scaling
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(transpose(inverse(model))) * normal;
 
     // Pass texture coordinates unchanged
     TexCoord = aTexCoord;
 
     // Final vertex position in screen space
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = frame.projection * frame.view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
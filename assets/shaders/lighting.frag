@@ -5,35 +5,85 @@ in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoord;
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+} frame;
+
 uniform vec3 objectColor;
-uniform vec3 viewPos;
 uniform sampler2D texture1;
 
+// Image based lighting from an EnvironmentMap, in the USE_ENVIRONMENT
+// variant (see ShaderVariants)
+struct Environment {
+    // Spherical harmonics irradiance, RGB per coefficient
+    vec3 irradiance[9];
+    samplerCube specular;
+    float max_level;
+    float intensity;
+};
+uniform Environment environment;
+uniform float roughness;
+
+vec3 sh_irradiance(vec3 n)
+{
+    return environment.irradiance[0] * 0.282095
+         + environment.irradiance[1] * 0.488603 * n.y
+         + environment.irradiance[2] * 0.488603 * n.z
+         + environment.irradiance[3] * 0.488603 * n.x
+         + environment.irradiance[4] * 1.092548 * n.x * n.y
+         + environment.irradiance[5] * 1.092548 * n.y * n.z
+         + environment.irradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+         + environment.irradiance[7] * 1.092548 * n.x * n.z
+         + environment.irradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Analytic fit of the split sum environment BRDF (Karis 2014, mobile)
+vec3 environment_brdf(vec3 f0, float r, float n_dot_v)
+{
+    const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+    const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+    vec4 r4 = r * c0 + c1;
+    float a004 = min(r4.x * r4.x, exp2(-9.28 * n_dot_v)) * r4.x + r4.y;
+    vec2 ab = vec2(-1.04, 1.04) * a004 + r4.zw;
+    return f0 * ab.x + ab.y;
+}
+
 void main()
 {
-    // Ambient
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(frame.cameraPosition.xyz - FragPos);
+
+    // Ambient, from the environment when there is one
     float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 ambient = ambientStrength * frame.lightColor.rgb;
+    vec3 reflected = vec3(0.0);
+#ifdef USE_ENVIRONMENT
+    ambient = max(sh_irradiance(norm), 0.0) * environment.intensity;
+    vec3 R = reflect(-viewDir, norm);
+    vec3 prefiltered = textureLod(environment.specular, R, roughness * environment.max_level).rgb;
+    vec3 brdf = environment_brdf(vec3(0.04), roughness, max(dot(norm, viewDir), 0.0));
+    reflected = prefiltered * brdf * environment.intensity;
+#endif
 
     // Diffuse
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(frame.lightPosition.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = diff * frame.lightColor.rgb;
 
     // Specular
     float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;
+    vec3 specular = specularStrength * spec * frame.lightColor.rgb;
 
     // Sample texture
     vec4 texColor = texture(texture1, TexCoord);
 
     // Combine lighting with texture
     vec3 result = (ambient + diffuse + specular) * objectColor;
-    FragColor = vec4(result, 1.0) * texColor;
+    FragColor = vec4(result, 1.0) * texColor + vec4(reflected, 0.0);
 }
\ No newline at end of file
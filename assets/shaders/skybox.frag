@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Direction;
+
+uniform samplerCube environmentMap;
+uniform float intensity;
+
+void main()
+{
+    vec3 color = textureLod(environmentMap, normalize(Direction), 0.0).rgb * intensity;
+    // The rest of the scene is unmapped, so only keep the sky in range
+    FragColor = vec4(color / (1.0 + color), 1.0);
+}
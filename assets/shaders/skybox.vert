@@ -0,0 +1,23 @@
+#version 330 core
+// Full screen triangle from gl_VertexID, drawn with an empty vertex array
+out vec3 Direction;
+
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+} frame;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    // Back through projection * view with the translation removed
+    mat4 inverseViewProjection = inverse(frame.projection * mat4(mat3(frame.view)));
+    vec4 world = inverseViewProjection * vec4(position, 1.0, 1.0);
+    Direction = world.xyz / world.w;
+
+    // On the far plane, behind everything drawn before it
+    gl_Position = vec4(position, 1.0, 1.0);
+}
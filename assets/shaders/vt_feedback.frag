@@ -0,0 +1,36 @@
+#version 330 core
+
+// Records which virtual texture tile every pixel needs (see VirtualTexture):
+// page x, page y and pyramid level, alpha 1 for covered pixels
+
+out uvec4 FragColor;
+
+in vec2 TexCoord;
+
+// Same parameters as basic.frag's VirtualTexture, without the samplers
+struct VirtualTexture {
+    vec2 size;
+    vec2 uv_scale;
+    float max_level;
+    float tile_size;
+    float lod_bias;
+};
+
+uniform VirtualTexture virtual_texture;
+
+// Must match virtual_texture_level() in basic.frag
+float virtual_texture_level(vec2 uv) {
+    vec2 texel = uv * virtual_texture.uv_scale * virtual_texture.size;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float rho = max(dot(dx, dx), dot(dy, dy));
+    return clamp(0.5 * log2(max(rho, 1e-8)) + virtual_texture.lod_bias, 0.0, virtual_texture.max_level);
+}
+
+void main() {
+    float level = floor(virtual_texture_level(TexCoord));
+    vec2 level_size = max(floor(virtual_texture.size / exp2(level)), vec2(1.0));
+    vec2 uv = fract(TexCoord) * virtual_texture.uv_scale;
+    uvec2 page = uvec2(uv * level_size / virtual_texture.tile_size);
+    FragColor = uvec4(page, uint(level), 1u);
+}
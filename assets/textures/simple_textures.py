@@ -2,6 +2,9 @@
 """
 Simple script to create basic textures for testing your 3D viewer
 Run this in your project's assets/textures/ directory
+
+The viewer generates the same patterns itself at startup (see
+ProceduralTexture), so this is only needed for image files to load.
 """
 
 from PIL import Image, ImageDraw
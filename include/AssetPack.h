@@ -0,0 +1,138 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Single file archive of the assets directory, opened with one mapping so
+// startup doesn't pay an open per shader, texture and model.
+//
+// Layout (little endian):
+//   AssetPackHeader
+//   entry table  entry_count * AssetPackEntry, sorted by name hash
+//   names        entry names back to back, not terminated
+//   contents     every file on a 4 KiB boundary, either as it is or as
+//                compressed blocks:
+//                  block offsets  block_count + 1 offsets relative to the
+//                                 entry, block i spans [offset i, offset i+1)
+//                  blocks         Lz4Codec blocks of block_size bytes each
+//                                 once decompressed, the last one shorter;
+//                                 a block that didn't shrink is stored as is
+//
+// Names are the paths the program opens, such as assets/shaders/basic.vert,
+// with forward slashes. Blocks are independent, so an entry decompresses in
+// parallel and a range of it without touching the rest.
+struct AssetPackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+    uint64_t entry_offset;
+    uint64_t name_offset;
+    uint64_t name_size;
+};
+
+struct AssetPackEntry {
+    uint64_t name_hash;
+    uint64_t offset;
+    // Bytes at offset, and the size of the contents once decompressed
+    uint64_t stored_size;
+    uint64_t size;
+    // Relative to name_offset
+    uint32_t name_offset;
+    uint32_t name_length;
+    // 0 for entries stored as they are
+    uint32_t block_size;
+    uint32_t reserved;
+};
+
+class AssetPack {
+public:
+    static constexpr char MAGIC[4] = {'A', 'P', 'A', 'K'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t CONTENT_ALIGNMENT = 4096;
+    static constexpr uint32_t MIN_BLOCK_SIZE = 64 * 1024;
+    static constexpr uint32_t MAX_BLOCK_SIZE = 256 * 1024;
+    static constexpr uint32_t DEFAULT_BLOCK_SIZE = 128 * 1024;
+
+    // FNV-1a of a normalized name
+    static uint64_t hash_name(std::string_view name);
+    // Name a path is stored under: lexically normal with forward slashes
+    static std::string normalize(std::string_view path);
+
+    // Pack every regular file under the directories, named by the directory
+    // as given plus the path inside it. Caches the loaders write next to
+    // their sources are left out. With a block_size files are compressed in
+    // blocks of that size, across the thread pool, and kept that way when
+    // it saves at least an eighth; 0 stores everything as it is. Baked .vtex
+    // and .ktx2 files always stay uncompressed so they map in place.
+    static bool write(const std::string& pack_path, const std::vector<std::string>& directories,
+                      uint32_t block_size = 0);
+
+    // Constructor, maps and validates the pack
+    AssetPack() = default;
+    explicit AssetPack(const std::string& path);
+
+    bool is_valid() const { return header != nullptr; }
+    size_t entry_count() const { return is_valid() ? header->entry_count : 0; }
+    // Entries in table order
+    const AssetPackEntry& entry(size_t index) const { return entries[index]; }
+
+    // Entry of a packed file, nullptr when the name isn't packed
+    const AssetPackEntry* find(std::string_view path) const;
+    // Contents of an entry stored as it is, as a view into the mapping valid
+    // while this object lives; a null view for compressed entries
+    std::string_view contents(const AssetPackEntry& entry) const;
+    // Copy size bytes of an entry's contents from offset into destination.
+    // Only the blocks covering the range are decompressed, spread over the
+    // thread pool, and whole blocks decompress straight into destination.
+    bool read(const AssetPackEntry& entry, uint64_t offset, uint64_t size, char* destination) const;
+    // Names of the packed files directly inside a directory
+    std::vector<std::string> list(std::string_view directory) const;
+
+    // Process wide pack AssetFile reads from. Mount once at startup, before
+    // anything loads; a failed mount leaves the previous pack in place.
+    static bool mount(const std::string& path);
+    static const AssetPack& mounted();
+
+private:
+    MappedFile file;
+    const AssetPackHeader* header = nullptr;
+    const AssetPackEntry* entries = nullptr;
+    const char* names = nullptr;
+
+    std::string_view entry_name(const AssetPackEntry& entry) const;
+    static AssetPack& mount_point();
+};
+
+// Contents of one asset: served from the mounted AssetPack when it holds the
+// path, without a copy unless the entry is compressed, otherwise mapped from
+// disk. Same interface as MappedFile so loaders can take either.
+class AssetFile {
+public:
+    // Constructor
+    AssetFile() = default;
+    explicit AssetFile(const std::string& path);
+
+    bool is_open() const { return contents.data() != nullptr; }
+    const char* data() const { return contents.data(); }
+    size_t size() const { return contents.size(); }
+    std::string_view view() const { return contents; }
+    uint64_t content_hash() const { return MappedFile::content_hash(contents); }
+
+    // Whether the mounted pack or the disk has the path
+    static bool exists(const std::string& path);
+    // Files directly inside a directory, from the mounted pack and the disk,
+    // sorted and without duplicates
+    static std::vector<std::string> list(const std::string& directory);
+
+private:
+    // Only open for files read from disk
+    MappedFile file;
+    // Only set for compressed entries
+    std::unique_ptr<char[]> buffer;
+    std::string_view contents;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// GPU block compressed formats, all made of 4x4 texel blocks
+enum class BlockFormat {
+    // RGB at 4 bits per texel, texels with alpha below 128 become transparent
+    BC1 = 0,
+    // BC1 color plus interpolated alpha, 8 bits per texel
+    BC3 = 1,
+    // Red and green as two independent channels, 8 bits per texel; for
+    // normal maps
+    BC5 = 2,
+    // RGBA at 8 bits per texel with much less banding than BC1/BC3
+    BC7 = 3
+};
+
+// Offline encoder for the BC formats, used by texbake.
+//
+// BC1 and the color half of BC3 fit endpoints along the principal axis of
+// the block's colors and refine them by least squares; BC3 alpha and BC5 use
+// min/max endpoints with eight interpolated values. BC7 is encoded in mode 6
+// only (one subset, RGBA endpoints with parity bits, 16 weights), which
+// handles most content well at a fraction of a full mode search's cost.
+class BlockCompressor {
+public:
+    // Bytes per 4x4 block
+    static size_t block_bytes(BlockFormat format);
+
+    // Bytes for one width x height image
+    static size_t compressed_size(BlockFormat format, int width, int height);
+
+    // Compress an RGBA8 image, rows of blocks spread over the thread pool.
+    // Edge blocks of sizes that aren't a multiple of four repeat the last
+    // row and column. Rows are kept in the order given.
+    static std::vector<unsigned char> compress(const unsigned char* rgba, int width, int height, BlockFormat format);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Precomputed image based lighting for one environment
+struct EnvironmentLighting {
+    // Diffuse irradiance as nine spherical harmonics coefficients, RGB each,
+    // already convolved with the cosine lobe and divided by pi: evaluating
+    // them for a normal gives the radiance a white Lambertian surface
+    // reflects
+    std::array<float, 27> irradiance{};
+    // Specular cubemap, face_size at level 0 and halving per level. Level 0
+    // is the environment itself, later levels are prefiltered for GGX with
+    // roughness level / (level_count - 1). Each level holds six faces of
+    // RGB floats in GL face order (+X -X +Y -Y +Z -Z), rows in the order
+    // glTexImage2D reads them.
+    int face_size = 0;
+    int level_count = 0;
+    std::vector<float> specular;
+
+    int level_size(int level) const;
+    // Offset of a level's first float in specular
+    size_t level_offset(int level) const;
+    static size_t float_count(int face_size, int level_count);
+};
+
+// Turns an equirectangular HDR image into EnvironmentLighting on the CPU.
+//
+// The image is box filtered down to about four texels per cube texel and
+// resampled onto the cube, which then gets a plain mip chain. Irradiance is
+// projected from a small level of that chain. Each specular level takes
+// sample_count GGX importance samples per texel, each read from the mip
+// level whose texels cover about as much solid angle as the sample, so few
+// samples give smooth results. Rows of every step are split across the
+// thread pool.
+class EnvironmentBaker {
+public:
+    static constexpr int DEFAULT_FACE_SIZE = 256;
+    static constexpr int DEFAULT_LEVEL_COUNT = 6;
+    static constexpr int DEFAULT_SAMPLE_COUNT = 64;
+
+    // Bake from width x height RGB floats, top row first as stbi_loadf
+    // returns them. The top row looks straight up (+Y) and the middle column
+    // along +X.
+    static EnvironmentLighting bake(const float* rgb, int width, int height, int face_size = DEFAULT_FACE_SIZE,
+                                    int level_count = DEFAULT_LEVEL_COUNT, int sample_count = DEFAULT_SAMPLE_COUNT);
+};
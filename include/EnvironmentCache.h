@@ -0,0 +1,61 @@
+#pragma once
+
+#include "EnvironmentBaker.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <string>
+
+// Binary container for baked EnvironmentLighting, written after the first
+// load of an HDR environment so later loads skip the bake.
+//
+// Layout (little endian):
+//   EnvironmentCacheHeader
+//   specular  RGB float cube levels back to back, largest first, starting on
+//             a 4 KiB boundary
+//
+// The cache is keyed by a hash of the source file's contents and the bake
+// settings, so touching or copying the source keeps it valid while any edit
+// rebuilds it.
+struct EnvironmentCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t face_size;
+    uint32_t level_count;
+    uint32_t sample_count;
+    uint32_t reserved;
+    float irradiance[27];
+    uint32_t reserved2;
+    uint64_t specular_offset;
+    uint64_t specular_size;
+};
+
+class EnvironmentCache {
+public:
+    static constexpr char MAGIC[4] = {'I', 'B', 'L', 'C'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t BLOB_ALIGNMENT = 4096;
+    // Largest cube face a cache may declare, beyond what drivers accept
+    static constexpr uint32_t MAX_FACE_SIZE = 16384;
+
+    // Cache file used for a given source image
+    static std::string cache_path_for(const std::string& source_path);
+
+    static bool write(const std::string& cache_path, const EnvironmentLighting& lighting, uint64_t source_hash,
+                      int sample_count);
+
+    // Constructor, maps and validates the cache file
+    EnvironmentCache() = default;
+    explicit EnvironmentCache(const std::string& cache_path);
+
+    bool is_valid() const { return header != nullptr; }
+    // True when baked from the same source contents with the same settings
+    bool matches(uint64_t source_hash, int face_size, int level_count, int sample_count) const;
+
+    // Copy of the cached lighting
+    EnvironmentLighting lighting() const;
+
+private:
+    MappedFile file;
+    const EnvironmentCacheHeader* header = nullptr;
+};
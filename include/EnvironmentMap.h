@@ -0,0 +1,60 @@
+#pragma once
+
+#include "EnvironmentBaker.h"
+#include "Shader.h"
+#include <GL/glew.h>
+#include <future>
+#include <string>
+
+// HDR environment lighting the scene: a prefiltered specular cubemap, also
+// drawn as the sky, and spherical harmonics irradiance.
+//
+// Construction returns at once. The thread pool hashes the .hdr file and
+// either reads its EnvironmentCache or decodes it with stbi_loadf, bakes it
+// with EnvironmentBaker and writes the cache for next time; update() uploads
+// the result on the GL thread.
+class EnvironmentMap {
+public:
+    // Constructor, starts loading an equirectangular HDR image
+    EnvironmentMap() = default;
+    explicit EnvironmentMap(const std::string& path);
+
+    // Destructor, waits for the bake
+    ~EnvironmentMap();
+
+    // Move constructor and assignment
+    EnvironmentMap(EnvironmentMap&& other) noexcept;
+    EnvironmentMap& operator=(EnvironmentMap&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    EnvironmentMap(const EnvironmentMap&) = delete;
+    EnvironmentMap& operator=(const EnvironmentMap&) = delete;
+
+    bool is_ready() const { return specular_map != 0; }
+
+    // Upload the lighting once it is baked, on the GL thread once per frame.
+    // Returns is_ready().
+    bool update();
+
+    // Bind the specular cubemap to unit and point the shader's environment
+    // uniforms at it and the irradiance
+    void bind(const Shader& shader, GLuint unit) const;
+    // Only bind the specular cubemap, for drawing the sky
+    void bind_cubemap(GLuint unit) const;
+
+private:
+    struct LoadedEnvironment {
+        EnvironmentLighting lighting;
+        // Set when loading failed
+        std::string error;
+    };
+
+    std::string path;
+    std::future<LoadedEnvironment> load;
+    GLuint specular_map = 0;
+    int level_count = 0;
+    std::array<float, 27> irradiance{};
+
+    static LoadedEnvironment load_environment(const std::string& path);
+    void release();
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Constants every program reads once per frame, matching the std140 Frame
+// uniform block declared in the shaders:
+//
+//   layout (std140) uniform Frame {
+//       mat4 view;
+//       mat4 projection;
+//       vec4 cameraPosition;
+//       vec4 lightPosition;
+//       vec4 lightColor;
+//   } frame;
+//
+// Shader binds the block to BINDING after linking and main.cpp writes it
+// through a UniformRing, so a program only has to declare the block.
+// Members are vec4 sized because std140 pads vec3 to 16 bytes anyway.
+struct FrameUniforms {
+    static constexpr const char* BLOCK_NAME = "Frame";
+    static constexpr GLuint BINDING = 0;
+
+    glm::mat4 view;
+    glm::mat4 projection;
+    // w unused
+    glm::vec4 camera_position;
+    glm::vec4 light_position;
+    glm::vec4 light_color;
+};
+
+static_assert(sizeof(FrameUniforms) == 2 * 64 + 3 * 16, "FrameUniforms must match the std140 Frame block");
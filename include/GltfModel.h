@@ -0,0 +1,154 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "Mesh.h"
+#include "MipGenerator.h"
+#include "TextureArrayPacker.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JsonValue;
+class ShaderVariants;
+
+// Metallic-roughness material, reduced to what the viewer shades with
+struct GltfMaterial {
+    std::string name;
+    glm::vec4 base_color{1.0f};
+    // Index into the model's textures, -1 for none
+    int base_color_texture = -1;
+    // Where that texture's image was packed, -1 when untextured
+    int texture_array = -1;
+    int texture_layer = 0;
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+};
+
+// One draw call. The VAO points straight at the buffer view buffers with the
+// accessor's own component types, offsets and strides.
+struct GltfPrimitive {
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    // Index count, or vertex count when not indexed
+    GLsizei count = 0;
+    // 0 when not indexed
+    GLenum index_type = 0;
+    size_t index_offset = 0;
+    int material = -1;
+    bool has_normals = false;
+    bool has_tex_coords = false;
+    Bounds bounds;
+};
+
+struct GltfMesh {
+    std::string name;
+    std::vector<GltfPrimitive> primitives;
+};
+
+// A mesh placed in the scene by a node
+struct GltfInstance {
+    size_t mesh = 0;
+    glm::mat4 transform{1.0f};
+};
+
+// glTF 2.0 binary (.glb) model.
+//
+// Construction parses the JSON chunk, creates every GL object and maps the
+// buffers, then returns while the thread pool copies the buffer views from
+// the file mapping into the mapped GL memory and decodes images. Call
+// update() once per frame on the GL thread to finish uploads; the model draws
+// once its buffers are resident, textures stay untextured until their image
+// decodes.
+//
+// Images are packed into texture arrays by size and sampler state (see
+// TextureArrayPacker), so a model typically binds one array for all of its
+// draws and switches materials with a layer index.
+class GltfModel {
+public:
+    // Unit the texture arrays are bound to, material.diffuse_array must
+    // point at it
+    static constexpr GLuint TEXTURE_ARRAY_UNIT = 3;
+
+    std::vector<GltfMesh> meshes;
+    std::vector<GltfMaterial> materials;
+    std::vector<GltfInstance> instances;
+
+    // Constructor, starts loading. Check is_valid() for parse errors.
+    GltfModel() = default;
+    explicit GltfModel(const std::string& path);
+
+    // Destructor, waits for outstanding copies
+    ~GltfModel();
+
+    // Move constructor and assignment
+    GltfModel(GltfModel&& other) noexcept;
+    GltfModel& operator=(GltfModel&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    GltfModel(const GltfModel&) = delete;
+    GltfModel& operator=(const GltfModel&) = delete;
+
+    bool is_valid() const { return valid; }
+    bool is_ready() const { return valid && pending_buffers.empty(); }
+
+    // Unmap buffers whose copies finished and upload decoded images.
+    // Returns is_ready().
+    bool update();
+
+    // Draw every instance with the variant of shaders for keywords, plus
+    // USE_TEXTURE_ARRAY for textured materials, setting the model matrix and
+    // material per draw. Leaves the last variant drawn with in use.
+    void draw(ShaderVariants& shaders, uint32_t keywords, const glm::mat4& model) const;
+
+private:
+    struct PendingBuffer {
+        GLuint buffer = 0;
+        const char* source = nullptr;
+        size_t size = 0;
+        std::vector<std::future<void>> copies;
+    };
+
+    struct DecodedImage {
+        // Empty when decoding failed
+        MipChain mips;
+        const char* error = nullptr;
+    };
+
+    struct PendingImage {
+        // Textures showing this image
+        std::vector<size_t> textures;
+        // Size from the image header, which picked the array
+        int width = 0;
+        int height = 0;
+        std::future<DecodedImage> decode;
+    };
+
+    bool valid = false;
+    std::string path;
+    // The GLB itself and any external buffers; copy jobs read from these
+    std::vector<AssetFile> files;
+    // One GL buffer per buffer view, 0 for views no primitive reads
+    std::vector<GLuint> buffers;
+    std::vector<GLuint> texture_arrays;
+    // Layer of each glTF texture, and whether its image is in it yet
+    std::vector<TextureLayer> texture_layers;
+    std::vector<bool> texture_ready;
+    std::vector<PendingBuffer> pending_buffers;
+    std::vector<PendingImage> pending_images;
+
+    bool load();
+    void load_materials(const JsonValue& document);
+    void load_textures(const JsonValue& document, const std::vector<std::string_view>& buffer_data);
+    void load_meshes(const JsonValue& document, const std::vector<std::string_view>& buffer_data);
+    GLuint upload_buffer_view(const JsonValue& document, const std::vector<std::string_view>& buffer_data,
+                              size_t view_index);
+    void load_instances(const JsonValue& document);
+    void release();
+
+    // Decode an encoded image and build its mip chain, on a pool thread
+    static DecodedImage decode_image(const char* data, size_t size);
+};
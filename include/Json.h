@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal read-only JSON document, enough for glTF and other asset manifests.
+// Lookups never fail: a missing key or index yields a shared null value.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    // Parse a complete document. Returns null and fills error on failure.
+    static JsonValue parse(std::string_view text, std::string* error = nullptr);
+
+    Type type() const { return kind; }
+    bool is_null() const { return kind == Type::Null; }
+    bool is_bool() const { return kind == Type::Bool; }
+    bool is_number() const { return kind == Type::Number; }
+    bool is_string() const { return kind == Type::String; }
+    bool is_array() const { return kind == Type::Array; }
+    bool is_object() const { return kind == Type::Object; }
+
+    // Typed reads, returning the fallback when the type does not match
+    bool as_bool(bool fallback = false) const;
+    double as_number(double fallback = 0.0) const;
+    int64_t as_int(int64_t fallback = 0) const;
+    float as_float(float fallback = 0.0f) const { return static_cast<float>(as_number(fallback)); }
+    const std::string& as_string() const;
+
+    // Element count of an array or object, 0 otherwise
+    size_t size() const;
+    const JsonValue& operator[](size_t index) const;
+    const JsonValue& operator[](std::string_view key) const;
+    bool contains(std::string_view key) const;
+
+    // Object members in document order
+    const std::vector<std::string>& keys() const { return object_keys; }
+    const std::vector<JsonValue>& values() const { return elements; }
+
+private:
+    friend class JsonParser;
+
+    Type kind = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    // Array elements, or object values parallel to object_keys
+    std::vector<JsonValue> elements;
+    std::vector<std::string> object_keys;
+};
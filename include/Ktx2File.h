@@ -0,0 +1,83 @@
+#pragma once
+
+#include "BlockCompressor.h"
+#include "AssetPack.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// KTX 2.0 file header, identifier included so the 64-bit fields line up
+struct Ktx2Header {
+    unsigned char identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct Ktx2LevelIndex {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+// Single 2D texture in a KTX 2.0 container, block compressed with one of the
+// BlockFormats and without supercompression, which is what texbake writes.
+//
+// Levels are stored smallest first as the format requires; texbake writes
+// rows bottom to top and marks them with KTXorientation "ru", so they upload
+// as they are.
+class Ktx2File {
+public:
+    static constexpr unsigned char IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                                     0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    // Largest side a file may declare, beyond what drivers accept
+    static constexpr uint32_t MAX_DIMENSION = 65536;
+
+    // Baked file texbake writes for a source image by default: the same
+    // path with a .ktx2 extension
+    static std::string baked_path_for(const std::string& source_path);
+
+    // Write levels, largest first, each compressed in format
+    static bool write(const std::string& path, BlockFormat format, bool srgb, int width, int height,
+                      const std::vector<std::vector<unsigned char>>& levels);
+
+    // Constructor, maps and validates the file
+    Ktx2File() = default;
+    explicit Ktx2File(const std::string& path);
+
+    bool is_valid() const { return header != nullptr; }
+
+    BlockFormat format() const { return block_format; }
+    bool is_srgb() const { return srgb; }
+    // False when the rows are stored top to bottom
+    bool is_bottom_up() const { return bottom_up; }
+    int width() const { return static_cast<int>(header->pixel_width); }
+    int height() const { return static_cast<int>(header->pixel_height); }
+    size_t level_count() const { return header->level_count; }
+
+    // Views into the mapping, valid while this object lives
+    const unsigned char* level_data(size_t level) const;
+    size_t level_size(size_t level) const { return static_cast<size_t>(levels[level].byte_length); }
+    size_t level_offset(size_t level) const { return static_cast<size_t>(levels[level].byte_offset); }
+    const unsigned char* file_data() const { return reinterpret_cast<const unsigned char*>(file.data()); }
+
+private:
+    AssetFile file;
+    const Ktx2Header* header = nullptr;
+    const Ktx2LevelIndex* levels = nullptr;
+    BlockFormat block_format = BlockFormat::BC1;
+    bool srgb = false;
+    bool bottom_up = false;
+};
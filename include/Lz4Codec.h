@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte compressor writing the LZ4 block format: tokens of literal runs
+// followed by matches up to 64 KiB back, with no framing or checksums.
+// Decoding is little more than memcpy, so it keeps up with fast storage.
+//
+// The encoder is the greedy single hash table search of the reference
+// "fast" mode. Callers keep track of the uncompressed size themselves; the
+// decoder checks every length and offset against both buffers.
+class Lz4Codec {
+public:
+    // Largest compressed size of size bytes
+    static size_t compress_bound(size_t size);
+
+    // Compress into destination and return the compressed size, or 0 when
+    // it doesn't fit in capacity
+    static size_t compress(const char* source, size_t size, char* destination, size_t capacity);
+
+    // Decompress exactly size bytes, false when the input is malformed or
+    // doesn't decode to that size
+    static bool decompress(const char* source, size_t compressed_size, char* destination, size_t size);
+};
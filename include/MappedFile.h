@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Large assets are parsed straight
+// out of the page cache instead of being copied through an ifstream.
+class MappedFile {
+public:
+    // Constructor
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+
+    // Destructor
+    ~MappedFile();
+
+    // Move constructor and assignment
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return mapping != nullptr; }
+    const char* data() const { return static_cast<const char*>(mapping); }
+    size_t size() const { return length; }
+    std::string_view view() const { return {data(), length}; }
+
+    // Hash of the whole contents for keying caches, never 0. FNV-1a over
+    // 64-bit words with the length mixed in, then a final avalanche.
+    uint64_t content_hash() const { return content_hash(view()); }
+    static uint64_t content_hash(std::string_view bytes);
+
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* map_handle = nullptr;
+#endif
+
+    void close();
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MeshCache;
+class Shader;
+
+// Interleaved vertex matching the attribute layout used by all shaders:
+// location 0 = position, 1 = normal, 2 = texture coordinates
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 tex_coords;
+};
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must stay tightly packed at stride 8");
+
+// 16 byte vertex for bandwidth bound scenes:
+// position quantized to unorm16 inside the mesh bounds (w unused),
+// octahedral normal in 2x snorm16 and half float texture coordinates
+struct CompactVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t tex_coords[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes");
+
+// Vertex layout used on the GPU
+enum class VertexFormat : uint32_t {
+    Float32 = 0,  // Vertex, 32 bytes
+    Compact = 1   // CompactVertex, 16 bytes
+};
+
+inline size_t vertex_stride(VertexFormat format) {
+    return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+// Axis aligned bounding box
+struct Bounds {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+};
+
+// Range of the index buffer drawn with one material
+struct Submesh {
+    uint32_t index_offset = 0;
+    uint32_t index_count = 0;
+};
+
+// Index range of one detail level. error is the largest distance from a full
+// detail vertex to this level's surface, in object space units.
+struct MeshLod {
+    uint32_t index_offset = 0;
+    uint32_t index_count = 0;
+    float error = 0.0f;
+    // Meshlets partitioning this level's index range
+    uint32_t meshlet_offset = 0;
+    uint32_t meshlet_count = 0;
+};
+
+// Cluster of triangles, contiguous in the index buffer, with culling bounds
+// in object space
+struct Meshlet {
+    uint32_t index_offset = 0;
+    uint32_t index_count = 0;
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+    // Normal cone: every triangle faces away from an eye for which
+    // dot(center - eye, cone_axis) >= cone_cutoff * |center - eye| + radius.
+    // A zero axis never culls.
+    glm::vec3 cone_axis{0.0f};
+    float cone_cutoff = 1.0f;
+};
+static_assert(sizeof(Meshlet) == 40, "Meshlet is stored as is in the mesh cache");
+
+// What the culled draw path submitted
+struct MeshletCullStats {
+    size_t meshlets_total = 0;
+    size_t meshlets_drawn = 0;
+    size_t triangles_total = 0;
+    size_t triangles_drawn = 0;
+};
+
+// CPU side geometry, produced by the loaders
+struct MeshData {
+    std::vector<Vertex> vertices;
+    // Triangle list indices, empty for a non-indexed triangle soup
+    std::vector<uint32_t> indices;
+    std::vector<Submesh> submeshes;
+    // Detail levels, finest first; coarser levels are stored in indices after
+    // the full detail triangles. Empty means the mesh has a single level.
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    Bounds bounds;
+
+    // Build from a float array laid out like Vertex (3 position, 3 normal, 2 uv),
+    // or without the normals (3 position, 2 uv) when has_normals is false
+    static MeshData from_interleaved(const float* data, size_t float_count, bool has_normals = true);
+
+    // Recompute the bounding box from the vertex positions
+    void compute_bounds();
+
+    // Encode the vertices as CompactVertex relative to the current bounds
+    std::vector<CompactVertex> compact_vertices() const;
+};
+
+// GPU side geometry: one VAO with its vertex and index buffers ready to draw
+class Mesh {
+public:
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLsizei vertex_count = 0;
+    GLsizei index_count = 0;
+    // GL_UNSIGNED_SHORT whenever every index fits in 16 bits
+    GLenum index_type = GL_UNSIGNED_INT;
+    VertexFormat vertex_format = VertexFormat::Float32;
+
+    Bounds bounds;
+    std::vector<Submesh> submeshes;
+    // Always holds at least the full detail level for indexed meshes
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+
+    // Constructor
+    Mesh() = default;
+    explicit Mesh(const MeshData& data, VertexFormat format = VertexFormat::Float32);
+    // Uploads straight from the mapped cache file, without an intermediate copy
+    explicit Mesh(const MeshCache& cache);
+
+    // Destructor
+    ~Mesh();
+
+    // Move constructor and assignment
+    Mesh(Mesh&& other) noexcept;
+    Mesh& operator=(Mesh&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // Set the uniforms the vertex shaders use to decode this mesh's format
+    void apply_vertex_decode(const Shader& shader) const;
+
+    // Coarsest level whose error projects to less than max_pixel_error pixels
+    // at the given distance, for a vertical field of view in degrees
+    size_t select_lod(float distance, float fov, float viewport_height, float max_pixel_error = 1.0f) const;
+
+    void draw(size_t lod = 0) const;
+
+    // Draw only the meshlets of a level that intersect the frustum and, with
+    // cull_backfaces, are not entirely back facing. Only pass cull_backfaces
+    // while GL_CULL_FACE culls back faces, or the image changes. eye is the
+    // camera position in object space. Falls back to draw() for meshes
+    // without meshlets.
+    MeshletCullStats draw_culled(size_t lod, const glm::mat4& model_view_projection, const glm::vec3& eye,
+                                 bool cull_backfaces);
+
+private:
+    // Per frame draw ranges, kept to avoid reallocating every frame
+    std::vector<GLsizei> draw_counts;
+    std::vector<const void*> draw_offsets;
+
+
+    void upload(const void* vertex_data, size_t vertices, const void* index_data, size_t indices, GLenum type);
+    void setup_vertex_attributes() const;
+    void release();
+};
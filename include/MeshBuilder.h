@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Result of a weld: remap[i] is the unique id of input i, and first[u] the
+// lowest input index mapped to u, so unique ids follow first appearance
+struct WeldMap {
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> first;
+};
+
+// Turns loader output into render ready meshes
+class MeshBuilder {
+public:
+    // Merge bitwise identical vertices of a triangle soup (or an already
+    // indexed mesh) and emit an index buffer referencing the unique ones.
+    static MeshData weld(const MeshData& mesh);
+
+    // Weld count keys on the thread pool through a lock-free hash table.
+    // key_at(i) returns a trivially copyable key that is compared bitwise,
+    // so fold -0.0 into 0.0 before returning it. It is called several times
+    // per index and should be cheap. expected_unique only sizes the table.
+    // The result does not depend on thread timing.
+    template <typename KeyAt>
+    static WeldMap weld_parallel(size_t count, KeyAt key_at, size_t expected_unique);
+
+    // FNV-1a over 32-bit words, then a final avalanche
+    static uint64_t hash_words(const void* data, size_t word_count) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < word_count; ++i) {
+            uint32_t word;
+            std::memcpy(&word, static_cast<const char*>(data) + i * sizeof(uint32_t), sizeof(uint32_t));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+};
+
+template <typename KeyAt>
+WeldMap MeshBuilder::weld_parallel(size_t count, KeyAt key_at, size_t expected_unique) {
+    using Key = std::remove_cvref_t<decltype(key_at(size_t(0)))>;
+    static_assert(std::is_trivially_copyable_v<Key> && sizeof(Key) % sizeof(uint32_t) == 0,
+                  "weld keys are hashed as 32-bit words");
+
+    WeldMap result;
+    if (count == 0) {
+        return result;
+    }
+    result.remap.resize(count);
+
+    ThreadPool& pool = ThreadPool::shared();
+    auto hash = [](const Key& key) { return hash_words(&key, sizeof(Key) / sizeof(uint32_t)); };
+    auto equal = [](const Key& a, const Key& b) { return std::memcmp(&a, &b, sizeof(Key)) == 0; };
+
+    // Slots hold key index + 1 so the zero initialized table is empty. Slots
+    // are claimed with a compare and swap, then lowered to the smallest index
+    // with that key, which keeps the outcome independent of thread timing.
+    size_t table_size = 1024;
+    while (table_size < expected_unique * 2) {
+        table_size <<= 1;
+    }
+
+    while (true) {
+        std::vector<std::atomic<uint32_t>> table(table_size);
+        size_t mask = table_size - 1;
+        size_t limit = table_size / 4 * 3;
+        std::atomic<size_t> used{0};
+        std::atomic<bool> overflow{false};
+
+        // Pass 1: insert, remap temporarily holds each key's slot
+        pool.parallel_for(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end && !overflow.load(std::memory_order_relaxed); ++i) {
+                Key key = key_at(i);
+                uint32_t mine = static_cast<uint32_t>(i + 1);
+                size_t slot = hash(key) & mask;
+
+                while (true) {
+                    uint32_t current = table[slot].load(std::memory_order_relaxed);
+                    if (current == 0) {
+                        if (table[slot].compare_exchange_strong(current, mine, std::memory_order_relaxed)) {
+                            if (used.fetch_add(1, std::memory_order_relaxed) >= limit) {
+                                overflow.store(true, std::memory_order_relaxed);
+                            }
+                            break;
+                        }
+                    }
+                    if (equal(key_at(current - 1), key)) {
+                        while (current > mine &&
+                               !table[slot].compare_exchange_weak(current, mine, std::memory_order_relaxed)) {
+                        }
+                        break;
+                    }
+                    slot = (slot + 1) & mask;
+                }
+                result.remap[i] = static_cast<uint32_t>(slot);
+            }
+        }, 4096);
+
+        if (overflow.load()) {
+            // More unique keys than expected, start over with a larger table
+            table_size <<= 1;
+            continue;
+        }
+
+        // Pass 2: count the keys that own their slot in fixed blocks, so ids
+        // can be handed out in index order from a prefix sum
+        constexpr uint32_t OWNER = 0x80000000u;
+        size_t block_count = std::min<size_t>(count, pool.size() * 16u);
+        size_t block_size = (count + block_count - 1) / block_count;
+        block_count = (count + block_size - 1) / block_size;
+        std::vector<uint32_t> block_offsets(block_count + 1, 0);
+
+        pool.parallel_for(block_count, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; ++block) {
+                size_t first = block * block_size;
+                size_t last = std::min(count, first + block_size);
+                uint32_t owners = 0;
+                for (size_t i = first; i < last; ++i) {
+                    if (table[result.remap[i]].load(std::memory_order_relaxed) == i + 1) {
+                        result.remap[i] |= OWNER;
+                        ++owners;
+                    }
+                }
+                block_offsets[block + 1] = owners;
+            }
+        });
+        for (size_t block = 0; block < block_count; ++block) {
+            block_offsets[block + 1] += block_offsets[block];
+        }
+        result.first.resize(block_offsets[block_count]);
+
+        // Pass 3: owners replace their slot's content with their unique id
+        pool.parallel_for(block_count, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; ++block) {
+                size_t first = block * block_size;
+                size_t last = std::min(count, first + block_size);
+                uint32_t id = block_offsets[block];
+                for (size_t i = first; i < last; ++i) {
+                    if (result.remap[i] & OWNER) {
+                        table[result.remap[i] & ~OWNER].store(id, std::memory_order_relaxed);
+                        result.first[id++] = static_cast<uint32_t>(i);
+                    }
+                }
+            }
+        });
+
+        // Pass 4: every key picks up its slot's id
+        pool.parallel_for(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                result.remap[i] = table[result.remap[i] & ~OWNER].load(std::memory_order_relaxed);
+            }
+        }, 4096);
+
+        return result;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary mesh container written after the first import of a model.
+//
+// Layout (little endian, every blob starts on a 4 KiB boundary so the
+// mapped pointers can be handed to glBufferData as they are):
+//   MeshCacheHeader
+//   vertex blob   vertex_count * vertex_stride bytes, Vertex or CompactVertex
+//   index blob    index_count * index_size bytes
+//   submesh table submesh_count * Submesh
+//   lod table     lod_count * MeshLod, finest first
+//   meshlet table meshlet_count * Meshlet
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_format;  // VertexFormat
+    uint32_t vertex_stride;
+    uint32_t index_size;  // 2 or 4
+    uint32_t reserved;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint64_t submesh_count;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t lod_count;
+    uint64_t lod_offset;
+    uint64_t meshlet_count;
+    uint64_t meshlet_offset;
+    // Source file state when the cache was written, used to detect edits
+    uint64_t source_size;
+    int64_t source_time;
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+class MeshCache {
+public:
+    static constexpr char MAGIC[4] = {'M', 'S', 'H', 'C'};
+    static constexpr uint32_t VERSION = 7;
+    static constexpr uint64_t BLOB_ALIGNMENT = 4096;
+
+    // Cache file used for a given source model
+    static std::string cache_path_for(const std::string& source_path);
+
+    // Serialize an indexed mesh, remembering the state of its source file
+    static bool write(const std::string& cache_path, const MeshData& mesh, const std::string& source_path,
+                      VertexFormat format = VertexFormat::Float32);
+
+    // Constructor, maps and validates the cache file
+    MeshCache() = default;
+    explicit MeshCache(const std::string& cache_path);
+
+    bool is_valid() const { return header != nullptr; }
+    // True when the source file has not changed since the cache was written
+    bool is_up_to_date(const std::string& source_path) const;
+
+    // Views into the mapping, valid while this object lives
+    VertexFormat vertex_format() const { return static_cast<VertexFormat>(header->vertex_format); }
+    const void* vertex_data() const;
+    size_t vertex_count() const { return header->vertex_count; }
+    const void* index_data() const;
+    size_t index_count() const { return header->index_count; }
+    GLenum index_type() const { return header->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+    std::vector<Submesh> submeshes() const;
+    std::vector<MeshLod> lods() const;
+    std::vector<Meshlet> meshlets() const;
+    Bounds bounds() const;
+
+private:
+    MappedFile file;
+    const MeshCacheHeader* header = nullptr;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstdint>
+#include <vector>
+
+// Post-transform cache statistics for an index buffer
+struct VertexCacheStats {
+    // Average cache miss ratio: transformed vertices per triangle (0.5 - 3.0)
+    float acmr = 0.0f;
+    // Average transform to vertex ratio: transformed vertices per vertex (1.0 is ideal)
+    float atvr = 0.0f;
+};
+
+// Import time reordering passes for indexed meshes
+class MeshOptimizer {
+public:
+    // Run every pass on each submesh in order: vertex cache, overdraw, vertex fetch
+    static void optimize(MeshData& mesh);
+
+    // Reorder triangles for post-transform cache locality (Forsyth's algorithm)
+    static void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count);
+
+    // Split a cache optimized triangle order into clusters at cache flush points
+    // and sort the clusters outward facing first, so near surfaces tend to be
+    // drawn before what they hide. threshold bounds the allowed ACMR increase.
+    static void optimize_overdraw(uint32_t* indices, size_t index_count, const std::vector<Vertex>& vertices,
+                                  float threshold = 1.05f);
+
+    // Renumber vertices in order of first use so fetches stream through memory
+    static void optimize_vertex_fetch(MeshData& mesh);
+
+    // Simulate a FIFO post-transform cache of the given size
+    static VertexCacheStats analyze_vertex_cache(const uint32_t* indices, size_t index_count, size_t vertex_count,
+                                                 size_t cache_size = 16);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert).
+//
+// Edges only collapse onto one of their existing endpoints, so every level
+// keeps referencing the full detail vertex buffer and costs nothing but an
+// extra index range. Open borders only slide along themselves. Seams between
+// two sets of attributes slide along themselves too, with both sides
+// collapsing together; seam ends and non-manifold vertices stay put.
+class MeshSimplifier {
+public:
+    // Levels including the full detail mesh
+    static constexpr size_t MAX_LODS = 6;
+    // Stop adding levels once they would drop below this many triangles
+    static constexpr size_t MIN_LOD_TRIANGLES = 64;
+
+    // Append simplified levels to mesh.indices, halving the triangle count
+    // each time, and describe them in mesh.lods. Meshes with more than one
+    // submesh are left at a single level.
+    static void build_lods(MeshData& mesh);
+
+    // Simplify an index buffer down to at most target_index_count indices when
+    // the geometry allows it. error receives the largest distance from a full
+    // detail vertex to the simplified surface, in object space units.
+    static std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const uint32_t* indices,
+                                          size_t index_count, size_t target_index_count, float* error = nullptr);
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+
+// Partitions index ranges into meshlets for cluster culling
+class MeshletBuilder {
+public:
+    static constexpr size_t MAX_VERTICES = 64;
+    static constexpr size_t MAX_TRIANGLES = 124;
+
+    // Split every level (and every submesh of the full detail level) into
+    // meshlets. Triangles are reordered inside their range so each meshlet is
+    // contiguous; ranges themselves do not move.
+    static void build(MeshData& mesh);
+};
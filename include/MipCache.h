@@ -0,0 +1,72 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MipGenerator.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary container for a texture's finished mip chain, written after the
+// first load of an image so later loads skip decoding and filtering.
+//
+// Layout (little endian):
+//   MipCacheHeader
+//   level table  level_count * MipCacheLevel, largest first
+//   pixel blob   RGBA8 levels back to back, starting on a 4 KiB boundary,
+//                rows bottom to top as glTexImage2D expects
+struct MipCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t filter;  // MipFilter
+    uint32_t srgb;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t reserved;
+    uint64_t level_offset;
+    uint64_t pixel_offset;
+    uint64_t pixel_size;
+    // Source file state when the cache was written, used to detect edits
+    uint64_t source_size;
+    int64_t source_time;
+};
+
+struct MipCacheLevel {
+    uint32_t width;
+    uint32_t height;
+    // Relative to pixel_offset
+    uint64_t offset;
+};
+
+class MipCache {
+public:
+    static constexpr char MAGIC[4] = {'M', 'I', 'P', 'C'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t BLOB_ALIGNMENT = 4096;
+
+    // Cache file used for a given source image
+    static std::string cache_path_for(const std::string& source_path);
+
+    // Serialize a chain built with the given settings, remembering the state
+    // of its source file
+    static bool write(const std::string& cache_path, const MipChain& chain, const std::string& source_path,
+                      MipFilter filter, bool srgb);
+
+    // Constructor, maps and validates the cache file
+    MipCache() = default;
+    explicit MipCache(const std::string& cache_path);
+
+    bool is_valid() const { return header != nullptr; }
+    // True when the source file has not changed and the chain was built
+    // with the same settings
+    bool is_up_to_date(const std::string& source_path, MipFilter filter, bool srgb) const;
+
+    // Views into the mapping, valid while this object lives
+    std::vector<MipLevel> levels() const;
+    const unsigned char* pixel_data() const;
+    size_t pixel_size() const { return header->pixel_size; }
+
+private:
+    MappedFile file;
+    const MipCacheHeader* header = nullptr;
+};
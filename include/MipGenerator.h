@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Downsampling kernel for mip levels
+enum class MipFilter {
+    // Average of the texels each level covers; cheap, slightly soft
+    Box = 0,
+    // Kaiser windowed sinc, three texels wide; sharper levels with less
+    // aliasing, may ring a little on hard edges
+    Kaiser = 1
+};
+
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    // Byte offset of the level in the chain's pixels
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// RGBA8 levels stored back to back, largest first, down to 1x1
+struct MipChain {
+    std::vector<MipLevel> levels;
+    std::vector<unsigned char> pixels;
+};
+
+// Builds complete mip chains on the CPU, so every driver shows the same
+// levels and uploads need no glGenerateMipmap.
+//
+// Each level is filtered from the bytes of the previous one in floating
+// point, horizontally into bands of rows and then vertically, with the bands
+// split across the thread pool. The vertical pass runs eight floats at a time
+// with AVX2 or four with SSE, the horizontal pass one RGBA texel per SSE
+// register; all paths give the same bytes.
+class MipGenerator {
+public:
+    // Chain for a width x height RGBA8 image; level 0 is a copy of it. With
+    // srgb the color channels are decoded to linear light before filtering
+    // and encoded again after, alpha is always filtered as is.
+    static MipChain generate(const unsigned char* rgba, int width, int height, MipFilter filter, bool srgb);
+
+    // Levels in a full chain for the given size
+    static int level_count(int width, int height);
+
+    // Filter rows [first_row, last_row) of the level below a width x height
+    // image into target, back to back. Unlike generate(), that level is half
+    // the size rounded up and keeps exactly half the texel density, so an odd
+    // last texel repeats the edge instead of stretching the image. Only the
+    // rows half_source_rows() names are read through source_row, so a huge
+    // image can be filtered one band at a time.
+    static void downsample_half(const std::function<const unsigned char*(int)>& source_row, int width,
+                                int height, int first_row, int last_row, MipFilter filter, bool srgb,
+                                unsigned char* target);
+
+    // Source rows [low, high) that downsample_half() reads for target rows
+    // [first_row, last_row), which must not be empty
+    static void half_source_rows(int height, int first_row, int last_row, MipFilter filter, int& low, int& high);
+};
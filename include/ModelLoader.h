@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Mesh.h"
+#include <string>
+#include <string_view>
+
+// Imports model files from disk into MeshData
+class ModelLoader {
+public:
+    // Load any supported model, picking the importer by file extension
+    // (.obj, .stl, .ply). Returns an empty mesh on failure.
+    static MeshData load(const std::string& path);
+
+    // Load a Wavefront OBJ file. The file is memory mapped and split into
+    // chunks that are parsed in parallel, then welded into an indexed mesh,
+    // given smooth normals where the file has none and reordered for the
+    // vertex cache.
+    // Returns an empty mesh on failure.
+    static MeshData load_obj(const std::string& path);
+
+    // Parse OBJ text that is already in memory into a triangle soup. Corners
+    // without a normal get a zero one; has_normals is set to whether every
+    // corner had one.
+    static MeshData parse_obj(std::string_view text, bool* has_normals = nullptr);
+
+    // Load a binary STL file. The fixed size triangle records are read
+    // straight from the mapping in parallel and welded by position, and
+    // smooth normals are generated since STL only stores face normals.
+    static MeshData load_stl(const std::string& path);
+
+    // Parse binary STL data into an indexed mesh without normals
+    static MeshData parse_stl(std::string_view data);
+
+    // Load a binary PLY file (either byte order). Vertex positions, normals
+    // and texture coordinates are read in parallel, polygons are fanned into
+    // triangles and duplicate vertices are welded.
+    static MeshData load_ply(const std::string& path);
+
+    // Parse binary PLY data into an indexed mesh. Sets has_normals to
+    // whether the file provided vertex normals.
+    static MeshData parse_ply(std::string_view data, bool* has_normals = nullptr);
+};
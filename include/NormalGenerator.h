@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Mesh.h"
+#include <vector>
+
+// Smooth normals and tangent frames for triangle meshes.
+//
+// Every vertex gathers the corners that reference it through a vertex to
+// corner table, so vertices are split across the thread pool without any
+// write conflicts and the sums always run in the same order. The per corner
+// terms are computed on structure of arrays copies of the attributes, eight
+// corners at a time with AVX2, four with SSE, or one by one elsewhere; all
+// paths give the same result.
+class NormalGenerator {
+public:
+    // Replace the vertex normals by the sum of the adjacent face normals
+    // weighted by face area and corner angle. A triangle soup (no indices)
+    // gets flat face normals.
+    static void compute_normals(MeshData& mesh);
+
+    // Per vertex tangents in the MikkTSpace convention: xyz is the angle
+    // weighted tangent orthogonalized against the vertex normal and w the
+    // sign of the bitangent, so bitangent = w * cross(normal, tangent).
+    // Needs normals and texture coordinates. Returns one entry per vertex.
+    // Vertices are not split at mirrored UV seams, so tangents there are off
+    // until the weld learns to split them; nothing uploads tangents yet.
+    static std::vector<glm::vec4> compute_tangents(const MeshData& mesh);
+
+    // True when any vertex has a texture coordinate other than zero
+    static bool has_tex_coords(const MeshData& mesh);
+};
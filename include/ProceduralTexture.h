@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Noise functions ProceduralTexture sums into octaves
+enum class NoiseType {
+    // Interpolated random values; blocky, cheapest
+    Value = 0,
+    // Interpolated random gradients
+    Perlin = 1,
+    // Gradients on a triangular lattice; fewer directional artifacts, but
+    // does not repeat, so textures built from it do not tile
+    Simplex = 2
+};
+
+// Fractal sum of noise octaves over a whole texture
+struct NoiseParameters {
+    NoiseType type = NoiseType::Perlin;
+    // Lattice cells across the texture at the first octave; whole numbers so
+    // value and Perlin noise textures tile
+    int cells_x = 8;
+    int cells_y = 8;
+    // Each octave has twice the cells and persistence times the amplitude
+    int octaves = 4;
+    float persistence = 0.5f;
+    uint32_t seed = 0;
+};
+
+// Patterns the viewer generates instead of loading image files
+enum class ProceduralPattern {
+    Checkerboard = 0,
+    Brick = 1,
+    Wood = 2,
+    Metal = 3,
+    Grass = 4,
+    Noise = 5
+};
+
+// Builds RGBA8 textures from noise at any resolution, the in-engine
+// replacement for assets/textures/simple_textures.py.
+//
+// Patterns are defined in texture coordinates rather than texels, so every
+// resolution shows the same image, and repeat seamlessly. Rows are split
+// across the thread pool in bands; within a row, noise is evaluated eight
+// texels at a time with AVX2 or four with SSE2, all paths giving the same
+// values.
+class ProceduralTexture {
+public:
+    static constexpr int PATTERN_COUNT = 6;
+
+    // One noise sample at lattice coordinates (x, y), in about [-1, 1]. With
+    // a period, coordinates in [0, period) wrap around at the period.
+    static float noise(NoiseType type, float x, float y, uint32_t seed = 0, uint32_t period_x = 0,
+                       uint32_t period_y = 0);
+
+    // Fractal noise for one row of a width x height texture, normalized to
+    // about [-1, 1]
+    static void noise_row(const NoiseParameters& parameters, int width, int height, int row, float* out);
+
+    // Width x height RGBA8 image, rows bottom to top, as glTexImage2D expects
+    static std::vector<unsigned char> generate(ProceduralPattern pattern, int width, int height, uint32_t seed = 0);
+
+    // Fractal noise as a grey RGBA8 image
+    static std::vector<unsigned char> noise_texture(const NoiseParameters& parameters, int width, int height);
+
+    static const char* name(ProceduralPattern pattern);
+};
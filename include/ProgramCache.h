@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Linked program binaries from glGetProgramBinary, saved after the first
+// link so later runs skip compiling and linking GLSL.
+//
+// Layout (little endian):
+//   ProgramCacheHeader
+//   binary  binary_size bytes in the driver's binary_format
+//
+// Each program is one file in CACHE_DIRECTORY named after its key, a hash
+// of the shader sources and the GL vendor, renderer and version strings, so
+// editing a shader or updating the driver just misses the cache.
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binary_format;
+    uint32_t binary_size;
+};
+
+class ProgramCache {
+public:
+    static constexpr char MAGIC[4] = {'P', 'B', 'I', 'N'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr const char* CACHE_DIRECTORY = "shader_cache";
+
+    // Whether the driver can hand out program binaries at all
+    static bool is_supported();
+
+    // Key for a program linked from these sources on the current driver
+    static uint64_t key(std::initializer_list<std::string_view> sources);
+
+    // Ask the driver to keep program's binary retrievable; call before
+    // linking it
+    static void prepare(GLuint program);
+
+    // Link program from a cached binary, false when there is none or the
+    // driver rejects it, after which program can still be linked from
+    // source as usual
+    static bool load(GLuint program, uint64_t key);
+
+    // Save a linked program's binary
+    static bool store(GLuint program, uint64_t key);
+
+private:
+    static std::string cache_path(uint64_t key);
+};
@@ -3,16 +3,56 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class AssetFile;
+
+// Uniform name hashed with FNV-1a. String literals convert implicitly and
+// are hashed at compile time, so setting a uniform by name neither
+// allocates nor hashes at run time.
+class UniformId {
+public:
+    consteval UniformId(const char* name) : name(name), hash(hash_name(name)) {}
+
+    // For names built at run time
+    static constexpr UniformId from(std::string_view name) { return UniformId(name, hash_name(name)); }
+
+    static constexpr uint64_t hash_name(std::string_view name) {
+        uint64_t value = 14695981039346656037ull;
+        for (char c : name) {
+            value = (value ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    // Only for messages, not kept beyond the call it's passed to
+    std::string_view name;
+    uint64_t hash;
+
+private:
+    constexpr UniformId(std::string_view name, uint64_t hash) : name(name), hash(hash) {}
+};
 
 class Shader {
 public:
-    GLuint id;
+    // Whether the constructor waits for the program to link, or leaves it
+    // compiling for update() to finish
+    enum class Compile { Wait, Background };
+
+    GLuint id = 0;
 
     // Constructor
     Shader() = default;
     Shader(const std::string& vertex_path, const std::string& fragment_path);
+    // With each define added as a #define line after #version in both stages
+    Shader(const std::string& vertex_path, const std::string& fragment_path, std::span<const std::string> defines,
+           Compile compile = Compile::Wait);
     Shader(const std::string& vertex_path, const std::string& fragment_path, const std::string& geometry_path);
 
     // Destructor
@@ -26,29 +66,59 @@ public:
     Shader(const Shader&) = delete;
     Shader& operator=(const Shader&) = delete;
 
+    // Linked, or failed to, and ready for use() and setting uniforms
+    bool is_ready() const { return pending_stages.empty(); }
+    // Finish a background compile once the driver reports it done, polling
+    // GL_COMPLETION_STATUS_KHR without blocking where KHR or
+    // ARB_parallel_shader_compile is supported and waiting for it otherwise.
+    // Returns is_ready().
+    bool update();
+    // Finish a background compile, waiting for the driver if needed
+    void wait();
+
     // Use/activate the shader
     void use() const;
 
     // Utility uniform functions
-    void set_bool(const std::string& name, bool value) const;
-    void set_int(const std::string& name, int value) const;
-    void set_float(const std::string& name, float value) const;
-    void set_vec2(const std::string& name, const glm::vec2& value) const;
-    void set_vec2(const std::string& name, float x, float y) const;
-    void set_vec3(const std::string& name, const glm::vec3& value) const;
-    void set_vec3(const std::string& name, float x, float y, float z) const;
-    void set_vec4(const std::string& name, const glm::vec4& value) const;
-    void set_vec4(const std::string& name, float x, float y, float z, float w) const;
-    void set_mat2(const std::string& name, const glm::mat2& mat) const;
-    void set_mat3(const std::string& name, const glm::mat3& mat) const;
-    void set_mat4(const std::string& name, const glm::mat4& mat) const;
+    void set_bool(UniformId uniform, bool value) const;
+    void set_int(UniformId uniform, int value) const;
+    void set_float(UniformId uniform, float value) const;
+    void set_vec2(UniformId uniform, const glm::vec2& value) const;
+    void set_vec2(UniformId uniform, float x, float y) const;
+    void set_vec3(UniformId uniform, const glm::vec3& value) const;
+    void set_vec3(UniformId uniform, float x, float y, float z) const;
+    void set_vec4(UniformId uniform, const glm::vec4& value) const;
+    void set_vec4(UniformId uniform, float x, float y, float z, float w) const;
+    void set_mat2(UniformId uniform, const glm::mat2& mat) const;
+    void set_mat3(UniformId uniform, const glm::mat3& mat) const;
+    void set_mat4(UniformId uniform, const glm::mat4& mat) const;
+    // Whole array from count tightly packed vec3s
+    void set_vec3_array(UniformId uniform, const float* values, int count) const;
+
+    // Location of an active uniform, -1 when the program has none by that
+    // name. Arrays are found by their name with or without an index.
+    GLint uniform_location(UniformId uniform) const;
+    // Whether the program has an active uniform by that name, without the
+    // warning setting a missing one gives
+    bool has_uniform(UniformId uniform) const;
 
 private:
-    mutable std::unordered_map<std::string, GLint> uniform_cache;
+    // Stages of a link still in progress, and the key to cache its binary under
+    std::vector<GLuint> pending_stages;
+    uint64_t cache_key = 0;
+    // Active uniforms reflected after linking, sorted by name hash
+    std::vector<std::pair<uint64_t, GLint>> uniforms;
+    // Names already warned about
+    mutable std::vector<uint64_t> missing_uniforms;
 
     // Utility functions
-    std::string load_shader_source(const std::string& path) const;
-    GLuint compile_shader(const std::string& source, GLenum type) const;
+    std::string_view load_shader_source(const AssetFile& file, const std::string& path) const;
+    static std::string with_defines(std::string_view source, std::span<const std::string> defines);
+    GLuint compile_shader(std::string_view source, GLenum type) const;
+    void start_link(std::initializer_list<GLuint> stages, uint64_t key);
     void check_compile_errors(GLuint shader, const std::string& type) const;
-    GLint get_uniform_location(const std::string& name) const;
+    void store_binary(uint64_t key) const;
+    // Also binds the Frame uniform block (see FrameUniforms)
+    void reflect_uniforms();
+    GLint find_uniform(uint64_t hash) const;
 };
\ No newline at end of file
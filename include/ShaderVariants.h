@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Shader.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Permutations of one vertex and fragment shader pair. Each keyword is a
+// bit of a variant mask, and the variant for a mask is the program compiled
+// with #define KEYWORD for every bit set, so shaders branch with #ifdef at
+// compile time instead of on uniforms per fragment.
+//
+// A variant compiles the first time it is asked for and stays cached by its
+// mask; the ProgramCache key covers the defines, so later runs load each
+// variant's binary. prepare() starts variants compiling in the background
+// ahead of time, and find_ready() lets a frame draw with something else
+// until they finish instead of waiting on the driver.
+class ShaderVariants {
+public:
+    static constexpr size_t MAX_KEYWORDS = 32;
+
+    // Called with a freshly compiled variant in use, to set what stays fixed
+    // for its lifetime such as sampler units
+    using Setup = std::function<void(const Shader&)>;
+
+    // Constructor
+    ShaderVariants() = default;
+    ShaderVariants(std::string vertex_path, std::string fragment_path, std::vector<std::string> keywords,
+                   Setup setup = {});
+
+    // Mask bit of a keyword, 0 when the shaders have no such keyword
+    uint32_t keyword(std::string_view name) const;
+
+    // Start compiling the variant for a mask in the background
+    void prepare(uint32_t mask);
+    // Finish variants whose background compile completed, on the GL thread
+    // once per frame. Returns whether none are left compiling.
+    bool update();
+
+    // Program for a mask of keyword bits, compiling it or waiting for its
+    // background compile. The reference stays valid while this object lives.
+    const Shader& variant(uint32_t mask);
+    // Program for a mask if it has finished compiling, otherwise nullptr
+    // after starting it in the background
+    const Shader* find_ready(uint32_t mask);
+    // Finished variant closest to a mask: the one with the most of its
+    // keywords and none besides, or nullptr. Starts no compiles; the
+    // variant's own mask goes in found_mask.
+    const Shader* find_ready_subset(uint32_t mask, uint32_t& found_mask) const;
+
+    size_t compiled_count() const { return variants.size(); }
+
+private:
+    struct Variant {
+        Shader shader;
+        bool set_up = false;
+    };
+
+    std::string vertex_path;
+    std::string fragment_path;
+    std::vector<std::string> keywords;
+    Setup setup;
+    std::unordered_map<uint32_t, Variant> variants;
+
+    uint32_t valid_mask(uint32_t mask) const;
+    Variant& find_or_start(uint32_t mask);
+    void finish(Variant& variant);
+};
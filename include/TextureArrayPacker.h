@@ -0,0 +1,60 @@
+#pragma once
+
+#include "MipGenerator.h"
+#include <GL/glew.h>
+#include <vector>
+
+// Size and sampler state every layer of one texture array shares
+struct TextureArrayFormat {
+    int width = 0;
+    int height = 0;
+    GLenum wrap_s = GL_REPEAT;
+    GLenum wrap_t = GL_REPEAT;
+    GLenum min_filter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum mag_filter = GL_LINEAR;
+
+    bool operator==(const TextureArrayFormat& other) const = default;
+};
+
+// Where an image ended up: which of the packer's arrays and which layer
+struct TextureLayer {
+    int array = -1;
+    int layer = 0;
+
+    bool is_valid() const { return array >= 0; }
+};
+
+// Groups RGBA8 images of the same format into GL_TEXTURE_2D_ARRAYs, so
+// everything drawn from one array needs a single bind and a layer index per
+// material instead of a texture bind per draw.
+//
+// Layers are handed out before any pixels exist (the size comes from the
+// image header), the arrays are created with every mip level allocated, and
+// each layer is filled with upload() once its image decodes.
+class TextureArrayPacker {
+public:
+    // Constructor, max_layers is usually GL_MAX_ARRAY_TEXTURE_LAYERS;
+    // formats with more images than that take several arrays
+    explicit TextureArrayPacker(int max_layers);
+
+    // Reserve a layer for an image of the given format
+    TextureLayer add(const TextureArrayFormat& format);
+
+    size_t array_count() const { return groups.size(); }
+
+    // Create one array per group with storage for the full mip chain of
+    // every layer, contents undefined until uploaded
+    std::vector<GLuint> create_arrays() const;
+
+    // Copy a mip chain into a layer of the bound GL_TEXTURE_2D_ARRAY
+    static void upload(int layer, const MipChain& mips);
+
+private:
+    struct Group {
+        TextureArrayFormat format;
+        int layers = 0;
+    };
+
+    int max_layers;
+    std::vector<Group> groups;
+};
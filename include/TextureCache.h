@@ -0,0 +1,125 @@
+#pragma once
+
+#include "TextureLoader.h"
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class TextureCache;
+
+// Counted reference to a texture in a TextureCache. Copies share the texture;
+// the cache only evicts textures no handle refers to. Handles must not
+// outlive their cache.
+class TextureHandle {
+public:
+    // Constructor, refers to nothing
+    TextureHandle() = default;
+
+    // Destructor
+    ~TextureHandle();
+
+    // Copy constructor and assignment
+    TextureHandle(const TextureHandle& other);
+    TextureHandle& operator=(const TextureHandle& other);
+
+    // Move constructor and assignment
+    TextureHandle(TextureHandle&& other) noexcept;
+    TextureHandle& operator=(TextureHandle&& other) noexcept;
+
+    bool is_valid() const { return slot != nullptr; }
+
+    // Texture name to bind: the cache's placeholder until the image is
+    // loaded, 0 for an empty handle
+    GLuint id() const;
+
+private:
+    friend class TextureCache;
+    struct Slot;
+
+    explicit TextureHandle(Slot* slot);
+    void release();
+
+    Slot* slot = nullptr;
+};
+
+// Shares image textures between everything that draws them.
+//
+// Paths are normalized and looked up first; a new path has its file hashed on
+// the thread pool and, if the contents match a texture already loaded under
+// another name, reuses that texture instead of loading a second copy. Each
+// texture's GPU memory is estimated from its size including the mip chain.
+// When the total passes the budget, update() deletes the textures no handle
+// holds, least recently released first.
+class TextureCache {
+public:
+    // Constructor, touches no GL state so it may run before the context exists
+    explicit TextureCache(size_t budget_bytes = size_t(512) << 20);
+
+    // Destructor, see clear()
+    ~TextureCache();
+
+    // Delete copy/move, handles hold a pointer to the cache
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // Handle to the texture for an image file, loading it if needed
+    TextureHandle acquire(const std::string& path);
+
+    // Resolve hashed files, advance uploads and evict over budget. Call on
+    // the GL thread once per frame.
+    void update();
+
+    size_t gpu_bytes() const { return total_bytes; }
+    size_t budget() const { return budget_bytes; }
+    void set_budget(size_t bytes) { budget_bytes = bytes; }
+    size_t texture_count() const { return textures.size(); }
+
+    // Files still being hashed, decoded or uploaded
+    size_t pending() const;
+
+    // Delete every texture, needs the GL context. Handles still alive fall
+    // back to id() 0.
+    void clear();
+
+private:
+    // One loaded image, possibly shared by several paths
+    struct Texture {
+        GLuint name = 0;
+        // Key in textures: hash of the file contents
+        uint64_t content_hash = 0;
+        // 0 until the upload finished and the size is known
+        size_t bytes = 0;
+    };
+
+    friend class TextureHandle;
+
+    TextureLoader loader;
+    std::unordered_map<std::string, std::unique_ptr<TextureHandle::Slot>> slots;
+    std::unordered_map<uint64_t, std::unique_ptr<Texture>> textures;
+    // Bound through handles whose texture isn't known yet
+    GLuint placeholder = 0;
+    size_t budget_bytes;
+    size_t total_bytes = 0;
+    // Advances on every release, orders textures for eviction
+    uint64_t clock = 0;
+
+    void resolve(TextureHandle::Slot& slot, uint64_t content_hash);
+    void measure();
+    void evict();
+};
+
+// A path's entry. Lives in the cache; handles point at it.
+struct TextureHandle::Slot {
+    TextureCache* cache = nullptr;
+    std::string path;
+    // Null while the file is being hashed
+    TextureCache::Texture* texture = nullptr;
+    std::future<uint64_t> hash;
+    size_t references = 0;
+    // Clock value of the last release
+    uint64_t last_used = 0;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "MipGenerator.h"
+#include <GL/glew.h>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Loads image files into 2D textures without stalling the render thread.
+//
+// load() hands out the texture name right away, showing a 1x1 placeholder.
+// The thread pool either maps the image's mip cache or decodes the file with
+// stb_image, builds the mip chain with MipGenerator and writes the cache for
+// next time. update() then maps a pixel buffer object on the GL thread, the
+// pool copies every level into it, and a later update() specifies the levels
+// from the buffer so the driver transfers them without blocking the frame.
+// The name never changes, so callers can bind it before the image arrives.
+//
+// Images baked by texbake skip all of that: a .ktx2 path, or a .ktx2 next to
+// the image that is at least as new as it, is mapped and its block
+// compressed levels go to glCompressedTexImage2D the same way.
+class TextureLoader {
+public:
+    // Constructor, touches no GL state so it may run before the context exists
+    TextureLoader() = default;
+
+    // Destructor, see clear()
+    ~TextureLoader();
+
+    // Move constructor and assignment
+    TextureLoader(TextureLoader&& other) noexcept;
+    TextureLoader& operator=(TextureLoader&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // Start loading an image file. Returns a texture that shows the
+    // placeholder until the image is uploaded, or forever if it fails. Color
+    // images are sRGB encoded and filtered in linear light; pass false for
+    // data such as normal maps.
+    GLuint load(const std::string& path, bool srgb = true);
+
+    // Advance outstanding loads, on the GL thread once per frame. At most
+    // upload_budget bytes of new uploads start per call, but always at least
+    // one image so large ones cannot starve. Returns pending().
+    size_t update();
+
+    // Loads still decoding or uploading
+    size_t pending() const { return pending_loads.size(); }
+    bool is_pending(GLuint texture) const;
+
+    // Delete one texture made by load(), waiting for its jobs if it is
+    // still loading
+    void unload(GLuint texture);
+
+    // Bytes of pixel data to start uploading per update()
+    void set_upload_budget(size_t bytes) { upload_budget = bytes; }
+
+    // Kernel for mip chains built from now on; caches built with another
+    // kernel are rebuilt
+    void set_mip_filter(MipFilter filter) { mip_filter = filter; }
+
+    // Wait for outstanding jobs and delete every texture and buffer. Needs
+    // the GL context; call it before the context goes away.
+    void clear();
+
+private:
+    struct DecodedImage {
+        // Rows bottom to top, as glTexImage2D expects
+        std::vector<MipLevel> levels;
+        // Internal format of block compressed levels, 0 for RGBA8
+        GLenum compressed_format = 0;
+        // Every level back to back, owned by the cache or KTX2 mapping or the
+        // chain
+        std::shared_ptr<const unsigned char> pixels;
+        size_t size = 0;
+        // stb_image keeps its failure reason per thread, so keep it here
+        const char* error = nullptr;
+    };
+
+    struct PendingLoad {
+        GLuint texture = 0;
+        std::string path;
+        std::future<DecodedImage> decode;
+        // Set once the pixels are on their way into pixel_buffer
+        DecodedImage image;
+        GLuint pixel_buffer = 0;
+        std::vector<std::future<void>> copies;
+    };
+
+    std::vector<GLuint> textures;
+    std::vector<PendingLoad> pending_loads;
+    // Pixel buffers kept around for reuse
+    std::vector<GLuint> free_pixel_buffers;
+    size_t upload_budget = size_t(64) << 20;
+    MipFilter mip_filter = MipFilter::Kaiser;
+
+    bool start_upload(PendingLoad& load);
+    void finish_upload(PendingLoad& load);
+    void cancel(PendingLoad& load);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads shared by the loaders. Work is either submitted
+// as single tasks or split into ranges with parallel_for().
+class ThreadPool {
+public:
+    // Constructor
+    explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+
+    // Destructor
+    ~ThreadPool();
+
+    // Delete copy/move, workers hold a pointer to the pool
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Process-wide pool sized to the machine
+    static ThreadPool& shared();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // Queue a single task and get its result through a future
+    template <typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    // Split [0, count) into batches of at least min_batch items and run
+    // body(begin, end) on them in parallel. The calling thread takes part and
+    // the call returns once every batch is done, so it is safe to nest. If
+    // body throws, batches not yet started are skipped and the first
+    // exception is rethrown on the calling thread once the rest have finished.
+    void parallel_for(size_t count, const std::function<void(size_t, size_t)>& body, size_t min_batch = 1);
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    bool stopping = false;
+
+    void enqueue(std::function<void()> task);
+    void worker_loop();
+};
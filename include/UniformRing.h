@@ -0,0 +1,55 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <array>
+#include <cstddef>
+
+// Uniform buffer for data rewritten every frame, split into SECTION_COUNT
+// sections used round robin. The CPU fills one section while the GPU may
+// still read the previous frames' sections, and a fence per section only
+// makes it wait when it laps a frame the GPU hasn't finished.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently and
+// coherently, and written with a plain memcpy. Otherwise each section is
+// uploaded with glBufferSubData, which the fences keep from stalling too.
+class UniformRing {
+public:
+    static constexpr int SECTION_COUNT = 3;
+
+    // Constructor, creates a buffer for blocks of size bytes bound to the
+    // uniform block binding point
+    UniformRing() = default;
+    UniformRing(GLuint binding, size_t size);
+
+    // Destructor
+    ~UniformRing();
+
+    // Move constructor and assignment
+    UniformRing(UniformRing&& other) noexcept;
+    UniformRing& operator=(UniformRing&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    bool is_valid() const { return buffer != 0; }
+    bool is_persistent() const { return mapping != nullptr; }
+
+    // Copy this frame's block into the next section and bind that section to
+    // the binding point, before the frame's draws
+    void update(const void* data);
+    // Fence the section, after the frame's last draw reading it
+    void end_frame();
+
+private:
+    GLuint buffer = 0;
+    GLuint binding = 0;
+    size_t size = 0;
+    // Sections start on GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT boundaries
+    size_t stride = 0;
+    char* mapping = nullptr;
+    std::array<GLsync, SECTION_COUNT> fences{};
+    int section = SECTION_COUNT - 1;
+
+    void release();
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Shader.h"
+#include "VirtualTextureFile.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Streams a tiled image far larger than GPU memory (see VirtualTextureFile)
+// and samples it through basic.frag's material.diffuse_map path.
+//
+// Only the tiles the frame needs are resident, in a physical cache texture
+// with room for PHYSICAL_TILES x PHYSICAL_TILES tiles. A page table texture
+// with one texel per tile and a mip level per pyramid level points each tile
+// at its cache slot; tiles that are not resident point at the nearest
+// resident ancestor, so the image sharpens as tiles arrive instead of showing
+// holes. The last level is a single tile kept resident at all times.
+//
+// Which tiles are needed comes from a feedback pass: the caller draws the
+// virtual textured objects between begin_feedback() and end_feedback() with
+// the vt_feedback shader into a small integer target, which is read back
+// asynchronously. update() turns the readback into tile requests, coarse
+// levels first, reads the tiles on the thread pool and copies finished ones
+// into the cache, evicting the least recently needed.
+class VirtualTexture {
+public:
+    // Cache slots per side; 32 slots of 128 texels make a 4096x4096 cache
+    static constexpr int PHYSICAL_TILES = 32;
+    // Feedback target size relative to the framebuffer
+    static constexpr int FEEDBACK_SCALE = 8;
+    // Tile reads in flight and tile copies into the cache per update()
+    static constexpr size_t MAX_PENDING_TILES = 64;
+    static constexpr size_t MAX_UPLOADS_PER_UPDATE = 32;
+
+    // Constructor, maps the file and creates the GL objects
+    VirtualTexture() = default;
+    explicit VirtualTexture(const std::string& path);
+
+    // Destructor
+    ~VirtualTexture();
+
+    // Move constructor and assignment
+    VirtualTexture(VirtualTexture&& other) noexcept;
+    VirtualTexture& operator=(VirtualTexture&& other) noexcept;
+
+    // Delete copy constructor and assignment
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    bool is_valid() const { return page_table != 0; }
+
+    // Bind the page table and physical cache to texture units first_unit and
+    // first_unit + 1 and point the shader's virtual_texture uniforms at them
+    void bind(const Shader& shader, GLuint first_unit) const;
+
+    // Render into the feedback target when the previous readback has been
+    // consumed; returns false, leaving the framebuffer alone, otherwise.
+    // Draw with the vt_feedback shader after bind_feedback().
+    bool begin_feedback(int framebuffer_width, int framebuffer_height);
+    void bind_feedback(const Shader& shader) const;
+    // Start reading the target back and restore the default framebuffer
+    void end_feedback(int framebuffer_width, int framebuffer_height);
+
+    // Consume finished readbacks and tile reads, on the GL thread once per
+    // frame. Returns the tiles still loading.
+    size_t update();
+
+    size_t resident_tiles() const { return resident.size(); }
+    size_t pending_tiles() const { return pending.size(); }
+
+private:
+    struct Slot {
+        // Tile held, EMPTY_TILE when free
+        uint64_t tile = EMPTY_TILE;
+        uint64_t last_used = 0;
+        bool pinned = false;
+    };
+
+    struct PendingTile {
+        uint64_t tile = 0;
+        std::future<std::vector<unsigned char>> data;
+    };
+
+    static constexpr uint64_t EMPTY_TILE = ~uint64_t(0);
+
+    std::unique_ptr<VirtualTextureFile> file;
+    GLuint page_table = 0;
+    GLuint physical_cache = 0;
+    int physical_tiles = PHYSICAL_TILES;
+
+    GLuint feedback_framebuffer = 0;
+    GLuint feedback_color = 0;
+    GLuint feedback_depth = 0;
+    GLuint feedback_buffer = 0;
+    GLsync feedback_fence = nullptr;
+    int feedback_width = 0;
+    int feedback_height = 0;
+
+    std::vector<Slot> slots;
+    // Tile key to slot
+    std::unordered_map<uint64_t, uint32_t> resident;
+    std::vector<PendingTile> pending;
+    // Page table texels per level, rebuilt when residency changes
+    std::vector<std::vector<uint32_t>> page_entries;
+    bool page_table_dirty = true;
+    uint64_t frame = 0;
+
+    static uint64_t tile_key(int level, int x, int y);
+
+    void set_parameters(const Shader& shader, float lod_bias) const;
+    void process_feedback(const uint16_t* texels, size_t count);
+    void request(uint64_t tile);
+    bool upload(uint64_t tile, const unsigned char* data, bool pinned);
+    void update_page_table();
+    void release();
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "MipGenerator.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tiled mip pyramid of one large image, streamed by VirtualTexture and
+// written by texbake --virtual.
+//
+// Layout (little endian):
+//   VirtualTextureHeader
+//   tiles  RGBA8, level by level from the largest, each level's tiles in rows
+//          bottom to top, starting on a 4 KiB boundary
+//
+// Each level is the one above halved and rounded up, at exactly half its
+// texel density, and only the tiles covering it are stored. The page table
+// addressing them is pages_x * pages_y at level 0, both powers of two, so it
+// halves exactly down to the last level, which is a single tile; its pages
+// past a level's tiles are never sampled. Every tile carries tile_border
+// texels of its neighbours on each side, repeating the level's edges past
+// them, so bilinear filtering in the physical cache never reads another tile.
+struct VirtualTextureHeader {
+    char magic[4];
+    uint32_t version;
+    // Image size in texels; the page table covers pages * tile_size
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t tile_border;
+    uint32_t pages_x;
+    uint32_t pages_y;
+    uint32_t level_count;
+    uint32_t srgb;
+    uint64_t tile_offset;
+    uint64_t tile_count;
+};
+
+class VirtualTextureFile {
+public:
+    static constexpr char MAGIC[4] = {'V', 'T', 'E', 'X'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t TILE_ALIGNMENT = 4096;
+    // Content and border texels per tile; 120 + 2 * 4 stores 128x128 tiles
+    static constexpr int DEFAULT_TILE_SIZE = 120;
+    static constexpr int DEFAULT_TILE_BORDER = 4;
+    // Largest tile size a file may declare
+    static constexpr uint32_t MAX_TILE_SIZE = 4096;
+
+    // File texbake --virtual writes for a source image by default: the same
+    // path with a .vtex extension
+    static std::string baked_path_for(const std::string& source_path);
+
+    // Cut an RGBA8 image, rows bottom to top, into tiles at every level. The
+    // pyramid is built and cut in bands of rows, so besides the image only a
+    // few tile rows per level are held in memory.
+    static bool write(const std::string& path, const unsigned char* rgba, int width, int height, MipFilter filter,
+                      bool srgb, int tile_size = DEFAULT_TILE_SIZE, int tile_border = DEFAULT_TILE_BORDER);
+
+    // Constructor, maps and validates the file
+    VirtualTextureFile() = default;
+    explicit VirtualTextureFile(const std::string& path);
+
+    bool is_valid() const { return header != nullptr; }
+
+    int width() const { return static_cast<int>(header->width); }
+    int height() const { return static_cast<int>(header->height); }
+    bool is_srgb() const { return header->srgb != 0; }
+    int tile_size() const { return static_cast<int>(header->tile_size); }
+    int tile_border() const { return static_cast<int>(header->tile_border); }
+    // Texels per side of a stored tile, borders included
+    int stored_tile_size() const { return tile_size() + 2 * tile_border(); }
+    size_t tile_bytes() const;
+    int level_count() const { return static_cast<int>(header->level_count); }
+    // Page table size of a level
+    int pages_x(int level) const;
+    int pages_y(int level) const;
+    // Stored tiles of a level, at most its pages
+    int tiles_x(int level) const { return tile_counts[level * 2]; }
+    int tiles_y(int level) const { return tile_counts[level * 2 + 1]; }
+
+    // View into the mapping, valid while this object lives
+    const unsigned char* tile_data(int level, int x, int y) const;
+
+private:
+    AssetFile file;
+    const VirtualTextureHeader* header = nullptr;
+    // Index of each level's first tile
+    std::vector<uint64_t> level_first_tile;
+    // Stored tiles along x and y, per level
+    std::vector<int> tile_counts;
+};
@@ -0,0 +1,419 @@
+#include "AssetPack.h"
+#include "Lz4Codec.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Whether count elements at offset fit in a file of file_size bytes, without
+// the sum ever wrapping
+bool blob_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / element_size;
+}
+
+// Whether a compressed entry has a sane block size and room for its block
+// offset table
+bool block_table_fits(const AssetPackEntry& entry) {
+    if (entry.block_size < AssetPack::MIN_BLOCK_SIZE || entry.block_size > AssetPack::MAX_BLOCK_SIZE) {
+        return false;
+    }
+    uint64_t block_count = entry.size / entry.block_size + (entry.size % entry.block_size != 0 ? 1 : 0);
+    return blob_fits(0, block_count + 1, sizeof(uint64_t), entry.stored_size);
+}
+
+// Written by the loaders next to their sources, rebuilt on the target
+bool is_generated(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    return extension == ".mipcache" || extension == ".meshcache" || extension == ".iblcache" ||
+           extension == ".tmp";
+}
+
+// Read in place, a tile or level at a time, by AssetFile views; compressed
+// they would be inflated whole on open
+bool is_mapped_in_place(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    return extension == ".vtex" || extension == ".ktx2";
+}
+
+// Block offset table and blocks for an entry, or nothing when compressing
+// saves less than an eighth
+std::vector<char> compress_blocks(std::string_view contents, uint32_t block_size) {
+    size_t block_count = (contents.size() + block_size - 1) / block_size;
+    std::vector<std::vector<char>> blocks(block_count);
+    ThreadPool::shared().parallel_for(block_count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::string_view source = contents.substr(i * block_size, block_size);
+            std::vector<char>& block = blocks[i];
+            block.resize(Lz4Codec::compress_bound(source.size()));
+            size_t compressed = Lz4Codec::compress(source.data(), source.size(), block.data(), block.size());
+            // Readers tell stored blocks by their size
+            if (compressed == 0 || compressed >= source.size()) {
+                block.assign(source.begin(), source.end());
+            } else {
+                block.resize(compressed);
+            }
+        }
+    });
+
+    std::vector<uint64_t> offsets(block_count + 1);
+    offsets[0] = offsets.size() * sizeof(uint64_t);
+    for (size_t i = 0; i < block_count; ++i) {
+        offsets[i + 1] = offsets[i] + blocks[i].size();
+    }
+    if (offsets.back() > contents.size() - contents.size() / 8) {
+        return {};
+    }
+
+    std::vector<char> stored(offsets.back());
+    std::memcpy(stored.data(), offsets.data(), offsets.size() * sizeof(uint64_t));
+    for (size_t i = 0; i < block_count; ++i) {
+        std::memcpy(stored.data() + offsets[i], blocks[i].data(), blocks[i].size());
+    }
+    return stored;
+}
+
+} // namespace
+
+uint64_t AssetPack::hash_name(std::string_view name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string AssetPack::normalize(std::string_view path) {
+    std::string name = std::filesystem::path(path).lexically_normal().generic_string();
+    // Directories come back with a trailing slash
+    if (name.size() > 1 && name.back() == '/') {
+        name.pop_back();
+    }
+    return name;
+}
+
+bool AssetPack::write(const std::string& pack_path, const std::vector<std::string>& directories,
+                      uint32_t block_size) {
+    if (block_size != 0 && (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE)) {
+        std::cerr << "ERROR::ASSET_PACK::INVALID_BLOCK_SIZE: " << block_size << std::endl;
+        return false;
+    }
+
+    struct Source {
+        std::string name;
+        std::filesystem::path path;
+    };
+    std::vector<Source> sources;
+    for (const std::string& directory : directories) {
+        std::error_code error;
+        std::filesystem::recursive_directory_iterator it(directory, error), end;
+        if (error) {
+            std::cerr << "ERROR::ASSET_PACK::CANNOT_READ_DIRECTORY: " << directory << ": " << error.message()
+                      << std::endl;
+            return false;
+        }
+        for (; it != end; it.increment(error)) {
+            if (error) {
+                std::cerr << "ERROR::ASSET_PACK::CANNOT_READ_DIRECTORY: " << directory << ": " << error.message()
+                          << std::endl;
+                return false;
+            }
+            // Empty files can't be mapped, so they don't open from disk either
+            if (!it->is_regular_file(error) || it->file_size(error) == 0 || is_generated(it->path())) {
+                continue;
+            }
+            sources.push_back({normalize(it->path().generic_string()), it->path()});
+        }
+    }
+
+    std::vector<AssetPackEntry> entries(sources.size());
+    std::string names;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        entries[i].name_hash = hash_name(sources[i].name);
+        entries[i].name_offset = static_cast<uint32_t>(names.size());
+        entries[i].name_length = static_cast<uint32_t>(sources[i].name.size());
+        names += sources[i].name;
+    }
+
+    // Contents go in name order, so files from one directory stay together
+    std::vector<size_t> order(sources.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sources[a].name < sources[b].name; });
+
+    AssetPackHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    header.entry_offset = sizeof(AssetPackHeader);
+    header.name_offset = header.entry_offset + entries.size() * sizeof(AssetPackEntry);
+    header.name_size = names.size();
+
+    // Write next to the final name and rename, so a crash never leaves a
+    // half written pack that looks valid
+    std::string temp_path = pack_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::ASSET_PACK::CANNOT_WRITE: " << pack_path << std::endl;
+            return false;
+        }
+
+        // The table goes in once every offset is known
+        uint64_t offset = align_up(header.name_offset + header.name_size, CONTENT_ALIGNMENT);
+        out.seekp(static_cast<std::streamoff>(offset));
+        static const char zeros[CONTENT_ALIGNMENT] = {};
+        for (size_t index : order) {
+            MappedFile source(sources[index].path.string());
+            if (!source.is_open()) {
+                std::cerr << "ERROR::ASSET_PACK::CANNOT_READ_SOURCE: " << sources[index].path.string() << std::endl;
+                out.close();
+                std::error_code error;
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+            std::vector<char> compressed = block_size != 0 && !is_mapped_in_place(sources[index].path)
+                                                   ? compress_blocks(source.view(), block_size)
+                                                   : std::vector<char>();
+            std::string_view stored = compressed.empty() ? source.view()
+                                                         : std::string_view(compressed.data(), compressed.size());
+            entries[index].offset = offset;
+            entries[index].stored_size = stored.size();
+            entries[index].size = source.size();
+            entries[index].block_size = compressed.empty() ? 0 : block_size;
+            out.write(stored.data(), static_cast<std::streamsize>(stored.size()));
+            uint64_t end = offset + stored.size();
+            offset = align_up(end, CONTENT_ALIGNMENT);
+            out.write(zeros, static_cast<std::streamsize>(offset - end));
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const AssetPackEntry& a, const AssetPackEntry& b) { return a.name_hash < b.name_hash; });
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()),
+                  static_cast<std::streamsize>(entries.size() * sizeof(AssetPackEntry)));
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+        if (!out) {
+            std::cerr << "ERROR::ASSET_PACK::CANNOT_WRITE: " << pack_path << std::endl;
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, pack_path, error);
+    if (error) {
+        std::cerr << "ERROR::ASSET_PACK::CANNOT_WRITE: " << pack_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+AssetPack::AssetPack(const std::string& path) : file(path) {
+    if (!file.is_open()) {
+        std::cerr << "ERROR::ASSET_PACK::CANNOT_OPEN: " << path << std::endl;
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const AssetPackHeader*>(file.data());
+    bool valid = file.size() >= sizeof(AssetPackHeader) &&
+                 std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) == 0 && candidate->version == VERSION &&
+                 candidate->entry_offset >= sizeof(AssetPackHeader) &&
+                 candidate->entry_offset % alignof(AssetPackEntry) == 0 &&
+                 blob_fits(candidate->entry_offset, candidate->entry_count, sizeof(AssetPackEntry), file.size()) &&
+                 blob_fits(candidate->name_offset, candidate->name_size, 1, file.size());
+    if (valid) {
+        const auto* table = reinterpret_cast<const AssetPackEntry*>(file.data() + candidate->entry_offset);
+        for (uint32_t i = 0; i < candidate->entry_count && valid; ++i) {
+            valid = table[i].offset % CONTENT_ALIGNMENT == 0 &&
+                    blob_fits(table[i].offset, table[i].stored_size, 1, file.size()) &&
+                    (table[i].block_size != 0 ? block_table_fits(table[i]) : table[i].stored_size == table[i].size) &&
+                    static_cast<uint64_t>(table[i].name_offset) + table[i].name_length <= candidate->name_size &&
+                    (i == 0 || table[i - 1].name_hash <= table[i].name_hash);
+        }
+    }
+    if (!valid) {
+        std::cerr << "ERROR::ASSET_PACK::INVALID_PACK: " << path << std::endl;
+        return;
+    }
+
+    header = candidate;
+    entries = reinterpret_cast<const AssetPackEntry*>(file.data() + header->entry_offset);
+    names = file.data() + header->name_offset;
+}
+
+std::string_view AssetPack::entry_name(const AssetPackEntry& entry) const {
+    return {names + entry.name_offset, entry.name_length};
+}
+
+const AssetPackEntry* AssetPack::find(std::string_view path) const {
+    if (!is_valid()) {
+        return nullptr;
+    }
+    std::string name = normalize(path);
+    uint64_t hash = hash_name(name);
+    const AssetPackEntry* end = entries + header->entry_count;
+    const AssetPackEntry* it = std::lower_bound(
+            entries, end, hash, [](const AssetPackEntry& entry, uint64_t value) { return entry.name_hash < value; });
+    // Names only differ within a run of equal hashes if they collide
+    for (; it != end && it->name_hash == hash; ++it) {
+        if (entry_name(*it) == name) {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+std::string_view AssetPack::contents(const AssetPackEntry& entry) const {
+    if (entry.block_size != 0) {
+        return {};
+    }
+    return {file.data() + entry.offset, entry.size};
+}
+
+bool AssetPack::read(const AssetPackEntry& entry, uint64_t offset, uint64_t size, char* destination) const {
+    if (offset > entry.size || size > entry.size - offset) {
+        return false;
+    }
+    const char* stored = file.data() + entry.offset;
+    if (entry.block_size == 0) {
+        std::memcpy(destination, stored + offset, size);
+        return true;
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    uint64_t block_count = (entry.size + entry.block_size - 1) / entry.block_size;
+    if ((block_count + 1) * sizeof(uint64_t) > entry.stored_size) {
+        return false;
+    }
+    // Entries start on a 4 KiB boundary, so the table is aligned
+    const auto* block_offsets = reinterpret_cast<const uint64_t*>(stored);
+    uint64_t first_block = offset / entry.block_size;
+    uint64_t end_block = (offset + size + entry.block_size - 1) / entry.block_size;
+
+    std::atomic<bool> ok = true;
+    ThreadPool::shared().parallel_for(end_block - first_block, [&](size_t begin, size_t end) {
+        std::unique_ptr<char[]> scratch;
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t block = first_block + i;
+            uint64_t block_start = block * entry.block_size;
+            uint64_t block_length = std::min<uint64_t>(entry.block_size, entry.size - block_start);
+            uint64_t stored_start = block_offsets[block];
+            uint64_t stored_end = block_offsets[block + 1];
+            if (stored_start > stored_end || stored_end > entry.stored_size) {
+                ok = false;
+                continue;
+            }
+            const char* source = stored + stored_start;
+            size_t source_size = stored_end - stored_start;
+
+            // Part of the block the range covers
+            uint64_t from = std::max(offset, block_start);
+            uint64_t to = std::min(offset + size, block_start + block_length);
+            char* target = destination + (from - offset);
+            if (source_size == block_length) {
+                std::memcpy(target, source + (from - block_start), to - from);
+            } else if (to - from == block_length) {
+                if (!Lz4Codec::decompress(source, source_size, target, block_length)) {
+                    ok = false;
+                }
+            } else {
+                if (!scratch) {
+                    scratch = std::make_unique_for_overwrite<char[]>(entry.block_size);
+                }
+                if (Lz4Codec::decompress(source, source_size, scratch.get(), block_length)) {
+                    std::memcpy(target, scratch.get() + (from - block_start), to - from);
+                } else {
+                    ok = false;
+                }
+            }
+        }
+    });
+    return ok;
+}
+
+std::vector<std::string> AssetPack::list(std::string_view directory) const {
+    std::vector<std::string> files;
+    std::string prefix = normalize(directory) + "/";
+    for (uint32_t i = 0; i < entry_count(); ++i) {
+        std::string_view name = entry_name(entries[i]);
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.find('/', prefix.size()) == std::string_view::npos) {
+            files.emplace_back(name);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+AssetPack& AssetPack::mount_point() {
+    static AssetPack pack;
+    return pack;
+}
+
+bool AssetPack::mount(const std::string& path) {
+    AssetPack pack(path);
+    if (!pack.is_valid()) {
+        return false;
+    }
+    mount_point() = std::move(pack);
+    return true;
+}
+
+const AssetPack& AssetPack::mounted() {
+    return mount_point();
+}
+
+AssetFile::AssetFile(const std::string& path) {
+    const AssetPack& pack = AssetPack::mounted();
+    const AssetPackEntry* entry = pack.find(path);
+    if (entry == nullptr) {
+        file = MappedFile(path);
+        contents = file.view();
+        return;
+    }
+
+    contents = pack.contents(*entry);
+    if (contents.data() == nullptr) {
+        buffer = std::make_unique_for_overwrite<char[]>(entry->size);
+        if (!pack.read(*entry, 0, entry->size, buffer.get())) {
+            std::cerr << "ERROR::ASSET_PACK::CORRUPT_ENTRY: " << path << std::endl;
+            buffer.reset();
+            return;
+        }
+        contents = {buffer.get(), entry->size};
+    }
+}
+
+bool AssetFile::exists(const std::string& path) {
+    std::error_code error;
+    return AssetPack::mounted().find(path) != nullptr || std::filesystem::is_regular_file(path, error);
+}
+
+std::vector<std::string> AssetFile::list(const std::string& directory) {
+    std::vector<std::string> files = AssetPack::mounted().list(directory);
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.is_regular_file(error)) {
+            files.push_back(AssetPack::normalize(entry.path().generic_string()));
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
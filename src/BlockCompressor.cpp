@@ -0,0 +1,451 @@
+#include "BlockCompressor.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+constexpr int TEXELS = 16;
+// Least squares passes after the initial endpoint fit
+constexpr int REFINE_PASSES = 2;
+
+// BC7 four bit index weights, out of 64
+constexpr int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Block {
+    // RGBA in 0..255
+    float texels[TEXELS][4];
+};
+
+// Writes bit fields least significant bit first
+struct BitWriter {
+    unsigned char* out;
+    int position = 0;
+
+    void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++position) {
+            if ((value >> i) & 1u) {
+                out[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+            }
+        }
+    }
+};
+
+float distance_squared(const float* a, const float* b, int channels) {
+    float sum = 0.0f;
+    for (int c = 0; c < channels; ++c) {
+        float d = a[c] - b[c];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// Mean and principal axis of the selected texels over the first channels,
+// by power iteration on the covariance matrix
+void principal_axis(const Block& block, const bool* selected, int channels, float mean[4], float axis[4]) {
+    int count = 0;
+    std::fill(mean, mean + 4, 0.0f);
+    for (int i = 0; i < TEXELS; ++i) {
+        if (selected[i]) {
+            for (int c = 0; c < channels; ++c) {
+                mean[c] += block.texels[i][c];
+            }
+            ++count;
+        }
+    }
+    for (int c = 0; c < channels; ++c) {
+        mean[c] /= static_cast<float>(std::max(count, 1));
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < TEXELS; ++i) {
+        if (!selected[i]) {
+            continue;
+        }
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                covariance[a][b] += (block.texels[i][a] - mean[a]) * (block.texels[i][b] - mean[b]);
+            }
+        }
+    }
+
+    std::fill(axis, axis + 4, 0.0f);
+    for (int c = 0; c < channels; ++c) {
+        axis[c] = 1.0f;
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            length += next[c] * next[c];
+        }
+        length = std::sqrt(length);
+        if (length < FLT_EPSILON) {
+            break;
+        }
+        for (int c = 0; c < channels; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+}
+
+// Endpoints at the extremes of the selected texels along the axis
+void fit_endpoints(const Block& block, const bool* selected, int channels, float endpoint0[4], float endpoint1[4]) {
+    float mean[4];
+    float axis[4];
+    principal_axis(block, selected, channels, mean, axis);
+
+    float low = FLT_MAX;
+    float high = -FLT_MAX;
+    for (int i = 0; i < TEXELS; ++i) {
+        if (!selected[i]) {
+            continue;
+        }
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (block.texels[i][c] - mean[c]) * axis[c];
+        }
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    if (low > high) {
+        low = high = 0.0f;
+    }
+    for (int c = 0; c < 4; ++c) {
+        endpoint0[c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+        endpoint1[c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+    }
+}
+
+// Endpoints minimizing the squared error for fixed interpolation factors,
+// texel i is approximated by (1 - t[i]) * endpoint0 + t[i] * endpoint1.
+// Leaves the endpoints alone when the system is singular.
+void refine_endpoints(const Block& block, const bool* selected, const float* t, int channels, float endpoint0[4],
+                      float endpoint1[4]) {
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    float x[4] = {};
+    float y[4] = {};
+    for (int i = 0; i < TEXELS; ++i) {
+        if (!selected[i]) {
+            continue;
+        }
+        float a = 1.0f - t[i];
+        float b = t[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; ++c) {
+            x[c] += a * block.texels[i][c];
+            y[c] += b * block.texels[i][c];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f) {
+        return;
+    }
+    for (int c = 0; c < channels; ++c) {
+        endpoint0[c] = std::clamp((bb * x[c] - ab * y[c]) / determinant, 0.0f, 255.0f);
+        endpoint1[c] = std::clamp((aa * y[c] - ab * x[c]) / determinant, 0.0f, 255.0f);
+    }
+}
+
+uint16_t pack_565(const float color[3]) {
+    auto quantize = [](float value, int max) {
+        return static_cast<uint16_t>(std::clamp(static_cast<int>(value * max / 255.0f + 0.5f), 0, max));
+    };
+    return static_cast<uint16_t>(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 | quantize(color[2], 31));
+}
+
+void unpack_565(uint16_t packed, float color[3]) {
+    int r = (packed >> 11) & 31;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    color[0] = static_cast<float>(r << 3 | r >> 2);
+    color[1] = static_cast<float>(g << 2 | g >> 4);
+    color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+// BC1 color block. With punch_through, texels with alpha below 128 use the
+// transparent index of the three color mode; BC3 passes false since its
+// color block always decodes with four colors.
+void encode_bc1(const Block& block, bool punch_through, unsigned char* out) {
+    bool selected[TEXELS];
+    bool transparent = false;
+    for (int i = 0; i < TEXELS; ++i) {
+        selected[i] = !punch_through || block.texels[i][3] >= 128.0f;
+        transparent = transparent || !selected[i];
+    }
+    std::memset(out, 0, 8);
+    if (std::none_of(selected, selected + TEXELS, [](bool s) { return s; })) {
+        // Equal endpoints select three color mode, index 3 is transparent
+        std::memset(out + 4, 0xFF, 4);
+        return;
+    }
+
+    float endpoint0[4];
+    float endpoint1[4];
+    fit_endpoints(block, selected, 3, endpoint0, endpoint1);
+
+    float best_error = FLT_MAX;
+    for (int pass = 0; pass <= REFINE_PASSES; ++pass) {
+        uint16_t color0 = pack_565(endpoint0);
+        uint16_t color1 = pack_565(endpoint1);
+        // Four color mode needs color0 > color1, three color mode the reverse
+        if (transparent ? color0 > color1 : color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        float palette[4][3];
+        unpack_565(color0, palette[0]);
+        unpack_565(color1, palette[1]);
+        float factors[4] = {0.0f, 1.0f, 0.0f, 0.0f};
+        int palette_size = 4;
+        if (transparent || color0 == color1) {
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (palette[0][c] + palette[1][c]) * 0.5f;
+            }
+            factors[2] = 0.5f;
+            palette_size = 3;
+        } else {
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            factors[2] = 1.0f / 3.0f;
+            factors[3] = 2.0f / 3.0f;
+        }
+
+        uint32_t indices = 0;
+        float t[TEXELS] = {};
+        float error = 0.0f;
+        for (int i = 0; i < TEXELS; ++i) {
+            int best = 3;
+            if (selected[i]) {
+                float best_distance = FLT_MAX;
+                for (int p = 0; p < palette_size; ++p) {
+                    float distance = distance_squared(block.texels[i], palette[p], 3);
+                    if (distance < best_distance) {
+                        best_distance = distance;
+                        best = p;
+                    }
+                }
+                error += best_distance;
+                t[i] = factors[best];
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+
+        if (error < best_error) {
+            best_error = error;
+            out[0] = static_cast<unsigned char>(color0 & 0xFF);
+            out[1] = static_cast<unsigned char>(color0 >> 8);
+            out[2] = static_cast<unsigned char>(color1 & 0xFF);
+            out[3] = static_cast<unsigned char>(color1 >> 8);
+            for (int b = 0; b < 4; ++b) {
+                out[4 + b] = static_cast<unsigned char>(indices >> (8 * b));
+            }
+        }
+
+        // Refit to the endpoints in the order that was written
+        unpack_565(color0, endpoint0);
+        unpack_565(color1, endpoint1);
+        refine_endpoints(block, selected, t, 3, endpoint0, endpoint1);
+    }
+}
+
+// One channel with eight interpolated values (BC3 alpha, BC5 red and green)
+void encode_bc4(const Block& block, int channel, unsigned char* out) {
+    float low = 255.0f;
+    float high = 0.0f;
+    for (int i = 0; i < TEXELS; ++i) {
+        low = std::min(low, block.texels[i][channel]);
+        high = std::max(high, block.texels[i][channel]);
+    }
+    int value0 = static_cast<int>(high + 0.5f);
+    int value1 = static_cast<int>(low + 0.5f);
+    std::memset(out, 0, 8);
+    out[0] = static_cast<unsigned char>(value0);
+    out[1] = static_cast<unsigned char>(value1);
+    if (value0 == value1) {
+        return;
+    }
+
+    float palette[8] = {static_cast<float>(value0), static_cast<float>(value1)};
+    for (int k = 1; k < 7; ++k) {
+        palette[k + 1] = static_cast<float>((7 - k) * value0 + k * value1) / 7.0f;
+    }
+    BitWriter bits{out + 2};
+    for (int i = 0; i < TEXELS; ++i) {
+        int best = 0;
+        float best_distance = FLT_MAX;
+        for (int p = 0; p < 8; ++p) {
+            float distance = std::fabs(block.texels[i][channel] - palette[p]);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = p;
+            }
+        }
+        bits.put(static_cast<uint32_t>(best), 3);
+    }
+}
+
+// BC7 mode 6: one subset, 7 bit RGBA endpoints with a parity bit each and
+// 4 bit indices
+void encode_bc7(const Block& block, unsigned char* out) {
+    bool selected[TEXELS];
+    std::fill(selected, selected + TEXELS, true);
+    float endpoint0[4];
+    float endpoint1[4];
+    fit_endpoints(block, selected, 4, endpoint0, endpoint1);
+
+    float best_error = FLT_MAX;
+    int best_quantized[2][4] = {};
+    int best_parity[2] = {};
+    int best_indices[TEXELS] = {};
+
+    for (int pass = 0; pass <= REFINE_PASSES; ++pass) {
+        float pass_error = FLT_MAX;
+        int pass_indices[TEXELS] = {};
+        // Try every parity bit pair, the endpoint is (value << 1) | parity
+        for (int parity = 0; parity < 4; ++parity) {
+            int p[2] = {parity & 1, parity >> 1};
+            int quantized[2][4];
+            int endpoints[2][4];
+            for (int e = 0; e < 2; ++e) {
+                const float* source = e == 0 ? endpoint0 : endpoint1;
+                for (int c = 0; c < 4; ++c) {
+                    quantized[e][c] = std::clamp(static_cast<int>((source[c] - p[e]) * 0.5f + 0.5f), 0, 127);
+                    endpoints[e][c] = quantized[e][c] << 1 | p[e];
+                }
+            }
+
+            float palette[16][4];
+            for (int w = 0; w < 16; ++w) {
+                for (int c = 0; c < 4; ++c) {
+                    palette[w][c] = static_cast<float>(
+                            ((64 - BC7_WEIGHTS[w]) * endpoints[0][c] + BC7_WEIGHTS[w] * endpoints[1][c] + 32) >> 6);
+                }
+            }
+
+            float error = 0.0f;
+            int indices[TEXELS];
+            for (int i = 0; i < TEXELS; ++i) {
+                float best_distance = FLT_MAX;
+                for (int w = 0; w < 16; ++w) {
+                    float distance = distance_squared(block.texels[i], palette[w], 4);
+                    if (distance < best_distance) {
+                        best_distance = distance;
+                        indices[i] = w;
+                    }
+                }
+                error += best_distance;
+            }
+
+            if (error < best_error) {
+                best_error = error;
+                std::memcpy(best_quantized, quantized, sizeof(quantized));
+                best_parity[0] = p[0];
+                best_parity[1] = p[1];
+                std::memcpy(best_indices, indices, sizeof(indices));
+            }
+            if (error < pass_error) {
+                pass_error = error;
+                std::memcpy(pass_indices, indices, sizeof(indices));
+            }
+        }
+
+        float t[TEXELS];
+        for (int i = 0; i < TEXELS; ++i) {
+            t[i] = BC7_WEIGHTS[pass_indices[i]] / 64.0f;
+        }
+        refine_endpoints(block, selected, t, 4, endpoint0, endpoint1);
+    }
+
+    // The first index is stored without its top bit, so it has to be below 8
+    if (best_indices[0] >= 8) {
+        for (int c = 0; c < 4; ++c) {
+            std::swap(best_quantized[0][c], best_quantized[1][c]);
+        }
+        std::swap(best_parity[0], best_parity[1]);
+        for (int& index : best_indices) {
+            index = 15 - index;
+        }
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter bits{out};
+    bits.put(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.put(static_cast<uint32_t>(best_quantized[0][c]), 7);
+        bits.put(static_cast<uint32_t>(best_quantized[1][c]), 7);
+    }
+    bits.put(static_cast<uint32_t>(best_parity[0]), 1);
+    bits.put(static_cast<uint32_t>(best_parity[1]), 1);
+    bits.put(static_cast<uint32_t>(best_indices[0]), 3);
+    for (int i = 1; i < TEXELS; ++i) {
+        bits.put(static_cast<uint32_t>(best_indices[i]), 4);
+    }
+}
+
+} // namespace
+
+size_t BlockCompressor::block_bytes(BlockFormat format) {
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t BlockCompressor::compressed_size(BlockFormat format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * block_bytes(format);
+}
+
+std::vector<unsigned char> BlockCompressor::compress(const unsigned char* rgba, int width, int height,
+                                                     BlockFormat format) {
+    int blocks_x = (width + 3) / 4;
+    int blocks_y = (height + 3) / 4;
+    size_t stride = block_bytes(format);
+    std::vector<unsigned char> result(compressed_size(format, width, height));
+
+    ThreadPool::shared().parallel_for(static_cast<size_t>(blocks_y), [&](size_t begin, size_t end) {
+        Block block;
+        for (size_t by = begin; by < end; ++by) {
+            for (int bx = 0; bx < blocks_x; ++bx) {
+                for (int i = 0; i < TEXELS; ++i) {
+                    int x = std::min(bx * 4 + (i & 3), width - 1);
+                    int y = std::min(static_cast<int>(by) * 4 + (i >> 2), height - 1);
+                    const unsigned char* texel = rgba + (static_cast<size_t>(y) * width + x) * 4;
+                    for (int c = 0; c < 4; ++c) {
+                        block.texels[i][c] = texel[c];
+                    }
+                }
+
+                unsigned char* out = result.data() + (by * blocks_x + bx) * stride;
+                switch (format) {
+                    case BlockFormat::BC1:
+                        encode_bc1(block, true, out);
+                        break;
+                    case BlockFormat::BC3:
+                        encode_bc4(block, 3, out);
+                        encode_bc1(block, false, out + 8);
+                        break;
+                    case BlockFormat::BC5:
+                        encode_bc4(block, 0, out);
+                        encode_bc4(block, 1, out + 8);
+                        break;
+                    case BlockFormat::BC7:
+                        encode_bc7(block, out);
+                        break;
+                }
+            }
+        }
+    });
+    return result;
+}
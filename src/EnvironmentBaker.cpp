@@ -0,0 +1,427 @@
+#include "EnvironmentBaker.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+namespace {
+
+constexpr float PI = 3.14159265358979f;
+constexpr int FACES = 6;
+constexpr int CHANNELS = 3;
+// Irradiance is smooth, a small level projects as well as a large one
+constexpr int IRRADIANCE_SOURCE_SIZE = 64;
+// Rows per parallel batch
+constexpr size_t BATCH_ROWS = 4;
+
+struct Vec3 {
+    float x, y, z;
+};
+
+Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+
+Vec3 cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+Vec3 normalize(Vec3 v) {
+    return v * (1.0f / std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z));
+}
+
+// Direction through a face at u, v in [-1, 1], u to the right and v down the
+// rows, per the GL cube map face table
+Vec3 face_direction(int face, float u, float v) {
+    switch (face) {
+        case 0:
+            return normalize({1.0f, -v, -u});
+        case 1:
+            return normalize({-1.0f, -v, u});
+        case 2:
+            return normalize({u, 1.0f, v});
+        case 3:
+            return normalize({u, -1.0f, -v});
+        case 4:
+            return normalize({u, -v, 1.0f});
+        default:
+            return normalize({-u, -v, -1.0f});
+    }
+}
+
+// The face a direction hits and where, s and t in [0, 1]
+void face_coordinates(Vec3 d, int& face, float& s, float& t) {
+    float ax = std::fabs(d.x);
+    float ay = std::fabs(d.y);
+    float az = std::fabs(d.z);
+    float sc, tc, ma;
+    if (ax >= ay && ax >= az) {
+        face = d.x > 0.0f ? 0 : 1;
+        sc = d.x > 0.0f ? -d.z : d.z;
+        tc = -d.y;
+        ma = ax;
+    } else if (ay >= az) {
+        face = d.y > 0.0f ? 2 : 3;
+        sc = d.x;
+        tc = d.y > 0.0f ? d.z : -d.z;
+        ma = ay;
+    } else {
+        face = d.z > 0.0f ? 4 : 5;
+        sc = d.z > 0.0f ? d.x : -d.x;
+        tc = -d.y;
+        ma = az;
+    }
+    s = 0.5f * (sc / ma + 1.0f);
+    t = 0.5f * (tc / ma + 1.0f);
+}
+
+// Solid angle of a texel at u, v for a face of size texels
+float texel_solid_angle(float u, float v, int size) {
+    float texel = 2.0f / static_cast<float>(size);
+    return texel * texel / std::pow(1.0f + u * u + v * v, 1.5f);
+}
+
+// Texel center in [-1, 1]
+float texel_center(int index, int size) {
+    return (static_cast<float>(index) + 0.5f) / static_cast<float>(size) * 2.0f - 1.0f;
+}
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+// One cube level, six faces of size x size RGB texels
+struct CubeLevel {
+    int size = 0;
+    std::vector<float> pixels;
+
+    float* texel(int face, int x, int y) {
+        return pixels.data() + ((static_cast<size_t>(face) * size + y) * size + x) * CHANNELS;
+    }
+    const float* texel(int face, int x, int y) const {
+        return pixels.data() + ((static_cast<size_t>(face) * size + y) * size + x) * CHANNELS;
+    }
+};
+
+// Halve an image with a 2x2 box, the last row or column repeated when odd
+Image halve(const Image& source) {
+    Image target;
+    target.width = std::max(source.width / 2, 1);
+    target.height = std::max(source.height / 2, 1);
+    target.pixels.resize(static_cast<size_t>(target.width) * target.height * CHANNELS);
+    ThreadPool::shared().parallel_for(target.height, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            int y0 = std::min(static_cast<int>(y) * 2, source.height - 1);
+            int y1 = std::min(y0 + 1, source.height - 1);
+            for (int x = 0; x < target.width; ++x) {
+                int x0 = std::min(x * 2, source.width - 1);
+                int x1 = std::min(x0 + 1, source.width - 1);
+                for (int c = 0; c < CHANNELS; ++c) {
+                    float sum = source.pixels[(static_cast<size_t>(y0) * source.width + x0) * CHANNELS + c] +
+                                source.pixels[(static_cast<size_t>(y0) * source.width + x1) * CHANNELS + c] +
+                                source.pixels[(static_cast<size_t>(y1) * source.width + x0) * CHANNELS + c] +
+                                source.pixels[(static_cast<size_t>(y1) * source.width + x1) * CHANNELS + c];
+                    target.pixels[(y * target.width + x) * CHANNELS + c] = sum * 0.25f;
+                }
+            }
+        }
+    }, BATCH_ROWS);
+    return target;
+}
+
+// Bilinear lookup in an equirectangular image, wrapping around horizontally
+void sample_equirect(const Image& image, Vec3 d, float* out) {
+    float u = 0.5f + std::atan2(d.z, d.x) / (2.0f * PI);
+    float v = std::acos(std::clamp(d.y, -1.0f, 1.0f)) / PI;
+    float x = u * image.width - 0.5f;
+    float y = std::clamp(v * image.height - 0.5f, 0.0f, static_cast<float>(image.height - 1));
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float wx = x - fx;
+    float wy = y - fy;
+    int x0 = (static_cast<int>(fx) % image.width + image.width) % image.width;
+    int x1 = (x0 + 1) % image.width;
+    int y0 = static_cast<int>(fy);
+    int y1 = std::min(y0 + 1, image.height - 1);
+    const float* row0 = image.pixels.data() + static_cast<size_t>(y0) * image.width * CHANNELS;
+    const float* row1 = image.pixels.data() + static_cast<size_t>(y1) * image.width * CHANNELS;
+    for (int c = 0; c < CHANNELS; ++c) {
+        float top = row0[x0 * CHANNELS + c] + (row0[x1 * CHANNELS + c] - row0[x0 * CHANNELS + c]) * wx;
+        float bottom = row1[x0 * CHANNELS + c] + (row1[x1 * CHANNELS + c] - row1[x0 * CHANNELS + c]) * wx;
+        out[c] = top + (bottom - top) * wy;
+    }
+}
+
+// Bilinear lookup within the face a direction hits; filtering stops at the
+// face edge
+void sample_level(const CubeLevel& level, Vec3 d, float* out) {
+    int face;
+    float s, t;
+    face_coordinates(d, face, s, t);
+    float limit = static_cast<float>(level.size - 1);
+    float x = std::clamp(s * level.size - 0.5f, 0.0f, limit);
+    float y = std::clamp(t * level.size - 0.5f, 0.0f, limit);
+    int x0 = static_cast<int>(x);
+    int y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, level.size - 1);
+    int y1 = std::min(y0 + 1, level.size - 1);
+    float wx = x - x0;
+    float wy = y - y0;
+    const float* a = level.texel(face, x0, y0);
+    const float* b = level.texel(face, x1, y0);
+    const float* c = level.texel(face, x0, y1);
+    const float* e = level.texel(face, x1, y1);
+    for (int i = 0; i < CHANNELS; ++i) {
+        float top = a[i] + (b[i] - a[i]) * wx;
+        float bottom = c[i] + (e[i] - c[i]) * wx;
+        out[i] = top + (bottom - top) * wy;
+    }
+}
+
+// Trilinear lookup in a cube mip chain
+void sample_cube(const std::vector<CubeLevel>& levels, Vec3 d, float lod, float* out) {
+    lod = std::clamp(lod, 0.0f, static_cast<float>(levels.size() - 1));
+    int level = static_cast<int>(lod);
+    float blend = lod - level;
+    sample_level(levels[level], d, out);
+    if (blend > 0.0f && level + 1 < static_cast<int>(levels.size())) {
+        float coarse[CHANNELS];
+        sample_level(levels[level + 1], d, coarse);
+        for (int c = 0; c < CHANNELS; ++c) {
+            out[c] += (coarse[c] - out[c]) * blend;
+        }
+    }
+}
+
+// Box filter each face down to 1x1
+std::vector<CubeLevel> build_cube_chain(CubeLevel base) {
+    std::vector<CubeLevel> levels;
+    levels.push_back(std::move(base));
+    while (levels.back().size > 1) {
+        const CubeLevel& source = levels.back();
+        CubeLevel target;
+        target.size = source.size / 2;
+        target.pixels.resize(static_cast<size_t>(FACES) * target.size * target.size * CHANNELS);
+        for (int face = 0; face < FACES; ++face) {
+            for (int y = 0; y < target.size; ++y) {
+                for (int x = 0; x < target.size; ++x) {
+                    float* out = target.texel(face, x, y);
+                    const float* a = source.texel(face, x * 2, y * 2);
+                    const float* b = source.texel(face, x * 2 + 1, y * 2);
+                    const float* c = source.texel(face, x * 2, y * 2 + 1);
+                    const float* d = source.texel(face, x * 2 + 1, y * 2 + 1);
+                    for (int i = 0; i < CHANNELS; ++i) {
+                        out[i] = 0.25f * (a[i] + b[i] + c[i] + d[i]);
+                    }
+                }
+            }
+        }
+        levels.push_back(std::move(target));
+    }
+    return levels;
+}
+
+// Real spherical harmonics basis up to band 2
+void sh_basis(Vec3 d, float* basis) {
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * d.y;
+    basis[2] = 0.488603f * d.z;
+    basis[3] = 0.488603f * d.x;
+    basis[4] = 1.092548f * d.x * d.y;
+    basis[5] = 1.092548f * d.y * d.z;
+    basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    basis[7] = 1.092548f * d.x * d.z;
+    basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+// Project radiance onto the basis, then apply the cosine lobe per band
+// (pi, 2pi/3, pi/4; Ramamoorthi and Hanrahan) and divide by pi
+std::array<float, 27> project_irradiance(const CubeLevel& level) {
+    std::mutex merge_mutex;
+    double sums[27] = {};
+    double total_weight = 0.0;
+    ThreadPool::shared().parallel_for(static_cast<size_t>(FACES) * level.size, [&](size_t begin, size_t end) {
+        double local[27] = {};
+        double local_weight = 0.0;
+        float basis[9];
+        for (size_t row = begin; row < end; ++row) {
+            int face = static_cast<int>(row) / level.size;
+            int y = static_cast<int>(row) % level.size;
+            float v = texel_center(y, level.size);
+            for (int x = 0; x < level.size; ++x) {
+                float u = texel_center(x, level.size);
+                float weight = texel_solid_angle(u, v, level.size);
+                sh_basis(face_direction(face, u, v), basis);
+                const float* radiance = level.texel(face, x, y);
+                for (int k = 0; k < 9; ++k) {
+                    for (int c = 0; c < CHANNELS; ++c) {
+                        local[k * CHANNELS + c] += static_cast<double>(radiance[c]) * basis[k] * weight;
+                    }
+                }
+                local_weight += weight;
+            }
+        }
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        for (int i = 0; i < 27; ++i) {
+            sums[i] += local[i];
+        }
+        total_weight += local_weight;
+    }, BATCH_ROWS);
+
+    // The texel solid angles only approximately add up to the sphere
+    double normalize = 4.0 * PI / total_weight;
+    const float band[9] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+    std::array<float, 27> irradiance{};
+    for (int k = 0; k < 9; ++k) {
+        for (int c = 0; c < CHANNELS; ++c) {
+            irradiance[k * CHANNELS + c] = static_cast<float>(sums[k * CHANNELS + c] * normalize) * band[k];
+        }
+    }
+    return irradiance;
+}
+
+// GGX sample directions around +Z for one roughness, with N = V = R
+struct SpecularSample {
+    Vec3 direction;
+    float weight;
+    float lod;
+};
+
+float radical_inverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+std::vector<SpecularSample> specular_samples(float roughness, int sample_count, int base_size) {
+    float alpha = roughness * roughness;
+    float alpha2 = alpha * alpha;
+    float texel_angle = 4.0f * PI / (FACES * static_cast<float>(base_size) * base_size);
+    std::vector<SpecularSample> samples;
+    for (int i = 0; i < sample_count; ++i) {
+        float xi1 = static_cast<float>(i) / sample_count;
+        float xi2 = radical_inverse(static_cast<uint32_t>(i));
+        float phi = 2.0f * PI * xi1;
+        float cos_theta = std::sqrt((1.0f - xi2) / (1.0f + (alpha2 - 1.0f) * xi2));
+        float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+        Vec3 half{sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+        // Reflect the view direction (+Z) about the half vector
+        Vec3 light{2.0f * cos_theta * half.x, 2.0f * cos_theta * half.y, 2.0f * cos_theta * half.z - 1.0f};
+        if (light.z <= 0.0f) {
+            continue;
+        }
+        // pdf of the light direction is D * NdotH / (4 VdotH) = D / 4 here
+        float denominator = cos_theta * cos_theta * (alpha2 - 1.0f) + 1.0f;
+        float distribution = alpha2 / (PI * denominator * denominator);
+        float sample_angle = 1.0f / (sample_count * distribution * 0.25f + 1e-4f);
+        float lod = 0.5f * std::log2(sample_angle / texel_angle) + 1.0f;
+        samples.push_back({light, light.z, lod});
+    }
+    return samples;
+}
+
+} // namespace
+
+int EnvironmentLighting::level_size(int level) const {
+    return std::max(face_size >> level, 1);
+}
+
+size_t EnvironmentLighting::level_offset(int level) const {
+    return float_count(face_size, level);
+}
+
+size_t EnvironmentLighting::float_count(int face_size, int level_count) {
+    size_t count = 0;
+    for (int level = 0; level < level_count; ++level) {
+        size_t size = static_cast<size_t>(std::max(face_size >> level, 1));
+        count += FACES * size * size * CHANNELS;
+    }
+    return count;
+}
+
+EnvironmentLighting EnvironmentBaker::bake(const float* rgb, int width, int height, int face_size, int level_count,
+                                           int sample_count) {
+    EnvironmentLighting lighting;
+    if (rgb == nullptr || width <= 0 || height <= 0 || face_size <= 0 || level_count <= 0 || sample_count <= 0) {
+        return lighting;
+    }
+
+    // An equirectangular image is four face widths around, so beyond four
+    // texels per cube texel the extra detail would only alias
+    Image image{width, height, std::vector<float>(rgb, rgb + static_cast<size_t>(width) * height * CHANNELS)};
+    while (image.width >= 8 * face_size && image.height > 1) {
+        image = halve(image);
+    }
+
+    CubeLevel base;
+    base.size = face_size;
+    base.pixels.resize(static_cast<size_t>(FACES) * face_size * face_size * CHANNELS);
+    ThreadPool::shared().parallel_for(static_cast<size_t>(FACES) * face_size, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            int face = static_cast<int>(row) / face_size;
+            int y = static_cast<int>(row) % face_size;
+            for (int x = 0; x < face_size; ++x) {
+                Vec3 d = face_direction(face, texel_center(x, face_size), texel_center(y, face_size));
+                sample_equirect(image, d, base.texel(face, x, y));
+            }
+        }
+    }, BATCH_ROWS);
+    image = {};
+    std::vector<CubeLevel> chain = build_cube_chain(std::move(base));
+
+    const CubeLevel* irradiance_source = &chain.back();
+    for (const CubeLevel& level : chain) {
+        if (level.size <= IRRADIANCE_SOURCE_SIZE) {
+            irradiance_source = &level;
+            break;
+        }
+    }
+    lighting.irradiance = project_irradiance(*irradiance_source);
+
+    lighting.face_size = face_size;
+    lighting.level_count = level_count;
+    lighting.specular.resize(EnvironmentLighting::float_count(face_size, level_count));
+    std::copy(chain[0].pixels.begin(), chain[0].pixels.end(), lighting.specular.begin());
+    for (int level = 1; level < level_count; ++level) {
+        float roughness = level_count > 1 ? static_cast<float>(level) / (level_count - 1) : 1.0f;
+        std::vector<SpecularSample> samples = specular_samples(roughness, sample_count, face_size);
+        int size = lighting.level_size(level);
+        float* target = lighting.specular.data() + lighting.level_offset(level);
+
+        ThreadPool::shared().parallel_for(static_cast<size_t>(FACES) * size, [&](size_t begin, size_t end) {
+            float color[CHANNELS];
+            for (size_t row = begin; row < end; ++row) {
+                int face = static_cast<int>(row) / size;
+                int y = static_cast<int>(row) % size;
+                for (int x = 0; x < size; ++x) {
+                    Vec3 normal = face_direction(face, texel_center(x, size), texel_center(y, size));
+                    Vec3 up = std::fabs(normal.z) < 0.999f ? Vec3{0.0f, 0.0f, 1.0f} : Vec3{1.0f, 0.0f, 0.0f};
+                    Vec3 tangent = normalize(cross(up, normal));
+                    Vec3 bitangent = cross(normal, tangent);
+
+                    float sum[CHANNELS] = {};
+                    float total_weight = 0.0f;
+                    for (const SpecularSample& sample : samples) {
+                        Vec3 d = tangent * sample.direction.x + bitangent * sample.direction.y +
+                                 normal * sample.direction.z;
+                        sample_cube(chain, d, sample.lod, color);
+                        for (int c = 0; c < CHANNELS; ++c) {
+                            sum[c] += color[c] * sample.weight;
+                        }
+                        total_weight += sample.weight;
+                    }
+                    float* out = target + ((static_cast<size_t>(face) * size + y) * size + x) * CHANNELS;
+                    for (int c = 0; c < CHANNELS; ++c) {
+                        out[c] = total_weight > 0.0f ? sum[c] / total_weight : 0.0f;
+                    }
+                }
+            }
+        }, 1);
+    }
+    return lighting;
+}
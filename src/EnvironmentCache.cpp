@@ -0,0 +1,133 @@
+#include "EnvironmentCache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Levels down to a single texel for a face size
+uint32_t max_level_count(uint32_t face_size) {
+    uint32_t levels = 1;
+    for (; face_size > 1; face_size >>= 1) {
+        ++levels;
+    }
+    return levels;
+}
+
+} // namespace
+
+std::string EnvironmentCache::cache_path_for(const std::string& source_path) {
+    return source_path + ".iblcache";
+}
+
+bool EnvironmentCache::write(const std::string& cache_path, const EnvironmentLighting& lighting, uint64_t source_hash,
+                             int sample_count) {
+    if (lighting.specular.empty()) {
+        std::cerr << "ERROR::ENVIRONMENT_CACHE::EMPTY_LIGHTING: " << cache_path << std::endl;
+        return false;
+    }
+    // Anything the constructor would reject is not worth writing
+    if (lighting.face_size <= 0 || static_cast<uint32_t>(lighting.face_size) > MAX_FACE_SIZE ||
+        lighting.level_count <= 0 ||
+        static_cast<uint32_t>(lighting.level_count) > max_level_count(static_cast<uint32_t>(lighting.face_size))) {
+        std::cerr << "ERROR::ENVIRONMENT_CACHE::INVALID_LIGHTING: " << cache_path << std::endl;
+        return false;
+    }
+
+    EnvironmentCacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.source_hash = source_hash;
+    header.face_size = static_cast<uint32_t>(lighting.face_size);
+    header.level_count = static_cast<uint32_t>(lighting.level_count);
+    header.sample_count = static_cast<uint32_t>(sample_count);
+    std::copy(lighting.irradiance.begin(), lighting.irradiance.end(), header.irradiance);
+    header.specular_offset = align_up(sizeof(EnvironmentCacheHeader), BLOB_ALIGNMENT);
+    header.specular_size = lighting.specular.size() * sizeof(float);
+
+    // Write next to the final name and rename, so a crash never leaves a
+    // half written cache that looks valid
+    std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::ENVIRONMENT_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        static const char zeros[BLOB_ALIGNMENT] = {};
+        out.write(zeros, static_cast<std::streamsize>(header.specular_offset - sizeof(header)));
+        out.write(reinterpret_cast<const char*>(lighting.specular.data()),
+                  static_cast<std::streamsize>(header.specular_size));
+        if (!out) {
+            std::cerr << "ERROR::ENVIRONMENT_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        std::cerr << "ERROR::ENVIRONMENT_CACHE::CANNOT_WRITE: " << cache_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+EnvironmentCache::EnvironmentCache(const std::string& cache_path) {
+    std::error_code error;
+    if (!std::filesystem::exists(cache_path, error)) {
+        return;
+    }
+
+    file = MappedFile(cache_path);
+    if (!file.is_open() || file.size() < sizeof(EnvironmentCacheHeader)) {
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const EnvironmentCacheHeader*>(file.data());
+    bool valid = std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) == 0 && candidate->version == VERSION &&
+                 candidate->face_size > 0 && candidate->face_size <= MAX_FACE_SIZE && candidate->level_count > 0 &&
+                 candidate->level_count <= max_level_count(candidate->face_size) &&
+                 candidate->specular_offset >= sizeof(EnvironmentCacheHeader) &&
+                 candidate->specular_offset % alignof(float) == 0 && candidate->specular_offset <= file.size() &&
+                 candidate->specular_size <= file.size() - candidate->specular_offset;
+    if (valid) {
+        // Every level has to be there
+        size_t floats = EnvironmentLighting::float_count(static_cast<int>(candidate->face_size),
+                                                         static_cast<int>(candidate->level_count));
+        valid = candidate->specular_size == floats * sizeof(float);
+    }
+    if (!valid) {
+        std::cerr << "Warning: ignoring invalid environment cache " << cache_path << std::endl;
+        return;
+    }
+
+    header = candidate;
+}
+
+bool EnvironmentCache::matches(uint64_t source_hash, int face_size, int level_count, int sample_count) const {
+    return is_valid() && header->source_hash == source_hash && header->face_size == static_cast<uint32_t>(face_size) &&
+           header->level_count == static_cast<uint32_t>(level_count) &&
+           header->sample_count == static_cast<uint32_t>(sample_count);
+}
+
+EnvironmentLighting EnvironmentCache::lighting() const {
+    EnvironmentLighting lighting;
+    std::copy(header->irradiance, header->irradiance + 27, lighting.irradiance.begin());
+    lighting.face_size = static_cast<int>(header->face_size);
+    lighting.level_count = static_cast<int>(header->level_count);
+    const auto* specular = reinterpret_cast<const float*>(file.data() + header->specular_offset);
+    lighting.specular.assign(specular, specular + header->specular_size / sizeof(float));
+    return lighting;
+}
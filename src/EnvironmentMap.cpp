@@ -0,0 +1,137 @@
+#include "EnvironmentMap.h"
+#include "EnvironmentCache.h"
+#include "AssetPack.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+EnvironmentMap::EnvironmentMap(const std::string& path) : path(path) {
+    load = ThreadPool::shared().submit([path]() { return load_environment(path); });
+}
+
+EnvironmentMap::LoadedEnvironment EnvironmentMap::load_environment(const std::string& path) {
+    LoadedEnvironment loaded;
+    AssetFile source(path);
+    if (!source.is_open()) {
+        loaded.error = "can't open file";
+        return loaded;
+    }
+
+    uint64_t source_hash = source.content_hash();
+    std::string cache_path = EnvironmentCache::cache_path_for(path);
+    EnvironmentCache cache(cache_path);
+    if (cache.matches(source_hash, EnvironmentBaker::DEFAULT_FACE_SIZE, EnvironmentBaker::DEFAULT_LEVEL_COUNT,
+                      EnvironmentBaker::DEFAULT_SAMPLE_COUNT)) {
+        loaded.lighting = cache.lighting();
+        return loaded;
+    }
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<float, void (*)(void*)> image(
+            stbi_loadf_from_memory(reinterpret_cast<const stbi_uc*>(source.data()), static_cast<int>(source.size()),
+                                   &width, &height, &channels, 3),
+            stbi_image_free);
+    if (!image) {
+        loaded.error = stbi_failure_reason();
+        return loaded;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    loaded.lighting = EnvironmentBaker::bake(image.get(), width, height);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "Baked environment " << path << " in " << static_cast<int>(elapsed.count()) << " ms" << std::endl;
+    EnvironmentCache::write(cache_path, loaded.lighting, source_hash, EnvironmentBaker::DEFAULT_SAMPLE_COUNT);
+    return loaded;
+}
+
+bool EnvironmentMap::update() {
+    if (!load.valid() || load.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return is_ready();
+    }
+
+    LoadedEnvironment loaded = load.get();
+    const EnvironmentLighting& lighting = loaded.lighting;
+    if (!loaded.error.empty() || lighting.specular.empty()) {
+        std::cerr << "ERROR::ENVIRONMENT::LOAD_FAILED: " << path << ": " << loaded.error << std::endl;
+        return false;
+    }
+
+    glGenTextures(1, &specular_map);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specular_map);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < lighting.level_count; ++level) {
+        int size = lighting.level_size(level);
+        size_t face_floats = static_cast<size_t>(size) * size * 3;
+        const float* pixels = lighting.specular.data() + lighting.level_offset(level);
+        for (int face = 0; face < 6; ++face) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT,
+                         pixels + face * face_floats);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, lighting.level_count - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    level_count = lighting.level_count;
+    irradiance = lighting.irradiance;
+    return true;
+}
+
+void EnvironmentMap::bind(const Shader& shader, GLuint unit) const {
+    bind_cubemap(unit);
+    shader.set_int("environment.specular", static_cast<int>(unit));
+    shader.set_float("environment.max_level", static_cast<float>(level_count - 1));
+    shader.set_vec3_array("environment.irradiance", irradiance.data(), 9);
+}
+
+void EnvironmentMap::bind_cubemap(GLuint unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, specular_map);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+EnvironmentMap::~EnvironmentMap() {
+    release();
+}
+
+EnvironmentMap::EnvironmentMap(EnvironmentMap&& other) noexcept
+        : path(std::move(other.path)), load(std::move(other.load)),
+          specular_map(std::exchange(other.specular_map, 0)), level_count(std::exchange(other.level_count, 0)),
+          irradiance(other.irradiance) {
+}
+
+EnvironmentMap& EnvironmentMap::operator=(EnvironmentMap&& other) noexcept {
+    if (this != &other) {
+        release();
+
+        path = std::move(other.path);
+        load = std::move(other.load);
+        specular_map = std::exchange(other.specular_map, 0);
+        level_count = std::exchange(other.level_count, 0);
+        irradiance = other.irradiance;
+    }
+    return *this;
+}
+
+void EnvironmentMap::release() {
+    // The bake reads nothing this object owns, but finish it before the
+    // program can tear down the pool
+    if (load.valid()) {
+        load.wait();
+        load = {};
+    }
+    if (specular_map != 0) {
+        glDeleteTextures(1, &specular_map);
+        specular_map = 0;
+    }
+}
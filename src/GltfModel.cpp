@@ -0,0 +1,812 @@
+#include "GltfModel.h"
+#include "Json.h"
+#include "ShaderVariants.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;  // "JSON"
+constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;   // "BIN\0"
+constexpr size_t GLB_HEADER_SIZE = 12;
+constexpr size_t GLB_CHUNK_HEADER_SIZE = 8;
+
+// Buffer views larger than this are copied by several jobs
+constexpr size_t COPY_CHUNK_BYTES = size_t(4) << 20;
+
+// Largest byteStride the glTF spec allows
+constexpr int64_t MAX_BYTE_STRIDE = 252;
+
+// Attribute locations shared with Mesh and the shaders
+constexpr GLuint POSITION_LOCATION = 0;
+constexpr GLuint NORMAL_LOCATION = 1;
+constexpr GLuint TEX_COORD_LOCATION = 2;
+
+uint32_t read_u32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+int component_count(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+size_t component_size(GLenum type) {
+    switch (type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+// Accessor resolved against its buffer view and checked to stay inside it
+struct AccessorView {
+    size_t buffer_view = 0;
+    size_t offset = 0;
+    size_t count = 0;
+    GLenum component_type = 0;
+    int components = 0;
+    bool normalized = false;
+    // 0 when tightly packed
+    GLsizei stride = 0;
+};
+
+bool resolve_accessor(const JsonValue& document, int64_t index, AccessorView& view) {
+    const JsonValue& accessor = document["accessors"][static_cast<size_t>(index)];
+    if (index < 0 || !accessor.is_object() || accessor.contains("sparse")) {
+        return false;
+    }
+
+    int64_t buffer_view = accessor["bufferView"].as_int(-1);
+    const JsonValue& view_json = document["bufferViews"][static_cast<size_t>(buffer_view)];
+    if (buffer_view < 0 || !view_json.is_object()) {
+        return false;
+    }
+
+    // Present but out of range reads as -1, not as the default
+    int64_t offset = accessor["byteOffset"].as_int(accessor.contains("byteOffset") ? -1 : 0);
+    int64_t count = accessor["count"].as_int(0);
+    int64_t stride = view_json["byteStride"].as_int(view_json.contains("byteStride") ? -1 : 0);
+    int64_t view_length = view_json["byteLength"].as_int(0);
+    if (offset < 0 || count <= 0 || stride < 0 || stride > MAX_BYTE_STRIDE || view_length < 0) {
+        return false;
+    }
+
+    view.buffer_view = static_cast<size_t>(buffer_view);
+    view.offset = static_cast<size_t>(offset);
+    view.count = static_cast<size_t>(count);
+    view.component_type = static_cast<GLenum>(accessor["componentType"].as_int(0));
+    view.components = component_count(accessor["type"].as_string());
+    view.normalized = accessor["normalized"].as_bool(false);
+    view.stride = static_cast<GLsizei>(stride);
+
+    // The last element has to end inside the view; divide rather than
+    // multiply so huge counts can't wrap
+    size_t element_size = component_size(view.component_type) * view.components;
+    size_t step = view.stride > 0 ? static_cast<size_t>(view.stride) : element_size;
+    size_t length = static_cast<size_t>(view_length);
+    return element_size > 0 && view.offset <= length && element_size <= length - view.offset &&
+           view.count - 1 <= (length - view.offset - element_size) / step;
+}
+
+// Bytes of a buffer view, empty when it isn't inside its buffer
+std::string_view view_bytes(const JsonValue& document, const std::vector<std::string_view>& buffer_data,
+                            size_t view_index) {
+    const JsonValue& view = document["bufferViews"][view_index];
+    int64_t buffer = view["buffer"].as_int(-1);
+    int64_t offset = view["byteOffset"].as_int(view.contains("byteOffset") ? -1 : 0);
+    int64_t length = view["byteLength"].as_int(0);
+    if (buffer < 0 || static_cast<size_t>(buffer) >= buffer_data.size() || offset < 0 || length <= 0) {
+        return {};
+    }
+    std::string_view data = buffer_data[static_cast<size_t>(buffer)];
+    if (static_cast<uint64_t>(offset) > data.size() || static_cast<uint64_t>(length) > data.size() - offset) {
+        return {};
+    }
+    return data.substr(static_cast<size_t>(offset), static_cast<size_t>(length));
+}
+
+// Whether every index of a tightly packed, resolved index accessor names
+// one of vertex_count vertices
+bool indices_fit(std::string_view view, const AccessorView& indices, size_t vertex_count) {
+    size_t size = component_size(indices.component_type);
+    // The view is empty when it lies outside its buffer
+    if (indices.offset > view.size() || indices.count > (view.size() - indices.offset) / size) {
+        return false;
+    }
+    const char* data = view.data() + indices.offset;
+    for (size_t i = 0; i < indices.count; ++i) {
+        // glTF is little endian, as is every host this runs on
+        uint32_t index = 0;
+        std::memcpy(&index, data + i * size, size);
+        if (index >= vertex_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+glm::mat4 node_matrix(const JsonValue& node) {
+    glm::mat4 result(1.0f);
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.size() == 16) {
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                result[column][row] = matrix[column * 4 + row].as_float();
+            }
+        }
+        return result;
+    }
+
+    // T * R * S, rotation as a unit quaternion (x, y, z, w)
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    float x = r[0].as_float(0.0f), y = r[1].as_float(0.0f), z = r[2].as_float(0.0f), w = r[3].as_float(1.0f);
+    glm::vec3 scale(s[0].as_float(1.0f), s[1].as_float(1.0f), s[2].as_float(1.0f));
+
+    result[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * scale.x;
+    result[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * scale.y;
+    result[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * scale.z;
+    result[3] = glm::vec4(t[0].as_float(0.0f), t[1].as_float(0.0f), t[2].as_float(0.0f), 1.0f);
+    return result;
+}
+
+} // namespace
+
+GltfModel::GltfModel(const std::string& path) : path(path) {
+    auto start_time = std::chrono::steady_clock::now();
+    valid = load();
+    if (!valid) {
+        release();
+        return;
+    }
+
+    size_t primitive_count = 0;
+    for (const GltfMesh& mesh : meshes) {
+        primitive_count += mesh.primitives.size();
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "Loaded " << path << ": " << meshes.size() << " meshes, " << primitive_count << " primitives, "
+              << materials.size() << " materials, streaming " << pending_buffers.size() << " buffers ("
+              << elapsed.count() << " ms)" << std::endl;
+}
+
+bool GltfModel::load() {
+    files.emplace_back(path);
+    const AssetFile& file = files.front();
+    if (!file.is_open()) {
+        std::cerr << "ERROR::GLTF::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+
+    const char* data = file.data();
+    if (file.size() < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE || read_u32(data) != GLB_MAGIC ||
+        read_u32(data + 4) != 2 || read_u32(data + 8) > file.size()) {
+        std::cerr << "ERROR::GLTF::NOT_A_GLB_2_FILE: " << path << std::endl;
+        return false;
+    }
+
+    // Chunks: JSON first, then an optional BIN
+    size_t total = read_u32(data + 8);
+    std::string_view json_chunk;
+    std::string_view bin_chunk;
+    for (size_t offset = GLB_HEADER_SIZE; offset + GLB_CHUNK_HEADER_SIZE <= total;) {
+        size_t length = read_u32(data + offset);
+        uint32_t type = read_u32(data + offset + 4);
+        offset += GLB_CHUNK_HEADER_SIZE;
+        if (offset + length > total) {
+            std::cerr << "ERROR::GLTF::TRUNCATED_CHUNK: " << path << std::endl;
+            return false;
+        }
+        if (type == GLB_CHUNK_JSON && json_chunk.empty()) {
+            json_chunk = std::string_view(data + offset, length);
+        } else if (type == GLB_CHUNK_BIN && bin_chunk.empty()) {
+            bin_chunk = std::string_view(data + offset, length);
+        }
+        offset += (length + 3) & ~size_t(3);
+    }
+
+    std::string error;
+    JsonValue document = JsonValue::parse(json_chunk, &error);
+    if (!document.is_object()) {
+        std::cerr << "ERROR::GLTF::INVALID_JSON: " << path << ": " << error << std::endl;
+        return false;
+    }
+
+    // Buffer 0 without a uri is the BIN chunk, others are files next to the model
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    const JsonValue& buffer_list = document["buffers"];
+    std::vector<std::string_view> buffer_data(buffer_list.size());
+    for (size_t i = 0; i < buffer_list.size(); ++i) {
+        const std::string& uri = buffer_list[i]["uri"].as_string();
+        if (uri.empty()) {
+            buffer_data[i] = i == 0 ? bin_chunk : std::string_view();
+        } else if (uri.compare(0, 5, "data:") == 0) {
+            std::cerr << "Warning: embedded data URI buffers are not supported: " << path << std::endl;
+        } else {
+            files.emplace_back((directory / uri).string());
+            if (files.back().is_open()) {
+                buffer_data[i] = files.back().view();
+            } else {
+                std::cerr << "ERROR::GLTF::BUFFER_NOT_FOUND: " << (directory / uri).string() << std::endl;
+            }
+        }
+    }
+
+    load_materials(document);
+    load_textures(document, buffer_data);
+    load_meshes(document, buffer_data);
+    load_instances(document);
+    return true;
+}
+
+void GltfModel::load_materials(const JsonValue& document) {
+    const JsonValue& list = document["materials"];
+    materials.resize(list.size());
+    for (size_t i = 0; i < list.size(); ++i) {
+        const JsonValue& source = list[i];
+        const JsonValue& pbr = source["pbrMetallicRoughness"];
+        GltfMaterial& material = materials[i];
+
+        material.name = source["name"].as_string();
+        const JsonValue& factor = pbr["baseColorFactor"];
+        if (factor.size() == 4) {
+            material.base_color = glm::vec4(factor[0].as_float(), factor[1].as_float(), factor[2].as_float(),
+                                            factor[3].as_float());
+        }
+        material.base_color_texture = static_cast<int>(pbr["baseColorTexture"]["index"].as_int(-1));
+        material.metallic = pbr["metallicFactor"].as_float(1.0f);
+        material.roughness = pbr["roughnessFactor"].as_float(1.0f);
+    }
+}
+
+void GltfModel::load_textures(const JsonValue& document, const std::vector<std::string_view>& buffer_data) {
+    const JsonValue& texture_list = document["textures"];
+    const JsonValue& image_list = document["images"];
+    const JsonValue& sampler_list = document["samplers"];
+    ThreadPool& pool = ThreadPool::shared();
+
+    // Find every used image's encoded bytes; external files are mapped here
+    // so their headers can be read before anything decodes
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::vector<std::string_view> image_data(image_list.size());
+    std::vector<bool> used(image_list.size(), false);
+    for (size_t i = 0; i < texture_list.size(); ++i) {
+        int64_t source = texture_list[i]["source"].as_int(-1);
+        if (source >= 0 && static_cast<size_t>(source) < used.size()) {
+            used[source] = true;
+        }
+    }
+    for (size_t i = 0; i < image_list.size(); ++i) {
+        if (!used[i]) {
+            continue;
+        }
+        const JsonValue& image = image_list[i];
+        int64_t view_index = image["bufferView"].as_int(-1);
+        const std::string& uri = image["uri"].as_string();
+        if (view_index >= 0) {
+            image_data[i] = view_bytes(document, buffer_data, static_cast<size_t>(view_index));
+            if (image_data[i].empty()) {
+                std::cerr << "ERROR::GLTF::IMAGE_OUT_OF_RANGE: " << path << std::endl;
+                continue;
+            }
+        } else if (!uri.empty() && uri.compare(0, 5, "data:") != 0) {
+            files.emplace_back((directory / uri).string());
+            if (files.back().is_open()) {
+                image_data[i] = files.back().view();
+            } else {
+                std::cerr << "ERROR::GLTF::IMAGE_NOT_FOUND: " << (directory / uri).string() << std::endl;
+            }
+        } else {
+            std::cerr << "Warning: unsupported glTF image source in " << path << std::endl;
+        }
+    }
+
+    // Hand every texture a layer of the array matching its image size and
+    // sampler; textures sharing both share the layer
+    GLint max_layers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    TextureArrayPacker packer(max_layers);
+    texture_layers.assign(texture_list.size(), TextureLayer{});
+    texture_ready.assign(texture_list.size(), false);
+    std::vector<PendingImage> images(image_list.size());
+    std::vector<std::vector<std::pair<TextureArrayFormat, TextureLayer>>> image_layers(image_list.size());
+    for (size_t i = 0; i < texture_list.size(); ++i) {
+        int64_t source = texture_list[i]["source"].as_int(-1);
+        if (source < 0 || static_cast<size_t>(source) >= image_data.size() || image_data[source].empty()) {
+            continue;
+        }
+        PendingImage& image = images[source];
+        if (image.width == 0) {
+            int channels = 0;
+            const std::string_view& data = image_data[source];
+            if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(data.data()), static_cast<int>(data.size()),
+                                       &image.width, &image.height, &channels)) {
+                std::cerr << "ERROR::GLTF::IMAGE_DECODE_FAILED: " << path << ": " << stbi_failure_reason()
+                          << std::endl;
+                image_data[source] = {};
+                continue;
+            }
+        }
+
+        const JsonValue& sampler = sampler_list[static_cast<size_t>(texture_list[i]["sampler"].as_int(-1))];
+        TextureArrayFormat format;
+        format.width = image.width;
+        format.height = image.height;
+        format.wrap_s = static_cast<GLenum>(sampler["wrapS"].as_int(GL_REPEAT));
+        format.wrap_t = static_cast<GLenum>(sampler["wrapT"].as_int(GL_REPEAT));
+        format.min_filter = static_cast<GLenum>(sampler["minFilter"].as_int(GL_LINEAR_MIPMAP_LINEAR));
+        format.mag_filter = static_cast<GLenum>(sampler["magFilter"].as_int(GL_LINEAR));
+
+        auto& layers = image_layers[source];
+        auto existing = std::find_if(layers.begin(), layers.end(),
+                                     [&format](const auto& entry) { return entry.first == format; });
+        if (existing == layers.end()) {
+            layers.emplace_back(format, packer.add(format));
+            existing = layers.end() - 1;
+        }
+        texture_layers[i] = existing->second;
+        image.textures.push_back(i);
+    }
+    texture_arrays = packer.create_arrays();
+
+    for (GltfMaterial& material : materials) {
+        int texture = material.base_color_texture;
+        if (texture >= 0 && static_cast<size_t>(texture) < texture_layers.size()) {
+            material.texture_array = texture_layers[texture].array;
+            material.texture_layer = texture_layers[texture].layer;
+        }
+    }
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (images[i].textures.empty()) {
+            continue;
+        }
+        const char* bytes = image_data[i].data();
+        size_t length = image_data[i].size();
+        images[i].decode = pool.submit([bytes, length]() { return decode_image(bytes, length); });
+        pending_images.push_back(std::move(images[i]));
+    }
+}
+
+GltfModel::DecodedImage GltfModel::decode_image(const char* data, size_t size) {
+    DecodedImage decoded;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(data), static_cast<int>(size), &width,
+                                            &height, &channels, 4);
+    if (pixels == nullptr) {
+        decoded.error = stbi_failure_reason();
+        return decoded;
+    }
+    // glTF images hold colors, the viewer only samples base color textures
+    decoded.mips = MipGenerator::generate(pixels, width, height, MipFilter::Kaiser, true);
+    stbi_image_free(pixels);
+    return decoded;
+}
+
+GLuint GltfModel::upload_buffer_view(const JsonValue& document, const std::vector<std::string_view>& buffer_data,
+                                     size_t view_index) {
+    if (buffers[view_index] != 0) {
+        return buffers[view_index];
+    }
+
+    std::string_view bytes = view_bytes(document, buffer_data, view_index);
+    if (bytes.empty()) {
+        std::cerr << "ERROR::GLTF::BUFFER_VIEW_OUT_OF_RANGE: " << path << " (view " << view_index << ")"
+                  << std::endl;
+        return 0;
+    }
+    const char* source = bytes.data();
+    size_t length = bytes.size();
+
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    buffers[view_index] = id;
+
+    // Map the storage and let the pool copy into it straight from the file
+    // mapping; the copy write target leaves VAO and element bindings alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(length), nullptr, GL_STATIC_DRAW);
+    auto* target = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(length),
+                                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (target == nullptr) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(length), source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return id;
+    }
+
+    PendingBuffer pending;
+    pending.buffer = id;
+    pending.source = source;
+    pending.size = length;
+    ThreadPool& pool = ThreadPool::shared();
+    for (size_t chunk = 0; chunk < length; chunk += COPY_CHUNK_BYTES) {
+        size_t bytes = std::min(COPY_CHUNK_BYTES, length - chunk);
+        pending.copies.push_back(pool.submit([target, source, chunk, bytes]() {
+            std::memcpy(target + chunk, source + chunk, bytes);
+        }));
+    }
+    pending_buffers.push_back(std::move(pending));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return id;
+}
+
+void GltfModel::load_meshes(const JsonValue& document, const std::vector<std::string_view>& buffer_data) {
+    buffers.assign(document["bufferViews"].size(), 0);
+
+    auto bind_attribute = [&](GLuint location, const AccessorView& accessor) {
+        GLuint buffer = upload_buffer_view(document, buffer_data, accessor.buffer_view);
+        if (buffer == 0) {
+            return false;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(location, accessor.components, accessor.component_type,
+                              accessor.normalized ? GL_TRUE : GL_FALSE, accessor.stride, (void*)accessor.offset);
+        glEnableVertexAttribArray(location);
+        return true;
+    };
+
+    const JsonValue& mesh_list = document["meshes"];
+    meshes.resize(mesh_list.size());
+    for (size_t m = 0; m < mesh_list.size(); ++m) {
+        GltfMesh& mesh = meshes[m];
+        mesh.name = mesh_list[m]["name"].as_string();
+
+        const JsonValue& primitive_list = mesh_list[m]["primitives"];
+        for (size_t p = 0; p < primitive_list.size(); ++p) {
+            const JsonValue& source = primitive_list[p];
+            const JsonValue& attributes = source["attributes"];
+
+            AccessorView position;
+            if (!resolve_accessor(document, attributes["POSITION"].as_int(-1), position) ||
+                position.component_type != GL_FLOAT || position.components != 3) {
+                std::cerr << "Warning: skipping glTF primitive without usable positions in " << path << std::endl;
+                continue;
+            }
+
+            GltfPrimitive primitive;
+            // glTF primitive modes are the GL enums, POINTS through TRIANGLE_FAN
+            int64_t mode = source["mode"].as_int(GL_TRIANGLES);
+            primitive.mode = (mode >= GL_POINTS && mode <= GL_TRIANGLE_FAN) ? static_cast<GLenum>(mode) : GL_TRIANGLES;
+            primitive.material = static_cast<int>(source["material"].as_int(-1));
+            primitive.count = static_cast<GLsizei>(position.count);
+            const JsonValue& accessor = document["accessors"][static_cast<size_t>(attributes["POSITION"].as_int())];
+            for (int i = 0; i < 3; ++i) {
+                primitive.bounds.min[i] = accessor["min"][i].as_float();
+                primitive.bounds.max[i] = accessor["max"][i].as_float();
+            }
+
+            AccessorView indices;
+            bool indexed = source.contains("indices");
+            // Element arrays are read tightly packed whatever the view's stride
+            if (indexed && (!resolve_accessor(document, source["indices"].as_int(-1), indices) ||
+                            indices.components != 1 || indices.component_type == GL_FLOAT ||
+                            indices.component_type == GL_BYTE || indices.component_type == GL_SHORT ||
+                            (indices.stride != 0 &&
+                             static_cast<size_t>(indices.stride) != component_size(indices.component_type)) ||
+                            !indices_fit(view_bytes(document, buffer_data, indices.buffer_view), indices,
+                                         position.count))) {
+                std::cerr << "Warning: skipping glTF primitive with invalid indices in " << path << std::endl;
+                continue;
+            }
+
+            glGenVertexArrays(1, &primitive.vao);
+            glBindVertexArray(primitive.vao);
+
+            bool ok = bind_attribute(POSITION_LOCATION, position);
+            AccessorView normal;
+            if (ok && resolve_accessor(document, attributes["NORMAL"].as_int(-1), normal) &&
+                normal.count >= position.count) {
+                primitive.has_normals = bind_attribute(NORMAL_LOCATION, normal);
+            }
+            AccessorView tex_coords;
+            if (ok && resolve_accessor(document, attributes["TEXCOORD_0"].as_int(-1), tex_coords) &&
+                tex_coords.count >= position.count) {
+                primitive.has_tex_coords = bind_attribute(TEX_COORD_LOCATION, tex_coords);
+            }
+            if (ok && indexed) {
+                GLuint buffer = upload_buffer_view(document, buffer_data, indices.buffer_view);
+                ok = buffer != 0;
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+                primitive.index_type = indices.component_type;
+                primitive.index_offset = indices.offset;
+                primitive.count = static_cast<GLsizei>(indices.count);
+            }
+
+            glBindVertexArray(0);
+            if (!ok) {
+                glDeleteVertexArrays(1, &primitive.vao);
+                continue;
+            }
+            mesh.primitives.push_back(primitive);
+        }
+    }
+}
+
+void GltfModel::load_instances(const JsonValue& document) {
+    const JsonValue& node_list = document["nodes"];
+    if (node_list.size() == 0) {
+        // No scene graph, show every mesh where it is
+        for (size_t m = 0; m < meshes.size(); ++m) {
+            instances.push_back({m, glm::mat4(1.0f)});
+        }
+        return;
+    }
+
+    // Roots of the default scene, or every node nothing else parents
+    std::vector<size_t> roots;
+    const JsonValue& scenes = document["scenes"];
+    if (scenes.size() > 0) {
+        const JsonValue& scene = scenes[static_cast<size_t>(document["scene"].as_int(0))];
+        for (size_t i = 0; i < scene["nodes"].size(); ++i) {
+            roots.push_back(static_cast<size_t>(scene["nodes"][i].as_int()));
+        }
+    } else {
+        std::vector<bool> is_child(node_list.size(), false);
+        for (size_t i = 0; i < node_list.size(); ++i) {
+            const JsonValue& children = node_list[i]["children"];
+            for (size_t c = 0; c < children.size(); ++c) {
+                size_t child = static_cast<size_t>(children[c].as_int());
+                if (child < is_child.size()) {
+                    is_child[child] = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < node_list.size(); ++i) {
+            if (!is_child[i]) {
+                roots.push_back(i);
+            }
+        }
+    }
+
+    // Depth first, visiting each node once so malformed cycles terminate
+    std::vector<bool> visited(node_list.size(), false);
+    std::vector<std::pair<size_t, glm::mat4>> stack;
+    for (size_t root : roots) {
+        stack.emplace_back(root, glm::mat4(1.0f));
+    }
+    while (!stack.empty()) {
+        auto [index, parent] = stack.back();
+        stack.pop_back();
+        if (index >= node_list.size() || visited[index]) {
+            continue;
+        }
+        visited[index] = true;
+
+        const JsonValue& node = node_list[index];
+        glm::mat4 world = parent * node_matrix(node);
+        int64_t mesh = node["mesh"].as_int(-1);
+        if (mesh >= 0 && static_cast<size_t>(mesh) < meshes.size()) {
+            instances.push_back({static_cast<size_t>(mesh), world});
+        }
+
+        const JsonValue& children = node["children"];
+        for (size_t c = 0; c < children.size(); ++c) {
+            stack.emplace_back(static_cast<size_t>(children[c].as_int(-1)), world);
+        }
+    }
+}
+
+bool GltfModel::update() {
+    for (auto it = pending_buffers.begin(); it != pending_buffers.end();) {
+        bool copied = std::all_of(it->copies.begin(), it->copies.end(), [](const std::future<void>& copy) {
+            return copy.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        if (!copied) {
+            ++it;
+            continue;
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, it->buffer);
+        if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE) {
+            // The driver dropped the mapped contents, upload the slow way
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(it->size), it->source);
+        }
+        it = pending_buffers.erase(it);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    for (auto it = pending_images.begin(); it != pending_images.end();) {
+        if (it->decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        DecodedImage image = it->decode.get();
+        if (image.mips.levels.empty()) {
+            std::cerr << "ERROR::GLTF::IMAGE_DECODE_FAILED: " << path << ": " << image.error << std::endl;
+        } else if (image.mips.levels[0].width != it->width || image.mips.levels[0].height != it->height) {
+            std::cerr << "ERROR::GLTF::IMAGE_SIZE_MISMATCH: " << path << std::endl;
+        } else {
+            for (size_t t = 0; t < it->textures.size(); ++t) {
+                size_t texture = it->textures[t];
+                const TextureLayer& layer = texture_layers[texture];
+                texture_ready[texture] = true;
+                bool uploaded = std::any_of(it->textures.begin(), it->textures.begin() + t, [&](size_t other) {
+                    return texture_layers[other].array == layer.array && texture_layers[other].layer == layer.layer;
+                });
+                if (!uploaded) {
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_arrays[layer.array]);
+                    TextureArrayPacker::upload(layer.layer, image.mips);
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+        it = pending_images.erase(it);
+    }
+
+    // Nothing reads the source files any more
+    if (pending_buffers.empty() && pending_images.empty()) {
+        files.clear();
+    }
+    return is_ready();
+}
+
+void GltfModel::draw(ShaderVariants& shaders, uint32_t keywords, const glm::mat4& model) const {
+    if (!is_ready()) {
+        return;
+    }
+
+    // Consecutive primitives usually share an array, only rebind on change
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_UNIT);
+    int bound_array = -1;
+    uint32_t texture_array_keyword = shaders.keyword("USE_TEXTURE_ARRAY");
+    const Shader* bound_shader = nullptr;
+
+    for (const GltfInstance& instance : instances) {
+        glm::mat4 instance_model = model * instance.transform;
+        bool model_set = false;
+
+        for (const GltfPrimitive& primitive : meshes[instance.mesh].primitives) {
+            const GltfMaterial* material =
+                    (primitive.material >= 0 && static_cast<size_t>(primitive.material) < materials.size())
+                    ? &materials[primitive.material] : nullptr;
+            glm::vec3 color = material ? glm::vec3(material->base_color) : glm::vec3(1.0f);
+            bool textured = material && material->texture_array >= 0 && texture_ready[material->base_color_texture];
+
+            // Textured and untextured materials are different variants; the
+            // untextured one stands in while the other is still compiling
+            const Shader* ready = shaders.find_ready(keywords | (textured ? texture_array_keyword : 0));
+            if (ready == nullptr) {
+                textured = false;
+                ready = &shaders.variant(keywords);
+            }
+            const Shader& shader = *ready;
+            if (&shader != bound_shader) {
+                bound_shader = &shader;
+                model_set = false;
+                shader.use();
+                // Float positions and normals, nothing to decode
+                shader.set_vec3("positionOffset", glm::vec3(0.0f));
+                shader.set_vec3("positionScale", glm::vec3(1.0f));
+                shader.set_bool("octNormals", false);
+            }
+            if (!model_set) {
+                model_set = true;
+                shader.set_mat4("model", instance_model);
+            }
+
+            shader.set_vec3("objectColor", color);
+            shader.set_vec3("material.diffuse", color);
+            if (textured) {
+                if (material->texture_array != bound_array) {
+                    bound_array = material->texture_array;
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_arrays[bound_array]);
+                }
+                shader.set_int("material.layer", material->texture_layer);
+            }
+
+            // Constant values for attributes the primitive does not have
+            if (!primitive.has_normals) {
+                glVertexAttrib3f(NORMAL_LOCATION, 0.0f, 0.0f, 1.0f);
+            }
+            if (!primitive.has_tex_coords) {
+                glVertexAttrib2f(TEX_COORD_LOCATION, 0.0f, 0.0f);
+            }
+
+            glBindVertexArray(primitive.vao);
+            if (primitive.index_type != 0) {
+                glDrawElements(primitive.mode, primitive.count, primitive.index_type, (void*)primitive.index_offset);
+            } else {
+                glDrawArrays(primitive.mode, 0, primitive.count);
+            }
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+GltfModel::~GltfModel() {
+    release();
+}
+
+GltfModel::GltfModel(GltfModel&& other) noexcept
+        : meshes(std::move(other.meshes)), materials(std::move(other.materials)),
+          instances(std::move(other.instances)), valid(std::exchange(other.valid, false)),
+          path(std::move(other.path)), files(std::move(other.files)), buffers(std::exchange(other.buffers, {})),
+          texture_arrays(std::exchange(other.texture_arrays, {})), texture_layers(std::exchange(other.texture_layers, {})),
+          texture_ready(std::exchange(other.texture_ready, {})),
+          pending_buffers(std::exchange(other.pending_buffers, {})),
+          pending_images(std::exchange(other.pending_images, {})) {
+}
+
+GltfModel& GltfModel::operator=(GltfModel&& other) noexcept {
+    if (this != &other) {
+        release();
+
+        meshes = std::exchange(other.meshes, {});
+        materials = std::move(other.materials);
+        instances = std::move(other.instances);
+        valid = std::exchange(other.valid, false);
+        path = std::move(other.path);
+        files = std::move(other.files);
+        buffers = std::exchange(other.buffers, {});
+        texture_arrays = std::exchange(other.texture_arrays, {});
+        texture_layers = std::exchange(other.texture_layers, {});
+        texture_ready = std::exchange(other.texture_ready, {});
+        pending_buffers = std::exchange(other.pending_buffers, {});
+        pending_images = std::exchange(other.pending_images, {});
+    }
+    return *this;
+}
+
+void GltfModel::release() {
+    // Copies write into mapped GL memory and read the files, finish them first
+    for (PendingBuffer& pending : pending_buffers) {
+        for (std::future<void>& copy : pending.copies) {
+            copy.wait();
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pending.buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    pending_buffers.clear();
+    for (PendingImage& pending : pending_images) {
+        pending.decode.wait();
+    }
+    pending_images.clear();
+    files.clear();
+
+    for (GltfMesh& mesh : meshes) {
+        for (GltfPrimitive& primitive : mesh.primitives) {
+            glDeleteVertexArrays(1, &primitive.vao);
+        }
+    }
+    meshes.clear();
+
+    buffers.erase(std::remove(buffers.begin(), buffers.end(), 0u), buffers.end());
+    if (!buffers.empty()) {
+        glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+        buffers.clear();
+    }
+    if (!texture_arrays.empty()) {
+        glDeleteTextures(static_cast<GLsizei>(texture_arrays.size()), texture_arrays.data());
+        texture_arrays.clear();
+    }
+    texture_layers.clear();
+    texture_ready.clear();
+}
@@ -0,0 +1,346 @@
+#include "Json.h"
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+namespace {
+
+// Nesting deeper than this is treated as malformed rather than risking the stack
+constexpr int MAX_DEPTH = 256;
+
+const JsonValue& null_value() {
+    static const JsonValue value;
+    return value;
+}
+
+const std::string& empty_string() {
+    static const std::string value;
+    return value;
+}
+
+void append_utf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+} // namespace
+
+// Recursive descent over the whole text
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : p(text.data()), end(text.data() + text.size()) {}
+
+    bool parse_document(JsonValue& value) {
+        skip_whitespace();
+        if (!parse_value(value, 0)) {
+            return false;
+        }
+        skip_whitespace();
+        return p == end || fail("trailing characters");
+    }
+
+    std::string error;
+    const char* p;
+    const char* end;
+
+private:
+    bool fail(const char* message) {
+        if (error.empty()) {
+            error = message;
+        }
+        return false;
+    }
+
+    void skip_whitespace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            ++p;
+        }
+    }
+
+    bool consume(const char* literal) {
+        size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end - p) < length || std::memcmp(p, literal, length) != 0) {
+            return false;
+        }
+        p += length;
+        return true;
+    }
+
+    bool parse_value(JsonValue& value, int depth) {
+        if (depth > MAX_DEPTH) {
+            return fail("nesting too deep");
+        }
+        if (p == end) {
+            return fail("unexpected end of input");
+        }
+
+        switch (*p) {
+        case '{':
+            return parse_object(value, depth);
+        case '[':
+            return parse_array(value, depth);
+        case '"':
+            value.kind = JsonValue::Type::String;
+            return parse_string(value.string);
+        case 't':
+            value.kind = JsonValue::Type::Bool;
+            value.boolean = true;
+            return consume("true") || fail("invalid literal");
+        case 'f':
+            value.kind = JsonValue::Type::Bool;
+            value.boolean = false;
+            return consume("false") || fail("invalid literal");
+        case 'n':
+            value.kind = JsonValue::Type::Null;
+            return consume("null") || fail("invalid literal");
+        default:
+            return parse_number(value);
+        }
+    }
+
+    bool parse_object(JsonValue& value, int depth) {
+        value.kind = JsonValue::Type::Object;
+        ++p;
+        skip_whitespace();
+        if (p < end && *p == '}') {
+            ++p;
+            return true;
+        }
+
+        while (true) {
+            skip_whitespace();
+            if (p == end || *p != '"') {
+                return fail("expected object key");
+            }
+            std::string key;
+            if (!parse_string(key)) {
+                return false;
+            }
+            skip_whitespace();
+            if (p == end || *p != ':') {
+                return fail("expected ':'");
+            }
+            ++p;
+            skip_whitespace();
+
+            value.object_keys.push_back(std::move(key));
+            value.elements.emplace_back();
+            if (!parse_value(value.elements.back(), depth + 1)) {
+                return false;
+            }
+
+            skip_whitespace();
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == '}') {
+                ++p;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    bool parse_array(JsonValue& value, int depth) {
+        value.kind = JsonValue::Type::Array;
+        ++p;
+        skip_whitespace();
+        if (p < end && *p == ']') {
+            ++p;
+            return true;
+        }
+
+        while (true) {
+            skip_whitespace();
+            value.elements.emplace_back();
+            if (!parse_value(value.elements.back(), depth + 1)) {
+                return false;
+            }
+
+            skip_whitespace();
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == ']') {
+                ++p;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool parse_hex4(uint32_t& code) {
+        if (end - p < 4) {
+            return fail("truncated escape");
+        }
+        auto [next, result] = std::from_chars(p, p + 4, code, 16);
+        if (result != std::errc() || next != p + 4) {
+            return fail("invalid escape");
+        }
+        p += 4;
+        return true;
+    }
+
+    bool parse_string(std::string& out) {
+        ++p;
+        while (true) {
+            // Copy plain runs in one go
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) {
+                ++p;
+            }
+            out.append(run, p);
+
+            if (p == end) {
+                return fail("unterminated string");
+            }
+            if (*p == '"') {
+                ++p;
+                return true;
+            }
+            if (*p != '\\') {
+                return fail("control character in string");
+            }
+
+            ++p;
+            if (p == end) {
+                return fail("unterminated string");
+            }
+            char escape = *p++;
+            switch (escape) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!parse_hex4(code)) {
+                    return false;
+                }
+                // Surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    p += 2;
+                    uint32_t low = 0;
+                    if (!parse_hex4(low)) {
+                        return false;
+                    }
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else {
+                        append_utf8(out, 0xFFFD);
+                        code = low;
+                    }
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default:
+                return fail("invalid escape");
+            }
+        }
+    }
+
+    bool parse_number(JsonValue& value) {
+        const char* start = p;
+        if (p < end && *p == '-') {
+            ++p;
+        }
+        while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' ||
+                           *p == '-')) {
+            ++p;
+        }
+        if (p == start) {
+            return fail("unexpected character");
+        }
+
+        value.kind = JsonValue::Type::Number;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        auto [next, result] = std::from_chars(start, p, value.number);
+        if (result != std::errc() || next != p) {
+            return fail("invalid number");
+        }
+#else
+        // Standard libraries without floating point from_chars
+        std::string buffer(start, p);
+        char* parsed_end = nullptr;
+        value.number = std::strtod(buffer.c_str(), &parsed_end);
+        if (parsed_end != buffer.c_str() + buffer.size()) {
+            return fail("invalid number");
+        }
+#endif
+        return true;
+    }
+};
+
+JsonValue JsonValue::parse(std::string_view text, std::string* error) {
+    JsonParser parser(text);
+    JsonValue value;
+    if (!parser.parse_document(value)) {
+        if (error) {
+            *error = parser.error + " at offset " + std::to_string(parser.p - text.data());
+        }
+        return JsonValue();
+    }
+    return value;
+}
+
+bool JsonValue::as_bool(bool fallback) const {
+    return kind == Type::Bool ? boolean : fallback;
+}
+
+double JsonValue::as_number(double fallback) const {
+    return kind == Type::Number ? number : fallback;
+}
+
+int64_t JsonValue::as_int(int64_t fallback) const {
+    // Converting a double outside int64_t's range is undefined, not clamped
+    return kind == Type::Number && number >= -0x1p63 && number < 0x1p63 ? static_cast<int64_t>(number) : fallback;
+}
+
+const std::string& JsonValue::as_string() const {
+    return kind == Type::String ? string : empty_string();
+}
+
+size_t JsonValue::size() const {
+    return (kind == Type::Array || kind == Type::Object) ? elements.size() : 0;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return (kind == Type::Array && index < elements.size()) ? elements[index] : null_value();
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const {
+    if (kind == Type::Object) {
+        for (size_t i = 0; i < object_keys.size(); ++i) {
+            if (object_keys[i] == key) {
+                return elements[i];
+            }
+        }
+    }
+    return null_value();
+}
+
+bool JsonValue::contains(std::string_view key) const {
+    return &(*this)[key] != &null_value();
+}
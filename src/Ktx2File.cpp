@@ -0,0 +1,262 @@
+#include "Ktx2File.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+namespace {
+
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout");
+
+// Vulkan format numbers of the block formats, UNORM then SRGB
+struct FormatInfo {
+    BlockFormat format;
+    uint32_t unorm;
+    uint32_t srgb;
+    // Khronos data format color model
+    uint32_t color_model;
+};
+
+constexpr FormatInfo FORMATS[] = {
+        {BlockFormat::BC1, 133, 134, 128},
+        {BlockFormat::BC3, 137, 138, 130},
+        {BlockFormat::BC5, 141, 0, 132},
+        {BlockFormat::BC7, 145, 146, 134},
+};
+
+const FormatInfo& format_info(BlockFormat format) {
+    return *std::find_if(std::begin(FORMATS), std::end(FORMATS),
+                         [format](const FormatInfo& info) { return info.format == format; });
+}
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Levels down to 1x1 for the larger side
+uint32_t max_level_count(uint32_t size) {
+    uint32_t levels = 1;
+    for (; size > 1; size >>= 1) {
+        ++levels;
+    }
+    return levels;
+}
+
+void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+}
+
+// Basic data format descriptor for a block format, one sample per 64-bit
+// half of the block: {channel id, bit offset}
+std::vector<unsigned char> data_format_descriptor(BlockFormat format, bool srgb) {
+    struct Sample {
+        uint32_t channel;
+        uint32_t bit_offset;
+        uint32_t bit_length;
+    };
+    std::vector<Sample> samples;
+    switch (format) {
+        case BlockFormat::BC1:
+            // Alpha present: texels may use the transparent index
+            samples = {{1, 0, 64}};
+            break;
+        case BlockFormat::BC3:
+            // Alpha is stored linearly even in sRGB files
+            samples = {{15 | (srgb ? 0x10u : 0u), 0, 64}, {0, 64, 64}};
+            break;
+        case BlockFormat::BC5:
+            samples = {{0, 0, 64}, {1, 64, 64}};
+            break;
+        case BlockFormat::BC7:
+            samples = {{0, 0, 128}};
+            break;
+    }
+
+    uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<unsigned char> out;
+    put_u32(out, 4 + block_size);
+    put_u32(out, 0);                   // vendor and descriptor type: Khronos basic
+    put_u32(out, 2 | block_size << 16);  // version 1.3
+    put_u32(out, format_info(format).color_model | 1u << 8 | (srgb ? 2u : 1u) << 16);  // BT.709, transfer
+    put_u32(out, 3 | 3 << 8);          // 4x4 texel blocks
+    put_u32(out, static_cast<uint32_t>(BlockCompressor::block_bytes(format)));
+    put_u32(out, 0);
+    for (const Sample& sample : samples) {
+        put_u32(out, sample.bit_offset | (sample.bit_length - 1) << 16 | sample.channel << 24);
+        put_u32(out, 0);
+        put_u32(out, 0);
+        put_u32(out, 0xFFFFFFFFu);
+    }
+    return out;
+}
+
+// Key/value data, keys sorted as the format requires
+std::vector<unsigned char> key_value_data() {
+    const std::pair<std::string_view, std::string_view> entries[] = {
+            {"KTXorientation", "ru"},
+            {"KTXwriter", "texbake"},
+    };
+    std::vector<unsigned char> out;
+    for (const auto& [key, value] : entries) {
+        put_u32(out, static_cast<uint32_t>(key.size() + value.size() + 2));
+        out.insert(out.end(), key.begin(), key.end());
+        out.push_back(0);
+        out.insert(out.end(), value.begin(), value.end());
+        out.push_back(0);
+        out.resize(align_up(out.size(), 4), 0);
+    }
+    return out;
+}
+
+} // namespace
+
+std::string Ktx2File::baked_path_for(const std::string& source_path) {
+    return std::filesystem::path(source_path).replace_extension(".ktx2").string();
+}
+
+bool Ktx2File::write(const std::string& path, BlockFormat format, bool srgb, int width, int height,
+                     const std::vector<std::vector<unsigned char>>& levels) {
+    const FormatInfo& info = format_info(format);
+    if (levels.empty() || (srgb && info.srgb == 0)) {
+        std::cerr << "ERROR::KTX2::INVALID_LEVELS: " << path << std::endl;
+        return false;
+    }
+
+    Ktx2Header header{};
+    std::memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+    header.vk_format = srgb ? info.srgb : info.unorm;
+    header.type_size = 1;
+    header.pixel_width = static_cast<uint32_t>(width);
+    header.pixel_height = static_cast<uint32_t>(height);
+    header.face_count = 1;
+    header.level_count = static_cast<uint32_t>(levels.size());
+
+    std::vector<unsigned char> descriptor = data_format_descriptor(format, srgb);
+    std::vector<unsigned char> key_values = key_value_data();
+    uint64_t index_end = sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2LevelIndex);
+    header.dfd_byte_offset = static_cast<uint32_t>(index_end);
+    header.dfd_byte_length = static_cast<uint32_t>(descriptor.size());
+    header.kvd_byte_offset = header.dfd_byte_offset + header.dfd_byte_length;
+    header.kvd_byte_length = static_cast<uint32_t>(key_values.size());
+
+    // Level data goes smallest first, each level aligned to the block size
+    uint64_t alignment = BlockCompressor::block_bytes(format);
+    std::vector<Ktx2LevelIndex> index(levels.size());
+    uint64_t offset = header.kvd_byte_offset + header.kvd_byte_length;
+    for (size_t level = levels.size(); level-- > 0;) {
+        offset = align_up(offset, alignment);
+        index[level] = {offset, levels[level].size(), levels[level].size()};
+        offset += levels[level].size();
+    }
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::KTX2::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()),
+                  static_cast<std::streamsize>(index.size() * sizeof(Ktx2LevelIndex)));
+        out.write(reinterpret_cast<const char*>(descriptor.data()), static_cast<std::streamsize>(descriptor.size()));
+        out.write(reinterpret_cast<const char*>(key_values.data()), static_cast<std::streamsize>(key_values.size()));
+        for (size_t level = levels.size(); level-- > 0;) {
+            static const char zeros[16] = {};
+            out.write(zeros, static_cast<std::streamsize>(index[level].byte_offset - static_cast<uint64_t>(out.tellp())));
+            out.write(reinterpret_cast<const char*>(levels[level].data()),
+                      static_cast<std::streamsize>(levels[level].size()));
+        }
+        if (!out) {
+            std::cerr << "ERROR::KTX2::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::cerr << "ERROR::KTX2::CANNOT_WRITE: " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+Ktx2File::Ktx2File(const std::string& path) : file(path) {
+    if (!file.is_open()) {
+        return;
+    }
+    if (file.size() < sizeof(Ktx2Header) ||
+        std::memcmp(file.data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+        std::cerr << "ERROR::KTX2::INVALID_FILE: " << path << std::endl;
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const Ktx2Header*>(file.data());
+    const FormatInfo* info = std::find_if(std::begin(FORMATS), std::end(FORMATS), [candidate](const FormatInfo& f) {
+        return f.unorm == candidate->vk_format || (f.srgb != 0 && f.srgb == candidate->vk_format);
+    });
+    if (info == std::end(FORMATS) || candidate->supercompression_scheme != 0 || candidate->face_count != 1 ||
+        candidate->layer_count > 1 || candidate->pixel_depth > 1 || candidate->pixel_height == 0) {
+        std::cerr << "ERROR::KTX2::UNSUPPORTED_FORMAT: " << path << " (only 2D BC1/BC3/BC5/BC7 without "
+                  << "supercompression)" << std::endl;
+        return;
+    }
+    if (candidate->pixel_width == 0 || candidate->pixel_width > MAX_DIMENSION ||
+        candidate->pixel_height > MAX_DIMENSION || candidate->level_count == 0 ||
+        candidate->level_count > max_level_count(std::max(candidate->pixel_width, candidate->pixel_height)) ||
+        candidate->level_count > (file.size() - sizeof(Ktx2Header)) / sizeof(Ktx2LevelIndex)) {
+        std::cerr << "ERROR::KTX2::INVALID_FILE: " << path << std::endl;
+        return;
+    }
+
+    // Every level has to be inside the file and hold its full size. Levels
+    // are stored smallest first without overlapping, so the ones a loader
+    // uploads together are one region ending with level 0
+    const auto* index = reinterpret_cast<const Ktx2LevelIndex*>(file.data() + sizeof(Ktx2Header));
+    for (uint32_t level = 0; level < candidate->level_count; ++level) {
+        int level_width = std::max(static_cast<int>(candidate->pixel_width >> level), 1);
+        int level_height = std::max(static_cast<int>(candidate->pixel_height >> level), 1);
+        if (index[level].byte_offset > file.size() ||
+            index[level].byte_length > file.size() - index[level].byte_offset ||
+            index[level].byte_length < BlockCompressor::compressed_size(info->format, level_width, level_height) ||
+            (level > 0 && index[level].byte_offset + index[level].byte_length > index[level - 1].byte_offset)) {
+            std::cerr << "ERROR::KTX2::INVALID_FILE: " << path << std::endl;
+            return;
+        }
+    }
+
+    // Rows run top to bottom unless KTXorientation says otherwise
+    if (static_cast<uint64_t>(candidate->kvd_byte_offset) + candidate->kvd_byte_length <= file.size()) {
+        const char* entry = file.data() + candidate->kvd_byte_offset;
+        const char* end = entry + candidate->kvd_byte_length;
+        while (end - entry >= 4) {
+            uint32_t length;
+            std::memcpy(&length, entry, sizeof(length));
+            if (length > static_cast<size_t>(end - entry - 4)) {
+                break;
+            }
+            std::string_view pair(entry + 4, length);
+            size_t separator = pair.find('\0');
+            if (separator != std::string_view::npos && pair.substr(0, separator) == "KTXorientation") {
+                std::string_view value = pair.substr(separator + 1);
+                bottom_up = value.size() >= 2 && value[1] == 'u';
+            }
+            entry += align_up(4 + length, 4);
+        }
+    }
+
+    block_format = info->format;
+    srgb = candidate->vk_format == info->srgb;
+    levels = index;
+    header = candidate;
+}
+
+const unsigned char* Ktx2File::level_data(size_t level) const {
+    return file_data() + levels[level].byte_offset;
+}
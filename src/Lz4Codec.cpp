@@ -0,0 +1,192 @@
+#include "Lz4Codec.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+// The format ends every block with at least this many literals, and the
+// last match starts at least MATCH_LIMIT bytes before the end
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t MAX_DISTANCE = 65535;
+constexpr int HASH_BITS = 14;
+// Skip ahead faster the longer the search goes without a match
+constexpr int SKIP_SHIFT = 6;
+
+uint32_t read_u32(const unsigned char* bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint32_t hash_sequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Length above a 4-bit token field: 255 per byte until the rest fits
+unsigned char* write_length(unsigned char* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<unsigned char>(length);
+    return out;
+}
+
+// Worst case bytes for a sequence with these lengths
+size_t sequence_bound(size_t literals, size_t match) {
+    return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+}
+
+} // namespace
+
+size_t Lz4Codec::compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t Lz4Codec::compress(const char* source, size_t size, char* destination, size_t capacity) {
+    const auto* in = reinterpret_cast<const unsigned char*>(source);
+    auto* out = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* out_end = out + capacity;
+    size_t anchor = 0;
+
+    // Anything shorter than the match limit is one literal run
+    if (size > MATCH_LIMIT) {
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        size_t match_end_limit = size - LAST_LITERALS;
+        size_t search_limit = size - MATCH_LIMIT;
+        size_t position = 1;
+        while (position < search_limit) {
+            uint32_t sequence = read_u32(in + position);
+            uint32_t& slot = table[hash_sequence(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if (position - candidate > MAX_DISTANCE || read_u32(in + candidate) != sequence) {
+                position += 1 + ((position - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+
+            // Grow the match both ways
+            while (position > anchor && candidate > 0 && in[position - 1] == in[candidate - 1]) {
+                --position;
+                --candidate;
+            }
+            size_t length = MIN_MATCH;
+            while (position + length < match_end_limit && in[candidate + length] == in[position + length]) {
+                ++length;
+            }
+
+            size_t literals = position - anchor;
+            if (sequence_bound(literals, length) > static_cast<size_t>(out_end - out)) {
+                return 0;
+            }
+            unsigned char* token = out++;
+            *token = static_cast<unsigned char>(std::min<size_t>(literals, 15) << 4);
+            if (literals >= 15) {
+                out = write_length(out, literals - 15);
+            }
+            std::memcpy(out, in + anchor, literals);
+            out += literals;
+            size_t distance = position - candidate;
+            *out++ = static_cast<unsigned char>(distance & 0xff);
+            *out++ = static_cast<unsigned char>(distance >> 8);
+            size_t extra = length - MIN_MATCH;
+            *token |= static_cast<unsigned char>(std::min<size_t>(extra, 15));
+            if (extra >= 15) {
+                out = write_length(out, extra - 15);
+            }
+
+            position += length;
+            anchor = position;
+            // Remember a position inside the match too, runs of repeats
+            // then keep finding each other
+            table[hash_sequence(read_u32(in + position - 2))] = static_cast<uint32_t>(position - 2);
+        }
+    }
+
+    size_t literals = size - anchor;
+    if (sequence_bound(literals, 0) > static_cast<size_t>(out_end - out)) {
+        return 0;
+    }
+    *out++ = static_cast<unsigned char>(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) {
+        out = write_length(out, literals - 15);
+    }
+    std::memcpy(out, in + anchor, literals);
+    out += literals;
+    return static_cast<size_t>(out - reinterpret_cast<unsigned char*>(destination));
+}
+
+bool Lz4Codec::decompress(const char* source, size_t compressed_size, char* destination, size_t size) {
+    const auto* in = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* in_end = in + compressed_size;
+    auto* out = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* out_end = out + size;
+
+    while (in < in_end) {
+        unsigned token = *in++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char byte;
+            do {
+                if (in == in_end) {
+                    return false;
+                }
+                byte = *in++;
+                literals += byte;
+            } while (byte == 255);
+        }
+        if (literals > static_cast<size_t>(in_end - in) || literals > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        std::memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        // The last sequence has literals only
+        if (in == in_end) {
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        size_t distance = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        if (distance == 0 || distance > static_cast<size_t>(out - reinterpret_cast<unsigned char*>(destination))) {
+            return false;
+        }
+
+        size_t length = token & 15;
+        if (length == 15) {
+            unsigned char byte;
+            do {
+                if (in == in_end) {
+                    return false;
+                }
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+        }
+        length += MIN_MATCH;
+        if (length > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+
+        const unsigned char* match = out - distance;
+        if (distance >= length) {
+            std::memcpy(out, match, length);
+            out += length;
+        } else {
+            // Overlapping copies repeat the last distance bytes
+            for (size_t i = 0; i < length; ++i) {
+                *out++ = match[i];
+            }
+        }
+    }
+    return out == out_end;
+}
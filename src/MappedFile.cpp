@@ -0,0 +1,143 @@
+#include "MappedFile.h"
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "ERROR::MAPPED_FILE::OPEN_FAILED: " << path << std::endl;
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        std::cerr << "ERROR::MAPPED_FILE::EMPTY_OR_UNREADABLE: " << path << std::endl;
+        return;
+    }
+
+    HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!map) {
+        CloseHandle(file);
+        std::cerr << "ERROR::MAPPED_FILE::MAP_FAILED: " << path << std::endl;
+        return;
+    }
+
+    mapping = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (!mapping) {
+        CloseHandle(map);
+        CloseHandle(file);
+        std::cerr << "ERROR::MAPPED_FILE::MAP_FAILED: " << path << std::endl;
+        return;
+    }
+
+    file_handle = file;
+    map_handle = map;
+    length = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "ERROR::MAPPED_FILE::OPEN_FAILED: " << path << std::endl;
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        std::cerr << "ERROR::MAPPED_FILE::EMPTY_OR_UNREADABLE: " << path << std::endl;
+        return;
+    }
+
+    void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (address == MAP_FAILED) {
+        std::cerr << "ERROR::MAPPED_FILE::MAP_FAILED: " << path << std::endl;
+        return;
+    }
+
+    // Loaders touch every chunk of the file at once from several threads,
+    // so ask the kernel to start reading all of it ahead
+    madvise(address, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+
+    mapping = address;
+    length = static_cast<size_t>(info.st_size);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+        : mapping(std::exchange(other.mapping, nullptr)), length(std::exchange(other.length, 0)) {
+#ifdef _WIN32
+    file_handle = std::exchange(other.file_handle, nullptr);
+    map_handle = std::exchange(other.map_handle, nullptr);
+#endif
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+
+        mapping = std::exchange(other.mapping, nullptr);
+        length = std::exchange(other.length, 0);
+#ifdef _WIN32
+        file_handle = std::exchange(other.file_handle, nullptr);
+        map_handle = std::exchange(other.map_handle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::close() {
+    if (!mapping) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle(map_handle);
+    CloseHandle(file_handle);
+    map_handle = nullptr;
+    file_handle = nullptr;
+#else
+    munmap(mapping, length);
+#endif
+
+    mapping = nullptr;
+    length = 0;
+}
+
+uint64_t MappedFile::content_hash(std::string_view bytes) {
+    size_t length = bytes.size();
+    uint64_t hash = 14695981039346656037ull ^ length;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(uint64_t));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    // 0 is left for callers to mean unreadable
+    return hash != 0 ? hash : 1;
+}
@@ -0,0 +1,303 @@
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "Shader.h"
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+MeshData MeshData::from_interleaved(const float* data, size_t float_count, bool has_normals) {
+    MeshData mesh;
+    if (has_normals) {
+        mesh.vertices.resize(float_count / 8);
+        std::memcpy(static_cast<void*>(mesh.vertices.data()), data, mesh.vertices.size() * sizeof(Vertex));
+    } else {
+        mesh.vertices.resize(float_count / 5);
+        for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+            const float* v = data + i * 5;
+            mesh.vertices[i] = {glm::vec3(v[0], v[1], v[2]), glm::vec3(0.0f), glm::vec2(v[3], v[4])};
+        }
+    }
+    mesh.compute_bounds();
+    return mesh;
+}
+
+void MeshData::compute_bounds() {
+    if (vertices.empty()) {
+        bounds = Bounds{};
+        return;
+    }
+
+    bounds.min = bounds.max = vertices[0].position;
+    for (const Vertex& vertex : vertices) {
+        bounds.min = glm::min(bounds.min, vertex.position);
+        bounds.max = glm::max(bounds.max, vertex.position);
+    }
+}
+
+std::vector<CompactVertex> MeshData::compact_vertices() const {
+    std::vector<CompactVertex> result(vertices.size());
+
+    glm::vec3 extent = bounds.max - bounds.min;
+    glm::vec3 inverse_extent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                             extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                             extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vertex& vertex = vertices[i];
+        CompactVertex& compact = result[i];
+
+        glm::vec3 relative = (vertex.position - bounds.min) * inverse_extent;
+        compact.position[0] = float_to_unorm16(relative.x);
+        compact.position[1] = float_to_unorm16(relative.y);
+        compact.position[2] = float_to_unorm16(relative.z);
+        compact.position[3] = 0;
+
+        glm::vec2 octahedral = encode_octahedral(vertex.normal);
+        compact.normal[0] = float_to_snorm16(octahedral.x);
+        compact.normal[1] = float_to_snorm16(octahedral.y);
+
+        compact.tex_coords[0] = float_to_half(vertex.tex_coords.x);
+        compact.tex_coords[1] = float_to_half(vertex.tex_coords.y);
+    }
+    return result;
+}
+
+Mesh::Mesh(const MeshData& data, VertexFormat format)
+        : vertex_format(format), bounds(data.bounds), submeshes(data.submeshes), lods(data.lods),
+          meshlets(data.meshlets) {
+    std::vector<CompactVertex> compact;
+    const void* vertex_data = data.vertices.data();
+    if (format == VertexFormat::Compact) {
+        compact = data.compact_vertices();
+        vertex_data = compact.data();
+    }
+
+    // Halve the index buffer when the mesh is small enough
+    if (!data.indices.empty() && data.vertices.size() <= std::numeric_limits<uint16_t>::max() + 1u) {
+        std::vector<uint16_t> short_indices(data.indices.begin(), data.indices.end());
+        upload(vertex_data, data.vertices.size(), short_indices.data(), short_indices.size(), GL_UNSIGNED_SHORT);
+    } else {
+        upload(vertex_data, data.vertices.size(), data.indices.data(), data.indices.size(), GL_UNSIGNED_INT);
+    }
+}
+
+Mesh::Mesh(const MeshCache& cache)
+        : vertex_format(cache.vertex_format()), bounds(cache.bounds()), submeshes(cache.submeshes()),
+          lods(cache.lods()), meshlets(cache.meshlets()) {
+    upload(cache.vertex_data(), cache.vertex_count(), cache.index_data(), cache.index_count(), cache.index_type());
+}
+
+void Mesh::upload(const void* vertex_data, size_t vertices, const void* index_data, size_t indices, GLenum type) {
+    vertex_count = static_cast<GLsizei>(vertices);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices * vertex_stride(vertex_format), vertex_data, GL_STATIC_DRAW);
+
+    setup_vertex_attributes();
+
+    if (indices > 0) {
+        index_count = static_cast<GLsizei>(indices);
+        index_type = type;
+        size_t index_size = (type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices * index_size, index_data, GL_STATIC_DRAW);
+
+        if (lods.empty()) {
+            lods.push_back({0, static_cast<uint32_t>(indices), 0.0f});
+        }
+    }
+
+    glBindVertexArray(0);
+}
+
+void Mesh::setup_vertex_attributes() const {
+    if (vertex_format == VertexFormat::Compact) {
+        // Position attribute, normalized to [0, 1] inside the bounds
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+        glEnableVertexAttribArray(0);
+        // Normal attribute, octahedral xy (z reads as 0)
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+        glEnableVertexAttribArray(1);
+        // Texture attribute
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, tex_coords));
+        glEnableVertexAttribArray(2);
+        return;
+    }
+
+    // Position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    // Normal attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+    // Texture attribute
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tex_coords));
+    glEnableVertexAttribArray(2);
+}
+
+void Mesh::apply_vertex_decode(const Shader& shader) const {
+    if (vertex_format == VertexFormat::Compact) {
+        shader.set_vec3("positionOffset", bounds.min);
+        shader.set_vec3("positionScale", bounds.max - bounds.min);
+        shader.set_bool("octNormals", true);
+    } else {
+        shader.set_vec3("positionOffset", glm::vec3(0.0f));
+        shader.set_vec3("positionScale", glm::vec3(1.0f));
+        shader.set_bool("octNormals", false);
+    }
+}
+
+Mesh::~Mesh() {
+    release();
+}
+
+Mesh::Mesh(Mesh&& other) noexcept
+        : vao(std::exchange(other.vao, 0)), vbo(std::exchange(other.vbo, 0)), ebo(std::exchange(other.ebo, 0)),
+          vertex_count(std::exchange(other.vertex_count, 0)), index_count(std::exchange(other.index_count, 0)),
+          index_type(other.index_type), vertex_format(other.vertex_format), bounds(other.bounds),
+          submeshes(std::move(other.submeshes)), lods(std::move(other.lods)),
+          meshlets(std::move(other.meshlets)) {
+}
+
+Mesh& Mesh::operator=(Mesh&& other) noexcept {
+    if (this != &other) {
+        release();
+
+        vao = std::exchange(other.vao, 0);
+        vbo = std::exchange(other.vbo, 0);
+        ebo = std::exchange(other.ebo, 0);
+        vertex_count = std::exchange(other.vertex_count, 0);
+        index_count = std::exchange(other.index_count, 0);
+        index_type = other.index_type;
+        vertex_format = other.vertex_format;
+        bounds = other.bounds;
+        submeshes = std::move(other.submeshes);
+        lods = std::move(other.lods);
+        meshlets = std::move(other.meshlets);
+    }
+    return *this;
+}
+
+size_t Mesh::select_lod(float distance, float fov, float viewport_height, float max_pixel_error) const {
+    if (lods.size() <= 1 || viewport_height <= 0.0f) {
+        return 0;
+    }
+
+    // Pixels covered by one object space unit at distance 1
+    float pixels_per_unit = viewport_height / (2.0f * std::tan(glm::radians(fov) * 0.5f));
+    float allowed_error = max_pixel_error * std::max(distance, 0.0f) / pixels_per_unit;
+
+    // Errors grow with every level
+    size_t level = 0;
+    while (level + 1 < lods.size() && lods[level + 1].error <= allowed_error) {
+        ++level;
+    }
+    return level;
+}
+
+void Mesh::draw(size_t lod) const {
+    glBindVertexArray(vao);
+    if (index_count > 0) {
+        const MeshLod& range = lods[std::min(lod, lods.size() - 1)];
+        size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(range.index_count), index_type,
+                       (void*)(range.index_offset * index_size));
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+    }
+}
+
+MeshletCullStats Mesh::draw_culled(size_t lod, const glm::mat4& model_view_projection, const glm::vec3& eye,
+                                   bool cull_backfaces) {
+    MeshletCullStats stats;
+    if (index_count == 0 || meshlets.empty()) {
+        draw(lod);
+        size_t triangles = (index_count > 0 ? lods[std::min(lod, lods.size() - 1)].index_count : vertex_count) / 3u;
+        stats.triangles_total = stats.triangles_drawn = triangles;
+        return stats;
+    }
+
+    // Frustum planes in object space (Gribb & Hartmann), normals pointing inward
+    const glm::mat4& m = model_view_projection;
+    glm::vec4 w_row(m[0][3], m[1][3], m[2][3], m[3][3]);
+    glm::vec4 planes[6];
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::vec4 row(m[0][axis], m[1][axis], m[2][axis], m[3][axis]);
+        planes[axis * 2] = w_row + row;
+        planes[axis * 2 + 1] = w_row - row;
+    }
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    const MeshLod& range = lods[std::min(lod, lods.size() - 1)];
+    size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+    uint32_t run_end = 0;
+    draw_counts.clear();
+    draw_offsets.clear();
+
+    for (uint32_t i = range.meshlet_offset; i < range.meshlet_offset + range.meshlet_count; ++i) {
+        const Meshlet& meshlet = meshlets[i];
+        ++stats.meshlets_total;
+        stats.triangles_total += meshlet.index_count / 3;
+
+        bool visible = true;
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius) {
+                visible = false;
+                break;
+            }
+        }
+        if (visible && cull_backfaces) {
+            glm::vec3 to_center = meshlet.center - eye;
+            visible = glm::dot(to_center, meshlet.cone_axis) <
+                      meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius;
+        }
+        if (!visible) {
+            continue;
+        }
+
+        ++stats.meshlets_drawn;
+        stats.triangles_drawn += meshlet.index_count / 3;
+
+        // Meshlets are contiguous, so neighbours that both survive share a draw
+        if (!draw_counts.empty() && meshlet.index_offset == run_end) {
+            draw_counts.back() += static_cast<GLsizei>(meshlet.index_count);
+        } else {
+            draw_counts.push_back(static_cast<GLsizei>(meshlet.index_count));
+            draw_offsets.push_back((const void*)(meshlet.index_offset * index_size));
+        }
+        run_end = meshlet.index_offset + meshlet.index_count;
+    }
+
+    if (!draw_counts.empty()) {
+        glBindVertexArray(vao);
+        glMultiDrawElements(GL_TRIANGLES, draw_counts.data(), index_type, draw_offsets.data(),
+                            static_cast<GLsizei>(draw_counts.size()));
+    }
+    return stats;
+}
+
+void Mesh::release() {
+    if (vao != 0) {
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+    }
+    if (vbo != 0) {
+        glDeleteBuffers(1, &vbo);
+        vbo = 0;
+    }
+    if (ebo != 0) {
+        glDeleteBuffers(1, &ebo);
+        ebo = 0;
+    }
+}
@@ -0,0 +1,84 @@
+#include "MeshBuilder.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+// -0.0 and 0.0 compare equal but differ bitwise, fold them before hashing
+Vertex canonical(const Vertex& vertex) {
+    float values[sizeof(Vertex) / sizeof(float)];
+    std::memcpy(values, &vertex, sizeof(Vertex));
+    for (float& value : values) {
+        value += 0.0f;
+    }
+
+    Vertex result;
+    std::memcpy(static_cast<void*>(&result), values, sizeof(Vertex));
+    return result;
+}
+
+uint64_t hash_vertex(const Vertex& vertex) {
+    return MeshBuilder::hash_words(&vertex, sizeof(Vertex) / sizeof(uint32_t));
+}
+
+} // namespace
+
+MeshData MeshBuilder::weld(const MeshData& mesh) {
+    MeshData result;
+
+    size_t corner_count = mesh.indices.empty() ? mesh.vertices.size() : mesh.indices.size();
+    if (corner_count == 0) {
+        return result;
+    }
+
+    // Open addressing table at most half full
+    size_t table_size = 1;
+    while (table_size < mesh.vertices.size() * 2) {
+        table_size <<= 1;
+    }
+    std::vector<uint32_t> table(table_size, EMPTY_SLOT);
+    size_t mask = table_size - 1;
+
+    // Remap every source vertex once, so indexed input costs no extra hashing
+    std::vector<uint32_t> remap(mesh.vertices.size());
+    result.vertices.reserve(mesh.vertices.size() / 2);
+
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        Vertex vertex = canonical(mesh.vertices[i]);
+        size_t slot = hash_vertex(vertex) & mask;
+
+        while (true) {
+            uint32_t existing = table[slot];
+            if (existing == EMPTY_SLOT) {
+                existing = static_cast<uint32_t>(result.vertices.size());
+                table[slot] = existing;
+                result.vertices.push_back(vertex);
+                remap[i] = existing;
+                break;
+            }
+            if (std::memcmp(&result.vertices[existing], &vertex, sizeof(Vertex)) == 0) {
+                remap[i] = existing;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    result.vertices.shrink_to_fit();
+    result.indices.resize(corner_count);
+    for (size_t i = 0; i < corner_count; ++i) {
+        result.indices[i] = remap[mesh.indices.empty() ? i : mesh.indices[i]];
+    }
+
+    // Corner order is unchanged, so submesh ranges carry over as they are
+    result.submeshes = mesh.submeshes;
+    if (result.submeshes.empty()) {
+        result.submeshes.push_back({0, static_cast<uint32_t>(corner_count)});
+    }
+    result.compute_bounds();
+
+    return result;
+}
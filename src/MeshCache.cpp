@@ -0,0 +1,256 @@
+#include "MeshCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool source_state(const std::string& source_path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = std::filesystem::file_size(source_path, error);
+    if (error) {
+        return false;
+    }
+    time = std::filesystem::last_write_time(source_path, error).time_since_epoch().count();
+    return !error;
+}
+
+// Whether count elements of element_size bytes at offset fit between the
+// header and the end of the file, without overflowing on a corrupt header
+bool blob_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size) {
+    return offset >= sizeof(MeshCacheHeader) && offset <= file_size &&
+           count <= (file_size - offset) / element_size;
+}
+
+// Whether every index range a table entry names lies inside the index blob
+template <typename Range>
+bool ranges_fit(const char* data, uint64_t offset, uint64_t count, uint64_t index_count) {
+    for (uint64_t i = 0; i < count; ++i) {
+        Range range;
+        std::memcpy(static_cast<void*>(&range), data + offset + i * sizeof(Range), sizeof(Range));
+        if (static_cast<uint64_t>(range.index_offset) + range.index_count > index_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every index names a vertex that exists
+template <typename Index>
+bool indices_fit(const char* indices, uint64_t index_count, uint64_t vertex_count) {
+    for (uint64_t i = 0; i < index_count; ++i) {
+        Index index;
+        std::memcpy(&index, indices + i * sizeof(Index), sizeof(Index));
+        if (index >= vertex_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void write_padding(std::ofstream& out, uint64_t target_offset) {
+    static const char zeros[MeshCache::BLOB_ALIGNMENT] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    if (target_offset > position) {
+        out.write(zeros, static_cast<std::streamsize>(target_offset - position));
+    }
+}
+
+} // namespace
+
+std::string MeshCache::cache_path_for(const std::string& source_path) {
+    return source_path + ".meshcache";
+}
+
+bool MeshCache::write(const std::string& cache_path, const MeshData& mesh, const std::string& source_path,
+                      VertexFormat format) {
+    if (mesh.indices.empty()) {
+        std::cerr << "ERROR::MESH_CACHE::MESH_NOT_INDEXED: " << source_path << std::endl;
+        return false;
+    }
+
+    MeshCacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertex_format = static_cast<uint32_t>(format);
+    header.vertex_stride = static_cast<uint32_t>(vertex_stride(format));
+    header.index_size = mesh.vertices.size() <= std::numeric_limits<uint16_t>::max() + 1u ? 2 : 4;
+    header.vertex_count = mesh.vertices.size();
+    header.index_count = mesh.indices.size();
+    header.submesh_count = mesh.submeshes.size();
+    header.vertex_offset = align_up(sizeof(MeshCacheHeader), BLOB_ALIGNMENT);
+    uint64_t vertex_end = header.vertex_offset + header.vertex_count * header.vertex_stride;
+    header.index_offset = align_up(vertex_end, BLOB_ALIGNMENT);
+    header.submesh_offset = align_up(header.index_offset + header.index_count * header.index_size, BLOB_ALIGNMENT);
+    header.lod_count = mesh.lods.size();
+    header.lod_offset = header.submesh_offset + header.submesh_count * sizeof(Submesh);
+    header.meshlet_count = mesh.meshlets.size();
+    header.meshlet_offset = header.lod_offset + header.lod_count * sizeof(MeshLod);
+    for (int i = 0; i < 3; ++i) {
+        header.bounds_min[i] = mesh.bounds.min[i];
+        header.bounds_max[i] = mesh.bounds.max[i];
+    }
+    if (!source_state(source_path, header.source_size, header.source_time)) {
+        std::cerr << "ERROR::MESH_CACHE::SOURCE_NOT_FOUND: " << source_path << std::endl;
+        return false;
+    }
+
+    // Write next to the final name and rename, so a crash never leaves a
+    // half written cache that looks valid
+    std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::MESH_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        write_padding(out, header.vertex_offset);
+        if (format == VertexFormat::Compact) {
+            std::vector<CompactVertex> compact = mesh.compact_vertices();
+            out.write(reinterpret_cast<const char*>(compact.data()),
+                      static_cast<std::streamsize>(compact.size() * sizeof(CompactVertex)));
+        } else {
+            out.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+                      static_cast<std::streamsize>(mesh.vertices.size() * sizeof(Vertex)));
+        }
+
+        write_padding(out, header.index_offset);
+        if (header.index_size == 2) {
+            std::vector<uint16_t> short_indices(mesh.indices.begin(), mesh.indices.end());
+            out.write(reinterpret_cast<const char*>(short_indices.data()),
+                      static_cast<std::streamsize>(short_indices.size() * sizeof(uint16_t)));
+        } else {
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                      static_cast<std::streamsize>(mesh.indices.size() * sizeof(uint32_t)));
+        }
+
+        write_padding(out, header.submesh_offset);
+        out.write(reinterpret_cast<const char*>(mesh.submeshes.data()),
+                  static_cast<std::streamsize>(mesh.submeshes.size() * sizeof(Submesh)));
+        out.write(reinterpret_cast<const char*>(mesh.lods.data()),
+                  static_cast<std::streamsize>(mesh.lods.size() * sizeof(MeshLod)));
+        out.write(reinterpret_cast<const char*>(mesh.meshlets.data()),
+                  static_cast<std::streamsize>(mesh.meshlets.size() * sizeof(Meshlet)));
+
+        if (!out) {
+            std::cerr << "ERROR::MESH_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        std::cerr << "ERROR::MESH_CACHE::CANNOT_WRITE: " << cache_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+MeshCache::MeshCache(const std::string& cache_path) {
+    std::error_code error;
+    if (!std::filesystem::exists(cache_path, error)) {
+        return;
+    }
+
+    file = MappedFile(cache_path);
+    if (!file.is_open() || file.size() < sizeof(MeshCacheHeader)) {
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const MeshCacheHeader*>(file.data());
+    bool valid = std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                 candidate->version == VERSION &&
+                 (candidate->vertex_format == static_cast<uint32_t>(VertexFormat::Float32) ||
+                  candidate->vertex_format == static_cast<uint32_t>(VertexFormat::Compact)) &&
+                 candidate->vertex_stride == vertex_stride(static_cast<VertexFormat>(candidate->vertex_format)) &&
+                 (candidate->index_size == 2 || candidate->index_size == 4) &&
+                 blob_fits(candidate->vertex_offset, candidate->vertex_count, candidate->vertex_stride, file.size()) &&
+                 blob_fits(candidate->index_offset, candidate->index_count, candidate->index_size, file.size()) &&
+                 blob_fits(candidate->submesh_offset, candidate->submesh_count, sizeof(Submesh), file.size()) &&
+                 blob_fits(candidate->lod_offset, candidate->lod_count, sizeof(MeshLod), file.size()) &&
+                 blob_fits(candidate->meshlet_offset, candidate->meshlet_count, sizeof(Meshlet), file.size());
+    // Tables may only name index ranges, levels meshlet ranges and indices
+    // vertices that exist
+    if (valid) {
+        const char* data = file.data();
+        valid = ranges_fit<Submesh>(data, candidate->submesh_offset, candidate->submesh_count,
+                                    candidate->index_count) &&
+                ranges_fit<MeshLod>(data, candidate->lod_offset, candidate->lod_count, candidate->index_count) &&
+                ranges_fit<Meshlet>(data, candidate->meshlet_offset, candidate->meshlet_count,
+                                    candidate->index_count);
+        for (uint64_t i = 0; valid && i < candidate->lod_count; ++i) {
+            MeshLod lod;
+            std::memcpy(&lod, data + candidate->lod_offset + i * sizeof(MeshLod), sizeof(MeshLod));
+            valid = static_cast<uint64_t>(lod.meshlet_offset) + lod.meshlet_count <= candidate->meshlet_count;
+        }
+        // An index past the vertex blob would make the GPU read outside it
+        const char* indices = data + candidate->index_offset;
+        if (valid) {
+            valid = candidate->index_size == 2
+                            ? indices_fit<uint16_t>(indices, candidate->index_count, candidate->vertex_count)
+                            : indices_fit<uint32_t>(indices, candidate->index_count, candidate->vertex_count);
+        }
+    }
+    if (!valid) {
+        std::cerr << "Warning: ignoring invalid or outdated mesh cache " << cache_path << std::endl;
+        return;
+    }
+
+    header = candidate;
+}
+
+bool MeshCache::is_up_to_date(const std::string& source_path) const {
+    uint64_t size = 0;
+    int64_t time = 0;
+    if (!is_valid() || !source_state(source_path, size, time)) {
+        return false;
+    }
+    return size == header->source_size && time == header->source_time;
+}
+
+const void* MeshCache::vertex_data() const {
+    return file.data() + header->vertex_offset;
+}
+
+const void* MeshCache::index_data() const {
+    return file.data() + header->index_offset;
+}
+
+std::vector<Submesh> MeshCache::submeshes() const {
+    std::vector<Submesh> result(header->submesh_count);
+    std::memcpy(result.data(), file.data() + header->submesh_offset, result.size() * sizeof(Submesh));
+    return result;
+}
+
+std::vector<MeshLod> MeshCache::lods() const {
+    std::vector<MeshLod> result(header->lod_count);
+    std::memcpy(result.data(), file.data() + header->lod_offset, result.size() * sizeof(MeshLod));
+    return result;
+}
+
+std::vector<Meshlet> MeshCache::meshlets() const {
+    std::vector<Meshlet> result(header->meshlet_count);
+    std::memcpy(static_cast<void*>(result.data()), file.data() + header->meshlet_offset,
+                result.size() * sizeof(Meshlet));
+    return result;
+}
+
+Bounds MeshCache::bounds() const {
+    Bounds result;
+    for (int i = 0; i < 3; ++i) {
+        result.min[i] = header->bounds_min[i];
+        result.max[i] = header->bounds_max[i];
+    }
+    return result;
+}
@@ -0,0 +1,357 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+constexpr size_t FORSYTH_CACHE_SIZE = 32;
+constexpr size_t FORSYTH_MAX_VALENCE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+// Clusters smaller than this are not split any further by the overdraw pass
+constexpr size_t MIN_CLUSTER_TRIANGLES = 64;
+constexpr size_t OVERDRAW_CACHE_SIZE = 16;
+
+struct ForsythTables {
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[FORSYTH_MAX_VALENCE + 1];
+
+    ForsythTables() {
+        for (size_t i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+            if (i < 3) {
+                // The last triangle's vertices get a fixed score so we do not
+                // favor reusing them over the rest of the cache
+                cache[i] = LAST_TRIANGLE_SCORE;
+            } else {
+                float scaler = 1.0f / static_cast<float>(FORSYTH_CACHE_SIZE - 3);
+                cache[i] = std::pow(1.0f - static_cast<float>(i - 3) * scaler, CACHE_DECAY_POWER);
+            }
+        }
+        valence[0] = 0.0f;
+        for (size_t i = 1; i <= FORSYTH_MAX_VALENCE; ++i) {
+            // Boost vertices with few triangles left so they get finished off
+            valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+        }
+    }
+
+    float score(int cache_position, uint32_t remaining) const {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float result = cache_position >= 0 ? cache[cache_position] : 0.0f;
+        return result + valence[std::min<size_t>(remaining, FORSYTH_MAX_VALENCE)];
+    }
+};
+
+const ForsythTables& forsyth_tables() {
+    static const ForsythTables tables;
+    return tables;
+}
+
+} // namespace
+
+void MeshOptimizer::optimize(MeshData& mesh) {
+    if (mesh.indices.empty()) {
+        return;
+    }
+
+    std::vector<Submesh> ranges = mesh.submeshes;
+    if (ranges.empty()) {
+        ranges.push_back({0, static_cast<uint32_t>(mesh.indices.size())});
+    }
+    for (const Submesh& range : ranges) {
+        uint32_t* indices = mesh.indices.data() + range.index_offset;
+        optimize_vertex_cache(indices, range.index_count, mesh.vertices.size());
+        optimize_overdraw(indices, range.index_count, mesh.vertices);
+    }
+    optimize_vertex_fetch(mesh);
+}
+
+void MeshOptimizer::optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+    const ForsythTables& tables = forsyth_tables();
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Vertex to triangle adjacency, remaining[v] live entries at the front of each range
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; ++i) {
+        ++remaining[indices[i]];
+    }
+    std::vector<size_t> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    {
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        vertex_score[v] = tables.score(-1, remaining[v]);
+    }
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (size_t t = 0; t < triangle_count; ++t) {
+        triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+    std::vector<uint32_t> cache, new_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    new_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+    size_t cursor = 0;
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+        if (best == std::numeric_limits<size_t>::max()) {
+            // Nothing in the cache has triangles left, continue with the next unused one
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        const uint32_t* triangle = indices + best * 3;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // Drop the triangle from its vertices' adjacency
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = triangle[k];
+            uint32_t* begin = adjacency.data() + offsets[v];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* found = std::find(begin, end, static_cast<uint32_t>(best));
+            if (found != end) {
+                std::swap(*found, *(end - 1));
+                --remaining[v];
+            }
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        new_cache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                new_cache.push_back(v);
+            }
+        }
+        std::swap(cache, new_cache);
+
+        // Rescore every vertex whose position changed, including evicted ones
+        for (size_t i = 0; i < cache.size(); ++i) {
+            uint32_t v = cache[i];
+            cache_position[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+
+            float score = tables.score(cache_position[v], remaining[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+            for (size_t a = 0; a < remaining[v]; ++a) {
+                triangle_score[adjacency[offsets[v] + a]] += delta;
+            }
+        }
+        if (cache.size() > FORSYTH_CACHE_SIZE) {
+            cache.resize(FORSYTH_CACHE_SIZE);
+        }
+
+        // The next triangle is the best one touching the cache
+        best = std::numeric_limits<size_t>::max();
+        float best_score = -std::numeric_limits<float>::max();
+        for (uint32_t v : cache) {
+            for (size_t a = 0; a < remaining[v]; ++a) {
+                uint32_t t = adjacency[offsets[v] + a];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::optimize_overdraw(uint32_t* indices, size_t index_count, const std::vector<Vertex>& vertices,
+                                      float threshold) {
+    size_t triangle_count = index_count / 3;
+    if (triangle_count <= MIN_CLUSTER_TRIANGLES * 2) {
+        return;
+    }
+
+    // Hard boundaries where the cache optimized order starts over: a triangle
+    // whose three vertices all miss the FIFO cache
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+    std::vector<uint32_t> misses(triangle_count);
+    std::vector<size_t> hard_boundaries;
+
+    for (size_t t = 0; t < triangle_count; ++t) {
+        uint32_t triangle_misses = 0;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = indices[t * 3 + k];
+            if (time - timestamps[v] > OVERDRAW_CACHE_SIZE) {
+                timestamps[v] = time++;
+                ++triangle_misses;
+            }
+        }
+        misses[t] = triangle_misses;
+        if (t == 0 || triangle_misses == 3) {
+            hard_boundaries.push_back(t);
+        }
+    }
+    hard_boundaries.push_back(triangle_count);
+
+    // Per triangle area weighted center and normal, summed per cluster below
+    std::vector<glm::vec3> triangle_center(triangle_count);
+    std::vector<glm::vec3> triangle_normal(triangle_count);
+    std::vector<float> triangle_area(triangle_count);
+    glm::vec3 mesh_center(0.0f);
+    float mesh_area = 0.0f;
+
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const glm::vec3& a = vertices[indices[t * 3]].position;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+
+        triangle_normal[t] = glm::cross(b - a, c - a);
+        triangle_area[t] = glm::length(triangle_normal[t]);
+        triangle_center[t] = (a + b + c) / 3.0f;
+
+        mesh_center += triangle_center[t] * triangle_area[t];
+        mesh_area += triangle_area[t];
+    }
+    if (mesh_area > 0.0f) {
+        mesh_center /= mesh_area;
+    }
+
+    VertexCacheStats original = analyze_vertex_cache(indices, index_count, vertices.size(), OVERDRAW_CACHE_SIZE);
+    std::vector<uint32_t> output(index_count);
+
+    // Every cluster starts with a cold cache once reordered. If that costs more
+    // than the threshold allows, retry with coarser clusters.
+    for (size_t min_cluster = MIN_CLUSTER_TRIANGLES; min_cluster * 2 <= triangle_count; min_cluster *= 2) {
+        // Soft boundaries inside each hard cluster, placed once the running
+        // ACMR is within the threshold of the cluster's ACMR
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hard_boundaries.size(); ++h) {
+            size_t start = hard_boundaries[h];
+            size_t end = hard_boundaries[h + 1];
+
+            size_t cluster_misses = 0;
+            for (size_t t = start; t < end; ++t) {
+                cluster_misses += misses[t];
+            }
+            float cluster_acmr = static_cast<float>(cluster_misses) / static_cast<float>(end - start);
+
+            clusters.push_back(start);
+            size_t running_misses = 0;
+            size_t running_start = start;
+            for (size_t t = start; t < end; ++t) {
+                running_misses += misses[t];
+                size_t running_triangles = t + 1 - running_start;
+                float running_acmr = static_cast<float>(running_misses) / static_cast<float>(running_triangles);
+
+                if (running_triangles >= min_cluster && end - (t + 1) >= min_cluster &&
+                    running_acmr <= cluster_acmr * threshold) {
+                    clusters.push_back(t + 1);
+                    running_start = t + 1;
+                    running_misses = 0;
+                }
+            }
+        }
+        clusters.push_back(triangle_count);
+
+        size_t cluster_count = clusters.size() - 1;
+        if (cluster_count <= 1) {
+            return;
+        }
+
+        // Clusters facing away from the center are the ones most likely in front
+        std::vector<float> sort_key(cluster_count, 0.0f);
+        for (size_t c = 0; c < cluster_count; ++c) {
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+                center += triangle_center[t] * triangle_area[t];
+                normal += triangle_normal[t];
+                area += triangle_area[t];
+            }
+            float normal_length = glm::length(normal);
+            if (area > 0.0f && normal_length > 0.0f) {
+                sort_key[c] = glm::dot(center / area - mesh_center, normal / normal_length);
+            }
+        }
+
+        std::vector<size_t> order(cluster_count);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&sort_key](size_t a, size_t b) { return sort_key[a] > sort_key[b]; });
+
+        uint32_t* out = output.data();
+        for (size_t c : order) {
+            out = std::copy(indices + clusters[c] * 3, indices + clusters[c + 1] * 3, out);
+        }
+
+        VertexCacheStats sorted = analyze_vertex_cache(output.data(), index_count, vertices.size(), OVERDRAW_CACHE_SIZE);
+        if (sorted.acmr <= original.acmr * threshold) {
+            std::copy(output.begin(), output.end(), indices);
+            return;
+        }
+    }
+}
+
+void MeshOptimizer::optimize_vertex_fetch(MeshData& mesh) {
+    constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(mesh.vertices.size(), UNUSED);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices = std::move(vertices);
+}
+
+VertexCacheStats MeshOptimizer::analyze_vertex_cache(const uint32_t* indices, size_t index_count, size_t vertex_count,
+                                                     size_t cache_size) {
+    VertexCacheStats stats;
+    if (index_count < 3 || vertex_count == 0) {
+        return stats;
+    }
+
+    std::vector<size_t> timestamps(vertex_count, 0);
+    size_t time = cache_size + 1;
+    size_t transformed = 0;
+
+    for (size_t i = 0; i < index_count; ++i) {
+        uint32_t v = indices[i];
+        if (time - timestamps[v] > cache_size) {
+            timestamps[v] = time++;
+            ++transformed;
+        }
+    }
+
+    stats.acmr = static_cast<float>(transformed) / static_cast<float>(index_count / 3);
+    stats.atvr = static_cast<float>(transformed) / static_cast<float>(vertex_count);
+    return stats;
+}
@@ -0,0 +1,772 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+
+// Border planes outweigh surface planes so silhouettes of open meshes survive
+constexpr double BORDER_WEIGHT = 10.0;
+// Reject collapses that turn a triangle by more than about 75 degrees
+constexpr float MIN_NORMAL_COSINE = 0.25f;
+// Take collapses up to this multiple of the cost needed to reach the target
+// in one pass; costlier ones wait until their neighbourhood settles
+constexpr float PASS_COST_SLACK = 1.5f;
+// A level has to drop at least this share of its parent's triangles to be kept
+constexpr float MIN_LOD_REDUCTION = 0.15f;
+
+// Symmetric 4x4 quadric as its 10 unique terms, plus the accumulated plane
+// weight so errors can be normalized back into a squared distance
+struct Quadric {
+    double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+    double weight = 0.0;
+
+    static Quadric plane(const glm::vec3& normal, float distance, double plane_weight) {
+        double x = normal.x, y = normal.y, z = normal.z, d = distance;
+        Quadric q;
+        q.a00 = plane_weight * x * x;
+        q.a11 = plane_weight * y * y;
+        q.a22 = plane_weight * z * z;
+        q.a01 = plane_weight * x * y;
+        q.a02 = plane_weight * x * z;
+        q.a12 = plane_weight * y * z;
+        q.b0 = plane_weight * x * d;
+        q.b1 = plane_weight * y * d;
+        q.b2 = plane_weight * z * d;
+        q.c = plane_weight * d * d;
+        q.weight = plane_weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        a00 += other.a00;
+        a11 += other.a11;
+        a22 += other.a22;
+        a01 += other.a01;
+        a02 += other.a02;
+        a12 += other.a12;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        return *this;
+    }
+
+    // Weighted mean squared distance of a point to the accumulated planes
+    double error(const glm::vec3& point) const {
+        double x = point.x, y = point.y, z = point.z;
+        double result = a00 * x * x + a11 * y * y + a22 * z * z +
+                        2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                        2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        if (weight > 0.0) {
+            result /= weight;
+        }
+        return std::max(result, 0.0);
+    }
+};
+
+enum class VertexKind : uint8_t {
+    Manifold,  // interior vertex with a single set of attributes, free to move
+    Border,    // on one open boundary loop, may only slide along it
+    Seam,      // two sets of attributes split along one seam line, both slide along it together
+    Locked     // seam end, crossing or non-manifold, never moves
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    float cost;
+};
+
+uint64_t edge_key(uint32_t a, uint32_t b) {
+    if (a > b) {
+        std::swap(a, b);
+    }
+    return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+glm::vec3 triangle_normal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+// Distance from p to the closest point of triangle abc, by the region of the
+// triangle that point falls in (Ericson, Real-Time Collision Detection 5.1.5)
+float point_triangle_distance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        return glm::length(ap);
+    }
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        return glm::length(bp);
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return glm::length(ap - ab * (d1 / (d1 - d3)));
+    }
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        return glm::length(cp);
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return glm::length(ap - ac * (d2 / (d2 - d6)));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        return glm::length(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    }
+
+    float denominator = va + vb + vc;
+    if (denominator == 0.0f) {
+        // Degenerate triangle, fall back to its corners
+        return std::min({glm::length(ap), glm::length(bp), glm::length(cp)});
+    }
+    float v = vb / denominator;
+    float w = vc / denominator;
+    return glm::length(ap - ab * v - ac * w);
+}
+
+class Simplifier {
+public:
+    // Constructor, copies the index buffer so the caller's stays untouched
+    Simplifier(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t index_count);
+
+    // Collapse edges until at most target_triangles remain or nothing can go
+    void run(size_t target_triangles);
+
+    size_t triangle_count() const { return live_triangles; }
+    // Largest distance from a full detail vertex to the simplified surface,
+    // measured against the triangles near the vertex it collapsed into
+    float error();
+    std::vector<uint32_t> indices() const;
+
+private:
+    const std::vector<Vertex>& vertices;
+    std::vector<uint32_t> triangles;
+    std::vector<uint8_t> dead;
+    std::vector<std::vector<uint32_t>> adjacency;
+    std::vector<Quadric> quadrics;
+    // Vertex each vertex collapsed into, itself while it is still in use;
+    // unreferenced vertices are UNUSED
+    std::vector<uint32_t> collapsed_into;
+    // Vertices sharing a position share an id; classification works on those
+    std::vector<uint32_t> position_ids;
+    std::vector<VertexKind> kinds;
+    std::vector<uint64_t> border_edges;
+    // Index space edges used by one triangle; those whose positions are not
+    // on a border run along a seam
+    std::vector<uint64_t> open_edges;
+    // The other vertex at a seam vertex's position
+    std::vector<uint32_t> seam_twins;
+    size_t live_triangles = 0;
+
+    void assign_position_ids();
+    void classify();
+    void add_quadrics();
+    bool collapse_pass(size_t target_triangles);
+    bool is_border_edge(uint32_t a, uint32_t b) const;
+    bool is_open_edge(uint32_t a, uint32_t b) const;
+    bool can_collapse(uint32_t from, uint32_t to) const;
+    uint32_t seam_target(uint32_t from, uint32_t to) const;
+    float collapse_cost(uint32_t from, uint32_t to) const;
+    bool flips(uint32_t from, uint32_t to) const;
+    void apply(uint32_t from, uint32_t to);
+    uint32_t representative(uint32_t vertex);
+};
+
+Simplifier::Simplifier(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t index_count)
+        : vertices(vertices), triangles(indices, indices + index_count - index_count % 3),
+          adjacency(vertices.size()) {
+    size_t triangle_total = triangles.size() / 3;
+    dead.assign(triangle_total, 0);
+
+    for (size_t t = 0; t < triangle_total; ++t) {
+        const uint32_t* corners = &triangles[t * 3];
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) {
+            dead[t] = 1;
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            adjacency[corners[k]].push_back(static_cast<uint32_t>(t));
+        }
+        ++live_triangles;
+    }
+
+    collapsed_into.assign(vertices.size(), UNUSED);
+    for (uint32_t v = 0; v < vertices.size(); ++v) {
+        if (!adjacency[v].empty()) {
+            collapsed_into[v] = v;
+        }
+    }
+
+    assign_position_ids();
+    classify();
+    add_quadrics();
+}
+
+void Simplifier::assign_position_ids() {
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+
+    auto less = [this](uint32_t a, uint32_t b) {
+        const glm::vec3& pa = vertices[a].position;
+        const glm::vec3& pb = vertices[b].position;
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        return pa.z < pb.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    position_ids.resize(vertices.size());
+    uint32_t next_id = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i > 0 && less(order[i - 1], order[i])) {
+            ++next_id;
+        }
+        position_ids[order[i]] = next_id;
+    }
+    kinds.resize(vertices.empty() ? 0 : next_id + 1);
+}
+
+void Simplifier::classify() {
+    std::fill(kinds.begin(), kinds.end(), VertexKind::Manifold);
+
+    // Count how many triangles use each position space and index space edge
+    std::vector<uint64_t> edges;
+    edges.reserve(live_triangles * 3);
+    std::vector<uint64_t> index_edges;
+    index_edges.reserve(live_triangles * 3);
+    // First two vertices found at each position; a third is never a seam
+    std::vector<uint32_t> wedges(kinds.size() * 2, UNUSED);
+
+    for (size_t t = 0; t < dead.size(); ++t) {
+        if (dead[t]) {
+            continue;
+        }
+        const uint32_t* corners = &triangles[t * 3];
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = position_ids[corners[k]];
+            uint32_t b = position_ids[corners[(k + 1) % 3]];
+            if (a != b) {
+                edges.push_back(edge_key(a, b));
+            }
+            index_edges.push_back(edge_key(corners[k], corners[(k + 1) % 3]));
+
+            // More than one vertex at the same position splits attributes
+            uint32_t* slots = &wedges[a * 2];
+            if (slots[0] == UNUSED) {
+                slots[0] = corners[k];
+            } else if (slots[0] != corners[k]) {
+                if (slots[1] == UNUSED) {
+                    slots[1] = corners[k];
+                } else if (slots[1] != corners[k]) {
+                    kinds[a] = VertexKind::Locked;
+                }
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::sort(index_edges.begin(), index_edges.end());
+
+    std::vector<uint8_t> open_degree(vertices.size(), 0);
+    open_edges.clear();
+    for (size_t i = 0; i < index_edges.size();) {
+        size_t run_end = i + 1;
+        while (run_end < index_edges.size() && index_edges[run_end] == index_edges[i]) {
+            ++run_end;
+        }
+        if (run_end - i == 1) {
+            uint32_t a = static_cast<uint32_t>(index_edges[i] >> 32);
+            uint32_t b = static_cast<uint32_t>(index_edges[i]);
+            open_edges.push_back(index_edges[i]);
+            open_degree[a] = static_cast<uint8_t>(std::min(open_degree[a] + 1, 255));
+            open_degree[b] = static_cast<uint8_t>(std::min(open_degree[b] + 1, 255));
+        }
+        i = run_end;
+    }
+
+    std::vector<uint8_t> border_degree(kinds.size(), 0);
+    border_edges.clear();
+    for (size_t i = 0; i < edges.size();) {
+        size_t run_end = i + 1;
+        while (run_end < edges.size() && edges[run_end] == edges[i]) {
+            ++run_end;
+        }
+
+        uint32_t a = static_cast<uint32_t>(edges[i] >> 32);
+        uint32_t b = static_cast<uint32_t>(edges[i]);
+        size_t uses = run_end - i;
+        if (uses == 1) {
+            border_edges.push_back(edges[i]);
+            border_degree[a] = static_cast<uint8_t>(std::min(border_degree[a] + 1, 255));
+            border_degree[b] = static_cast<uint8_t>(std::min(border_degree[b] + 1, 255));
+        } else if (uses > 2) {
+            kinds[a] = VertexKind::Locked;
+            kinds[b] = VertexKind::Locked;
+        }
+        i = run_end;
+    }
+
+    seam_twins.assign(vertices.size(), UNUSED);
+    for (size_t p = 0; p < kinds.size(); ++p) {
+        uint32_t first = wedges[p * 2];
+        uint32_t second = wedges[p * 2 + 1];
+        if (kinds[p] != VertexKind::Manifold || first == UNUSED) {
+            continue;
+        }
+        if (second != UNUSED) {
+            // Two vertices each with the seam passing through them; seam ends,
+            // seams on borders and seams meeting stay put
+            if (border_degree[p] == 0 && open_degree[first] == 2 && open_degree[second] == 2) {
+                kinds[p] = VertexKind::Seam;
+                seam_twins[first] = second;
+                seam_twins[second] = first;
+            } else {
+                kinds[p] = VertexKind::Locked;
+            }
+        } else if (open_degree[first] != border_degree[p]) {
+            // A seam ends here
+            kinds[p] = VertexKind::Locked;
+        } else if (border_degree[p] > 0) {
+            // Vertices where two boundary loops touch cannot slide along either
+            kinds[p] = border_degree[p] == 2 ? VertexKind::Border : VertexKind::Locked;
+        }
+    }
+}
+
+void Simplifier::add_quadrics() {
+    quadrics.assign(vertices.size(), Quadric{});
+
+    for (size_t t = 0; t < dead.size(); ++t) {
+        if (dead[t]) {
+            continue;
+        }
+        const uint32_t* corners = &triangles[t * 3];
+        glm::vec3 p[3] = {vertices[corners[0]].position, vertices[corners[1]].position,
+                          vertices[corners[2]].position};
+
+        glm::vec3 normal = triangle_normal(p[0], p[1], p[2]);
+        float length = glm::length(normal);
+        if (length == 0.0f) {
+            continue;
+        }
+        normal /= length;
+
+        Quadric surface = Quadric::plane(normal, -glm::dot(normal, p[0]), 0.5 * length);
+        for (int k = 0; k < 3; ++k) {
+            quadrics[corners[k]] += surface;
+        }
+
+        // Planes through each open edge, perpendicular to the triangle, keep
+        // border vertices on their outline
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = corners[k];
+            uint32_t b = corners[(k + 1) % 3];
+            if (!is_border_edge(position_ids[a], position_ids[b])) {
+                continue;
+            }
+            glm::vec3 edge = p[(k + 1) % 3] - p[k];
+            glm::vec3 border_normal = glm::cross(edge, normal);
+            float border_length = glm::length(border_normal);
+            if (border_length == 0.0f) {
+                continue;
+            }
+            border_normal /= border_length;
+
+            Quadric border = Quadric::plane(border_normal, -glm::dot(border_normal, p[k]),
+                                            glm::dot(edge, edge) * BORDER_WEIGHT);
+            quadrics[a] += border;
+            quadrics[b] += border;
+        }
+    }
+}
+
+bool Simplifier::is_border_edge(uint32_t a, uint32_t b) const {
+    return std::binary_search(border_edges.begin(), border_edges.end(), edge_key(a, b));
+}
+
+bool Simplifier::is_open_edge(uint32_t a, uint32_t b) const {
+    return std::binary_search(open_edges.begin(), open_edges.end(), edge_key(a, b));
+}
+
+bool Simplifier::can_collapse(uint32_t from, uint32_t to) const {
+    uint32_t from_position = position_ids[from];
+    uint32_t to_position = position_ids[to];
+    if (from_position == to_position) {
+        return false;
+    }
+
+    switch (kinds[from_position]) {
+    case VertexKind::Manifold:
+        return true;
+    case VertexKind::Border:
+        return is_border_edge(from_position, to_position);
+    case VertexKind::Seam:
+        return is_open_edge(from, to) && seam_target(from, to) != UNUSED;
+    default:
+        return false;
+    }
+}
+
+uint32_t Simplifier::seam_target(uint32_t from, uint32_t to) const {
+    // The twin has to follow along its own side of the same seam edge
+    uint32_t twin = seam_twins[from];
+    uint32_t to_position = position_ids[to];
+    for (uint32_t t : adjacency[twin]) {
+        if (dead[t]) {
+            continue;
+        }
+        const uint32_t* corners = &triangles[t * 3];
+        for (int k = 0; k < 3; ++k) {
+            if (position_ids[corners[k]] == to_position && is_open_edge(twin, corners[k])) {
+                return corners[k];
+            }
+        }
+    }
+    return UNUSED;
+}
+
+float Simplifier::collapse_cost(uint32_t from, uint32_t to) const {
+    double cost = quadrics[from].error(vertices[to].position);
+    if (kinds[position_ids[from]] == VertexKind::Seam) {
+        uint32_t twin_to = seam_target(from, to);
+        cost = std::max(cost, quadrics[seam_twins[from]].error(vertices[twin_to].position));
+    }
+    return static_cast<float>(cost);
+}
+
+bool Simplifier::flips(uint32_t from, uint32_t to) const {
+    const glm::vec3& target = vertices[to].position;
+
+    for (uint32_t t : adjacency[from]) {
+        if (dead[t]) {
+            continue;
+        }
+        const uint32_t* corners = &triangles[t * 3];
+        if (corners[0] == to || corners[1] == to || corners[2] == to) {
+            // Collapses to nothing
+            continue;
+        }
+
+        glm::vec3 p[3] = {vertices[corners[0]].position, vertices[corners[1]].position,
+                          vertices[corners[2]].position};
+        glm::vec3 before = triangle_normal(p[0], p[1], p[2]);
+        for (int k = 0; k < 3; ++k) {
+            if (corners[k] == from) {
+                p[k] = target;
+            }
+        }
+        glm::vec3 after = triangle_normal(p[0], p[1], p[2]);
+
+        if (glm::dot(before, after) < MIN_NORMAL_COSINE * glm::length(before) * glm::length(after)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Simplifier::apply(uint32_t from, uint32_t to) {
+    std::vector<uint32_t>& target_adjacency = adjacency[to];
+
+    for (uint32_t t : adjacency[from]) {
+        if (dead[t]) {
+            continue;
+        }
+        uint32_t* corners = &triangles[t * 3];
+        bool touches_target = corners[0] == to || corners[1] == to || corners[2] == to;
+        for (int k = 0; k < 3; ++k) {
+            if (corners[k] == from) {
+                corners[k] = to;
+            }
+        }
+
+        if (touches_target) {
+            dead[t] = 1;
+            --live_triangles;
+        } else {
+            target_adjacency.push_back(t);
+        }
+    }
+    std::vector<uint32_t>().swap(adjacency[from]);
+
+    target_adjacency.erase(std::remove_if(target_adjacency.begin(), target_adjacency.end(),
+                                          [this](uint32_t t) { return dead[t] != 0; }),
+                           target_adjacency.end());
+
+    quadrics[to] += quadrics[from];
+    collapsed_into[from] = to;
+}
+
+uint32_t Simplifier::representative(uint32_t vertex) {
+    uint32_t root = vertex;
+    while (collapsed_into[root] != root) {
+        root = collapsed_into[root];
+    }
+    // Shorten the chain for the next lookup
+    while (collapsed_into[vertex] != root) {
+        vertex = std::exchange(collapsed_into[vertex], root);
+    }
+    return root;
+}
+
+float Simplifier::error() {
+    // Group the moved vertices by what they collapsed into
+    std::vector<uint32_t> first(vertices.size() + 1, 0);
+    std::vector<uint32_t> roots(vertices.size(), UNUSED);
+    for (uint32_t v = 0; v < vertices.size(); ++v) {
+        if (collapsed_into[v] == UNUSED) {
+            continue;
+        }
+        uint32_t r = representative(v);
+        if (r != v) {
+            roots[v] = r;
+            ++first[r + 1];
+        }
+    }
+    std::partial_sum(first.begin(), first.end(), first.begin());
+    std::vector<uint32_t> moved(first.back());
+    std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+    for (uint32_t v = 0; v < vertices.size(); ++v) {
+        if (roots[v] != UNUSED) {
+            moved[cursor[roots[v]]++] = v;
+        }
+    }
+
+    // The surface that replaced a vertex lies around what it collapsed into.
+    // The fan alone can miss it on flat areas, so a vertex the fan leaves
+    // further off than the running maximum is searched one ring further
+    auto distance_to = [&](const glm::vec3& point, const std::vector<uint32_t>& candidates) {
+        float distance = std::numeric_limits<float>::max();
+        for (uint32_t t : candidates) {
+            const uint32_t* corners = &triangles[t * 3];
+            distance = std::min(distance, point_triangle_distance(point, vertices[corners[0]].position,
+                                                                  vertices[corners[1]].position,
+                                                                  vertices[corners[2]].position));
+        }
+        return static_cast<double>(distance);
+    };
+
+    std::vector<uint32_t> stamps(dead.size(), UNUSED);
+    std::vector<uint32_t> fan;
+    std::vector<uint32_t> ring;
+    double max_distance = 0.0;
+    for (uint32_t r = 0; r < vertices.size(); ++r) {
+        if (first[r] == first[r + 1]) {
+            continue;
+        }
+
+        fan.clear();
+        for (uint32_t t : adjacency[r]) {
+            if (!dead[t]) {
+                fan.push_back(t);
+            }
+        }
+        if (fan.empty()) {
+            continue;
+        }
+
+        ring.clear();
+        for (uint32_t m = first[r]; m < first[r + 1]; ++m) {
+            const glm::vec3& point = vertices[moved[m]].position;
+            if (distance_to(point, fan) <= max_distance) {
+                continue;
+            }
+            if (ring.empty()) {
+                for (uint32_t t : fan) {
+                    for (int k = 0; k < 3; ++k) {
+                        for (uint32_t neighbour : adjacency[triangles[t * 3 + k]]) {
+                            if (!dead[neighbour] && stamps[neighbour] != r) {
+                                stamps[neighbour] = r;
+                                ring.push_back(neighbour);
+                            }
+                        }
+                    }
+                }
+            }
+            max_distance = std::max(max_distance, distance_to(point, ring));
+        }
+    }
+    return static_cast<float>(max_distance);
+}
+
+bool Simplifier::collapse_pass(size_t target_triangles) {
+    classify();
+
+    std::vector<uint64_t> edges;
+    edges.reserve(live_triangles * 3);
+    for (size_t t = 0; t < dead.size(); ++t) {
+        if (dead[t]) {
+            continue;
+        }
+        const uint32_t* corners = &triangles[t * 3];
+        for (int k = 0; k < 3; ++k) {
+            edges.push_back(edge_key(corners[k], corners[(k + 1) % 3]));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // Cheapest direction of every edge that may collapse at all
+    std::vector<Collapse> candidates;
+    candidates.reserve(edges.size());
+    for (uint64_t key : edges) {
+        uint32_t a = static_cast<uint32_t>(key >> 32);
+        uint32_t b = static_cast<uint32_t>(key);
+
+        Collapse best{UNUSED, UNUSED, std::numeric_limits<float>::max()};
+        if (can_collapse(a, b)) {
+            best = {a, b, collapse_cost(a, b)};
+        }
+        if (can_collapse(b, a)) {
+            float cost = collapse_cost(b, a);
+            if (cost < best.cost) {
+                best = {b, a, cost};
+            }
+        }
+        if (best.from != UNUSED) {
+            candidates.push_back(best);
+        }
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+    // Each collapse removes about two triangles
+    size_t needed = (live_triangles - target_triangles) / 2 + 1;
+    float cost_limit = candidates[std::min(needed, candidates.size()) - 1].cost * PASS_COST_SLACK;
+
+    // A vertex takes part in one collapse per pass, so every cost used below
+    // was computed on the neighbourhood as it still is
+    std::vector<uint8_t> touched(vertices.size(), 0);
+    size_t applied = 0;
+    for (const Collapse& collapse : candidates) {
+        if (live_triangles <= target_triangles || collapse.cost > cost_limit) {
+            break;
+        }
+        if (touched[collapse.from] || touched[collapse.to] || flips(collapse.from, collapse.to)) {
+            continue;
+        }
+
+        // Seam vertices collapse with their twin onto the matching vertex on
+        // the twin's side, so the seam stays closed
+        uint32_t twin = UNUSED;
+        uint32_t twin_to = UNUSED;
+        if (kinds[position_ids[collapse.from]] == VertexKind::Seam) {
+            twin = seam_twins[collapse.from];
+            twin_to = seam_target(collapse.from, collapse.to);
+            if (touched[twin] || twin_to == UNUSED || touched[twin_to] || flips(twin, twin_to)) {
+                continue;
+            }
+        }
+
+        apply(collapse.from, collapse.to);
+        touched[collapse.from] = 1;
+        touched[collapse.to] = 1;
+        if (twin != UNUSED) {
+            apply(twin, twin_to);
+            touched[twin] = 1;
+            touched[twin_to] = 1;
+        }
+        ++applied;
+    }
+    return applied > 0;
+}
+
+void Simplifier::run(size_t target_triangles) {
+    while (live_triangles > target_triangles) {
+        if (!collapse_pass(target_triangles)) {
+            break;
+        }
+    }
+}
+
+std::vector<uint32_t> Simplifier::indices() const {
+    std::vector<uint32_t> result;
+    result.reserve(live_triangles * 3);
+    for (size_t t = 0; t < dead.size(); ++t) {
+        if (!dead[t]) {
+            result.insert(result.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const uint32_t* indices,
+                                               size_t index_count, size_t target_index_count, float* error) {
+    Simplifier simplifier(vertices, indices, index_count);
+    simplifier.run(target_index_count / 3);
+    if (error) {
+        *error = simplifier.error();
+    }
+    return simplifier.indices();
+}
+
+void MeshSimplifier::build_lods(MeshData& mesh) {
+    mesh.lods.clear();
+    if (mesh.indices.empty() || mesh.submeshes.size() > 1) {
+        return;
+    }
+
+    size_t base_index_count = mesh.indices.size();
+    mesh.lods.push_back({0, static_cast<uint32_t>(base_index_count), 0.0f});
+
+    // One run with a snapshot per level: every level's error is measured from
+    // the full detail vertices
+    Simplifier simplifier(mesh.vertices, mesh.indices.data(), base_index_count);
+    size_t previous_triangles = base_index_count / 3;
+
+    for (size_t level = 1; level < MAX_LODS; ++level) {
+        size_t target_triangles = previous_triangles / 2;
+        if (target_triangles < MIN_LOD_TRIANGLES) {
+            break;
+        }
+
+        simplifier.run(target_triangles);
+        size_t triangles = simplifier.triangle_count();
+        if (triangles > previous_triangles * (1.0f - MIN_LOD_REDUCTION)) {
+            break;
+        }
+
+        std::vector<uint32_t> lod = simplifier.indices();
+        MeshOptimizer::optimize_vertex_cache(lod.data(), lod.size(), mesh.vertices.size());
+
+        // A coarser level is never selected as more accurate than a finer one
+        float error = std::max(simplifier.error(), mesh.lods.back().error);
+        mesh.lods.push_back({static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lod.size()), error});
+        mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+        previous_triangles = triangles;
+    }
+
+    std::cout << "LOD chain:";
+    for (size_t level = 0; level < mesh.lods.size(); ++level) {
+        std::cout << (level == 0 ? " " : " -> ") << mesh.lods[level].index_count / 3;
+    }
+    std::cout << " triangles, max error " << mesh.lods.back().error << std::endl;
+}
@@ -0,0 +1,267 @@
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+
+// Cones wider than about 84 degrees next to never cull, so they are disabled
+constexpr float MIN_CONE_DOT = 0.1f;
+
+Meshlet make_meshlet(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t index_count,
+                     uint32_t index_offset) {
+    Meshlet meshlet;
+    meshlet.index_offset = index_offset;
+    meshlet.index_count = static_cast<uint32_t>(index_count);
+
+    // Bounding sphere around the box center
+    glm::vec3 min = vertices[indices[0]].position;
+    glm::vec3 max = min;
+    for (size_t i = 1; i < index_count; ++i) {
+        min = glm::min(min, vertices[indices[i]].position);
+        max = glm::max(max, vertices[indices[i]].position);
+    }
+    meshlet.center = (min + max) * 0.5f;
+    for (size_t i = 0; i < index_count; ++i) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+    }
+
+    // Normal cone around the average face normal
+    std::vector<glm::vec3> normals;
+    normals.reserve(index_count / 3);
+    glm::vec3 axis(0.0f);
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        const glm::vec3& p0 = vertices[indices[i]].position;
+        glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - p0, vertices[indices[i + 2]].position - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    float axis_length = glm::length(axis);
+    if (normals.empty() || axis_length == 0.0f) {
+        return meshlet;
+    }
+    axis /= axis_length;
+
+    float min_dot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        min_dot = std::min(min_dot, glm::dot(axis, normal));
+    }
+    if (min_dot <= MIN_CONE_DOT) {
+        return meshlet;
+    }
+
+    // Back facing once the view direction is within 90 degrees minus the cone
+    // angle of the axis: cos(90 - a) = sin(a)
+    meshlet.cone_axis = axis;
+    meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    return meshlet;
+}
+
+class Partitioner {
+public:
+    // Constructor
+    explicit Partitioner(MeshData& mesh) : mesh(mesh), local_ids(mesh.vertices.size(), UNUSED) {}
+
+    // Greedily grow meshlets over the triangles of one index range, always
+    // preferring the neighbour that adds the fewest new vertices
+    void partition(uint32_t offset, uint32_t count);
+
+private:
+    MeshData& mesh;
+    // Global to range local vertex ids, UNUSED outside the current range
+    std::vector<uint32_t> local_ids;
+};
+
+void Partitioner::partition(uint32_t offset, uint32_t count) {
+    size_t triangle_count = count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+    uint32_t* range = mesh.indices.data() + offset;
+
+    std::vector<uint32_t> globals;
+    std::vector<uint32_t> corners(triangle_count * 3);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        uint32_t& local = local_ids[range[i]];
+        if (local == UNUSED) {
+            local = static_cast<uint32_t>(globals.size());
+            globals.push_back(range[i]);
+        }
+        corners[i] = local;
+    }
+
+    // Vertex to triangle adjacency; the first live_counts[v] entries of each
+    // list are the triangles not emitted yet
+    std::vector<uint32_t> live_counts(globals.size(), 0);
+    for (uint32_t vertex : corners) {
+        ++live_counts[vertex];
+    }
+    std::vector<uint32_t> list_offsets(globals.size() + 1, 0);
+    for (size_t v = 0; v < globals.size(); ++v) {
+        list_offsets[v + 1] = list_offsets[v] + live_counts[v];
+    }
+    std::vector<uint32_t> adjacency(corners.size());
+    std::vector<uint32_t> fill(list_offsets.begin(), list_offsets.end() - 1);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        adjacency[fill[corners[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint8_t> emitted(triangle_count, 0);
+    std::vector<uint32_t> meshlet_marker(globals.size(), UNUSED);
+    // Slot of each vertex in meshlet_vertices, valid while its marker matches
+    std::vector<uint32_t> meshlet_slots(globals.size(), 0);
+    std::vector<uint32_t> meshlet_vertices;
+    meshlet_vertices.reserve(MeshletBuilder::MAX_VERTICES);
+    // Current meshlet's triangles as slots, for the cache pass in flush()
+    std::vector<uint32_t> meshlet_corners;
+    meshlet_corners.reserve(MeshletBuilder::MAX_TRIANGLES * 3);
+    uint32_t meshlet_id = 0;
+    size_t meshlet_triangles = 0;
+    size_t meshlet_start = 0;
+    size_t seed = 0;
+
+    std::vector<uint32_t> output;
+    output.reserve(corners.size());
+
+    auto new_vertices = [&](uint32_t triangle) {
+        size_t result = 0;
+        for (int k = 0; k < 3; ++k) {
+            result += meshlet_marker[corners[triangle * 3 + k]] != meshlet_id;
+        }
+        return result;
+    };
+
+    auto pick_neighbour = [&](size_t& best_new) {
+        uint32_t best = UNUSED;
+        best_new = 4;
+        for (uint32_t vertex : meshlet_vertices) {
+            const uint32_t* list = &adjacency[list_offsets[vertex]];
+            for (uint32_t i = 0; i < live_counts[vertex]; ++i) {
+                size_t added = new_vertices(list[i]);
+                if (added < best_new) {
+                    best = list[i];
+                    best_new = added;
+                    if (added == 0) {
+                        return best;
+                    }
+                }
+            }
+        }
+        return best;
+    };
+
+    auto flush = [&]() {
+        if (meshlet_triangles == 0) {
+            return;
+        }
+
+        // Growth order follows adjacency, not the cache; restore a cache
+        // friendly order inside the meshlet, which is tiny in slot space
+        MeshOptimizer::optimize_vertex_cache(meshlet_corners.data(), meshlet_corners.size(),
+                                             meshlet_vertices.size());
+        for (size_t i = 0; i < meshlet_corners.size(); ++i) {
+            output[meshlet_start + i] = globals[meshlet_vertices[meshlet_corners[i]]];
+        }
+        meshlet_corners.clear();
+
+        mesh.meshlets.push_back(make_meshlet(mesh.vertices, output.data() + meshlet_start,
+                                             output.size() - meshlet_start,
+                                             offset + static_cast<uint32_t>(meshlet_start)));
+        ++meshlet_id;
+        meshlet_vertices.clear();
+        meshlet_triangles = 0;
+        meshlet_start = output.size();
+    };
+
+    for (size_t done = 0; done < triangle_count; ++done) {
+        size_t added = 0;
+        uint32_t triangle = pick_neighbour(added);
+        if (triangle == UNUSED) {
+            // Nothing connected left, continue with the next triangle in the
+            // input order, which the cache optimizer already made local
+            while (emitted[seed]) {
+                ++seed;
+            }
+            triangle = static_cast<uint32_t>(seed);
+            added = new_vertices(triangle);
+        }
+
+        if (meshlet_vertices.size() + added > MeshletBuilder::MAX_VERTICES ||
+            meshlet_triangles + 1 > MeshletBuilder::MAX_TRIANGLES) {
+            flush();
+        }
+
+        emitted[triangle] = 1;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t vertex = corners[triangle * 3 + k];
+
+            // Swap the triangle out of the vertex's live list
+            uint32_t* list = &adjacency[list_offsets[vertex]];
+            uint32_t& live = live_counts[vertex];
+            for (uint32_t i = 0; i < live; ++i) {
+                if (list[i] == triangle) {
+                    std::swap(list[i], list[live - 1]);
+                    --live;
+                    break;
+                }
+            }
+
+            if (meshlet_marker[vertex] != meshlet_id) {
+                meshlet_marker[vertex] = meshlet_id;
+                meshlet_slots[vertex] = static_cast<uint32_t>(meshlet_vertices.size());
+                meshlet_vertices.push_back(vertex);
+            }
+            meshlet_corners.push_back(meshlet_slots[vertex]);
+            output.push_back(globals[vertex]);
+        }
+        ++meshlet_triangles;
+    }
+    flush();
+
+    std::copy(output.begin(), output.end(), range);
+    for (uint32_t vertex : globals) {
+        local_ids[vertex] = UNUSED;
+    }
+}
+
+} // namespace
+
+void MeshletBuilder::build(MeshData& mesh) {
+    mesh.meshlets.clear();
+    if (mesh.indices.empty()) {
+        return;
+    }
+    if (mesh.lods.empty()) {
+        mesh.lods.push_back({0, static_cast<uint32_t>(mesh.indices.size()), 0.0f});
+    }
+
+    Partitioner partitioner(mesh);
+    for (size_t level = 0; level < mesh.lods.size(); ++level) {
+        MeshLod& lod = mesh.lods[level];
+        lod.meshlet_offset = static_cast<uint32_t>(mesh.meshlets.size());
+
+        // Keep the full detail submeshes apart so a meshlet never mixes materials
+        if (level == 0 && !mesh.submeshes.empty()) {
+            for (const Submesh& submesh : mesh.submeshes) {
+                partitioner.partition(submesh.index_offset, submesh.index_count);
+            }
+        } else {
+            partitioner.partition(lod.index_offset, lod.index_count);
+        }
+
+        lod.meshlet_count = static_cast<uint32_t>(mesh.meshlets.size()) - lod.meshlet_offset;
+    }
+
+    const MeshLod& full = mesh.lods[0];
+    std::cout << "Meshlets: " << full.meshlet_count << " at full detail, "
+              << (full.meshlet_count ? full.index_count / 3.0f / full.meshlet_count : 0.0f)
+              << " triangles each on average" << std::endl;
+}
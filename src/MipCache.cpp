@@ -0,0 +1,157 @@
+#include "MipCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Whether count elements at offset fit in size bytes, without the sum ever
+// wrapping
+bool blob_fits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t size) {
+    return offset <= size && count <= (size - offset) / element_size;
+}
+
+bool source_state(const std::string& source_path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    size = std::filesystem::file_size(source_path, error);
+    if (error) {
+        return false;
+    }
+    time = std::filesystem::last_write_time(source_path, error).time_since_epoch().count();
+    return !error;
+}
+
+} // namespace
+
+std::string MipCache::cache_path_for(const std::string& source_path) {
+    return source_path + ".mipcache";
+}
+
+bool MipCache::write(const std::string& cache_path, const MipChain& chain, const std::string& source_path,
+                     MipFilter filter, bool srgb) {
+    if (chain.levels.empty()) {
+        std::cerr << "ERROR::MIP_CACHE::EMPTY_CHAIN: " << source_path << std::endl;
+        return false;
+    }
+
+    MipCacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.filter = static_cast<uint32_t>(filter);
+    header.srgb = srgb ? 1 : 0;
+    header.width = static_cast<uint32_t>(chain.levels[0].width);
+    header.height = static_cast<uint32_t>(chain.levels[0].height);
+    header.level_count = static_cast<uint32_t>(chain.levels.size());
+    header.level_offset = sizeof(MipCacheHeader);
+    header.pixel_offset = align_up(header.level_offset + header.level_count * sizeof(MipCacheLevel), BLOB_ALIGNMENT);
+    header.pixel_size = chain.pixels.size();
+    if (!source_state(source_path, header.source_size, header.source_time)) {
+        std::cerr << "ERROR::MIP_CACHE::SOURCE_NOT_FOUND: " << source_path << std::endl;
+        return false;
+    }
+
+    std::vector<MipCacheLevel> levels;
+    for (const MipLevel& level : chain.levels) {
+        levels.push_back({static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), level.offset});
+    }
+
+    // Write next to the final name and rename, so a crash never leaves a
+    // half written cache that looks valid
+    std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::MIP_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(levels.data()),
+                  static_cast<std::streamsize>(levels.size() * sizeof(MipCacheLevel)));
+        static const char zeros[BLOB_ALIGNMENT] = {};
+        out.write(zeros, static_cast<std::streamsize>(header.pixel_offset - static_cast<uint64_t>(out.tellp())));
+        out.write(reinterpret_cast<const char*>(chain.pixels.data()),
+                  static_cast<std::streamsize>(chain.pixels.size()));
+
+        if (!out) {
+            std::cerr << "ERROR::MIP_CACHE::CANNOT_WRITE: " << cache_path << std::endl;
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error) {
+        std::cerr << "ERROR::MIP_CACHE::CANNOT_WRITE: " << cache_path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+MipCache::MipCache(const std::string& cache_path) {
+    std::error_code error;
+    if (!std::filesystem::exists(cache_path, error)) {
+        return;
+    }
+
+    file = MappedFile(cache_path);
+    if (!file.is_open() || file.size() < sizeof(MipCacheHeader)) {
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const MipCacheHeader*>(file.data());
+    bool valid = std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) == 0 && candidate->version == VERSION &&
+                 candidate->level_count > 0 && candidate->level_offset % alignof(MipCacheLevel) == 0 &&
+                 blob_fits(candidate->level_offset, candidate->level_count, sizeof(MipCacheLevel), file.size()) &&
+                 blob_fits(candidate->pixel_offset, candidate->pixel_size, 1, file.size());
+    if (valid) {
+        // Every level has to fit inside the pixel blob
+        const auto* levels = reinterpret_cast<const MipCacheLevel*>(file.data() + candidate->level_offset);
+        for (uint32_t i = 0; i < candidate->level_count && valid; ++i) {
+            valid = levels[i].width > 0 && levels[i].height > 0 &&
+                    levels[i].width <= candidate->pixel_size / 4 / levels[i].height &&
+                    blob_fits(levels[i].offset, static_cast<uint64_t>(levels[i].width) * levels[i].height, 4,
+                              candidate->pixel_size);
+        }
+    }
+    if (!valid) {
+        std::cerr << "Warning: ignoring invalid or outdated mip cache " << cache_path << std::endl;
+        return;
+    }
+
+    header = candidate;
+}
+
+bool MipCache::is_up_to_date(const std::string& source_path, MipFilter filter, bool srgb) const {
+    uint64_t size = 0;
+    int64_t time = 0;
+    if (!is_valid() || !source_state(source_path, size, time)) {
+        return false;
+    }
+    return size == header->source_size && time == header->source_time &&
+           header->filter == static_cast<uint32_t>(filter) && header->srgb == (srgb ? 1u : 0u);
+}
+
+std::vector<MipLevel> MipCache::levels() const {
+    const auto* table = reinterpret_cast<const MipCacheLevel*>(file.data() + header->level_offset);
+    std::vector<MipLevel> result;
+    for (uint32_t i = 0; i < header->level_count; ++i) {
+        size_t bytes = static_cast<size_t>(table[i].width) * table[i].height * 4;
+        result.push_back({static_cast<int>(table[i].width), static_cast<int>(table[i].height),
+                          static_cast<size_t>(table[i].offset), bytes});
+    }
+    return result;
+}
+
+const unsigned char* MipCache::pixel_data() const {
+    return reinterpret_cast<const unsigned char*>(file.data()) + header->pixel_offset;
+}
@@ -0,0 +1,325 @@
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_GENERATOR_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE
+#endif
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+// Kaiser kernel half width in destination texels and window shape
+constexpr double KAISER_RADIUS = 3.0;
+constexpr double KAISER_ALPHA = 4.0;
+// Destination rows filtered together; their source rows are decoded and
+// filtered horizontally once into a band that stays in cache
+constexpr size_t BAND_ROWS = 32;
+constexpr size_t CHANNELS = 4;
+
+// Byte to float conversions and back, built once
+struct ColorTables {
+    float linear[256];
+    float srgb_to_linear[256];
+    // Linear light quantized to 16 bits to the nearest sRGB byte
+    unsigned char linear_to_srgb[65536];
+
+    ColorTables() {
+        for (int i = 0; i < 256; ++i) {
+            double c = i / 255.0;
+            linear[i] = static_cast<float>(c);
+            srgb_to_linear[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        for (int i = 0; i < 65536; ++i) {
+            double l = i / 65535.0;
+            double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            linear_to_srgb[i] = static_cast<unsigned char>(std::clamp(s * 255.0 + 0.5, 0.0, 255.0));
+        }
+    }
+};
+
+const ColorTables& color_tables() {
+    static const ColorTables tables;
+    return tables;
+}
+
+// Source texels contributing to each destination texel along one axis:
+// indices and weights of destination i sit at [i * taps, (i + 1) * taps).
+// Texels past the edge are clamped, so their weight lands on the border.
+struct AxisWeights {
+    size_t taps = 0;
+    std::vector<int> indices;
+    std::vector<float> weights;
+};
+
+double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64 && term > sum * 1e-16; ++k) {
+        double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+// Kernels take the distance in destination texels
+double box_kernel(double t) {
+    t = std::fabs(t);
+    return t < 0.5 ? 1.0 : (t == 0.5 ? 0.5 : 0.0);
+}
+
+double kaiser_kernel(double t) {
+    if (std::fabs(t) >= KAISER_RADIUS) {
+        return 0.0;
+    }
+    double sinc = t == 0.0 ? 1.0 : std::sin(PI * t) / (PI * t);
+    double x = t / KAISER_RADIUS;
+    return sinc * bessel_i0(KAISER_ALPHA * std::sqrt(1.0 - x * x)) / bessel_i0(KAISER_ALPHA);
+}
+
+// Weights for destination texels [target_first, target_first + target_size)
+// at scale source texels per destination texel
+AxisWeights axis_weights(int source_size, int target_first, int target_size, double scale, MipFilter filter) {
+    AxisWeights axis;
+    if (scale == 1.0) {
+        axis.taps = 1;
+        axis.indices.resize(target_size);
+        for (int i = 0; i < target_size; ++i) {
+            axis.indices[i] = target_first + i;
+        }
+        axis.weights.assign(target_size, 1.0f);
+        return axis;
+    }
+
+    double radius = (filter == MipFilter::Kaiser ? KAISER_RADIUS : 0.5) * scale;
+
+    // Collect the non-zero taps first, then pad every texel to the widest
+    std::vector<std::vector<std::pair<int, double>>> texels(target_size);
+    for (int i = 0; i < target_size; ++i) {
+        double center = (target_first + i + 0.5) * scale - 0.5;
+        int first = static_cast<int>(std::floor(center - radius));
+        int last = static_cast<int>(std::ceil(center + radius));
+        double sum = 0.0;
+        for (int s = first; s <= last; ++s) {
+            double t = (s - center) / scale;
+            double weight = filter == MipFilter::Kaiser ? kaiser_kernel(t) : box_kernel(t);
+            if (weight != 0.0) {
+                texels[i].emplace_back(std::clamp(s, 0, source_size - 1), weight);
+                sum += weight;
+            }
+        }
+        for (auto& tap : texels[i]) {
+            tap.second /= sum;
+        }
+        axis.taps = std::max(axis.taps, texels[i].size());
+    }
+
+    axis.indices.resize(target_size * axis.taps);
+    axis.weights.assign(target_size * axis.taps, 0.0f);
+    for (int i = 0; i < target_size; ++i) {
+        for (size_t k = 0; k < axis.taps; ++k) {
+            size_t tap = std::min(k, texels[i].size() - 1);
+            axis.indices[i * axis.taps + k] = texels[i][tap].first;
+            if (k < texels[i].size()) {
+                axis.weights[i * axis.taps + k] = static_cast<float>(texels[i][k].second);
+            }
+        }
+    }
+    return axis;
+}
+
+void decode_row(const unsigned char* source, int width, const float* color, const float* alpha, float* out) {
+    for (int x = 0; x < width; ++x) {
+        out[x * 4 + 0] = color[source[x * 4 + 0]];
+        out[x * 4 + 1] = color[source[x * 4 + 1]];
+        out[x * 4 + 2] = color[source[x * 4 + 2]];
+        out[x * 4 + 3] = alpha[source[x * 4 + 3]];
+    }
+}
+
+// One RGBA texel per register; the scalar loop does the same operations in
+// the same order
+void filter_row(const float* row, const AxisWeights& axis, int target_width, float* out) {
+    for (int x = 0; x < target_width; ++x) {
+        const int* indices = axis.indices.data() + x * axis.taps;
+        const float* weights = axis.weights.data() + x * axis.taps;
+#if defined(MIP_GENERATOR_SSE)
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(row + indices[0] * CHANNELS));
+        for (size_t k = 1; k < axis.taps; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(row + indices[k] * CHANNELS)));
+        }
+        _mm_storeu_ps(out + x * CHANNELS, sum);
+#else
+        for (size_t c = 0; c < CHANNELS; ++c) {
+            float sum = weights[0] * row[indices[0] * CHANNELS + c];
+            for (size_t k = 1; k < axis.taps; ++k) {
+                sum = sum + weights[k] * row[indices[k] * CHANNELS + c];
+            }
+            out[x * CHANNELS + c] = sum;
+        }
+#endif
+    }
+}
+
+// out[i] = sum of weights[k] * rows[k][i], accumulated in tap order
+void weighted_sum(const float* const* rows, const float* weights, size_t taps, size_t count, float* out) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(rows[0] + i));
+        for (size_t k = 1; k < taps; ++k) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+        _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#if defined(MIP_GENERATOR_SSE)
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(rows[0] + i));
+        for (size_t k = 1; k < taps; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        float sum = weights[0] * rows[0][i];
+        for (size_t k = 1; k < taps; ++k) {
+            sum = sum + weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+unsigned char encode_linear(float value) {
+    return static_cast<unsigned char>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+unsigned char encode_srgb(float value, const ColorTables& tables) {
+    return tables.linear_to_srgb[static_cast<int>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f)];
+}
+
+void encode_row(const float* row, int width, bool srgb, const ColorTables& tables, unsigned char* out) {
+    for (int x = 0; x < width; ++x) {
+        for (size_t c = 0; c < 3; ++c) {
+            float value = row[x * CHANNELS + c];
+            out[x * CHANNELS + c] = srgb ? encode_srgb(value, tables) : encode_linear(value);
+        }
+        out[x * CHANNELS + 3] = encode_linear(row[x * CHANNELS + 3]);
+    }
+}
+
+// Filter one level into rows of the next: source rows are decoded and
+// filtered horizontally into a band, then the band is combined vertically per
+// row. vertical holds the weights of the target_height rows written.
+template <typename SourceRow>
+void downsample(const SourceRow& source_row, int source_width, unsigned char* target, int target_width,
+                int target_height, const AxisWeights& horizontal, const AxisWeights& vertical, bool srgb) {
+    const ColorTables& tables = color_tables();
+    const float* color = srgb ? tables.srgb_to_linear : tables.linear;
+    size_t row_floats = static_cast<size_t>(target_width) * CHANNELS;
+
+    ThreadPool::shared().parallel_for(target_height, [&](size_t begin, size_t end) {
+        std::vector<float> decoded(static_cast<size_t>(source_width) * CHANNELS);
+        std::vector<float> band;
+        std::vector<float> filtered(row_floats);
+        std::vector<const float*> rows(vertical.taps);
+
+        for (size_t band_begin = begin; band_begin < end; band_begin += BAND_ROWS) {
+            size_t band_end = std::min(end, band_begin + BAND_ROWS);
+            const int* first_index = vertical.indices.data() + band_begin * vertical.taps;
+            const int* last_index = vertical.indices.data() + band_end * vertical.taps;
+            int low = *std::min_element(first_index, last_index);
+            int high = *std::max_element(first_index, last_index);
+
+            band.resize(static_cast<size_t>(high - low + 1) * row_floats);
+            for (int s = low; s <= high; ++s) {
+                decode_row(source_row(s), source_width, color, tables.linear, decoded.data());
+                filter_row(decoded.data(), horizontal, target_width, band.data() + (s - low) * row_floats);
+            }
+
+            for (size_t y = band_begin; y < band_end; ++y) {
+                for (size_t k = 0; k < vertical.taps; ++k) {
+                    rows[k] = band.data() + (vertical.indices[y * vertical.taps + k] - low) * row_floats;
+                }
+                weighted_sum(rows.data(), vertical.weights.data() + y * vertical.taps, vertical.taps, row_floats,
+                             filtered.data());
+                encode_row(filtered.data(), target_width, srgb, tables, target + y * row_floats);
+            }
+        }
+    }, BAND_ROWS);
+}
+
+} // namespace
+
+int MipGenerator::level_count(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+MipChain MipGenerator::generate(const unsigned char* rgba, int width, int height, MipFilter filter, bool srgb) {
+    MipChain chain;
+    if (rgba == nullptr || width <= 0 || height <= 0) {
+        return chain;
+    }
+
+    size_t total = 0;
+    int level_width = width;
+    int level_height = height;
+    for (int i = 0; i < level_count(width, height); ++i) {
+        size_t bytes = static_cast<size_t>(level_width) * level_height * CHANNELS;
+        chain.levels.push_back({level_width, level_height, total, bytes});
+        total += bytes;
+        level_width = std::max(level_width / 2, 1);
+        level_height = std::max(level_height / 2, 1);
+    }
+
+    // Each level is read back from the bytes of the one above it
+    chain.pixels.resize(total);
+    std::memcpy(chain.pixels.data(), rgba, static_cast<size_t>(width) * height * CHANNELS);
+    for (size_t i = 1; i < chain.levels.size(); ++i) {
+        const MipLevel& source = chain.levels[i - 1];
+        const MipLevel& target = chain.levels[i];
+        const unsigned char* pixels = chain.pixels.data() + source.offset;
+        auto source_row = [pixels, &source](int y) {
+            return pixels + static_cast<size_t>(y) * source.width * CHANNELS;
+        };
+        AxisWeights horizontal = axis_weights(source.width, 0, target.width,
+                                              static_cast<double>(source.width) / target.width, filter);
+        AxisWeights vertical = axis_weights(source.height, 0, target.height,
+                                            static_cast<double>(source.height) / target.height, filter);
+        downsample(source_row, source.width, chain.pixels.data() + target.offset, target.width, target.height,
+                   horizontal, vertical, srgb);
+    }
+    return chain;
+}
+
+void MipGenerator::downsample_half(const std::function<const unsigned char*(int)>& source_row, int width,
+                                   int height, int first_row, int last_row, MipFilter filter, bool srgb,
+                                   unsigned char* target) {
+    if (last_row <= first_row) {
+        return;
+    }
+    int target_width = (width + 1) / 2;
+    AxisWeights horizontal = axis_weights(width, 0, target_width, 2.0, filter);
+    AxisWeights vertical = axis_weights(height, first_row, last_row - first_row, 2.0, filter);
+    downsample(source_row, width, target, target_width, last_row - first_row, horizontal, vertical, srgb);
+}
+
+void MipGenerator::half_source_rows(int height, int first_row, int last_row, MipFilter filter, int& low,
+                                    int& high) {
+    AxisWeights vertical = axis_weights(height, first_row, last_row - first_row, 2.0, filter);
+    low = *std::min_element(vertical.indices.begin(), vertical.indices.end());
+    high = *std::max_element(vertical.indices.begin(), vertical.indices.end()) + 1;
+}
@@ -0,0 +1,992 @@
+#include "ModelLoader.h"
+#include "AssetPack.h"
+#include "MeshBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "NormalGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <string>
+
+namespace {
+
+// Chunks smaller than this are not worth a thread
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+struct ObjChunk {
+    std::string_view text;
+
+    // Attributes declared inside this chunk
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> tex_coords;
+    size_t triangle_count = 0;
+
+    // Offsets of this chunk's data in the merged arrays
+    size_t position_base = 0;
+    size_t normal_base = 0;
+    size_t tex_coord_base = 0;
+    size_t triangle_base = 0;
+};
+
+inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+inline const char* parse_float(const char* p, const char* end, float& value) {
+    p = skip_spaces(p, end);
+    if (p < end && *p == '+') {
+        ++p;
+    }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto [next, error] = std::from_chars(p, end, value);
+    return error == std::errc() ? next : nullptr;
+#else
+    // Standard libraries without floating point from_chars
+    char buffer[64];
+    size_t length = 0;
+    while (p + length < end && length < sizeof(buffer) - 1 && p[length] > ' ') {
+        buffer[length] = p[length];
+        ++length;
+    }
+    buffer[length] = '\0';
+    char* parsed_end = nullptr;
+    value = std::strtof(buffer, &parsed_end);
+    return parsed_end == buffer ? nullptr : p + (parsed_end - buffer);
+#endif
+}
+
+inline const char* parse_index(const char* p, const char* end, int64_t& value) {
+    auto [next, error] = std::from_chars(p, end, value);
+    return error == std::errc() ? next : nullptr;
+}
+
+// Split the text into roughly equal pieces that start at the beginning of a line
+std::vector<ObjChunk> split_into_chunks(std::string_view text, size_t chunk_count) {
+    std::vector<ObjChunk> chunks;
+    size_t chunk_size = text.size() / chunk_count;
+    size_t begin = 0;
+
+    while (begin < text.size()) {
+        size_t end = std::min(begin + chunk_size, text.size());
+        if (end < text.size()) {
+            size_t newline = text.find('\n', end);
+            end = (newline == std::string_view::npos) ? text.size() : newline + 1;
+        }
+
+        ObjChunk chunk;
+        chunk.text = text.substr(begin, end - begin);
+        chunks.push_back(std::move(chunk));
+        begin = end;
+    }
+    return chunks;
+}
+
+template <typename Fn>
+void for_each_line(std::string_view text, Fn&& fn) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!line_end) {
+            line_end = end;
+        }
+        const char* start = skip_spaces(p, line_end);
+        if (start < line_end) {
+            fn(start, line_end);
+        }
+        p = line_end + 1;
+    }
+}
+
+// First pass: parse attributes and count triangles
+void parse_attributes(ObjChunk& chunk) {
+    for_each_line(chunk.text, [&chunk](const char* p, const char* end) {
+        if (p[0] == 'v' && end - p > 1) {
+            if (p[1] == ' ' || p[1] == '\t') {
+                glm::vec3 position(0.0f);
+                const char* q = p + 2;
+                for (int i = 0; i < 3 && q; ++i) {
+                    q = parse_float(q, end, position[i]);
+                }
+                chunk.positions.push_back(position);
+            } else if (p[1] == 'n') {
+                glm::vec3 normal(0.0f);
+                const char* q = p + 2;
+                for (int i = 0; i < 3 && q; ++i) {
+                    q = parse_float(q, end, normal[i]);
+                }
+                chunk.normals.push_back(normal);
+            } else if (p[1] == 't') {
+                glm::vec2 tex_coord(0.0f);
+                const char* q = p + 2;
+                for (int i = 0; i < 2 && q; ++i) {
+                    q = parse_float(q, end, tex_coord[i]);
+                }
+                chunk.tex_coords.push_back(tex_coord);
+            }
+        } else if (p[0] == 'f' && end - p > 1 && (p[1] == ' ' || p[1] == '\t')) {
+            // Count corners, a polygon with n corners becomes n - 2 triangles
+            size_t corner_count = 0;
+            const char* q = p + 1;
+            while (true) {
+                q = skip_spaces(q, end);
+                if (q >= end || *q == '#') {
+                    break;
+                }
+                ++corner_count;
+                while (q < end && *q != ' ' && *q != '\t' && *q != '\r') {
+                    ++q;
+                }
+            }
+            if (corner_count >= 3) {
+                chunk.triangle_count += corner_count - 2;
+            }
+        }
+    });
+}
+
+// Turn a 1-based or negative OBJ index into a 0-based one, -1 if invalid
+inline int64_t resolve_index(int64_t index, size_t defined_so_far, size_t total) {
+    int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(defined_so_far) + index;
+    return (resolved >= 0 && resolved < static_cast<int64_t>(total)) ? resolved : -1;
+}
+
+struct ObjCorner {
+    int64_t position = -1;
+    int64_t tex_coord = -1;
+    int64_t normal = -1;
+};
+
+// Second pass: resolve faces into interleaved triangle vertices. Corners
+// without a normal get a zero one and are counted in missing_normals.
+size_t build_triangles(const ObjChunk& chunk, const std::vector<glm::vec3>& positions,
+                       const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& tex_coords,
+                       Vertex* output, size_t& missing_normals) {
+    size_t position_count = chunk.position_base;
+    size_t normal_count = chunk.normal_base;
+    size_t tex_coord_count = chunk.tex_coord_base;
+    size_t invalid_references = 0;
+    std::vector<ObjCorner> face;
+    Vertex* out = output + chunk.triangle_base * 3;
+
+    auto emit_vertex = [&](const ObjCorner& corner) {
+        Vertex& vertex = *out++;
+        vertex.position = positions[corner.position];
+        if (corner.normal >= 0) {
+            vertex.normal = normals[corner.normal];
+        } else {
+            vertex.normal = glm::vec3(0.0f);
+            ++missing_normals;
+        }
+        vertex.tex_coords = corner.tex_coord >= 0 ? tex_coords[corner.tex_coord] : glm::vec2(0.0f);
+    };
+
+    for_each_line(chunk.text, [&](const char* p, const char* end) {
+        if (p[0] == 'v' && end - p > 1) {
+            // Track how many attributes exist so far for negative indices
+            if (p[1] == ' ' || p[1] == '\t') {
+                ++position_count;
+            } else if (p[1] == 'n') {
+                ++normal_count;
+            } else if (p[1] == 't') {
+                ++tex_coord_count;
+            }
+            return;
+        }
+        if (p[0] != 'f' || end - p < 2 || (p[1] != ' ' && p[1] != '\t')) {
+            return;
+        }
+
+        face.clear();
+        const char* q = p + 1;
+        while (true) {
+            q = skip_spaces(q, end);
+            if (q >= end || *q == '#') {
+                break;
+            }
+
+            // Corner formats: v, v/vt, v//vn, v/vt/vn
+            ObjCorner corner;
+            int64_t index = 0;
+            const char* next = parse_index(q, end, index);
+            if (next) {
+                corner.position = resolve_index(index, position_count, positions.size());
+                q = next;
+            }
+            if (q < end && *q == '/') {
+                ++q;
+                if (q < end && *q != '/') {
+                    next = parse_index(q, end, index);
+                    if (next) {
+                        corner.tex_coord = resolve_index(index, tex_coord_count, tex_coords.size());
+                        q = next;
+                    }
+                }
+                if (q < end && *q == '/') {
+                    ++q;
+                    next = parse_index(q, end, index);
+                    if (next) {
+                        corner.normal = resolve_index(index, normal_count, normals.size());
+                        q = next;
+                    }
+                }
+            }
+            // Skip anything left in a malformed token
+            while (q < end && *q != ' ' && *q != '\t' && *q != '\r') {
+                ++q;
+            }
+            face.push_back(corner);
+        }
+
+        if (face.size() < 3) {
+            return;
+        }
+
+        // Triangulate as a fan around the first corner
+        for (size_t i = 1; i + 1 < face.size(); ++i) {
+            const ObjCorner& a = face[0];
+            const ObjCorner& b = face[i];
+            const ObjCorner& c = face[i + 1];
+
+            if (a.position < 0 || b.position < 0 || c.position < 0) {
+                // Keep the slot reserved in the first pass, but make it degenerate
+                ++invalid_references;
+                for (int k = 0; k < 3; ++k) {
+                    *out++ = Vertex{glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec2(0.0f)};
+                }
+                continue;
+            }
+
+            emit_vertex(a);
+            emit_vertex(b);
+            emit_vertex(c);
+        }
+    });
+
+    return invalid_references;
+}
+
+template <typename T>
+std::vector<T> merge_attribute(const std::vector<ObjChunk>& chunks, std::vector<T> ObjChunk::*member,
+                               size_t ObjChunk::*base, size_t total) {
+    std::vector<T> merged(total);
+    ThreadPool::shared().parallel_for(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const std::vector<T>& source = chunks[i].*member;
+            std::copy(source.begin(), source.end(), merged.begin() + chunks[i].*base);
+        }
+    });
+    return merged;
+}
+
+// Shared tail of every importer: vertex cache order, LOD chain and meshlets.
+// Returns the full detail triangle count.
+size_t finish_import(MeshData& mesh) {
+    size_t index_count = mesh.indices.size();
+    VertexCacheStats before =
+            MeshOptimizer::analyze_vertex_cache(mesh.indices.data(), index_count, mesh.vertices.size());
+    MeshOptimizer::optimize(mesh);
+    size_t triangle_count = index_count / 3;
+    MeshSimplifier::build_lods(mesh);
+    MeshletBuilder::build(mesh);
+
+    // Meshlets reorder triangles last, so the full detail range is measured
+    // in the order it is drawn
+    VertexCacheStats after =
+            MeshOptimizer::analyze_vertex_cache(mesh.indices.data(), index_count, mesh.vertices.size());
+    std::cout << "Mesh optimized: ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    return triangle_count;
+}
+
+// Remove triangles whose corners share a vertex, in place, keeping the order
+void remove_degenerate_triangles(std::vector<uint32_t>& indices) {
+    size_t kept = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a != b && b != c && a != c) {
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+    }
+    indices.resize(kept);
+}
+
+// Binary STL: 80 byte header, triangle count, then 50 byte records of
+// face normal, three positions and a 16-bit attribute word
+constexpr size_t STL_HEADER_BYTES = 80;
+constexpr size_t STL_RECORD_BYTES = 50;
+constexpr size_t STL_POSITIONS_OFFSET = 12;
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    // Type of the element count for list properties, Invalid otherwise
+    PlyType count_type = PlyType::Invalid;
+    // Byte offset in the record, valid while no list property precedes it
+    size_t offset = 0;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+    // Record size, 0 when the element has list properties
+    size_t stride = 0;
+
+    const PlyProperty* find(std::initializer_list<std::string_view> names) const {
+        for (std::string_view name : names) {
+            for (const PlyProperty& property : properties) {
+                if (property.name == name) {
+                    return &property;
+                }
+            }
+        }
+        return nullptr;
+    }
+};
+
+PlyType ply_type(std::string_view name) {
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+size_t ply_size(PlyType type) {
+    switch (type) {
+    case PlyType::Int8: case PlyType::UInt8: return 1;
+    case PlyType::Int16: case PlyType::UInt16: return 2;
+    case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+    case PlyType::Float64: return 8;
+    default: return 0;
+    }
+}
+
+template <typename T>
+T load_scalar(const char* p, bool swap_bytes) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (swap_bytes) {
+        std::reverse(bytes, bytes + sizeof(T));
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+double read_ply_value(const char* p, PlyType type, bool swap_bytes) {
+    switch (type) {
+    case PlyType::Int8: return static_cast<int8_t>(*p);
+    case PlyType::UInt8: return static_cast<uint8_t>(*p);
+    case PlyType::Int16: return load_scalar<int16_t>(p, swap_bytes);
+    case PlyType::UInt16: return load_scalar<uint16_t>(p, swap_bytes);
+    case PlyType::Int32: return load_scalar<int32_t>(p, swap_bytes);
+    case PlyType::UInt32: return load_scalar<uint32_t>(p, swap_bytes);
+    case PlyType::Float32: return load_scalar<float>(p, swap_bytes);
+    case PlyType::Float64: return load_scalar<double>(p, swap_bytes);
+    default: return 0.0;
+    }
+}
+
+// List indices are read as unsigned; negative values become out of range
+uint32_t read_ply_index(const char* p, PlyType type, bool swap_bytes) {
+    switch (type) {
+    case PlyType::Int8: case PlyType::UInt8: return static_cast<uint8_t>(*p);
+    case PlyType::Int16: case PlyType::UInt16: return load_scalar<uint16_t>(p, swap_bytes);
+    case PlyType::Int32: case PlyType::UInt32: return load_scalar<uint32_t>(p, swap_bytes);
+    default: return static_cast<uint32_t>(read_ply_value(p, type, swap_bytes));
+    }
+}
+
+std::vector<std::string_view> split_words(std::string_view line) {
+    std::vector<std::string_view> words;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') {
+            ++i;
+        }
+        if (i > start) {
+            words.push_back(line.substr(start, i - start));
+        }
+    }
+    return words;
+}
+
+// Parse the text header. On success body_offset points past "end_header".
+bool parse_ply_header(std::string_view data, std::vector<PlyElement>& elements, bool& big_endian,
+                      size_t& body_offset) {
+    if (data.substr(0, 3) != "ply") {
+        std::cerr << "Warning: missing PLY magic" << std::endl;
+        return false;
+    }
+
+    bool has_format = false;
+    size_t line_start = 0;
+    while (line_start < data.size()) {
+        size_t line_end = data.find('\n', line_start);
+        if (line_end == std::string_view::npos) {
+            break;
+        }
+        std::vector<std::string_view> words = split_words(data.substr(line_start, line_end - line_start));
+        line_start = line_end + 1;
+        if (words.empty()) {
+            continue;
+        }
+
+        if (words[0] == "end_header") {
+            body_offset = line_start;
+            if (!has_format) {
+                std::cerr << "Warning: PLY header has no format line" << std::endl;
+            }
+            return has_format;
+        }
+        if (words[0] == "format" && words.size() >= 2) {
+            if (words[1] == "binary_little_endian") {
+                big_endian = false;
+            } else if (words[1] == "binary_big_endian") {
+                big_endian = true;
+            } else {
+                std::cerr << "Warning: only binary PLY is supported, got " << words[1] << std::endl;
+                return false;
+            }
+            has_format = true;
+        } else if (words[0] == "element" && words.size() >= 3) {
+            PlyElement element;
+            element.name = std::string(words[1]);
+            auto [next, error] = std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count);
+            if (error != std::errc()) {
+                std::cerr << "Warning: invalid PLY element count: " << words[2] << std::endl;
+                return false;
+            }
+            elements.push_back(std::move(element));
+        } else if (words[0] == "property" && !elements.empty()) {
+            PlyProperty property;
+            if (words.size() >= 5 && words[1] == "list") {
+                property.count_type = ply_type(words[2]);
+                property.type = ply_type(words[3]);
+                property.name = std::string(words[4]);
+                if (property.count_type == PlyType::Invalid || property.type == PlyType::Invalid) {
+                    std::cerr << "Warning: invalid PLY list property: " << property.name << std::endl;
+                    return false;
+                }
+            } else if (words.size() >= 3) {
+                property.type = ply_type(words[1]);
+                property.name = std::string(words[2]);
+                if (property.type == PlyType::Invalid) {
+                    std::cerr << "Warning: invalid PLY property type: " << words[1] << std::endl;
+                    return false;
+                }
+            } else {
+                continue;
+            }
+            elements.back().properties.push_back(std::move(property));
+        }
+        // comment, obj_info and unknown lines are ignored
+    }
+
+    std::cerr << "Warning: PLY header has no end_header" << std::endl;
+    return false;
+}
+
+// Fill in property offsets and record strides of fixed size elements
+void layout_ply_element(PlyElement& element) {
+    size_t offset = 0;
+    bool fixed = true;
+    for (PlyProperty& property : element.properties) {
+        property.offset = offset;
+        if (property.count_type != PlyType::Invalid) {
+            fixed = false;
+            break;
+        }
+        offset += ply_size(property.type);
+    }
+    element.stride = fixed ? offset : 0;
+}
+
+// Size of one variable length record, or 0 when it runs past end
+size_t ply_record_size(const PlyElement& element, const char* p, const char* end, bool swap_bytes) {
+    const char* start = p;
+    for (const PlyProperty& property : element.properties) {
+        if (property.count_type != PlyType::Invalid) {
+            size_t count_size = ply_size(property.count_type);
+            if (static_cast<size_t>(end - p) < count_size) {
+                return 0;
+            }
+            size_t count = read_ply_index(p, property.count_type, swap_bytes);
+            p += count_size;
+            if (static_cast<size_t>(end - p) < count * ply_size(property.type)) {
+                return 0;
+            }
+            p += count * ply_size(property.type);
+        } else {
+            if (static_cast<size_t>(end - p) < ply_size(property.type)) {
+                return 0;
+            }
+            p += ply_size(property.type);
+        }
+    }
+    return static_cast<size_t>(p - start);
+}
+
+} // namespace
+
+MeshData ModelLoader::load(const std::string& path) {
+    std::string extension = path.substr(std::min(path.size(), path.find_last_of('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == ".obj") {
+        return load_obj(path);
+    }
+    if (extension == ".stl") {
+        return load_stl(path);
+    }
+    if (extension == ".ply") {
+        return load_ply(path);
+    }
+    std::cerr << "ERROR::MODEL::UNSUPPORTED_FORMAT: " << path << std::endl;
+    return {};
+}
+
+MeshData ModelLoader::load_obj(const std::string& path) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    AssetFile file(path);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return {};
+    }
+
+    bool has_normals = false;
+    MeshData soup = parse_obj(file.view(), &has_normals);
+    if (soup.vertices.empty()) {
+        std::cerr << "ERROR::MODEL::NO_TRIANGLES: " << path << std::endl;
+        return soup;
+    }
+
+    // Corners without a normal weld by position and texture coordinate alone
+    // and get smooth normals afterwards, like STL and PLY imports
+    MeshData mesh = MeshBuilder::weld(soup);
+    if (!has_normals) {
+        std::vector<glm::vec3> given(mesh.vertices.size());
+        for (size_t i = 0; i < given.size(); ++i) {
+            given[i] = mesh.vertices[i].normal;
+        }
+        NormalGenerator::compute_normals(mesh);
+        for (size_t i = 0; i < given.size(); ++i) {
+            if (given[i] != glm::vec3(0.0f)) {
+                mesh.vertices[i].normal = given[i];
+            }
+        }
+    }
+    size_t triangle_count = finish_import(mesh);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "Loaded " << path << ": " << triangle_count << " triangles, "
+              << soup.vertices.size() << " -> " << mesh.vertices.size() << " vertices in "
+              << elapsed.count() << " ms" << std::endl;
+    return mesh;
+}
+
+MeshData ModelLoader::parse_obj(std::string_view text, bool* has_normals) {
+    ThreadPool& pool = ThreadPool::shared();
+
+    size_t chunk_count = std::clamp<size_t>(text.size() / MIN_CHUNK_BYTES, 1, pool.size() * 8u);
+    std::vector<ObjChunk> chunks = split_into_chunks(text, chunk_count);
+
+    // Pass 1: attributes and triangle counts, every chunk independently
+    pool.parallel_for(chunks.size(), [&chunks](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            parse_attributes(chunks[i]);
+        }
+    });
+
+    // Prefix sums give each chunk its place in the merged arrays
+    size_t position_total = 0, normal_total = 0, tex_coord_total = 0, triangle_total = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.position_base = position_total;
+        chunk.normal_base = normal_total;
+        chunk.tex_coord_base = tex_coord_total;
+        chunk.triangle_base = triangle_total;
+        position_total += chunk.positions.size();
+        normal_total += chunk.normals.size();
+        tex_coord_total += chunk.tex_coords.size();
+        triangle_total += chunk.triangle_count;
+    }
+
+    std::vector<glm::vec3> positions = merge_attribute(chunks, &ObjChunk::positions, &ObjChunk::position_base, position_total);
+    std::vector<glm::vec3> normals = merge_attribute(chunks, &ObjChunk::normals, &ObjChunk::normal_base, normal_total);
+    std::vector<glm::vec2> tex_coords = merge_attribute(chunks, &ObjChunk::tex_coords, &ObjChunk::tex_coord_base, tex_coord_total);
+    for (ObjChunk& chunk : chunks) {
+        chunk.positions = {};
+        chunk.normals = {};
+        chunk.tex_coords = {};
+    }
+
+    // Pass 2: faces, each chunk writes its own range of the output
+    MeshData mesh;
+    mesh.vertices.resize(triangle_total * 3);
+    std::atomic<size_t> invalid_references{0};
+    std::atomic<size_t> missing_normals{0};
+    pool.parallel_for(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t missing = 0;
+            invalid_references += build_triangles(chunks[i], positions, normals, tex_coords, mesh.vertices.data(),
+                                                  missing);
+            missing_normals += missing;
+        }
+    });
+    if (has_normals) {
+        *has_normals = missing_normals == 0;
+    }
+
+    if (invalid_references > 0) {
+        std::cerr << "Warning: OBJ has " << invalid_references.load()
+                  << " triangles with out of range vertex indices" << std::endl;
+    }
+
+    return mesh;
+}
+
+MeshData ModelLoader::load_stl(const std::string& path) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    AssetFile file(path);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return {};
+    }
+
+    MeshData mesh = parse_stl(file.view());
+    if (mesh.indices.empty()) {
+        std::cerr << "ERROR::MODEL::NO_TRIANGLES: " << path << std::endl;
+        return {};
+    }
+    size_t corner_count = mesh.indices.size();
+
+    NormalGenerator::compute_normals(mesh);
+    size_t triangle_count = finish_import(mesh);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "Loaded " << path << ": " << triangle_count << " triangles, "
+              << corner_count << " -> " << mesh.vertices.size() << " vertices in "
+              << elapsed.count() << " ms" << std::endl;
+    return mesh;
+}
+
+MeshData ModelLoader::parse_stl(std::string_view data) {
+    if (data.size() < STL_HEADER_BYTES + sizeof(uint32_t)) {
+        std::cerr << "Warning: STL is too small for a binary header" << std::endl;
+        return {};
+    }
+
+    uint32_t stored_count = 0;
+    std::memcpy(&stored_count, data.data() + STL_HEADER_BYTES, sizeof(uint32_t));
+    size_t available = (data.size() - STL_HEADER_BYTES - sizeof(uint32_t)) / STL_RECORD_BYTES;
+    size_t triangle_count = stored_count;
+    if (triangle_count > available) {
+        if (data.substr(0, 5) == "solid") {
+            std::cerr << "Warning: STL looks like ASCII, only binary STL is supported" << std::endl;
+            return {};
+        }
+        std::cerr << "Warning: STL is truncated, reading " << available << " of " << stored_count
+                  << " triangles" << std::endl;
+        triangle_count = available;
+    }
+    if (triangle_count == 0 || triangle_count * 3 >= std::numeric_limits<uint32_t>::max()) {
+        return {};
+    }
+
+    // Corners are read straight out of the mapping; welding touches each
+    // record a few times, so no intermediate copy of the soup is made
+    const char* records = data.data() + STL_HEADER_BYTES + sizeof(uint32_t);
+    auto position_at = [records](size_t corner) {
+        float xyz[3];
+        std::memcpy(xyz, records + corner / 3 * STL_RECORD_BYTES + STL_POSITIONS_OFFSET + corner % 3 * sizeof(xyz),
+                    sizeof(xyz));
+        return glm::vec3(xyz[0] + 0.0f, xyz[1] + 0.0f, xyz[2] + 0.0f);
+    };
+
+    // Closed meshes have about half as many vertices as triangles
+    WeldMap weld = MeshBuilder::weld_parallel(triangle_count * 3, position_at, triangle_count / 2 + 1);
+
+    MeshData mesh;
+    mesh.vertices.resize(weld.first.size());
+    ThreadPool::shared().parallel_for(mesh.vertices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mesh.vertices[i] = {position_at(weld.first[i]), glm::vec3(0.0f), glm::vec2(0.0f)};
+        }
+    }, 4096);
+
+    mesh.indices = std::move(weld.remap);
+    remove_degenerate_triangles(mesh.indices);
+    mesh.submeshes.push_back({0, static_cast<uint32_t>(mesh.indices.size())});
+    mesh.compute_bounds();
+    return mesh;
+}
+
+MeshData ModelLoader::load_ply(const std::string& path) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    AssetFile file(path);
+    if (!file.is_open()) {
+        std::cerr << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return {};
+    }
+
+    bool has_normals = false;
+    MeshData mesh = parse_ply(file.view(), &has_normals);
+    if (mesh.indices.empty()) {
+        std::cerr << "ERROR::MODEL::NO_TRIANGLES: " << path << std::endl;
+        return {};
+    }
+
+    if (!has_normals) {
+        NormalGenerator::compute_normals(mesh);
+    }
+    size_t triangle_count = finish_import(mesh);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time);
+    std::cout << "Loaded " << path << ": " << triangle_count << " triangles, "
+              << mesh.vertices.size() << " vertices in " << elapsed.count() << " ms" << std::endl;
+    return mesh;
+}
+
+MeshData ModelLoader::parse_ply(std::string_view data, bool* has_normals) {
+    std::vector<PlyElement> elements;
+    bool big_endian = false;
+    size_t body_offset = 0;
+    if (!parse_ply_header(data, elements, big_endian, body_offset)) {
+        return {};
+    }
+    bool swap_bytes = big_endian != (std::endian::native == std::endian::big);
+
+    ThreadPool& pool = ThreadPool::shared();
+    const char* p = data.data() + body_offset;
+    const char* end = data.data() + data.size();
+
+    MeshData mesh;
+    bool normals_found = false;
+    std::atomic<size_t> invalid_references{0};
+
+    for (PlyElement& element : elements) {
+        layout_ply_element(element);
+        size_t remaining = static_cast<size_t>(end - p);
+
+        if (element.name == "vertex") {
+            if (element.stride == 0 || element.count > remaining / std::max<size_t>(element.stride, 1)) {
+                std::cerr << "Warning: PLY vertex element is truncated or has list properties" << std::endl;
+                return {};
+            }
+
+            const PlyProperty* x = element.find({"x"});
+            const PlyProperty* y = element.find({"y"});
+            const PlyProperty* z = element.find({"z"});
+            const PlyProperty* nx = element.find({"nx"});
+            const PlyProperty* ny = element.find({"ny"});
+            const PlyProperty* nz = element.find({"nz"});
+            const PlyProperty* u = element.find({"u", "s", "texture_u", "texture_s"});
+            const PlyProperty* v = element.find({"v", "t", "texture_v", "texture_t"});
+            if (!x || !y || !z) {
+                std::cerr << "Warning: PLY vertices have no position" << std::endl;
+                return {};
+            }
+            normals_found = nx && ny && nz;
+            bool has_tex_coords = u && v;
+
+            // Fixed size records, so every thread can index its range directly
+            const char* records = p;
+            size_t stride = element.stride;
+            mesh.vertices.resize(element.count);
+            pool.parallel_for(element.count, [&](size_t begin, size_t last) {
+                // Adding 0 folds -0.0 into 0.0 for the bitwise weld below
+                auto read = [swap_bytes](const char* record, const PlyProperty* property) {
+                    return static_cast<float>(read_ply_value(record + property->offset, property->type, swap_bytes)) + 0.0f;
+                };
+                for (size_t i = begin; i < last; ++i) {
+                    const char* record = records + i * stride;
+                    Vertex& vertex = mesh.vertices[i];
+                    vertex.position = glm::vec3(read(record, x), read(record, y), read(record, z));
+                    vertex.normal = normals_found ? glm::vec3(read(record, nx), read(record, ny), read(record, nz))
+                                                  : glm::vec3(0.0f);
+                    vertex.tex_coords = has_tex_coords ? glm::vec2(read(record, u), read(record, v)) : glm::vec2(0.0f);
+                }
+            }, 4096);
+            p += element.count * stride;
+            continue;
+        }
+
+        const PlyProperty* list = element.name == "face" ? element.find({"vertex_indices", "vertex_index"}) : nullptr;
+        if (!list || list->count_type == PlyType::Invalid) {
+            // Not needed, skip over it
+            if (element.stride != 0) {
+                if (element.count > remaining / std::max<size_t>(element.stride, 1)) {
+                    std::cerr << "Warning: PLY element " << element.name << " is truncated" << std::endl;
+                    return {};
+                }
+                p += element.count * element.stride;
+            } else {
+                for (size_t i = 0; i < element.count; ++i) {
+                    size_t size = ply_record_size(element, p, end, swap_bytes);
+                    if (size == 0) {
+                        std::cerr << "Warning: PLY element " << element.name << " is truncated" << std::endl;
+                        return {};
+                    }
+                    p += size;
+                }
+            }
+            continue;
+        }
+
+        // Faces are variable length, but almost always all triangles. Assume a
+        // fixed triangle record and check every count in parallel: a record
+        // before the first polygon is always at its assumed offset, so any
+        // polygon is caught and the faces are walked one by one instead.
+        size_t count_size = ply_size(list->count_type);
+        size_t index_size = ply_size(list->type);
+        size_t list_offset = 0;
+        size_t triangle_stride = 0;
+        for (const PlyProperty& property : element.properties) {
+            if (&property == list) {
+                list_offset = triangle_stride;
+                triangle_stride += count_size + 3 * index_size;
+            } else if (property.count_type != PlyType::Invalid) {
+                triangle_stride = 0;
+                break;
+            } else {
+                triangle_stride += ply_size(property.type);
+            }
+        }
+
+        uint32_t vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        const char* faces = p;
+        std::atomic<bool> all_triangles{triangle_stride != 0 && element.count <= remaining / std::max<size_t>(triangle_stride, 1)};
+        if (all_triangles) {
+            pool.parallel_for(element.count, [&](size_t begin, size_t last) {
+                for (size_t i = begin; i < last && all_triangles.load(std::memory_order_relaxed); ++i) {
+                    if (read_ply_index(faces + i * triangle_stride + list_offset, list->count_type, swap_bytes) != 3) {
+                        all_triangles.store(false, std::memory_order_relaxed);
+                    }
+                }
+            }, 4096);
+        }
+
+        if (all_triangles) {
+            size_t base = mesh.indices.size();
+            mesh.indices.resize(base + element.count * 3);
+            pool.parallel_for(element.count, [&](size_t begin, size_t last) {
+                size_t invalid = 0;
+                for (size_t i = begin; i < last; ++i) {
+                    const char* record = faces + i * triangle_stride + list_offset + count_size;
+                    uint32_t* triangle = &mesh.indices[base + i * 3];
+                    for (int k = 0; k < 3; ++k) {
+                        triangle[k] = read_ply_index(record + k * index_size, list->type, swap_bytes);
+                    }
+                    if (triangle[0] >= vertex_count || triangle[1] >= vertex_count || triangle[2] >= vertex_count) {
+                        // Made degenerate here and removed below
+                        triangle[0] = triangle[1] = triangle[2] = 0;
+                        ++invalid;
+                    }
+                }
+                invalid_references += invalid;
+            }, 4096);
+            p += element.count * triangle_stride;
+            continue;
+        }
+
+        // Polygons present: walk the records and fan them into triangles
+        for (size_t i = 0; i < element.count; ++i) {
+            size_t size = ply_record_size(element, p, end, swap_bytes);
+            if (size == 0) {
+                std::cerr << "Warning: PLY faces are truncated" << std::endl;
+                return {};
+            }
+
+            const char* field = p;
+            for (const PlyProperty& property : element.properties) {
+                if (property.count_type == PlyType::Invalid) {
+                    field += ply_size(property.type);
+                    continue;
+                }
+                size_t count = read_ply_index(field, property.count_type, swap_bytes);
+                field += ply_size(property.count_type);
+                if (&property == list) {
+                    uint32_t first = read_ply_index(field, property.type, swap_bytes);
+                    for (size_t k = 2; k < count; ++k) {
+                        uint32_t b = read_ply_index(field + (k - 1) * index_size, property.type, swap_bytes);
+                        uint32_t c = read_ply_index(field + k * index_size, property.type, swap_bytes);
+                        if (first >= vertex_count || b >= vertex_count || c >= vertex_count) {
+                            ++invalid_references;
+                            continue;
+                        }
+                        mesh.indices.insert(mesh.indices.end(), {first, b, c});
+                    }
+                }
+                field += count * ply_size(property.type);
+            }
+            p += size;
+        }
+    }
+
+    if (invalid_references > 0) {
+        std::cerr << "Warning: PLY has " << invalid_references.load()
+                  << " faces with out of range vertex indices" << std::endl;
+    }
+    if (has_normals) {
+        *has_normals = normals_found;
+    }
+    if (mesh.vertices.empty() || mesh.indices.empty()) {
+        return {};
+    }
+
+    // Scanners often write shared vertices more than once, weld them too
+    WeldMap weld = MeshBuilder::weld_parallel(mesh.vertices.size(), [&mesh](size_t i) { return mesh.vertices[i]; },
+                                              mesh.vertices.size());
+
+    if (weld.first.size() < mesh.vertices.size()) {
+        std::vector<Vertex> unique(weld.first.size());
+        for (size_t i = 0; i < unique.size(); ++i) {
+            unique[i] = mesh.vertices[weld.first[i]];
+        }
+        mesh.vertices = std::move(unique);
+        pool.parallel_for(mesh.indices.size(), [&](size_t begin, size_t last) {
+            for (size_t i = begin; i < last; ++i) {
+                mesh.indices[i] = weld.remap[mesh.indices[i]];
+            }
+        }, 4096);
+    }
+    remove_degenerate_triangles(mesh.indices);
+
+    mesh.submeshes.push_back({0, static_cast<uint32_t>(mesh.indices.size())});
+    mesh.compute_bounds();
+    return mesh;
+}
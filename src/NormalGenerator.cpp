@@ -0,0 +1,486 @@
+#include "NormalGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define NORMAL_GENERATOR_SSE
+#endif
+
+namespace {
+
+// Corners handled per pass of a worker, sized to keep the scratch in L1
+constexpr size_t BLOCK_CORNERS = 256;
+constexpr size_t MIN_BATCH_VERTICES = 2048;
+// Corner sort granularity: vertex buckets and the smallest corner block
+constexpr size_t MAX_BUCKETS = 1024;
+constexpr size_t MIN_BLOCK_CORNERS = 1 << 16;
+constexpr float PI = 3.14159265358979f;
+
+// Lane types share one interface, so the kernels below are written once.
+// Only IEEE exact operations are used, which keeps every width bit identical.
+struct ScalarLanes {
+    using V = float;
+    static constexpr size_t WIDTH = 1;
+
+    static V gather(const float* base, const uint32_t* indices) { return base[indices[0]]; }
+    static V splat(float value) { return value; }
+    static void store(float* out, V value) { *out = value; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V max(V a, V b) { return a > b ? a : b; }
+    static V abs(V a) { return std::fabs(a); }
+    // a < b ? if_less : otherwise, per lane
+    static V select_less(V a, V b, V if_less, V otherwise) { return a < b ? if_less : otherwise; }
+};
+
+#if defined(__AVX2__)
+struct SimdLanes {
+    using V = __m256;
+    static constexpr size_t WIDTH = 8;
+
+    static V gather(const float* base, const uint32_t* indices) {
+        __m256i offsets = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices));
+        return _mm256_i32gather_ps(base, offsets, sizeof(float));
+    }
+    static V splat(float value) { return _mm256_set1_ps(value); }
+    static void store(float* out, V value) { _mm256_storeu_ps(out, value); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V max(V a, V b) { return _mm256_max_ps(a, b); }
+    static V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static V select_less(V a, V b, V if_less, V otherwise) {
+        return _mm256_blendv_ps(otherwise, if_less, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+    }
+};
+#elif defined(NORMAL_GENERATOR_SSE)
+struct SimdLanes {
+    using V = __m128;
+    static constexpr size_t WIDTH = 4;
+
+    // SSE has no gather, but the four loads still overlap well
+    static V gather(const float* base, const uint32_t* indices) {
+        return _mm_setr_ps(base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]]);
+    }
+    static V splat(float value) { return _mm_set1_ps(value); }
+    static void store(float* out, V value) { _mm_storeu_ps(out, value); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm_div_ps(a, b); }
+    static V sqrt(V a) { return _mm_sqrt_ps(a); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    static V max(V a, V b) { return _mm_max_ps(a, b); }
+    static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static V select_less(V a, V b, V if_less, V otherwise) {
+        __m128 mask = _mm_cmplt_ps(a, b);
+        return _mm_or_ps(_mm_and_ps(mask, if_less), _mm_andnot_ps(mask, otherwise));
+    }
+};
+#else
+using SimdLanes = ScalarLanes;
+#endif
+
+// Structure of arrays copies of the vertex attributes the kernels read
+struct Attributes {
+    std::vector<float> x, y, z;
+    std::vector<float> u, v;
+    std::vector<float> nx, ny, nz;
+};
+
+// Corners of each vertex in ascending order: corners[offsets[v], offsets[v + 1])
+struct VertexCorners {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+};
+
+// Vertex ids of one block of corners: the corner's own vertex and the two
+// following it around the triangle, so the face winding is preserved
+struct CornerBlock {
+    uint32_t own[BLOCK_CORNERS];
+    uint32_t next[BLOCK_CORNERS];
+    uint32_t prev[BLOCK_CORNERS];
+    float out[6][BLOCK_CORNERS];
+};
+
+template <typename L>
+struct Vec3Lanes {
+    typename L::V x, y, z;
+};
+
+template <typename L>
+Vec3Lanes<L> gather3(const float* x, const float* y, const float* z, const uint32_t* indices) {
+    return {L::gather(x, indices), L::gather(y, indices), L::gather(z, indices)};
+}
+
+template <typename L>
+Vec3Lanes<L> sub3(const Vec3Lanes<L>& a, const Vec3Lanes<L>& b) {
+    return {L::sub(a.x, b.x), L::sub(a.y, b.y), L::sub(a.z, b.z)};
+}
+
+template <typename L>
+Vec3Lanes<L> scale3(const Vec3Lanes<L>& a, typename L::V s) {
+    return {L::mul(a.x, s), L::mul(a.y, s), L::mul(a.z, s)};
+}
+
+template <typename L>
+typename L::V dot3(const Vec3Lanes<L>& a, const Vec3Lanes<L>& b) {
+    return L::add(L::add(L::mul(a.x, b.x), L::mul(a.y, b.y)), L::mul(a.z, b.z));
+}
+
+template <typename L>
+Vec3Lanes<L> cross3(const Vec3Lanes<L>& a, const Vec3Lanes<L>& b) {
+    return {L::sub(L::mul(a.y, b.z), L::mul(a.z, b.y)), L::sub(L::mul(a.z, b.x), L::mul(a.x, b.z)),
+            L::sub(L::mul(a.x, b.y), L::mul(a.y, b.x))};
+}
+
+template <typename L>
+void store3(float* x, float* y, float* z, const Vec3Lanes<L>& a) {
+    L::store(x, a.x);
+    L::store(y, a.y);
+    L::store(z, a.z);
+}
+
+// Angle between two edges leaving a corner. acos uses the Abramowitz and
+// Stegun polynomial (error below 1e-4 radians), plenty for a weight.
+template <typename L>
+typename L::V corner_angle(const Vec3Lanes<L>& e1, const Vec3Lanes<L>& e2) {
+    using V = typename L::V;
+    V lengths = L::sqrt(L::mul(dot3<L>(e1, e1), dot3<L>(e2, e2)));
+    V cosine = L::div(dot3<L>(e1, e2), L::max(lengths, L::splat(FLT_MIN)));
+    cosine = L::min(L::max(cosine, L::splat(-1.0f)), L::splat(1.0f));
+
+    V a = L::abs(cosine);
+    V poly = L::add(L::mul(L::splat(-0.0187293f), a), L::splat(0.0742610f));
+    poly = L::add(L::mul(poly, a), L::splat(-0.2121144f));
+    poly = L::add(L::mul(poly, a), L::splat(1.5707288f));
+    V angle = L::mul(L::sqrt(L::sub(L::splat(1.0f), a)), poly);
+    return L::select_less(cosine, L::splat(0.0f), L::sub(L::splat(PI), angle), angle);
+}
+
+// Normalize, leaving zero vectors at zero
+template <typename L>
+Vec3Lanes<L> normalize3(const Vec3Lanes<L>& a) {
+    return scale3<L>(a, L::div(L::splat(1.0f), L::max(L::sqrt(dot3<L>(a, a)), L::splat(FLT_MIN))));
+}
+
+// Face normal at each corner, scaled by twice the face area and the corner angle
+struct NormalTerms {
+    static constexpr size_t COUNT = 3;
+
+    template <typename L>
+    static void compute(const Attributes& attributes, CornerBlock& block, size_t i);
+};
+
+template <typename L>
+void NormalTerms::compute(const Attributes& attributes, CornerBlock& block, size_t i) {
+    const float* x = attributes.x.data();
+    const float* y = attributes.y.data();
+    const float* z = attributes.z.data();
+    Vec3Lanes<L> p = gather3<L>(x, y, z, block.own + i);
+    Vec3Lanes<L> e1 = sub3<L>(gather3<L>(x, y, z, block.next + i), p);
+    Vec3Lanes<L> e2 = sub3<L>(gather3<L>(x, y, z, block.prev + i), p);
+
+    Vec3Lanes<L> normal = scale3<L>(cross3<L>(e1, e2), corner_angle<L>(e1, e2));
+    store3<L>(block.out[0] + i, block.out[1] + i, block.out[2] + i, normal);
+}
+
+// Face tangent and bitangent at each corner, projected into the vertex
+// normal's plane, normalized and weighted by the corner angle as MikkTSpace
+// does. Triangles without UV area contribute nothing.
+struct TangentTerms {
+    static constexpr size_t COUNT = 6;
+
+    template <typename L>
+    static void compute(const Attributes& attributes, CornerBlock& block, size_t i);
+};
+
+template <typename L>
+void TangentTerms::compute(const Attributes& attributes, CornerBlock& block, size_t i) {
+    using V = typename L::V;
+    const float* x = attributes.x.data();
+    const float* y = attributes.y.data();
+    const float* z = attributes.z.data();
+    Vec3Lanes<L> p = gather3<L>(x, y, z, block.own + i);
+    Vec3Lanes<L> e1 = sub3<L>(gather3<L>(x, y, z, block.next + i), p);
+    Vec3Lanes<L> e2 = sub3<L>(gather3<L>(x, y, z, block.prev + i), p);
+
+    const float* u = attributes.u.data();
+    const float* v = attributes.v.data();
+    V u0 = L::gather(u, block.own + i);
+    V v0 = L::gather(v, block.own + i);
+    V du1 = L::sub(L::gather(u, block.next + i), u0);
+    V dv1 = L::sub(L::gather(v, block.next + i), v0);
+    V du2 = L::sub(L::gather(u, block.prev + i), u0);
+    V dv2 = L::sub(L::gather(v, block.prev + i), v0);
+
+    // Only the direction matters, so the UV determinant contributes its sign
+    V det = L::sub(L::mul(du1, dv2), L::mul(du2, dv1));
+    V sign = L::select_less(det, L::splat(0.0f), L::splat(-1.0f), L::splat(1.0f));
+    V weight = L::select_less(L::abs(det), L::splat(FLT_MIN), L::splat(0.0f), corner_angle<L>(e1, e2));
+
+    Vec3Lanes<L> tangent = sub3<L>(scale3<L>(e1, dv2), scale3<L>(e2, dv1));
+    Vec3Lanes<L> bitangent = sub3<L>(scale3<L>(e2, du1), scale3<L>(e1, du2));
+
+    Vec3Lanes<L> normal = gather3<L>(attributes.nx.data(), attributes.ny.data(), attributes.nz.data(), block.own + i);
+    tangent = sub3<L>(tangent, scale3<L>(normal, dot3<L>(normal, tangent)));
+    bitangent = sub3<L>(bitangent, scale3<L>(normal, dot3<L>(normal, bitangent)));
+    tangent = scale3<L>(normalize3<L>(tangent), L::mul(weight, sign));
+    bitangent = scale3<L>(normalize3<L>(bitangent), L::mul(weight, sign));
+
+    store3<L>(block.out[0] + i, block.out[1] + i, block.out[2] + i, tangent);
+    store3<L>(block.out[3] + i, block.out[4] + i, block.out[5] + i, bitangent);
+}
+
+// Two level counting sort of the corners by vertex. Blocks of corners first
+// scatter into buckets of neighbouring vertices, then every bucket sorts its
+// own corners by vertex. Both passes are stable and need no atomics, so the
+// corners of a vertex come out in ascending order.
+VertexCorners build_vertex_corners(const uint32_t* indices, size_t corner_count, size_t vertex_count) {
+    ThreadPool& pool = ThreadPool::shared();
+    VertexCorners table;
+    table.offsets.assign(vertex_count + 1, 0);
+    table.corners.resize(corner_count);
+    if (corner_count == 0 || vertex_count == 0) {
+        return table;
+    }
+
+    unsigned bucket_shift = 0;
+    while (((vertex_count - 1) >> bucket_shift) >= MAX_BUCKETS) {
+        ++bucket_shift;
+    }
+    size_t bucket_count = ((vertex_count - 1) >> bucket_shift) + 1;
+    size_t block_count = std::clamp<size_t>(corner_count / MIN_BLOCK_CORNERS, 1, pool.size() * 4u);
+    size_t block_size = (corner_count + block_count - 1) / block_count;
+    block_count = (corner_count + block_size - 1) / block_size;
+
+    // Pass 1: bucket histogram per block, turned into scatter positions laid
+    // out bucket by bucket, then block by block
+    std::vector<uint32_t> cursors(block_count * bucket_count, 0);
+    pool.parallel_for(block_count, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block) {
+            uint32_t* counts = &cursors[block * bucket_count];
+            size_t last = std::min(corner_count, (block + 1) * block_size);
+            for (size_t c = block * block_size; c < last; ++c) {
+                ++counts[indices[c] >> bucket_shift];
+            }
+        }
+    });
+
+    std::vector<uint32_t> bucket_offsets(bucket_count + 1, 0);
+    uint32_t running = 0;
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        bucket_offsets[bucket] = running;
+        for (size_t block = 0; block < block_count; ++block) {
+            uint32_t count = cursors[block * bucket_count + bucket];
+            cursors[block * bucket_count + bucket] = running;
+            running += count;
+        }
+    }
+    bucket_offsets[bucket_count] = running;
+
+    std::vector<uint32_t> bucketed(corner_count);
+    pool.parallel_for(block_count, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block) {
+            uint32_t* positions = &cursors[block * bucket_count];
+            size_t last = std::min(corner_count, (block + 1) * block_size);
+            for (size_t c = block * block_size; c < last; ++c) {
+                bucketed[positions[indices[c] >> bucket_shift]++] = static_cast<uint32_t>(c);
+            }
+        }
+    });
+
+    // Pass 2: counting sort inside each bucket, which owns its vertex range
+    pool.parallel_for(bucket_count, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> fill;
+        for (size_t bucket = begin; bucket < end; ++bucket) {
+            size_t first_vertex = bucket << bucket_shift;
+            size_t end_vertex = std::min(vertex_count, (bucket + 1) << bucket_shift);
+            const uint32_t* corners = &bucketed[bucket_offsets[bucket]];
+            size_t count = bucket_offsets[bucket + 1] - bucket_offsets[bucket];
+
+            fill.assign(end_vertex - first_vertex, 0);
+            for (size_t i = 0; i < count; ++i) {
+                ++fill[indices[corners[i]] - first_vertex];
+            }
+            uint32_t offset = bucket_offsets[bucket];
+            for (size_t v = first_vertex; v < end_vertex; ++v) {
+                uint32_t vertex_corners = fill[v - first_vertex];
+                fill[v - first_vertex] = offset;
+                offset += vertex_corners;
+                table.offsets[v + 1] = offset;
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                table.corners[fill[indices[corners[i]] - first_vertex]++] = corners[i];
+            }
+        }
+    });
+
+    return table;
+}
+
+// Compute Terms over every vertex's corners in blocks and hand each vertex
+// its summed terms: finish(vertex, sums)
+template <typename Terms, typename Finish>
+void gather_corners(const uint32_t* indices, const VertexCorners& table, const Attributes& attributes,
+                    Finish finish) {
+    constexpr size_t TERMS = Terms::COUNT;
+    size_t vertex_count = table.offsets.size() - 1;
+
+    ThreadPool::shared().parallel_for(vertex_count, [&](size_t first_vertex, size_t end_vertex) {
+        CornerBlock block;
+        size_t vertex = first_vertex;
+        float sums[TERMS] = {};
+
+        size_t first_corner = table.offsets[first_vertex];
+        size_t end_corner = table.offsets[end_vertex];
+        for (size_t start = first_corner; start < end_corner; start += BLOCK_CORNERS) {
+            size_t count = std::min(BLOCK_CORNERS, end_corner - start);
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t corner = table.corners[start + i];
+                uint32_t triangle = corner - corner % 3;
+                block.own[i] = indices[corner];
+                block.next[i] = indices[triangle + (corner + 1) % 3];
+                block.prev[i] = indices[triangle + (corner + 2) % 3];
+            }
+
+            size_t i = 0;
+            for (; i + SimdLanes::WIDTH <= count; i += SimdLanes::WIDTH) {
+                Terms::template compute<SimdLanes>(attributes, block, i);
+            }
+            for (; i < count; ++i) {
+                Terms::template compute<ScalarLanes>(attributes, block, i);
+            }
+
+            // Corners are grouped by vertex, so a running sum per vertex
+            // carries over block boundaries
+            for (i = 0; i < count; ++i) {
+                while (table.offsets[vertex + 1] <= start + i) {
+                    finish(vertex, sums);
+                    std::fill(sums, sums + TERMS, 0.0f);
+                    ++vertex;
+                }
+                for (size_t term = 0; term < TERMS; ++term) {
+                    sums[term] += block.out[term][i];
+                }
+            }
+        }
+
+        for (; vertex < end_vertex; ++vertex) {
+            finish(vertex, sums);
+            std::fill(sums, sums + TERMS, 0.0f);
+        }
+    }, MIN_BATCH_VERTICES);
+}
+
+// Triangle list indices, made up for a triangle soup
+const uint32_t* triangle_indices(const MeshData& mesh, std::vector<uint32_t>& storage) {
+    if (!mesh.indices.empty()) {
+        return mesh.indices.data();
+    }
+    storage.resize(mesh.vertices.size() / 3 * 3);
+    std::iota(storage.begin(), storage.end(), 0u);
+    return storage.data();
+}
+
+size_t corner_count_of(const MeshData& mesh) {
+    return mesh.indices.empty() ? mesh.vertices.size() / 3 * 3 : mesh.indices.size() / 3 * 3;
+}
+
+Attributes copy_attributes(const MeshData& mesh, bool tangent_inputs) {
+    Attributes attributes;
+    size_t count = mesh.vertices.size();
+    attributes.x.resize(count);
+    attributes.y.resize(count);
+    attributes.z.resize(count);
+    if (tangent_inputs) {
+        attributes.u.resize(count);
+        attributes.v.resize(count);
+        attributes.nx.resize(count);
+        attributes.ny.resize(count);
+        attributes.nz.resize(count);
+    }
+
+    ThreadPool::shared().parallel_for(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Vertex& vertex = mesh.vertices[i];
+            attributes.x[i] = vertex.position.x;
+            attributes.y[i] = vertex.position.y;
+            attributes.z[i] = vertex.position.z;
+            if (tangent_inputs) {
+                attributes.u[i] = vertex.tex_coords.x;
+                attributes.v[i] = vertex.tex_coords.y;
+                attributes.nx[i] = vertex.normal.x;
+                attributes.ny[i] = vertex.normal.y;
+                attributes.nz[i] = vertex.normal.z;
+            }
+        }
+    }, 4096);
+    return attributes;
+}
+
+} // namespace
+
+void NormalGenerator::compute_normals(MeshData& mesh) {
+    std::vector<uint32_t> soup_indices;
+    const uint32_t* indices = triangle_indices(mesh, soup_indices);
+    VertexCorners table = build_vertex_corners(indices, corner_count_of(mesh), mesh.vertices.size());
+    Attributes attributes = copy_attributes(mesh, false);
+
+    gather_corners<NormalTerms>(indices, table, attributes, [&mesh](size_t vertex, const float* sum) {
+        glm::vec3 normal(sum[0], sum[1], sum[2]);
+        float length = glm::length(normal);
+        mesh.vertices[vertex].normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    });
+}
+
+std::vector<glm::vec4> NormalGenerator::compute_tangents(const MeshData& mesh) {
+    std::vector<glm::vec4> tangents(mesh.vertices.size());
+    std::vector<uint32_t> soup_indices;
+    const uint32_t* indices = triangle_indices(mesh, soup_indices);
+    VertexCorners table = build_vertex_corners(indices, corner_count_of(mesh), mesh.vertices.size());
+    Attributes attributes = copy_attributes(mesh, true);
+
+    gather_corners<TangentTerms>(indices, table, attributes, [&](size_t vertex, const float* sum) {
+        const glm::vec3& normal = mesh.vertices[vertex].normal;
+        glm::vec3 tangent(sum[0], sum[1], sum[2]);
+        glm::vec3 bitangent(sum[3], sum[4], sum[5]);
+
+        tangent -= normal * glm::dot(normal, tangent);
+        float length = glm::length(tangent);
+        if (length > 0.0f) {
+            tangent /= length;
+        } else {
+            // No UV gradient here, any direction in the tangent plane will do
+            glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            tangent = glm::cross(normal, axis);
+            length = glm::length(tangent);
+            tangent = length > 0.0f ? tangent / length : glm::vec3(1.0f, 0.0f, 0.0f);
+        }
+        float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+        tangents[vertex] = glm::vec4(tangent, handedness);
+    });
+
+    return tangents;
+}
+
+bool NormalGenerator::has_tex_coords(const MeshData& mesh) {
+    return std::any_of(mesh.vertices.begin(), mesh.vertices.end(), [](const Vertex& vertex) {
+        return vertex.tex_coords.x != 0.0f || vertex.tex_coords.y != 0.0f;
+    });
+}
@@ -0,0 +1,651 @@
+#include "ProceduralTexture.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PROCEDURAL_TEXTURE_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PROCEDURAL_TEXTURE_SSE
+#endif
+
+namespace {
+
+constexpr float PI = 3.14159265358979f;
+// Lattice hash constants
+constexpr uint32_t PRIME_X = 0x8da6b343u;
+constexpr uint32_t PRIME_Y = 0xd8163841u;
+constexpr uint32_t HASH_MULTIPLIER = 0x85ebca6bu;
+// Seed offset between octaves
+constexpr uint32_t OCTAVE_SEED = 0x9e3779b9u;
+// (sqrt(3) - 1) / 2 and (3 - sqrt(3)) / 6
+constexpr float SIMPLEX_SKEW = 0.366025403784f;
+constexpr float SIMPLEX_UNSKEW = 0.211324865405f;
+// Bring each noise type's peaks to about 1
+constexpr float PERLIN_SCALE = 0.66f;
+constexpr float SIMPLEX_SCALE = 45.0f;
+// Rows generated per batch
+constexpr size_t BAND_ROWS = 16;
+constexpr size_t CHANNELS = 4;
+
+// The noise functions are written once against float and uint32_t and run
+// on SIMD registers through these wrappers, which provide the same
+// operators, so every path performs the same operations in the same order.
+// Masks are all ones for true and all zeros for false.
+template <typename F>
+struct Lanes;
+
+template <>
+struct Lanes<float> {
+    using Int = uint32_t;
+    static constexpr int WIDTH = 1;
+
+    // Texel centers x, x + 1, ... in texels
+    static float ramp(int x) { return static_cast<float>(x) + 0.5f; }
+    static float load(const float* in) { return *in; }
+    static void store(float* out, float value) { *out = value; }
+};
+
+float floor_of(float value) {
+    return std::floor(value);
+}
+
+float max_of(float a, float b) {
+    return a > b ? a : b;
+}
+
+uint32_t to_int(float value) {
+    return static_cast<uint32_t>(static_cast<int32_t>(value));
+}
+
+float to_float(uint32_t value) {
+    return static_cast<float>(static_cast<int32_t>(value));
+}
+
+uint32_t equal(uint32_t a, uint32_t b) {
+    return a == b ? ~0u : 0u;
+}
+
+uint32_t greater(float a, float b) {
+    return a > b ? ~0u : 0u;
+}
+
+float select(uint32_t mask, float a, float b) {
+    return mask != 0 ? a : b;
+}
+
+uint32_t select(uint32_t mask, uint32_t a, uint32_t b) {
+    return mask != 0 ? a : b;
+}
+
+#if defined(PROCEDURAL_TEXTURE_SSE)
+struct Float4 {
+    __m128 v;
+    Float4(__m128 v) : v(v) {}
+    Float4(float value) : v(_mm_set1_ps(value)) {}
+};
+
+struct Int4 {
+    __m128i v;
+    Int4(__m128i v) : v(v) {}
+    Int4(uint32_t value) : v(_mm_set1_epi32(static_cast<int>(value))) {}
+};
+
+template <>
+struct Lanes<Float4> {
+    using Int = Int4;
+    static constexpr int WIDTH = 4;
+
+    static Float4 ramp(int x) {
+        return _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+    }
+    static Float4 load(const float* in) { return _mm_loadu_ps(in); }
+    static void store(float* out, Float4 value) { _mm_storeu_ps(out, value.v); }
+};
+
+Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+Float4 operator-(Float4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+Int4 operator+(Int4 a, Int4 b) { return _mm_add_epi32(a.v, b.v); }
+Int4 operator^(Int4 a, Int4 b) { return _mm_xor_si128(a.v, b.v); }
+Int4 operator&(Int4 a, Int4 b) { return _mm_and_si128(a.v, b.v); }
+Int4 operator>>(Int4 a, int bits) { return _mm_srli_epi32(a.v, bits); }
+
+// Low 32 bits of each product; SSE2 only multiplies the even lanes
+Int4 operator*(Int4 a, Int4 b) {
+    __m128i even = _mm_mul_epu32(a.v, b.v);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Truncate, then step down where that rounded up
+Float4 floor_of(Float4 value) {
+    __m128i truncated = _mm_cvttps_epi32(value.v);
+    __m128 rounded_up = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value.v);
+    return _mm_cvtepi32_ps(_mm_add_epi32(truncated, _mm_castps_si128(rounded_up)));
+}
+
+Float4 max_of(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+Int4 to_int(Float4 value) { return _mm_cvttps_epi32(value.v); }
+Float4 to_float(Int4 value) { return _mm_cvtepi32_ps(value.v); }
+Int4 equal(Int4 a, Int4 b) { return _mm_cmpeq_epi32(a.v, b.v); }
+Int4 greater(Float4 a, Float4 b) { return _mm_castps_si128(_mm_cmpgt_ps(a.v, b.v)); }
+
+Float4 select(Int4 mask, Float4 a, Float4 b) {
+    __m128 m = _mm_castsi128_ps(mask.v);
+    return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v));
+}
+
+Int4 select(Int4 mask, Int4 a, Int4 b) {
+    return _mm_or_si128(_mm_and_si128(mask.v, a.v), _mm_andnot_si128(mask.v, b.v));
+}
+#endif
+
+#if defined(__AVX2__)
+struct Float8 {
+    __m256 v;
+    Float8(__m256 v) : v(v) {}
+    Float8(float value) : v(_mm256_set1_ps(value)) {}
+};
+
+struct Int8 {
+    __m256i v;
+    Int8(__m256i v) : v(v) {}
+    Int8(uint32_t value) : v(_mm256_set1_epi32(static_cast<int>(value))) {}
+};
+
+template <>
+struct Lanes<Float8> {
+    using Int = Int8;
+    static constexpr int WIDTH = 8;
+
+    static Float8 ramp(int x) {
+        return _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)),
+                             _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+    }
+    static Float8 load(const float* in) { return _mm256_loadu_ps(in); }
+    static void store(float* out, Float8 value) { _mm256_storeu_ps(out, value.v); }
+};
+
+Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+Float8 operator-(Float8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+Int8 operator+(Int8 a, Int8 b) { return _mm256_add_epi32(a.v, b.v); }
+Int8 operator*(Int8 a, Int8 b) { return _mm256_mullo_epi32(a.v, b.v); }
+Int8 operator^(Int8 a, Int8 b) { return _mm256_xor_si256(a.v, b.v); }
+Int8 operator&(Int8 a, Int8 b) { return _mm256_and_si256(a.v, b.v); }
+Int8 operator>>(Int8 a, int bits) { return _mm256_srli_epi32(a.v, bits); }
+
+Float8 floor_of(Float8 value) { return _mm256_floor_ps(value.v); }
+Float8 max_of(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+Int8 to_int(Float8 value) { return _mm256_cvttps_epi32(value.v); }
+Float8 to_float(Int8 value) { return _mm256_cvtepi32_ps(value.v); }
+Int8 equal(Int8 a, Int8 b) { return _mm256_cmpeq_epi32(a.v, b.v); }
+Int8 greater(Float8 a, Float8 b) { return _mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+
+Float8 select(Int8 mask, Float8 a, Float8 b) {
+    return _mm256_blendv_ps(b.v, a.v, _mm256_castsi256_ps(mask.v));
+}
+
+Int8 select(Int8 mask, Int8 a, Int8 b) {
+    return _mm256_blendv_epi8(b.v, a.v, mask.v);
+}
+#endif
+
+// 32 well mixed bits for a lattice point
+template <typename I>
+I hash(I x, I y, I seed) {
+    I h = (x * I(PRIME_X)) ^ (y * I(PRIME_Y)) ^ seed;
+    h = h ^ (h >> 13);
+    h = h * I(HASH_MULTIPLIER);
+    return h ^ (h >> 16);
+}
+
+// Lattice index past the end of a period back to 0; a period of 0 never
+// wraps anything that is not already 0
+template <typename I>
+I wrap(I index, I period) {
+    return select(equal(index, period), I(0u), index);
+}
+
+// Quintic fade, flat first and second derivatives at the lattice points
+template <typename F>
+F fade(F t) {
+    return t * t * t * (t * (t * F(6.0f) - F(15.0f)) + F(10.0f));
+}
+
+template <typename F>
+F lerp(F a, F b, F t) {
+    return a + (b - a) * t;
+}
+
+// Random value in [-1, 1] from the low 24 bits, which convert exactly
+template <typename F, typename I>
+F lattice_value(I h) {
+    return to_float(h & I(0xffffffu)) * F(2.0f / 16777215.0f) - F(1.0f);
+}
+
+// Dot product with one of eight gradients: (+-1, +-2) and (+-2, +-1)
+template <typename F, typename I>
+F gradient(I h, F x, F y) {
+    I swap = equal(h & I(4u), I(4u));
+    F u = select(swap, y, x);
+    F v = select(swap, x, y);
+    u = select(equal(h & I(1u), I(1u)), -u, u);
+    v = select(equal(h & I(2u), I(2u)), -v, v);
+    return u + v * F(2.0f);
+}
+
+template <typename F>
+F value_noise(F x, F y, uint32_t seed, uint32_t period_x, uint32_t period_y) {
+    using I = typename Lanes<F>::Int;
+    F x0 = floor_of(x);
+    F y0 = floor_of(y);
+    I ix0 = wrap(to_int(x0), I(period_x));
+    I iy0 = wrap(to_int(y0), I(period_y));
+    I ix1 = wrap(ix0 + I(1u), I(period_x));
+    I iy1 = wrap(iy0 + I(1u), I(period_y));
+    F u = fade(x - x0);
+    F v = fade(y - y0);
+    F bottom = lerp(lattice_value<F>(hash(ix0, iy0, I(seed))), lattice_value<F>(hash(ix1, iy0, I(seed))), u);
+    F top = lerp(lattice_value<F>(hash(ix0, iy1, I(seed))), lattice_value<F>(hash(ix1, iy1, I(seed))), u);
+    return lerp(bottom, top, v);
+}
+
+template <typename F>
+F perlin_noise(F x, F y, uint32_t seed, uint32_t period_x, uint32_t period_y) {
+    using I = typename Lanes<F>::Int;
+    F x0 = floor_of(x);
+    F y0 = floor_of(y);
+    F fx = x - x0;
+    F fy = y - y0;
+    I ix0 = wrap(to_int(x0), I(period_x));
+    I iy0 = wrap(to_int(y0), I(period_y));
+    I ix1 = wrap(ix0 + I(1u), I(period_x));
+    I iy1 = wrap(iy0 + I(1u), I(period_y));
+    F u = fade(fx);
+    F v = fade(fy);
+    F bottom = lerp(gradient(hash(ix0, iy0, I(seed)), fx, fy), gradient(hash(ix1, iy0, I(seed)), fx - F(1.0f), fy), u);
+    F top = lerp(gradient(hash(ix0, iy1, I(seed)), fx, fy - F(1.0f)),
+                 gradient(hash(ix1, iy1, I(seed)), fx - F(1.0f), fy - F(1.0f)), u);
+    return lerp(bottom, top, v) * F(PERLIN_SCALE);
+}
+
+// One corner's contribution, falling off to 0 at distance sqrt(0.5)
+template <typename F, typename I>
+F simplex_corner(I h, F x, F y) {
+    F t = max_of(F(0.5f) - x * x - y * y, F(0.0f));
+    t = t * t;
+    return t * t * gradient(h, x, y);
+}
+
+template <typename F>
+F simplex_noise(F x, F y, uint32_t seed, uint32_t, uint32_t) {
+    using I = typename Lanes<F>::Int;
+    // Skew to find the cell, then unskew its origin back
+    F skew = (x + y) * F(SIMPLEX_SKEW);
+    F i = floor_of(x + skew);
+    F j = floor_of(y + skew);
+    F unskew = (i + j) * F(SIMPLEX_UNSKEW);
+    F x0 = x - (i - unskew);
+    F y0 = y - (j - unskew);
+
+    // Lower or upper triangle of the cell picks the middle corner
+    I lower = greater(x0, y0);
+    F i1 = select(lower, F(1.0f), F(0.0f));
+    F j1 = F(1.0f) - i1;
+    F x1 = x0 - i1 + F(SIMPLEX_UNSKEW);
+    F y1 = y0 - j1 + F(SIMPLEX_UNSKEW);
+    F x2 = x0 - F(1.0f - 2.0f * SIMPLEX_UNSKEW);
+    F y2 = y0 - F(1.0f - 2.0f * SIMPLEX_UNSKEW);
+
+    I ii = to_int(i);
+    I jj = to_int(j);
+    F n0 = simplex_corner(hash(ii, jj, I(seed)), x0, y0);
+    F n1 = simplex_corner(hash(ii + to_int(i1), jj + to_int(j1), I(seed)), x1, y1);
+    F n2 = simplex_corner(hash(ii + I(1u), jj + I(1u), I(seed)), x2, y2);
+    return (n0 + n1 + n2) * F(SIMPLEX_SCALE);
+}
+
+// Add amplitude times one octave to out[begin, width) in steps of the lane
+// width; returns where the lanes stopped
+template <typename F, typename Noise>
+int accumulate_octave(int begin, int width, float scale_x, float y, float amplitude, uint32_t seed,
+                      uint32_t period_x, uint32_t period_y, float* out, Noise noise) {
+    int x = begin;
+    for (; x + Lanes<F>::WIDTH <= width; x += Lanes<F>::WIDTH) {
+        F value = noise(Lanes<F>::ramp(x) * F(scale_x), F(y), seed, period_x, period_y);
+        Lanes<F>::store(out + x, Lanes<F>::load(out + x) + value * F(amplitude));
+    }
+    return x;
+}
+
+template <typename Noise>
+void fractal_row(const NoiseParameters& parameters, int width, int height, int row, float* out, bool periodic,
+                 Noise noise) {
+    std::fill(out, out + width, 0.0f);
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    for (int octave = 0; octave < std::max(parameters.octaves, 1); ++octave) {
+        uint32_t cells_x = static_cast<uint32_t>(std::max(parameters.cells_x, 1)) << octave;
+        uint32_t cells_y = static_cast<uint32_t>(std::max(parameters.cells_y, 1)) << octave;
+        float scale_x = static_cast<float>(cells_x) / static_cast<float>(width);
+        float y = (static_cast<float>(row) + 0.5f) * (static_cast<float>(cells_y) / static_cast<float>(height));
+        uint32_t seed = parameters.seed + static_cast<uint32_t>(octave) * OCTAVE_SEED;
+        uint32_t period_x = periodic ? cells_x : 0;
+        uint32_t period_y = periodic ? cells_y : 0;
+
+        int x = 0;
+#if defined(__AVX2__)
+        x = accumulate_octave<Float8>(x, width, scale_x, y, amplitude, seed, period_x, period_y, out, noise);
+#endif
+#if defined(PROCEDURAL_TEXTURE_SSE)
+        x = accumulate_octave<Float4>(x, width, scale_x, y, amplitude, seed, period_x, period_y, out, noise);
+#endif
+        accumulate_octave<float>(x, width, scale_x, y, amplitude, seed, period_x, period_y, out, noise);
+
+        total += amplitude;
+        amplitude *= parameters.persistence;
+    }
+
+    float normalize = 1.0f / total;
+    for (int x = 0; x < width; ++x) {
+        out[x] *= normalize;
+    }
+}
+
+unsigned char to_byte(float value) {
+    return static_cast<unsigned char>(std::clamp(value, 0.0f, 255.0f) + 0.5f);
+}
+
+void store_texel(unsigned char* out, float r, float g, float b) {
+    out[0] = to_byte(r);
+    out[1] = to_byte(g);
+    out[2] = to_byte(b);
+    out[3] = 255;
+}
+
+float smoothstep(float edge0, float edge1, float x) {
+    float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float fract(float value) {
+    return value - std::floor(value);
+}
+
+// Fills one RGBA8 row; scratch holds noise rows reused across a band
+using RowGenerator = void (*)(int width, int height, int row, uint32_t seed, std::vector<float>* scratch,
+                              unsigned char* out);
+
+void checkerboard_row(int width, int height, int row, uint32_t, std::vector<float>*, unsigned char* out) {
+    constexpr int SQUARES = 8;
+    int square_y = row * SQUARES / height;
+    for (int x = 0; x < width; ++x) {
+        float shade = ((x * SQUARES / width + square_y) % 2 == 1) ? 0.0f : 255.0f;
+        store_texel(out + x * CHANNELS, shade, shade, shade);
+    }
+}
+
+// Four bricks across and eight rows, every other row offset by half a brick,
+// each brick a slightly different shade of the same brown
+void brick_row(int width, int height, int row, uint32_t seed, std::vector<float>* scratch, unsigned char* out) {
+    constexpr int ROWS = 8;
+    constexpr int COLUMNS = 4;
+    // Mortar thickness as a fraction of a brick
+    constexpr float MORTAR_Y = 3.0f / 32.0f;
+    constexpr float MORTAR_X = 2.0f / 64.0f;
+
+    NoiseParameters grain;
+    grain.type = NoiseType::Value;
+    grain.cells_x = 64;
+    grain.cells_y = 64;
+    grain.octaves = 2;
+    grain.seed = seed;
+    float* noise = scratch[0].data();
+    ProceduralTexture::noise_row(grain, width, height, row, noise);
+
+    float brick_y = (static_cast<float>(row) + 0.5f) / static_cast<float>(height) * ROWS;
+    uint32_t brick_row = static_cast<uint32_t>(brick_y);
+    float offset = (brick_row % 2 == 1) ? 0.5f : 0.0f;
+    bool mortar_row = fract(brick_y) < MORTAR_Y;
+    for (int x = 0; x < width; ++x) {
+        float brick_x = (static_cast<float>(x) + 0.5f) / static_cast<float>(width) * COLUMNS + offset;
+        float n = noise[x];
+        unsigned char* texel = out + x * CHANNELS;
+        if (mortar_row || fract(brick_x) < MORTAR_X) {
+            float shade = 200.0f + n * 12.0f;
+            store_texel(texel, shade, shade, shade);
+            continue;
+        }
+        uint32_t column = static_cast<uint32_t>(brick_x) % COLUMNS;
+        float tint = 0.85f + 0.3f * (hash<uint32_t>(column, brick_row, seed) & 0xffffu) / 65535.0f;
+        store_texel(texel, 139.0f * tint + n * 16.0f, 69.0f * tint + n * 10.0f, 19.0f * tint + n * 6.0f);
+    }
+}
+
+// Rings across the rows, warped by coarse noise, over fine grain stretched
+// along them
+void wood_row(int width, int height, int row, uint32_t seed, std::vector<float>* scratch, unsigned char* out) {
+    constexpr float RINGS = 16.0f;
+
+    NoiseParameters warp;
+    warp.cells_x = 4;
+    warp.cells_y = 4;
+    warp.octaves = 3;
+    warp.seed = seed;
+    NoiseParameters grain;
+    grain.type = NoiseType::Value;
+    grain.cells_x = 4;
+    grain.cells_y = 128;
+    grain.octaves = 2;
+    grain.seed = seed + 1;
+    float* warp_noise = scratch[0].data();
+    float* grain_noise = scratch[1].data();
+    ProceduralTexture::noise_row(warp, width, height, row, warp_noise);
+    ProceduralTexture::noise_row(grain, width, height, row, grain_noise);
+
+    float v = (static_cast<float>(row) + 0.5f) / static_cast<float>(height);
+    for (int x = 0; x < width; ++x) {
+        float ring = std::fabs(std::sin((v + 0.1f * warp_noise[x]) * PI * RINGS)) * 30.0f;
+        float grain_value = grain_noise[x] * 20.0f;
+        store_texel(out + x * CHANNELS, 101.0f + ring + grain_value, 67.0f + ring + grain_value,
+                    33.0f + ring + grain_value);
+    }
+}
+
+// Brushed along the rows: fine streaks, broad undulation and a little speckle
+void metal_row(int width, int height, int row, uint32_t seed, std::vector<float>* scratch, unsigned char* out) {
+    NoiseParameters brush;
+    brush.type = NoiseType::Value;
+    brush.cells_x = 2;
+    brush.cells_y = 256;
+    brush.octaves = 3;
+    brush.seed = seed;
+    NoiseParameters streak;
+    streak.cells_x = 4;
+    streak.cells_y = 4;
+    streak.octaves = 2;
+    streak.seed = seed + 1;
+    NoiseParameters speckle;
+    speckle.type = NoiseType::Value;
+    speckle.cells_x = 256;
+    speckle.cells_y = 256;
+    speckle.octaves = 1;
+    speckle.seed = seed + 2;
+    float* brush_noise = scratch[0].data();
+    float* streak_noise = scratch[1].data();
+    float* speckle_noise = scratch[2].data();
+    ProceduralTexture::noise_row(brush, width, height, row, brush_noise);
+    ProceduralTexture::noise_row(streak, width, height, row, streak_noise);
+    ProceduralTexture::noise_row(speckle, width, height, row, speckle_noise);
+
+    for (int x = 0; x < width; ++x) {
+        float shade = std::clamp(150.0f + brush_noise[x] * 20.0f + streak_noise[x] * 10.0f + speckle_noise[x] * 10.0f,
+                                 100.0f, 200.0f);
+        // Slightly blue tinted
+        store_texel(out + x * CHANNELS, shade, shade, shade + 10.0f);
+    }
+}
+
+// Green with darker and lighter patches and fine blades
+void grass_row(int width, int height, int row, uint32_t seed, std::vector<float>* scratch, unsigned char* out) {
+    NoiseParameters patches;
+    patches.cells_x = 6;
+    patches.cells_y = 6;
+    patches.octaves = 4;
+    patches.seed = seed;
+    NoiseParameters blades;
+    blades.type = NoiseType::Value;
+    blades.cells_x = 128;
+    blades.cells_y = 32;
+    blades.octaves = 2;
+    blades.seed = seed + 1;
+    float* patch_noise = scratch[0].data();
+    float* blade_noise = scratch[1].data();
+    ProceduralTexture::noise_row(patches, width, height, row, patch_noise);
+    ProceduralTexture::noise_row(blades, width, height, row, blade_noise);
+
+    for (int x = 0; x < width; ++x) {
+        float dark = smoothstep(-0.15f, -0.3f, patch_noise[x]);
+        float light = smoothstep(0.2f, 0.35f, patch_noise[x]);
+        float r = 34.0f + (0.0f - 34.0f) * dark + (50.0f - 34.0f) * light;
+        float g = 139.0f + (100.0f - 139.0f) * dark + (205.0f - 139.0f) * light;
+        float b = 34.0f + (0.0f - 34.0f) * dark + (50.0f - 34.0f) * light;
+        float blade = blade_noise[x] * 15.0f;
+        store_texel(out + x * CHANNELS, r + blade, g + blade, b + blade);
+    }
+}
+
+void noise_pattern_row(int width, int height, int row, uint32_t seed, std::vector<float>* scratch,
+                       unsigned char* out) {
+    NoiseParameters parameters;
+    parameters.octaves = 5;
+    parameters.seed = seed;
+    float* noise = scratch[0].data();
+    ProceduralTexture::noise_row(parameters, width, height, row, noise);
+    for (int x = 0; x < width; ++x) {
+        float shade = 127.5f + noise[x] * 127.5f;
+        store_texel(out + x * CHANNELS, shade, shade, shade);
+    }
+}
+
+// Generate the rows in bands across the pool
+std::vector<unsigned char> generate_rows(int width, int height, uint32_t seed, RowGenerator generator) {
+    constexpr size_t SCRATCH_ROWS = 3;
+    if (width <= 0 || height <= 0) {
+        return {};
+    }
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * CHANNELS);
+    ThreadPool::shared().parallel_for(height, [&](size_t begin, size_t end) {
+        std::vector<float> scratch[SCRATCH_ROWS];
+        for (std::vector<float>& rows : scratch) {
+            rows.resize(width);
+        }
+        for (size_t y = begin; y < end; ++y) {
+            generator(width, height, static_cast<int>(y), seed, scratch,
+                      pixels.data() + y * static_cast<size_t>(width) * CHANNELS);
+        }
+    }, BAND_ROWS);
+    return pixels;
+}
+
+} // namespace
+
+float ProceduralTexture::noise(NoiseType type, float x, float y, uint32_t seed, uint32_t period_x,
+                               uint32_t period_y) {
+    switch (type) {
+        case NoiseType::Value:
+            return value_noise(x, y, seed, period_x, period_y);
+        case NoiseType::Perlin:
+            return perlin_noise(x, y, seed, period_x, period_y);
+        case NoiseType::Simplex:
+            return simplex_noise(x, y, seed, period_x, period_y);
+    }
+    return 0.0f;
+}
+
+void ProceduralTexture::noise_row(const NoiseParameters& parameters, int width, int height, int row, float* out) {
+    auto value = [](auto x, auto y, uint32_t seed, uint32_t period_x, uint32_t period_y) {
+        return value_noise(x, y, seed, period_x, period_y);
+    };
+    auto perlin = [](auto x, auto y, uint32_t seed, uint32_t period_x, uint32_t period_y) {
+        return perlin_noise(x, y, seed, period_x, period_y);
+    };
+    auto simplex = [](auto x, auto y, uint32_t seed, uint32_t period_x, uint32_t period_y) {
+        return simplex_noise(x, y, seed, period_x, period_y);
+    };
+    switch (parameters.type) {
+        case NoiseType::Value:
+            fractal_row(parameters, width, height, row, out, true, value);
+            break;
+        case NoiseType::Perlin:
+            fractal_row(parameters, width, height, row, out, true, perlin);
+            break;
+        case NoiseType::Simplex:
+            fractal_row(parameters, width, height, row, out, false, simplex);
+            break;
+    }
+}
+
+std::vector<unsigned char> ProceduralTexture::generate(ProceduralPattern pattern, int width, int height,
+                                                       uint32_t seed) {
+    switch (pattern) {
+        case ProceduralPattern::Checkerboard:
+            return generate_rows(width, height, seed, checkerboard_row);
+        case ProceduralPattern::Brick:
+            return generate_rows(width, height, seed, brick_row);
+        case ProceduralPattern::Wood:
+            return generate_rows(width, height, seed, wood_row);
+        case ProceduralPattern::Metal:
+            return generate_rows(width, height, seed, metal_row);
+        case ProceduralPattern::Grass:
+            return generate_rows(width, height, seed, grass_row);
+        case ProceduralPattern::Noise:
+            return generate_rows(width, height, seed, noise_pattern_row);
+    }
+    return {};
+}
+
+std::vector<unsigned char> ProceduralTexture::noise_texture(const NoiseParameters& parameters, int width,
+                                                            int height) {
+    if (width <= 0 || height <= 0) {
+        return {};
+    }
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * CHANNELS);
+    ThreadPool::shared().parallel_for(height, [&](size_t begin, size_t end) {
+        std::vector<float> noise(width);
+        for (size_t y = begin; y < end; ++y) {
+            noise_row(parameters, width, height, static_cast<int>(y), noise.data());
+            unsigned char* out = pixels.data() + y * static_cast<size_t>(width) * CHANNELS;
+            for (int x = 0; x < width; ++x) {
+                float shade = 127.5f + noise[x] * 127.5f;
+                store_texel(out + x * CHANNELS, shade, shade, shade);
+            }
+        }
+    }, BAND_ROWS);
+    return pixels;
+}
+
+const char* ProceduralTexture::name(ProceduralPattern pattern) {
+    switch (pattern) {
+        case ProceduralPattern::Checkerboard:
+            return "Checkerboard";
+        case ProceduralPattern::Brick:
+            return "Brick";
+        case ProceduralPattern::Wood:
+            return "Wood";
+        case ProceduralPattern::Metal:
+            return "Metal";
+        case ProceduralPattern::Grass:
+            return "Grass";
+        case ProceduralPattern::Noise:
+            return "Noise";
+    }
+    return "?";
+}
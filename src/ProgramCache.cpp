@@ -0,0 +1,128 @@
+#include "ProgramCache.h"
+#include "MappedFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+std::string gl_string(GLenum name) {
+    const auto* value = reinterpret_cast<const char*>(glGetString(name));
+    return value ? value : "";
+}
+
+} // namespace
+
+bool ProgramCache::is_supported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    // Some drivers expose the entry points but no formats
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    return format_count > 0;
+}
+
+uint64_t ProgramCache::key(std::initializer_list<std::string_view> sources) {
+    // Binaries only load on the driver that produced them
+    std::string text = gl_string(GL_VENDOR) + '\n' + gl_string(GL_RENDERER) + '\n' + gl_string(GL_VERSION);
+    for (std::string_view source : sources) {
+        text += '\0';
+        text += source;
+    }
+    return MappedFile::content_hash(text);
+}
+
+std::string ProgramCache::cache_path(uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.glprog", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(CACHE_DIRECTORY) / name).string();
+}
+
+void ProgramCache::prepare(GLuint program) {
+    if (is_supported()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+}
+
+bool ProgramCache::load(GLuint program, uint64_t key) {
+    std::string path = cache_path(key);
+    std::error_code error;
+    if (!is_supported() || !std::filesystem::exists(path, error)) {
+        return false;
+    }
+
+    MappedFile file(path);
+    if (!file.is_open() || file.size() < sizeof(ProgramCacheHeader)) {
+        return false;
+    }
+    const auto* header = reinterpret_cast<const ProgramCacheHeader*>(file.data());
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION ||
+        header->key != key || sizeof(ProgramCacheHeader) + header->binary_size > file.size()) {
+        std::cerr << "Warning: ignoring invalid program cache " << path << std::endl;
+        return false;
+    }
+
+    glProgramBinary(program, header->binary_format, file.data() + sizeof(ProgramCacheHeader),
+                    static_cast<GLsizei>(header->binary_size));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+bool ProgramCache::store(GLuint program, uint64_t key) {
+    if (!is_supported()) {
+        return false;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return false;
+    }
+
+    ProgramCacheHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.key = key;
+    header.binary_format = format;
+    header.binary_size = static_cast<uint32_t>(written);
+
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIRECTORY, error);
+    std::string path = cache_path(key);
+
+    // Write next to the final name and rename, so a crash never leaves a
+    // half written binary that looks valid
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::PROGRAM_CACHE::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), written);
+        if (!out) {
+            std::cerr << "ERROR::PROGRAM_CACHE::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::cerr << "ERROR::PROGRAM_CACHE::CANNOT_WRITE: " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
@@ -1,164 +1,208 @@
 #include "Shader.h"
-#include <fstream>
-#include <sstream>
+#include "AssetPack.h"
+#include "FrameUniforms.h"
+#include "ProgramCache.h"
+#include <algorithm>
 #include <iostream>
 
-Shader::Shader(const std::string& vertex_path, const std::string& fragment_path) {
-    // Load shader source code
-    std::string vertex_code = load_shader_source(vertex_path);
-    std::string fragment_code = load_shader_source(fragment_path);
+Shader::Shader(const std::string& vertex_path, const std::string& fragment_path)
+        : Shader(vertex_path, fragment_path, std::span<const std::string>()) {
+}
 
-    // Compile shaders
-    GLuint vertex_shader = compile_shader(vertex_code, GL_VERTEX_SHADER);
-    GLuint fragment_shader = compile_shader(fragment_code, GL_FRAGMENT_SHADER);
+Shader::Shader(const std::string& vertex_path, const std::string& fragment_path,
+               std::span<const std::string> defines, Compile compile) {
+    // Load shader source code, straight from the asset pack when mounted
+    AssetFile vertex_file(vertex_path);
+    AssetFile fragment_file(fragment_path);
+    std::string_view vertex_code = load_shader_source(vertex_file, vertex_path);
+    std::string_view fragment_code = load_shader_source(fragment_file, fragment_path);
+    std::string vertex_source;
+    std::string fragment_source;
+    if (!defines.empty()) {
+        vertex_source = with_defines(vertex_code, defines);
+        fragment_source = with_defines(fragment_code, defines);
+        vertex_code = vertex_source;
+        fragment_code = fragment_source;
+    }
 
-    // Create shader program
+    // Create shader program, from the binary an earlier run saved if possible
     id = glCreateProgram();
-    glAttachShader(id, vertex_shader);
-    glAttachShader(id, fragment_shader);
-    glLinkProgram(id);
-
-    // Check for linking errors
-    check_compile_errors(id, "PROGRAM");
+    uint64_t key = ProgramCache::key({vertex_code, fragment_code});
+    if (ProgramCache::load(id, key)) {
+        reflect_uniforms();
+        return;
+    }
 
-    // Delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+    // Compile and link; the driver may carry on after this returns
+    start_link({compile_shader(vertex_code, GL_VERTEX_SHADER), compile_shader(fragment_code, GL_FRAGMENT_SHADER)},
+               key);
+    if (compile == Compile::Wait) {
+        wait();
+    }
 }
 
 Shader::Shader(const std::string& vertex_path, const std::string& fragment_path, const std::string& geometry_path) {
     // Load shader source code
-    std::string vertex_code = load_shader_source(vertex_path);
-    std::string fragment_code = load_shader_source(fragment_path);
-    std::string geometry_code = load_shader_source(geometry_path);
-
-    // Compile shaders
-    GLuint vertex_shader = compile_shader(vertex_code, GL_VERTEX_SHADER);
-    GLuint fragment_shader = compile_shader(fragment_code, GL_FRAGMENT_SHADER);
-    GLuint geometry_shader = compile_shader(geometry_code, GL_GEOMETRY_SHADER);
-
-    // Create shader program
+    AssetFile vertex_file(vertex_path);
+    AssetFile fragment_file(fragment_path);
+    AssetFile geometry_file(geometry_path);
+    std::string_view vertex_code = load_shader_source(vertex_file, vertex_path);
+    std::string_view fragment_code = load_shader_source(fragment_file, fragment_path);
+    std::string_view geometry_code = load_shader_source(geometry_file, geometry_path);
+
+    // Create shader program, from a saved binary if possible
     id = glCreateProgram();
-    glAttachShader(id, vertex_shader);
-    glAttachShader(id, fragment_shader);
-    glAttachShader(id, geometry_shader);
-    glLinkProgram(id);
-
-    // Check for linking errors
-    check_compile_errors(id, "PROGRAM");
+    uint64_t key = ProgramCache::key({vertex_code, fragment_code, geometry_code});
+    if (ProgramCache::load(id, key)) {
+        reflect_uniforms();
+        return;
+    }
 
-    // Delete the shaders
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    glDeleteShader(geometry_shader);
+    // Compile and link
+    start_link({compile_shader(vertex_code, GL_VERTEX_SHADER), compile_shader(fragment_code, GL_FRAGMENT_SHADER),
+                compile_shader(geometry_code, GL_GEOMETRY_SHADER)},
+               key);
+    wait();
 }
 
 Shader::~Shader() {
+    for (GLuint stage : pending_stages) {
+        glDeleteShader(stage);
+    }
     if (id != 0) {
         glDeleteProgram(id);
     }
 }
 
-Shader::Shader(Shader&& other) noexcept : id(other.id), uniform_cache(std::move(other.uniform_cache)) {
+Shader::Shader(Shader&& other) noexcept
+        : id(other.id), pending_stages(std::move(other.pending_stages)), cache_key(other.cache_key),
+          uniforms(std::move(other.uniforms)), missing_uniforms(std::move(other.missing_uniforms)) {
     other.id = 0; // Prevent the moved-from object from deleting the program
+    other.pending_stages.clear();
 }
 
 Shader& Shader::operator=(Shader&& other) noexcept {
     if (this != &other) {
         // Delete current program if it exists
+        for (GLuint stage : pending_stages) {
+            glDeleteShader(stage);
+        }
         if (id != 0) {
             glDeleteProgram(id);
         }
 
         // Move resources
         id = other.id;
-        uniform_cache = std::move(other.uniform_cache);
+        pending_stages = std::move(other.pending_stages);
+        cache_key = other.cache_key;
+        uniforms = std::move(other.uniforms);
+        missing_uniforms = std::move(other.missing_uniforms);
 
         // Prevent moved-from object from deleting the program
         other.id = 0;
+        other.pending_stages.clear();
     }
     return *this;
 }
 
-void Shader::use() const {
-    glUseProgram(id);
+bool Shader::update() {
+    if (is_ready()) {
+        return true;
+    }
+    if (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &done);
+        if (done != GL_TRUE) {
+            return false;
+        }
+    }
+    wait();
+    return true;
 }
 
-void Shader::set_bool(const std::string& name, bool value) const {
-    glUniform1i(get_uniform_location(name), static_cast<int>(value));
-}
+void Shader::wait() {
+    if (is_ready()) {
+        return;
+    }
 
-void Shader::set_int(const std::string& name, int value) const {
-    glUniform1i(get_uniform_location(name), value);
-}
+    // Querying the status is what waits for the driver
+    for (GLuint stage : pending_stages) {
+        GLint type = 0;
+        glGetShaderiv(stage, GL_SHADER_TYPE, &type);
+        check_compile_errors(stage, type == GL_VERTEX_SHADER     ? "VERTEX"
+                                    : type == GL_FRAGMENT_SHADER ? "FRAGMENT"
+                                                                 : "GEOMETRY");
+    }
+    check_compile_errors(id, "PROGRAM");
+    store_binary(cache_key);
+    reflect_uniforms();
 
-void Shader::set_float(const std::string& name, float value) const {
-    glUniform1f(get_uniform_location(name), value);
+    // Delete the shaders as they're linked into our program now and no longer necessary
+    for (GLuint stage : pending_stages) {
+        glDeleteShader(stage);
+    }
+    pending_stages.clear();
 }
 
-void Shader::set_vec2(const std::string& name, const glm::vec2& value) const {
-    glUniform2fv(get_uniform_location(name), 1, &value[0]);
+void Shader::use() const {
+    glUseProgram(id);
 }
 
-void Shader::set_vec2(const std::string& name, float x, float y) const {
-    glUniform2f(get_uniform_location(name), x, y);
+void Shader::set_bool(UniformId uniform, bool value) const {
+    glUniform1i(uniform_location(uniform), static_cast<int>(value));
 }
 
-void Shader::set_vec3(const std::string& name, const glm::vec3& value) const {
-    GLint location = glGetUniformLocation(id, name.c_str());
-    if (location != -1) {
-        glUniform3fv(location, 1, &value[0]);
-    }
+void Shader::set_int(UniformId uniform, int value) const {
+    glUniform1i(uniform_location(uniform), value);
 }
 
-void Shader::set_vec3(const std::string& name, float x, float y, float z) const {
-    glUniform3f(get_uniform_location(name), x, y, z);
+void Shader::set_float(UniformId uniform, float value) const {
+    glUniform1f(uniform_location(uniform), value);
 }
 
-void Shader::set_vec4(const std::string& name, const glm::vec4& value) const {
-    glUniform4fv(get_uniform_location(name), 1, &value[0]);
+void Shader::set_vec2(UniformId uniform, const glm::vec2& value) const {
+    glUniform2fv(uniform_location(uniform), 1, &value[0]);
 }
 
-void Shader::set_vec4(const std::string& name, float x, float y, float z, float w) const {
-    glUniform4f(get_uniform_location(name), x, y, z, w);
+void Shader::set_vec2(UniformId uniform, float x, float y) const {
+    glUniform2f(uniform_location(uniform), x, y);
 }
 
-void Shader::set_mat2(const std::string& name, const glm::mat2& mat) const {
-    glUniformMatrix2fv(get_uniform_location(name), 1, GL_FALSE, &mat[0][0]);
+void Shader::set_vec3(UniformId uniform, const glm::vec3& value) const {
+    glUniform3fv(uniform_location(uniform), 1, &value[0]);
 }
 
-void Shader::set_mat3(const std::string& name, const glm::mat3& mat) const {
-    glUniformMatrix3fv(get_uniform_location(name), 1, GL_FALSE, &mat[0][0]);
+void Shader::set_vec3(UniformId uniform, float x, float y, float z) const {
+    glUniform3f(uniform_location(uniform), x, y, z);
 }
 
-void Shader::set_mat4(const std::string& name, const glm::mat4& mat) const {
-    glUniformMatrix4fv(get_uniform_location(name), 1, GL_FALSE, &mat[0][0]);
+void Shader::set_vec4(UniformId uniform, const glm::vec4& value) const {
+    glUniform4fv(uniform_location(uniform), 1, &value[0]);
 }
 
-std::string Shader::load_shader_source(const std::string& path) const {
-    std::string shader_code;
-    std::ifstream shader_file;
+void Shader::set_vec4(UniformId uniform, float x, float y, float z, float w) const {
+    glUniform4f(uniform_location(uniform), x, y, z, w);
+}
 
-    // Ensure ifstream objects can throw exceptions
-    shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+void Shader::set_mat2(UniformId uniform, const glm::mat2& mat) const {
+    glUniformMatrix2fv(uniform_location(uniform), 1, GL_FALSE, &mat[0][0]);
+}
 
-    try {
-        // Open files
-        shader_file.open(path);
-        std::stringstream shader_stream;
+void Shader::set_mat3(UniformId uniform, const glm::mat3& mat) const {
+    glUniformMatrix3fv(uniform_location(uniform), 1, GL_FALSE, &mat[0][0]);
+}
 
-        // Read file's buffer contents into streams
-        shader_stream << shader_file.rdbuf();
+void Shader::set_mat4(UniformId uniform, const glm::mat4& mat) const {
+    glUniformMatrix4fv(uniform_location(uniform), 1, GL_FALSE, &mat[0][0]);
+}
 
-        // Close file handlers
-        shader_file.close();
+void Shader::set_vec3_array(UniformId uniform, const float* values, int count) const {
+    glUniform3fv(uniform_location(uniform), count, values);
+}
 
-        // Convert stream into string
-        shader_code = shader_stream.str();
-    }
-    catch (std::ifstream::failure& e) {
-        std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        std::cerr << "Failed to load shader: " << path << std::endl;
+std::string_view Shader::load_shader_source(const AssetFile& file, const std::string& path) const {
+    if (!file.is_open()) {
+        std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
 
         // Return a basic fallback shader based on the path
         if (path.find("vert") != std::string::npos || path.find(".vert") != std::string::npos) {
@@ -173,16 +217,37 @@ std::string Shader::load_shader_source(const std::string& path) const {
                 out vec3 Normal;
                 out vec2 TexCoord;
 
+                layout (std140) uniform Frame {
+                    mat4 view;
+                    mat4 projection;
+                    vec4 cameraPosition;
+                    vec4 lightPosition;
+                    vec4 lightColor;
+                } frame;
+
                 uniform mat4 model;
-                uniform mat4 view;
-                uniform mat4 projection;
+
+                uniform vec3 positionOffset;
+                uniform vec3 positionScale;
+                uniform bool octNormals;
+
+                vec3 oct_decode(vec2 e) {
+                    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+                    float t = max(-n.z, 0.0);
+                    n.x += n.x >= 0.0 ? -t : t;
+                    n.y += n.y >= 0.0 ? -t : t;
+                    return normalize(n);
+                }
 
                 void main() {
-                    FragPos = vec3(model * vec4(aPos, 1.0));
-                    Normal = mat3(transpose(inverse(model))) * aNormal;
+                    vec3 position = positionOffset + aPos * positionScale;
+                    vec3 normal = octNormals ? oct_decode(aNormal.xy) : aNormal;
+
+                    FragPos = vec3(model * vec4(position, 1.0));
+                    Normal = mat3(transpose(inverse(model))) * normal;
                     TexCoord = aTexCoord;
 
-                    gl_Position = projection * view * vec4(FragPos, 1.0);
+                    gl_Position = frame.projection * frame.view * vec4(FragPos, 1.0);
                 }
             )";
         } else {
@@ -195,12 +260,21 @@ std::string Shader::load_shader_source(const std::string& path) const {
                 in vec3 Normal;
                 in vec2 TexCoord;
 
+                layout (std140) uniform Frame {
+                    mat4 view;
+                    mat4 projection;
+                    vec4 cameraPosition;
+                    vec4 lightPosition;
+                    vec4 lightColor;
+                } frame;
+
                 uniform vec3 objectColor;
-                uniform vec3 lightColor;
-                uniform vec3 lightPos;
-                uniform vec3 viewPos;
 
                 void main() {
+                    vec3 lightColor = frame.lightColor.rgb;
+                    vec3 lightPos = frame.lightPosition.xyz;
+                    vec3 viewPos = frame.cameraPosition.xyz;
+
                     // Ambient
                     float ambientStrength = 0.1;
                     vec3 ambient = ambientStrength * lightColor;
@@ -225,27 +299,59 @@ std::string Shader::load_shader_source(const std::string& path) const {
         }
     }
 
-    return shader_code;
+    return file.view();
+}
+
+std::string Shader::with_defines(std::string_view source, std::span<const std::string> defines) {
+    // #version has to stay the first directive
+    size_t insert_at = 0;
+    size_t version = source.find("#version");
+    if (version != std::string_view::npos) {
+        size_t line_end = source.find('\n', version);
+        insert_at = line_end == std::string_view::npos ? source.size() : line_end + 1;
+    }
+
+    std::string result(source.substr(0, insert_at));
+    if (insert_at > 0 && result.back() != '\n') {
+        result += '\n';
+    }
+    for (const std::string& define : defines) {
+        result += "#define ";
+        result += define;
+        result += '\n';
+    }
+    result += source.substr(insert_at);
+    return result;
 }
 
-GLuint Shader::compile_shader(const std::string& source, GLenum type) const {
+GLuint Shader::compile_shader(std::string_view source, GLenum type) const {
     GLuint shader = glCreateShader(type);
-    const char* source_cstr = source.c_str();
-    glShaderSource(shader, 1, &source_cstr, nullptr);
+    // Sources are views into the file and not terminated
+    const char* source_data = source.data();
+    GLint source_length = static_cast<GLint>(source.size());
+    glShaderSource(shader, 1, &source_data, &source_length);
+    // Errors are checked by wait(), so compiles and the link can overlap
     glCompileShader(shader);
+    return shader;
+}
 
-    // Check for compilation errors
-    std::string type_string;
-    if (type == GL_VERTEX_SHADER)
-        type_string = "VERTEX";
-    else if (type == GL_FRAGMENT_SHADER)
-        type_string = "FRAGMENT";
-    else if (type == GL_GEOMETRY_SHADER)
-        type_string = "GEOMETRY";
-
-    check_compile_errors(shader, type_string);
+void Shader::start_link(std::initializer_list<GLuint> stages, uint64_t key) {
+    for (GLuint stage : stages) {
+        glAttachShader(id, stage);
+    }
+    ProgramCache::prepare(id);
+    glLinkProgram(id);
+    pending_stages.assign(stages.begin(), stages.end());
+    cache_key = key;
+}
 
-    return shader;
+void Shader::store_binary(uint64_t key) const {
+    // Failed links are left to be reported again next run
+    GLint linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (linked == GL_TRUE) {
+        ProgramCache::store(id, key);
+    }
 }
 
 void Shader::check_compile_errors(GLuint shader, const std::string& type) const {
@@ -271,19 +377,84 @@ void Shader::check_compile_errors(GLuint shader, const std::string& type) const
     }
 }
 
-GLint Shader::get_uniform_location(const std::string& name) const {
-    // Check if location is already cached
-    auto it = uniform_cache.find(name);
-    if (it != uniform_cache.end()) {
-        return it->second;
+void Shader::reflect_uniforms() {
+    uniforms.clear();
+    GLint linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        return;
     }
 
-    // Get location and cache it
-    GLint location = glGetUniformLocation(id, name.c_str());
-    if (location == -1) {
-        std::cerr << "Warning: uniform '" << name << "' doesn't exist or is not used!" << std::endl;
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::string name(static_cast<size_t>(std::max(max_length, 1)), '\0');
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id, static_cast<GLuint>(i), max_length, &length, &size, &type, name.data());
+        std::string_view active(name.data(), static_cast<size_t>(length));
+        GLint location = glGetUniformLocation(id, name.c_str());
+        // Uniform block members have no location
+        if (location == -1) {
+            continue;
+        }
+
+        // Arrays are reported as name[0]; their elements are found by index
+        // and the whole array by the bare name too
+        constexpr std::string_view first_element = "[0]";
+        if (active.size() > first_element.size() && active.ends_with(first_element)) {
+            std::string base(active.substr(0, active.size() - first_element.size()));
+            uniforms.emplace_back(UniformId::hash_name(base), location);
+            for (GLint element = 0; element < size; ++element) {
+                std::string element_name = base + "[" + std::to_string(element) + "]";
+                GLint element_location = element == 0 ? location : glGetUniformLocation(id, element_name.c_str());
+                uniforms.emplace_back(UniformId::hash_name(element_name), element_location);
+            }
+        } else {
+            uniforms.emplace_back(UniformId::hash_name(active), location);
+        }
+    }
+    std::sort(uniforms.begin(), uniforms.end());
+
+    // GLSL 330 can't set block bindings in the shader, and relinking or
+    // loading a binary resets them
+    GLuint frame_block = glGetUniformBlockIndex(id, FrameUniforms::BLOCK_NAME);
+    if (frame_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(id, frame_block, FrameUniforms::BINDING);
     }
 
-    uniform_cache[name] = location;
-    return location;
-}
\ No newline at end of file
+    for (size_t i = 1; i < uniforms.size(); ++i) {
+        if (uniforms[i].first == uniforms[i - 1].first) {
+            std::cerr << "Warning: two uniforms share the name hash " << uniforms[i].first << std::endl;
+        }
+    }
+}
+
+GLint Shader::find_uniform(uint64_t hash) const {
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), hash,
+                               [](const std::pair<uint64_t, GLint>& entry, uint64_t hash) {
+                                   return entry.first < hash;
+                               });
+    return it != uniforms.end() && it->first == hash ? it->second : -1;
+}
+
+bool Shader::has_uniform(UniformId uniform) const {
+    return find_uniform(uniform.hash) != -1;
+}
+
+GLint Shader::uniform_location(UniformId uniform) const {
+    GLint location = find_uniform(uniform.hash);
+    if (location != -1) {
+        return location;
+    }
+
+    // Warn once per name; setting location -1 is a no-op in GL
+    if (std::find(missing_uniforms.begin(), missing_uniforms.end(), uniform.hash) == missing_uniforms.end()) {
+        missing_uniforms.push_back(uniform.hash);
+        std::cerr << "Warning: uniform '" << uniform.name << "' doesn't exist or is not used!" << std::endl;
+    }
+    return -1;
+}
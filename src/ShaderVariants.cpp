@@ -0,0 +1,106 @@
+#include "ShaderVariants.h"
+#include <bit>
+#include <iostream>
+#include <utility>
+
+ShaderVariants::ShaderVariants(std::string vertex_path, std::string fragment_path,
+                               std::vector<std::string> keywords, Setup setup)
+        : vertex_path(std::move(vertex_path)), fragment_path(std::move(fragment_path)),
+          keywords(std::move(keywords)), setup(std::move(setup)) {
+    if (this->keywords.size() > MAX_KEYWORDS) {
+        std::cerr << "Warning: " << this->fragment_path << " has more than " << MAX_KEYWORDS
+                  << " keywords, ignoring the rest" << std::endl;
+        this->keywords.resize(MAX_KEYWORDS);
+    }
+}
+
+uint32_t ShaderVariants::keyword(std::string_view name) const {
+    for (size_t i = 0; i < keywords.size(); ++i) {
+        if (keywords[i] == name) {
+            return uint32_t(1) << i;
+        }
+    }
+    return 0;
+}
+
+void ShaderVariants::prepare(uint32_t mask) {
+    find_or_start(mask);
+}
+
+bool ShaderVariants::update() {
+    bool all_ready = true;
+    for (auto& [mask, variant] : variants) {
+        if (!variant.set_up && variant.shader.update()) {
+            finish(variant);
+        }
+        all_ready = all_ready && variant.set_up;
+    }
+    return all_ready;
+}
+
+const Shader& ShaderVariants::variant(uint32_t mask) {
+    Variant& variant = find_or_start(mask);
+    if (!variant.set_up) {
+        variant.shader.wait();
+        finish(variant);
+    }
+    return variant.shader;
+}
+
+const Shader* ShaderVariants::find_ready(uint32_t mask) {
+    Variant& variant = find_or_start(mask);
+    if (!variant.set_up) {
+        if (!variant.shader.update()) {
+            return nullptr;
+        }
+        finish(variant);
+    }
+    return &variant.shader;
+}
+
+const Shader* ShaderVariants::find_ready_subset(uint32_t mask, uint32_t& found_mask) const {
+    const Shader* found = nullptr;
+    for (const auto& [variant_mask, variant] : variants) {
+        if (!variant.set_up || (variant_mask & ~mask) != 0) {
+            continue;
+        }
+        if (found == nullptr || std::popcount(variant_mask) > std::popcount(found_mask)) {
+            found = &variant.shader;
+            found_mask = variant_mask;
+        }
+    }
+    return found;
+}
+
+uint32_t ShaderVariants::valid_mask(uint32_t mask) const {
+    // Bits without a keyword would only compile duplicates
+    if (keywords.size() < MAX_KEYWORDS) {
+        mask &= (uint32_t(1) << keywords.size()) - 1;
+    }
+    return mask;
+}
+
+ShaderVariants::Variant& ShaderVariants::find_or_start(uint32_t mask) {
+    mask = valid_mask(mask);
+    auto it = variants.find(mask);
+    if (it != variants.end()) {
+        return it->second;
+    }
+
+    std::vector<std::string> defines;
+    for (size_t i = 0; i < keywords.size(); ++i) {
+        if (mask & (uint32_t(1) << i)) {
+            defines.push_back(keywords[i]);
+        }
+    }
+    Variant variant{Shader(vertex_path, fragment_path, defines, Shader::Compile::Background)};
+    return variants.emplace(mask, std::move(variant)).first->second;
+}
+
+void ShaderVariants::finish(Variant& variant) {
+    variant.set_up = true;
+    if (setup) {
+        variant.shader.use();
+        setup(variant.shader);
+    }
+}
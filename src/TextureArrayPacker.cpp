@@ -0,0 +1,51 @@
+#include "TextureArrayPacker.h"
+#include <algorithm>
+
+TextureArrayPacker::TextureArrayPacker(int max_layers) : max_layers(std::max(max_layers, 1)) {
+}
+
+TextureLayer TextureArrayPacker::add(const TextureArrayFormat& format) {
+    // Fill the last group of this format, start another when it is full
+    auto group = std::find_if(groups.rbegin(), groups.rend(),
+                              [&format](const Group& candidate) { return candidate.format == format; });
+    if (group == groups.rend() || group->layers >= max_layers) {
+        groups.push_back({format, 0});
+        group = groups.rbegin();
+    }
+    int array = static_cast<int>(std::distance(group, groups.rend())) - 1;
+    return {array, group->layers++};
+}
+
+std::vector<GLuint> TextureArrayPacker::create_arrays() const {
+    std::vector<GLuint> arrays(groups.size());
+    if (arrays.empty()) {
+        return arrays;
+    }
+    glGenTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+    for (size_t i = 0; i < groups.size(); ++i) {
+        const TextureArrayFormat& format = groups[i].format;
+        int levels = MipGenerator::level_count(format.width, format.height);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+        for (int level = 0; level < levels; ++level) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(format.width >> level, 1),
+                         std::max(format.height >> level, 1), groups[i].layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format.wrap_s);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format.wrap_t);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, format.min_filter);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, format.mag_filter);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return arrays;
+}
+
+void TextureArrayPacker::upload(int layer, const MipChain& mips) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (size_t level = 0; level < mips.levels.size(); ++level) {
+        const MipLevel& mip = mips.levels[level];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, layer, mip.width, mip.height, 1, GL_RGBA,
+                        GL_UNSIGNED_BYTE, mips.pixels.data() + mip.offset);
+    }
+}
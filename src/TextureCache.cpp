@@ -0,0 +1,244 @@
+#include "TextureCache.h"
+#include "AssetPack.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Content hash of a whole file, 0 when it can't be read
+uint64_t hash_file(const std::string& path) {
+    AssetFile file(path);
+    return file.is_open() ? file.content_hash() : 0;
+}
+
+} // namespace
+
+TextureHandle::TextureHandle(Slot* slot) : slot(slot) {
+    ++slot->references;
+}
+
+TextureHandle::~TextureHandle() {
+    release();
+}
+
+TextureHandle::TextureHandle(const TextureHandle& other) : slot(other.slot) {
+    if (slot != nullptr) {
+        ++slot->references;
+    }
+}
+
+TextureHandle& TextureHandle::operator=(const TextureHandle& other) {
+    if (slot != other.slot) {
+        release();
+        slot = other.slot;
+        if (slot != nullptr) {
+            ++slot->references;
+        }
+    }
+    return *this;
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) noexcept : slot(std::exchange(other.slot, nullptr)) {
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle&& other) noexcept {
+    if (this != &other) {
+        release();
+        slot = std::exchange(other.slot, nullptr);
+    }
+    return *this;
+}
+
+GLuint TextureHandle::id() const {
+    if (slot == nullptr) {
+        return 0;
+    }
+    if (slot->texture != nullptr && slot->texture->name != 0) {
+        return slot->texture->name;
+    }
+    return slot->cache->placeholder;
+}
+
+void TextureHandle::release() {
+    if (slot != nullptr && --slot->references == 0) {
+        slot->last_used = ++slot->cache->clock;
+    }
+    slot = nullptr;
+}
+
+TextureCache::TextureCache(size_t budget_bytes) : budget_bytes(budget_bytes) {
+}
+
+TextureCache::~TextureCache() {
+    clear();
+}
+
+TextureHandle TextureCache::acquire(const std::string& path) {
+    if (placeholder == 0) {
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        const unsigned char grey[4] = {128, 128, 128, 255};
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    std::string key = std::filesystem::path(path).lexically_normal().generic_string();
+    auto found = slots.find(key);
+    if (found != slots.end()) {
+        return TextureHandle(found->second.get());
+    }
+
+    auto slot = std::make_unique<TextureHandle::Slot>();
+    slot->cache = this;
+    slot->path = key;
+    slot->hash = ThreadPool::shared().submit([key]() { return hash_file(key); });
+    TextureHandle handle(slot.get());
+    slots.emplace(key, std::move(slot));
+    return handle;
+}
+
+void TextureCache::update() {
+    for (auto& [path, slot] : slots) {
+        if (slot->texture == nullptr && slot->hash.valid() &&
+            slot->hash.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            resolve(*slot, slot->hash.get());
+        }
+    }
+    loader.update();
+    measure();
+    if (total_bytes > budget_bytes) {
+        evict();
+    }
+}
+
+size_t TextureCache::pending() const {
+    size_t hashing = std::count_if(slots.begin(), slots.end(),
+                                   [](const auto& entry) { return entry.second->hash.valid(); });
+    return hashing + loader.pending();
+}
+
+void TextureCache::resolve(TextureHandle::Slot& slot, uint64_t content_hash) {
+    std::unique_ptr<Texture>& texture = textures[content_hash];
+    if (!texture) {
+        // Unreadable files share one entry that keeps showing the placeholder
+        texture = std::make_unique<Texture>();
+        texture->content_hash = content_hash;
+        if (content_hash != 0) {
+            texture->name = loader.load(slot.path);
+        }
+    }
+    slot.texture = texture.get();
+}
+
+void TextureCache::measure() {
+    for (auto& [content_hash, texture] : textures) {
+        if (texture->bytes != 0 || texture->name == 0 || loader.is_pending(texture->name)) {
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture->name);
+        GLint compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+
+        // Every level the loader specified: RGBA8, or whatever the driver
+        // reports for block compressed ones
+        size_t bytes = 0;
+        for (GLint level = 0;; ++level) {
+            GLint width = 0;
+            GLint height = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0) {
+                break;
+            }
+            if (compressed == GL_TRUE) {
+                GLint level_bytes = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &level_bytes);
+                bytes += static_cast<size_t>(level_bytes);
+            } else {
+                bytes += static_cast<size_t>(width) * static_cast<size_t>(height) * 4;
+            }
+            if (width <= 1 && height <= 1) {
+                break;
+            }
+        }
+        texture->bytes = bytes;
+        total_bytes += bytes;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureCache::evict() {
+    // A texture can go once none of its paths is held; it was last used when
+    // the last of them was released
+    struct Candidate {
+        Texture* texture;
+        uint64_t last_used;
+    };
+    std::unordered_map<Texture*, Candidate> candidates;
+    std::vector<Texture*> held;
+    for (auto& [path, slot] : slots) {
+        if (slot->texture == nullptr) {
+            continue;
+        }
+        if (slot->references > 0) {
+            held.push_back(slot->texture);
+            continue;
+        }
+        Candidate& candidate = candidates.try_emplace(slot->texture, Candidate{slot->texture, 0}).first->second;
+        candidate.last_used = std::max(candidate.last_used, slot->last_used);
+    }
+    for (Texture* texture : held) {
+        candidates.erase(texture);
+    }
+
+    std::vector<Candidate> order;
+    for (auto& [texture, candidate] : candidates) {
+        if (texture->bytes != 0) {
+            order.push_back(candidate);
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [](const Candidate& a, const Candidate& b) { return a.last_used < b.last_used; });
+
+    for (const Candidate& candidate : order) {
+        if (total_bytes <= budget_bytes) {
+            break;
+        }
+        Texture* texture = candidate.texture;
+        for (auto it = slots.begin(); it != slots.end();) {
+            if (it->second->texture == texture) {
+                it = slots.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        loader.unload(texture->name);
+        total_bytes -= texture->bytes;
+        textures.erase(texture->content_hash);
+    }
+}
+
+void TextureCache::clear() {
+    for (auto it = slots.begin(); it != slots.end();) {
+        TextureHandle::Slot& slot = *it->second;
+        if (slot.hash.valid()) {
+            slot.hash.wait();
+            slot.hash = {};
+        }
+        slot.texture = nullptr;
+        it = slot.references == 0 ? slots.erase(it) : std::next(it);
+    }
+    textures.clear();
+    total_bytes = 0;
+    loader.clear();
+    if (placeholder != 0) {
+        glDeleteTextures(1, &placeholder);
+        placeholder = 0;
+    }
+}
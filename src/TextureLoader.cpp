@@ -0,0 +1,396 @@
+#include "TextureLoader.h"
+#include "Ktx2File.h"
+#include "AssetPack.h"
+#include "MipCache.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+// Images larger than this are copied into their pixel buffer by several jobs
+constexpr size_t COPY_CHUNK_BYTES = size_t(4) << 20;
+
+// Pixel buffers beyond this many are deleted instead of kept for reuse
+constexpr size_t MAX_FREE_PIXEL_BUFFERS = 4;
+
+constexpr size_t BYTES_PER_PIXEL = 4;
+
+template <typename T>
+bool is_ready(const std::future<T>& future) {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+size_t image_bytes(int width, int height) {
+    return static_cast<size_t>(width) * static_cast<size_t>(height) * BYTES_PER_PIXEL;
+}
+
+// The KTX2 file to load instead of path: path itself, or the baked file next
+// to it unless the image was edited after baking. Empty when there is none.
+std::string baked_path(const std::string& path) {
+    std::filesystem::path source(path);
+    if (source.extension() == ".ktx2") {
+        return path;
+    }
+    std::string baked = Ktx2File::baked_path_for(path);
+    // A pack holds what was baked when it was built
+    if (AssetPack::mounted().find(baked) != nullptr) {
+        return baked;
+    }
+    std::error_code error;
+    auto baked_time = std::filesystem::last_write_time(baked, error);
+    if (error) {
+        return {};
+    }
+    auto source_time = std::filesystem::last_write_time(source, error);
+    return error || baked_time >= source_time ? baked : std::string();
+}
+
+// Sampled as UNORM even when the file is sRGB: the RGBA8 path keeps sRGB
+// bytes in GL_RGBA8 too and the shaders expect them that way
+GLenum compressed_format(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case BlockFormat::BC3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BlockFormat::BC5:
+            return GL_COMPRESSED_RG_RGTC2;
+        case BlockFormat::BC7:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+// RGTC is core in 3.3, S3TC and BPTC are extensions
+bool is_supported(GLenum format) {
+    switch (format) {
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return GLEW_EXT_texture_compression_s3tc;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            return GLEW_ARB_texture_compression_bptc;
+        default:
+            return true;
+    }
+}
+
+} // namespace
+
+TextureLoader::~TextureLoader() {
+    clear();
+}
+
+TextureLoader::TextureLoader(TextureLoader&& other) noexcept
+        : textures(std::exchange(other.textures, {})), pending_loads(std::exchange(other.pending_loads, {})),
+          free_pixel_buffers(std::exchange(other.free_pixel_buffers, {})), upload_budget(other.upload_budget),
+          mip_filter(other.mip_filter) {
+}
+
+TextureLoader& TextureLoader::operator=(TextureLoader&& other) noexcept {
+    if (this != &other) {
+        clear();
+        textures = std::exchange(other.textures, {});
+        pending_loads = std::exchange(other.pending_loads, {});
+        free_pixel_buffers = std::exchange(other.free_pixel_buffers, {});
+        upload_budget = other.upload_budget;
+        mip_filter = other.mip_filter;
+    }
+    return *this;
+}
+
+GLuint TextureLoader::load(const std::string& path, bool srgb) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char placeholder[4] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    textures.push_back(texture);
+
+    PendingLoad pending;
+    pending.texture = texture;
+    pending.path = path;
+    pending.decode = ThreadPool::shared().submit([path, srgb, filter = mip_filter]() {
+        DecodedImage decoded;
+
+        // Baked levels upload as they are
+        std::string ktx2_path = baked_path(path);
+        if (!ktx2_path.empty()) {
+            auto ktx2 = std::make_shared<Ktx2File>(ktx2_path);
+            if (!ktx2->is_valid()) {
+                decoded.error = "invalid KTX2 file";
+                return decoded;
+            }
+            if (!ktx2->is_bottom_up()) {
+                std::cerr << "Warning: " << ktx2_path << " stores rows top to bottom, it will show upside down"
+                          << std::endl;
+            }
+            // Levels are stored smallest first without overlapping, which
+            // Ktx2File checks, so the last one starts the region that holds
+            // them all
+            size_t start = ktx2->level_offset(ktx2->level_count() - 1);
+            for (size_t i = 0; i < ktx2->level_count(); ++i) {
+                decoded.levels.push_back({std::max(ktx2->width() >> i, 1), std::max(ktx2->height() >> i, 1),
+                                          ktx2->level_offset(i) - start, ktx2->level_size(i)});
+            }
+            decoded.compressed_format = compressed_format(ktx2->format());
+            decoded.size = ktx2->level_offset(0) + ktx2->level_size(0) - start;
+            decoded.pixels = std::shared_ptr<const unsigned char>(ktx2, ktx2->file_data() + start);
+            return decoded;
+        }
+
+        // A cache from an earlier run holds the finished levels
+        std::string cache_path = MipCache::cache_path_for(path);
+        auto cache = std::make_shared<MipCache>(cache_path);
+        if (cache->is_up_to_date(path, filter, srgb)) {
+            decoded.levels = cache->levels();
+            decoded.size = cache->pixel_size();
+            decoded.pixels = std::shared_ptr<const unsigned char>(cache, cache->pixel_data());
+            return decoded;
+        }
+
+        AssetFile file(path);
+        if (!file.is_open()) {
+            decoded.error = "can't open file";
+            return decoded;
+        }
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        std::unique_ptr<stbi_uc, void (*)(void*)> image(
+                stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), static_cast<int>(file.size()),
+                                      &width, &height, &channels, 4),
+                stbi_image_free);
+        if (!image) {
+            decoded.error = stbi_failure_reason();
+            return decoded;
+        }
+
+        // stb_image decodes the top row first while GL expects the bottom row
+        // first, flip before filtering so the cache holds upload ready levels
+        size_t row_bytes = image_bytes(width, 1);
+        std::vector<unsigned char> row(row_bytes);
+        for (int top = 0, bottom = height - 1; top < bottom; ++top, --bottom) {
+            unsigned char* a = image.get() + top * row_bytes;
+            unsigned char* b = image.get() + bottom * row_bytes;
+            std::memcpy(row.data(), a, row_bytes);
+            std::memcpy(a, b, row_bytes);
+            std::memcpy(b, row.data(), row_bytes);
+        }
+
+        auto chain = std::make_shared<MipChain>(MipGenerator::generate(image.get(), width, height, filter, srgb));
+        image.reset();
+        MipCache::write(cache_path, *chain, path, filter, srgb);
+        decoded.levels = chain->levels;
+        decoded.size = chain->pixels.size();
+        decoded.pixels = std::shared_ptr<const unsigned char>(chain, chain->pixels.data());
+        return decoded;
+    });
+    pending_loads.push_back(std::move(pending));
+    return texture;
+}
+
+size_t TextureLoader::update() {
+    size_t budget = upload_budget;
+    bool started = false;
+
+    for (auto it = pending_loads.begin(); it != pending_loads.end();) {
+        if (it->pixel_buffer != 0) {
+            // Uploading: specify the texture once every copy has landed
+            bool copied = std::all_of(it->copies.begin(), it->copies.end(),
+                                      [](const std::future<void>& copy) { return is_ready(copy); });
+            if (!copied) {
+                ++it;
+                continue;
+            }
+            finish_upload(*it);
+            it = pending_loads.erase(it);
+            continue;
+        }
+
+        // Decoded: start the upload if this frame still has budget for it
+        if (!it->image.pixels) {
+            if (!is_ready(it->decode)) {
+                ++it;
+                continue;
+            }
+            it->image = it->decode.get();
+            if (!it->image.pixels) {
+                std::cerr << "ERROR::TEXTURE::FAILED_TO_LOAD: " << it->path << ": "
+                          << (it->image.error ? it->image.error : "unknown error") << std::endl;
+                it = pending_loads.erase(it);
+                continue;
+            }
+            if (it->image.compressed_format != 0 && !is_supported(it->image.compressed_format)) {
+                std::cerr << "ERROR::TEXTURE::UNSUPPORTED_COMPRESSION: " << it->path << std::endl;
+                it = pending_loads.erase(it);
+                continue;
+            }
+        }
+        size_t bytes = it->image.size;
+        if (started && bytes > budget) {
+            ++it;
+            continue;
+        }
+        budget -= std::min(budget, bytes);
+        started = true;
+
+        if (start_upload(*it)) {
+            ++it;
+        } else {
+            it = pending_loads.erase(it);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return pending();
+}
+
+bool TextureLoader::start_upload(PendingLoad& load) {
+    const DecodedImage& image = load.image;
+
+    GLuint pixel_buffer = 0;
+    if (free_pixel_buffers.empty()) {
+        glGenBuffers(1, &pixel_buffer);
+    } else {
+        pixel_buffer = free_pixel_buffers.back();
+        free_pixel_buffers.pop_back();
+    }
+
+    // Fresh storage each time, so the driver never waits for an earlier
+    // transfer out of the same buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(image.size), nullptr, GL_STREAM_DRAW);
+    auto* target = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                                static_cast<GLsizeiptr>(image.size),
+                                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (target == nullptr) {
+        // No mapping, upload straight from the decoded pixels instead
+        free_pixel_buffers.push_back(pixel_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        load.pixel_buffer = 0;
+        finish_upload(load);
+        return false;
+    }
+    load.pixel_buffer = pixel_buffer;
+
+    const unsigned char* source = image.pixels.get();
+    ThreadPool& pool = ThreadPool::shared();
+    for (size_t chunk = 0; chunk < image.size; chunk += COPY_CHUNK_BYTES) {
+        size_t bytes = std::min(COPY_CHUNK_BYTES, image.size - chunk);
+        load.copies.push_back(pool.submit([target, source, chunk, bytes]() {
+            std::memcpy(target + chunk, source + chunk, bytes);
+        }));
+    }
+    return true;
+}
+
+void TextureLoader::finish_upload(PendingLoad& load) {
+    const DecodedImage& image = load.image;
+    glBindTexture(GL_TEXTURE_2D, load.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Levels come from the bound buffer when the copies landed in it, and
+    // from client memory when the driver dropped or never mapped its contents
+    const unsigned char* base = image.pixels.get();
+    if (load.pixel_buffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.pixel_buffer);
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+            base = nullptr;
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // With a buffer bound the calls only queue the transfers
+    for (size_t i = 0; i < image.levels.size(); ++i) {
+        const MipLevel& level = image.levels[i];
+        const void* data = base != nullptr ? static_cast<const void*>(base + level.offset)
+                                           : reinterpret_cast<const void*>(level.offset);
+        if (image.compressed_format != 0) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), image.compressed_format, level.width,
+                                   level.height, 0, static_cast<GLsizei>(level.size), data);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA8, level.width, level.height, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, data);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    if (load.pixel_buffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (free_pixel_buffers.size() < MAX_FREE_PIXEL_BUFFERS) {
+            free_pixel_buffers.push_back(load.pixel_buffer);
+        } else {
+            glDeleteBuffers(1, &load.pixel_buffer);
+        }
+        load.pixel_buffer = 0;
+    }
+    load.copies.clear();
+    load.image = {};
+}
+
+bool TextureLoader::is_pending(GLuint texture) const {
+    return std::any_of(pending_loads.begin(), pending_loads.end(),
+                       [texture](const PendingLoad& load) { return load.texture == texture; });
+}
+
+void TextureLoader::unload(GLuint texture) {
+    auto owned = std::find(textures.begin(), textures.end(), texture);
+    if (owned == textures.end()) {
+        return;
+    }
+    auto pending = std::find_if(pending_loads.begin(), pending_loads.end(),
+                                [texture](const PendingLoad& load) { return load.texture == texture; });
+    if (pending != pending_loads.end()) {
+        cancel(*pending);
+        pending_loads.erase(pending);
+    }
+    glDeleteTextures(1, &texture);
+    textures.erase(owned);
+}
+
+void TextureLoader::cancel(PendingLoad& load) {
+    // Jobs write into the pixel buffer mapping, so it stays until they finish
+    if (load.decode.valid()) {
+        load.decode.wait();
+    }
+    for (std::future<void>& copy : load.copies) {
+        copy.wait();
+    }
+    if (load.pixel_buffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.pixel_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &load.pixel_buffer);
+        load.pixel_buffer = 0;
+    }
+}
+
+void TextureLoader::clear() {
+    for (PendingLoad& load : pending_loads) {
+        cancel(load);
+    }
+    pending_loads.clear();
+
+    if (!free_pixel_buffers.empty()) {
+        glDeleteBuffers(static_cast<GLsizei>(free_pixel_buffers.size()), free_pixel_buffers.data());
+        free_pixel_buffers.clear();
+    }
+    if (!textures.empty()) {
+        glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+        textures.clear();
+    }
+}
@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+    thread_count = std::max(thread_count, 1u);
+    workers.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_condition.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        tasks.push(std::move(task));
+    }
+    queue_condition.notify_one();
+}
+
+void ThreadPool::worker_loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t, size_t)>& body, size_t min_batch) {
+    if (count == 0) {
+        return;
+    }
+
+    // A few batches per thread keeps everyone busy when batches are uneven
+    size_t batch_count = std::min<size_t>(count / std::max<size_t>(min_batch, 1), size() * 4u + 4u);
+    if (batch_count <= 1) {
+        body(0, count);
+        return;
+    }
+    size_t batch_size = (count + batch_count - 1) / batch_count;
+    batch_count = (count + batch_size - 1) / batch_size;
+
+    // Batches are claimed from a shared counter, so whoever gets there first
+    // does the work. The caller never waits on a batch nobody has started.
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+        std::atomic<bool> failed{false};
+        // First exception thrown by body, guarded by mutex
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto state = std::make_shared<State>();
+
+    // A throwing batch must still count as finished, or the caller would wait
+    // forever; batches claimed after a failure are skipped
+    auto run_batches = [state, &body, count, batch_size, batch_count]() {
+        size_t batch;
+        while ((batch = state->next.fetch_add(1)) < batch_count) {
+            if (!state->failed.load()) {
+                size_t begin = batch * batch_size;
+                try {
+                    body(begin, std::min(begin + batch_size, count));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                    state->failed = true;
+                }
+            }
+            if (state->finished.fetch_add(1) + 1 == batch_count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(size(), batch_count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        enqueue(run_batches);
+    }
+    run_batches();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state, batch_count]() { return state->finished.load() == batch_count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
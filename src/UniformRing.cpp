@@ -0,0 +1,120 @@
+#include "UniformRing.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+} // namespace
+
+UniformRing::UniformRing(GLuint binding, size_t size) : binding(binding), size(size) {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t align = static_cast<size_t>(std::max(alignment, 1));
+    stride = (size + align - 1) / align * align;
+    auto total = static_cast<GLsizeiptr>(stride * SECTION_COUNT);
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, total, nullptr, flags);
+        mapping = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags));
+        if (mapping == nullptr) {
+            std::cerr << "Warning: persistent uniform buffer mapping failed, uploading instead" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        }
+    }
+    if (mapping == nullptr) {
+        glBufferData(GL_UNIFORM_BUFFER, total, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRing::~UniformRing() {
+    release();
+}
+
+UniformRing::UniformRing(UniformRing&& other) noexcept
+        : buffer(std::exchange(other.buffer, 0)), binding(other.binding), size(other.size), stride(other.stride),
+          mapping(std::exchange(other.mapping, nullptr)), fences(std::exchange(other.fences, {})),
+          section(other.section) {
+}
+
+UniformRing& UniformRing::operator=(UniformRing&& other) noexcept {
+    if (this != &other) {
+        release();
+        buffer = std::exchange(other.buffer, 0);
+        binding = other.binding;
+        size = other.size;
+        stride = other.stride;
+        mapping = std::exchange(other.mapping, nullptr);
+        fences = std::exchange(other.fences, {});
+        section = other.section;
+    }
+    return *this;
+}
+
+void UniformRing::update(const void* data) {
+    if (!is_valid()) {
+        return;
+    }
+    section = (section + 1) % SECTION_COUNT;
+
+    // Only blocks when the GPU is SECTION_COUNT frames behind
+    GLsync& fence = fences[section];
+    if (fence != nullptr) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+        while (status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, 0, FENCE_TIMEOUT_NS);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    size_t offset = stride * section;
+    if (mapping != nullptr) {
+        std::memcpy(mapping + offset, data, size);
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, static_cast<GLintptr>(offset),
+                      static_cast<GLsizeiptr>(size));
+}
+
+void UniformRing::end_frame() {
+    if (!is_valid()) {
+        return;
+    }
+    GLsync& fence = fences[section];
+    if (fence != nullptr) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformRing::release() {
+    for (GLsync& fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (buffer != 0) {
+        if (mapping != nullptr) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            mapping = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
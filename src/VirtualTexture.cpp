@@ -0,0 +1,414 @@
+#include "VirtualTexture.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+// Page table texel pointing at a cache slot holding a tile of level
+uint32_t page_entry(int slot_x, int slot_y, int level) {
+    return static_cast<uint32_t>(slot_x) | static_cast<uint32_t>(slot_y) << 8 | static_cast<uint32_t>(level) << 16 |
+           0xFFu << 24;
+}
+
+int key_level(uint64_t tile) {
+    return static_cast<int>(tile >> 48);
+}
+
+int key_y(uint64_t tile) {
+    return static_cast<int>((tile >> 24) & 0xFFFFFF);
+}
+
+int key_x(uint64_t tile) {
+    return static_cast<int>(tile & 0xFFFFFF);
+}
+
+} // namespace
+
+VirtualTexture::VirtualTexture(const std::string& path)
+        : file(std::make_unique<VirtualTextureFile>(path)) {
+    if (!file->is_valid()) {
+        return;
+    }
+
+    // As many slots as the driver allows, up to PHYSICAL_TILES per side;
+    // page table entries hold slot coordinates in a byte
+    int stored = file->stored_tile_size();
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    physical_tiles = std::clamp(static_cast<int>(max_size) / stored, 1, std::min(PHYSICAL_TILES, 255));
+    slots.resize(static_cast<size_t>(physical_tiles) * physical_tiles);
+
+    glGenTextures(1, &physical_cache);
+    glBindTexture(GL_TEXTURE_2D, physical_cache);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physical_tiles * stored, physical_tiles * stored, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    glGenTextures(1, &page_table);
+    glBindTexture(GL_TEXTURE_2D, page_table);
+    for (int level = 0; level < file->level_count(); ++level) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, file->pages_x(level), file->pages_y(level), 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, nullptr);
+        page_entries.emplace_back(static_cast<size_t>(file->pages_x(level)) * file->pages_y(level), 0);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file->level_count() - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &feedback_buffer);
+
+    // The last level covers everything, every page table entry falls back to it
+    int top = file->level_count() - 1;
+    upload(tile_key(top, 0, 0), file->tile_data(top, 0, 0), true);
+    update_page_table();
+}
+
+VirtualTexture::~VirtualTexture() {
+    release();
+}
+
+VirtualTexture::VirtualTexture(VirtualTexture&& other) noexcept
+        : file(std::move(other.file)), page_table(std::exchange(other.page_table, 0)),
+          physical_cache(std::exchange(other.physical_cache, 0)), physical_tiles(other.physical_tiles),
+          feedback_framebuffer(std::exchange(other.feedback_framebuffer, 0)),
+          feedback_color(std::exchange(other.feedback_color, 0)),
+          feedback_depth(std::exchange(other.feedback_depth, 0)),
+          feedback_buffer(std::exchange(other.feedback_buffer, 0)),
+          feedback_fence(std::exchange(other.feedback_fence, nullptr)),
+          feedback_width(std::exchange(other.feedback_width, 0)),
+          feedback_height(std::exchange(other.feedback_height, 0)), slots(std::exchange(other.slots, {})),
+          resident(std::exchange(other.resident, {})), pending(std::exchange(other.pending, {})),
+          page_entries(std::exchange(other.page_entries, {})), page_table_dirty(other.page_table_dirty),
+          frame(other.frame) {
+}
+
+VirtualTexture& VirtualTexture::operator=(VirtualTexture&& other) noexcept {
+    if (this != &other) {
+        release();
+        file = std::move(other.file);
+        page_table = std::exchange(other.page_table, 0);
+        physical_cache = std::exchange(other.physical_cache, 0);
+        physical_tiles = other.physical_tiles;
+        feedback_framebuffer = std::exchange(other.feedback_framebuffer, 0);
+        feedback_color = std::exchange(other.feedback_color, 0);
+        feedback_depth = std::exchange(other.feedback_depth, 0);
+        feedback_buffer = std::exchange(other.feedback_buffer, 0);
+        feedback_fence = std::exchange(other.feedback_fence, nullptr);
+        feedback_width = std::exchange(other.feedback_width, 0);
+        feedback_height = std::exchange(other.feedback_height, 0);
+        slots = std::exchange(other.slots, {});
+        resident = std::exchange(other.resident, {});
+        pending = std::exchange(other.pending, {});
+        page_entries = std::exchange(other.page_entries, {});
+        page_table_dirty = other.page_table_dirty;
+        frame = other.frame;
+    }
+    return *this;
+}
+
+uint64_t VirtualTexture::tile_key(int level, int x, int y) {
+    return static_cast<uint64_t>(level) << 48 | static_cast<uint64_t>(y) << 24 | static_cast<uint64_t>(x);
+}
+
+void VirtualTexture::bind(const Shader& shader, GLuint first_unit) const {
+    glActiveTexture(GL_TEXTURE0 + first_unit);
+    glBindTexture(GL_TEXTURE_2D, page_table);
+    glActiveTexture(GL_TEXTURE0 + first_unit + 1);
+    glBindTexture(GL_TEXTURE_2D, physical_cache);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.set_int("virtual_texture.page_table", static_cast<int>(first_unit));
+    shader.set_int("virtual_texture.physical_cache", static_cast<int>(first_unit + 1));
+    shader.set_float("virtual_texture.tile_border", static_cast<float>(file->tile_border()));
+    set_parameters(shader, 0.0f);
+}
+
+void VirtualTexture::set_parameters(const Shader& shader, float lod_bias) const {
+    float padded_width = static_cast<float>(file->pages_x(0) * file->tile_size());
+    float padded_height = static_cast<float>(file->pages_y(0) * file->tile_size());
+    shader.set_vec2("virtual_texture.size", padded_width, padded_height);
+    shader.set_vec2("virtual_texture.uv_scale", static_cast<float>(file->width()) / padded_width,
+                    static_cast<float>(file->height()) / padded_height);
+    shader.set_float("virtual_texture.max_level", static_cast<float>(file->level_count() - 1));
+    shader.set_float("virtual_texture.tile_size", static_cast<float>(file->tile_size()));
+    shader.set_float("virtual_texture.lod_bias", lod_bias);
+}
+
+bool VirtualTexture::begin_feedback(int framebuffer_width, int framebuffer_height) {
+    if (!is_valid() || feedback_fence != nullptr) {
+        return false;
+    }
+
+    int width = std::max(framebuffer_width / FEEDBACK_SCALE, 1);
+    int height = std::max(framebuffer_height / FEEDBACK_SCALE, 1);
+    if (width != feedback_width || height != feedback_height) {
+        if (feedback_framebuffer == 0) {
+            glGenFramebuffers(1, &feedback_framebuffer);
+            glGenTextures(1, &feedback_color);
+            glGenRenderbuffers(1, &feedback_depth);
+        }
+        glBindTexture(GL_TEXTURE_2D, feedback_color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return false;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4 * sizeof(uint16_t), nullptr,
+                     GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedback_width = width;
+        feedback_height = height;
+    }
+
+    // Zero alpha marks texels no virtual textured surface covers
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer);
+    glViewport(0, 0, feedback_width, feedback_height);
+    const GLuint clear_color[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clear_color);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void VirtualTexture::bind_feedback(const Shader& shader) const {
+    // Feedback pixels are FEEDBACK_SCALE times larger, so are their derivatives
+    set_parameters(shader, -std::log2(static_cast<float>(FEEDBACK_SCALE)));
+}
+
+void VirtualTexture::end_feedback(int framebuffer_width, int framebuffer_height) {
+    // Into the pack buffer without waiting; update() maps it once the fence
+    // says the copy is done
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_buffer);
+    glReadPixels(0, 0, feedback_width, feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, framebuffer_width, framebuffer_height);
+}
+
+size_t VirtualTexture::update() {
+    if (!is_valid()) {
+        return 0;
+    }
+    ++frame;
+
+    if (feedback_fence != nullptr) {
+        GLenum status = glClientWaitSync(feedback_fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(feedback_fence);
+            feedback_fence = nullptr;
+            size_t count = static_cast<size_t>(feedback_width) * feedback_height;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_buffer);
+            const void* texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                  static_cast<GLsizeiptr>(count * 4 * sizeof(uint16_t)),
+                                                  GL_MAP_READ_BIT);
+            if (texels != nullptr) {
+                process_feedback(static_cast<const uint16_t*>(texels), count);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // Copy finished tiles into the cache; the rest wait for the next frame
+    size_t uploads = 0;
+    glBindTexture(GL_TEXTURE_2D, physical_cache);
+    for (auto it = pending.begin(); it != pending.end() && uploads < MAX_UPLOADS_PER_UPDATE;) {
+        if (it->data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        std::vector<unsigned char> data = it->data.get();
+        upload(it->tile, data.data(), false);
+        ++uploads;
+        it = pending.erase(it);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (page_table_dirty) {
+        update_page_table();
+    }
+    return pending.size();
+}
+
+void VirtualTexture::process_feedback(const uint16_t* texels, size_t count) {
+    std::vector<uint64_t> tiles;
+    for (size_t i = 0; i < count; ++i) {
+        const uint16_t* texel = texels + i * 4;
+        if (texel[3] == 0 || texel[2] >= file->level_count()) {
+            continue;
+        }
+        int level = texel[2];
+        int x = std::min<int>(texel[0], file->tiles_x(level) - 1);
+        int y = std::min<int>(texel[1], file->tiles_y(level) - 1);
+        tiles.push_back(tile_key(level, x, y));
+    }
+    std::sort(tiles.begin(), tiles.end());
+    tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+    // Keep what is in use, then fill gaps coarsest first so every region
+    // gets a sharper fallback before any gets its final tile
+    std::vector<uint64_t> missing;
+    for (uint64_t tile : tiles) {
+        auto found = resident.find(tile);
+        if (found != resident.end()) {
+            slots[found->second].last_used = frame;
+            continue;
+        }
+        int level = key_level(tile);
+        int x = key_x(tile);
+        int y = key_y(tile);
+        while (level < file->level_count()) {
+            uint64_t ancestor = tile_key(level, x, y);
+            auto ancestor_slot = resident.find(ancestor);
+            if (ancestor_slot != resident.end()) {
+                slots[ancestor_slot->second].last_used = frame;
+                break;
+            }
+            missing.push_back(ancestor);
+            ++level;
+            x >>= 1;
+            y >>= 1;
+        }
+    }
+    std::sort(missing.begin(), missing.end(), std::greater<>());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+    for (uint64_t tile : missing) {
+        request(tile);
+    }
+}
+
+void VirtualTexture::request(uint64_t tile) {
+    if (pending.size() >= MAX_PENDING_TILES ||
+        std::any_of(pending.begin(), pending.end(), [tile](const PendingTile& p) { return p.tile == tile; })) {
+        return;
+    }
+    // Reading through the mapping faults the tile in on the pool, so the GL
+    // thread only ever copies memory that is already there
+    const unsigned char* source = file->tile_data(key_level(tile), key_x(tile), key_y(tile));
+    size_t bytes = file->tile_bytes();
+    pending.push_back({tile, ThreadPool::shared().submit([source, bytes]() {
+        return std::vector<unsigned char>(source, source + bytes);
+    })});
+}
+
+bool VirtualTexture::upload(uint64_t tile, const unsigned char* data, bool pinned) {
+    // A free slot, else the least recently needed one not needed this frame
+    uint32_t chosen = static_cast<uint32_t>(slots.size());
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+        const Slot& slot = slots[i];
+        if (slot.tile == EMPTY_TILE) {
+            chosen = i;
+            break;
+        }
+        if (!slot.pinned && slot.last_used < frame &&
+            (chosen == slots.size() || slot.last_used < slots[chosen].last_used)) {
+            chosen = i;
+        }
+    }
+    if (chosen == slots.size()) {
+        // Everything is in use this frame; the tile is requested again later
+        return false;
+    }
+
+    Slot& slot = slots[chosen];
+    if (slot.tile != EMPTY_TILE) {
+        resident.erase(slot.tile);
+    }
+    slot = {tile, frame, pinned};
+    resident[tile] = chosen;
+    page_table_dirty = true;
+
+    int stored = file->stored_tile_size();
+    glBindTexture(GL_TEXTURE_2D, physical_cache);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(chosen % physical_tiles) * stored,
+                    static_cast<GLint>(chosen / physical_tiles) * stored, stored, stored, GL_RGBA, GL_UNSIGNED_BYTE,
+                    data);
+    return true;
+}
+
+void VirtualTexture::update_page_table() {
+    // Coarsest first: a tile that is not resident inherits its parent's entry
+    glBindTexture(GL_TEXTURE_2D, page_table);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = file->level_count() - 1; level >= 0; --level) {
+        int pages_x = file->pages_x(level);
+        int pages_y = file->pages_y(level);
+        std::vector<uint32_t>& entries = page_entries[level];
+        for (int y = 0; y < pages_y; ++y) {
+            for (int x = 0; x < pages_x; ++x) {
+                auto found = resident.find(tile_key(level, x, y));
+                if (found != resident.end()) {
+                    entries[y * pages_x + x] = page_entry(static_cast<int>(found->second % physical_tiles),
+                                                          static_cast<int>(found->second / physical_tiles), level);
+                } else if (level + 1 < file->level_count()) {
+                    entries[y * pages_x + x] = page_entries[level + 1][(y >> 1) * file->pages_x(level + 1) + (x >> 1)];
+                }
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages_x, pages_y, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    page_table_dirty = false;
+}
+
+void VirtualTexture::release() {
+    // Reads point into the file mapping
+    for (PendingTile& tile : pending) {
+        tile.data.wait();
+    }
+    pending.clear();
+
+    if (feedback_fence != nullptr) {
+        glDeleteSync(feedback_fence);
+        feedback_fence = nullptr;
+    }
+    if (feedback_framebuffer != 0) {
+        glDeleteFramebuffers(1, &feedback_framebuffer);
+        glDeleteTextures(1, &feedback_color);
+        glDeleteRenderbuffers(1, &feedback_depth);
+        feedback_framebuffer = 0;
+        feedback_color = 0;
+        feedback_depth = 0;
+    }
+    if (feedback_buffer != 0) {
+        glDeleteBuffers(1, &feedback_buffer);
+        feedback_buffer = 0;
+    }
+    if (page_table != 0) {
+        glDeleteTextures(1, &page_table);
+        page_table = 0;
+    }
+    if (physical_cache != 0) {
+        glDeleteTextures(1, &physical_cache);
+        physical_cache = 0;
+    }
+    slots.clear();
+    resident.clear();
+    page_entries.clear();
+}
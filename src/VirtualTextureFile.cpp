@@ -0,0 +1,293 @@
+#include "VirtualTextureFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Rows filtered into each level per pass; enough to keep the pool busy
+constexpr int VIRTUAL_BAND_ROWS = 256;
+
+// Largest image side a file may declare; keeps the level math in int
+constexpr uint32_t MAX_EXTENT = 1u << 30;
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t next_power_of_two(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+int level_count_for(uint32_t pages_x, uint32_t pages_y) {
+    int levels = 1;
+    for (uint32_t pages = std::max(pages_x, pages_y); pages > 1; pages >>= 1) {
+        ++levels;
+    }
+    return levels;
+}
+
+// Texel extents and stored tiles of every level, x and y interleaved
+void level_layout(uint32_t width, uint32_t height, uint32_t tile_size, int level_count, std::vector<int>& extents,
+                  std::vector<int>& tiles) {
+    extents.clear();
+    tiles.clear();
+    for (int level = 0; level < level_count; ++level) {
+        for (uint32_t extent : {width, height}) {
+            extents.push_back(static_cast<int>(extent));
+            tiles.push_back(static_cast<int>((extent + tile_size - 1) / tile_size));
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+// Rows of one level that are still needed, produced a band at a time from the
+// level above and dropped once both the tile cutter and the level below are
+// past them. Level 0 is the source image itself.
+struct LevelRows {
+    int width = 0;
+    int height = 0;
+    // Rows [first, produced) are held in rows
+    int first = 0;
+    int produced = 0;
+    std::vector<unsigned char> rows;
+    const unsigned char* image = nullptr;
+
+    const unsigned char* row(int y) const {
+        const unsigned char* base = image ? image : rows.data();
+        int start = image ? 0 : first;
+        return base + static_cast<size_t>(y - start) * width * 4;
+    }
+
+    void drop_before(int y) {
+        if (image || y <= first) {
+            return;
+        }
+        y = std::min(y, produced);
+        rows.erase(rows.begin(), rows.begin() + static_cast<ptrdiff_t>(y - first) * width * 4);
+        first = y;
+    }
+};
+
+} // namespace
+
+std::string VirtualTextureFile::baked_path_for(const std::string& source_path) {
+    return std::filesystem::path(source_path).replace_extension(".vtex").string();
+}
+
+bool VirtualTextureFile::write(const std::string& path, const unsigned char* rgba, int width, int height,
+                               MipFilter filter, bool srgb, int tile_size, int tile_border) {
+    if (width <= 0 || height <= 0 || tile_size <= 0 || tile_border < 0) {
+        std::cerr << "ERROR::VIRTUAL_TEXTURE::INVALID_IMAGE: " << path << std::endl;
+        return false;
+    }
+
+    VirtualTextureHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.tile_size = static_cast<uint32_t>(tile_size);
+    header.tile_border = static_cast<uint32_t>(tile_border);
+    header.pages_x = next_power_of_two((header.width + header.tile_size - 1) / header.tile_size);
+    header.pages_y = next_power_of_two((header.height + header.tile_size - 1) / header.tile_size);
+    header.level_count = static_cast<uint32_t>(level_count_for(header.pages_x, header.pages_y));
+    header.srgb = srgb ? 1 : 0;
+    header.tile_offset = align_up(sizeof(VirtualTextureHeader), TILE_ALIGNMENT);
+
+    int level_count = static_cast<int>(header.level_count);
+    std::vector<int> extents;
+    std::vector<int> tiles;
+    level_layout(header.width, header.height, header.tile_size, level_count, extents, tiles);
+    std::vector<uint64_t> first_tile(level_count);
+    for (int level = 0; level < level_count; ++level) {
+        first_tile[level] = header.tile_count;
+        header.tile_count += static_cast<uint64_t>(tiles[level * 2]) * tiles[level * 2 + 1];
+    }
+
+    std::vector<LevelRows> levels(level_count);
+    for (int level = 0; level < level_count; ++level) {
+        levels[level].width = extents[level * 2];
+        levels[level].height = extents[level * 2 + 1];
+    }
+    levels[0].image = rgba;
+    levels[0].produced = height;
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR::VIRTUAL_TEXTURE::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        int stored = tile_size + 2 * tile_border;
+        size_t tile_bytes = static_cast<size_t>(stored) * stored * 4;
+        std::vector<unsigned char> row;
+        std::vector<int> rows_cut(level_count, 0);
+
+        // Cut one row of tiles in parallel and write it where its level keeps it
+        auto cut_row = [&](int level, int page_y) {
+            const LevelRows& source = levels[level];
+            int pages_x = tiles[level * 2];
+            row.resize(tile_bytes * pages_x);
+            ThreadPool::shared().parallel_for(pages_x, [&](size_t begin, size_t end) {
+                for (size_t page_x = begin; page_x < end; ++page_x) {
+                    unsigned char* tile = row.data() + page_x * tile_bytes;
+                    for (int y = 0; y < stored; ++y) {
+                        int source_y = std::clamp(page_y * tile_size - tile_border + y, 0, source.height - 1);
+                        const unsigned char* pixels = source.row(source_y);
+                        for (int x = 0; x < stored; ++x) {
+                            int source_x = std::clamp(static_cast<int>(page_x) * tile_size - tile_border + x, 0,
+                                                      source.width - 1);
+                            std::memcpy(tile + (static_cast<size_t>(y) * stored + x) * 4, pixels + source_x * 4, 4);
+                        }
+                    }
+                }
+            });
+            uint64_t index = first_tile[level] + static_cast<uint64_t>(page_y) * pages_x;
+            out.seekp(static_cast<std::streamoff>(header.tile_offset + index * tile_bytes));
+            out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+        };
+
+        // Last row a tile row reads, exclusive
+        auto rows_needed = [&](int level, int page_y) {
+            return std::min((page_y + 1) * tile_size + tile_border, levels[level].height);
+        };
+
+        // Every pass filters up to a band of rows into each level, as far as
+        // the level above allows, then cuts the tile rows that became complete
+        bool done = false;
+        while (!done && out) {
+            for (int level = 1; level < level_count; ++level) {
+                LevelRows& target = levels[level];
+                const LevelRows& source = levels[level - 1];
+                int last = target.produced;
+                int limit = std::min(target.height, target.produced + VIRTUAL_BAND_ROWS);
+                int low = 0, high = 0;
+                while (last < limit) {
+                    MipGenerator::half_source_rows(source.height, last, last + 1, filter, low, high);
+                    if (high > source.produced) {
+                        break;
+                    }
+                    ++last;
+                }
+                if (last == target.produced) {
+                    continue;
+                }
+                target.rows.resize(static_cast<size_t>(last - target.first) * target.width * 4);
+                MipGenerator::downsample_half([&source](int y) { return source.row(y); }, source.width,
+                                              source.height, target.produced, last, filter, srgb,
+                                              target.rows.data() +
+                                                      static_cast<size_t>(target.produced - target.first) *
+                                                              target.width * 4);
+                target.produced = last;
+            }
+
+            done = true;
+            for (int level = 0; level < level_count; ++level) {
+                LevelRows& source = levels[level];
+                while (rows_cut[level] < tiles[level * 2 + 1] &&
+                       rows_needed(level, rows_cut[level]) <= source.produced) {
+                    cut_row(level, rows_cut[level]++);
+                }
+                done = done && rows_cut[level] == tiles[level * 2 + 1];
+
+                // Keep what the next tile row and the level below still read
+                int keep = rows_cut[level] * tile_size - tile_border;
+                if (level + 1 < level_count && levels[level + 1].produced < levels[level + 1].height) {
+                    int low = 0, high = 0;
+                    MipGenerator::half_source_rows(source.height, levels[level + 1].produced,
+                                                   levels[level + 1].produced + 1, filter, low, high);
+                    keep = std::min(keep, low);
+                }
+                source.drop_before(keep);
+            }
+        }
+
+        if (!out) {
+            std::cerr << "ERROR::VIRTUAL_TEXTURE::CANNOT_WRITE: " << path << std::endl;
+            out.close();
+            std::error_code error;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::cerr << "ERROR::VIRTUAL_TEXTURE::CANNOT_WRITE: " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+VirtualTextureFile::VirtualTextureFile(const std::string& path) : file(path) {
+    if (!file.is_open()) {
+        return;
+    }
+
+    const auto* candidate = reinterpret_cast<const VirtualTextureHeader*>(file.data());
+    bool valid = file.size() >= sizeof(VirtualTextureHeader) &&
+                 std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) == 0 && candidate->version == VERSION &&
+                 candidate->width > 0 && candidate->height > 0 && candidate->width <= MAX_EXTENT &&
+                 candidate->height <= MAX_EXTENT && candidate->tile_size > 0 &&
+                 candidate->tile_size <= MAX_TILE_SIZE && candidate->tile_border <= candidate->tile_size &&
+                 candidate->pages_x > 0 && candidate->pages_y > 0 &&
+                 (candidate->pages_x & (candidate->pages_x - 1)) == 0 &&
+                 (candidate->pages_y & (candidate->pages_y - 1)) == 0 &&
+                 candidate->width <= static_cast<uint64_t>(candidate->pages_x) * candidate->tile_size &&
+                 candidate->height <= static_cast<uint64_t>(candidate->pages_y) * candidate->tile_size &&
+                 static_cast<int>(candidate->level_count) == level_count_for(candidate->pages_x, candidate->pages_y);
+    if (valid) {
+        // Every stored tile of every level has to be in the file
+        std::vector<int> extents;
+        level_layout(candidate->width, candidate->height, candidate->tile_size,
+                     static_cast<int>(candidate->level_count), extents, tile_counts);
+        uint64_t tiles = 0;
+        for (uint32_t level = 0; level < candidate->level_count; ++level) {
+            level_first_tile.push_back(tiles);
+            tiles += static_cast<uint64_t>(tile_counts[level * 2]) * tile_counts[level * 2 + 1];
+        }
+        uint64_t stored = candidate->tile_size + 2ull * candidate->tile_border;
+        uint64_t tile_bytes = stored * stored * 4;
+        valid = tiles == candidate->tile_count && candidate->tile_offset >= sizeof(VirtualTextureHeader) &&
+                candidate->tile_offset <= file.size() && tiles <= (file.size() - candidate->tile_offset) / tile_bytes;
+    }
+    if (!valid) {
+        std::cerr << "ERROR::VIRTUAL_TEXTURE::INVALID_FILE: " << path << std::endl;
+        level_first_tile.clear();
+        tile_counts.clear();
+        return;
+    }
+
+    header = candidate;
+}
+
+size_t VirtualTextureFile::tile_bytes() const {
+    return static_cast<size_t>(stored_tile_size()) * static_cast<size_t>(stored_tile_size()) * 4;
+}
+
+int VirtualTextureFile::pages_x(int level) const {
+    return static_cast<int>(std::max(header->pages_x >> level, 1u));
+}
+
+int VirtualTextureFile::pages_y(int level) const {
+    return static_cast<int>(std::max(header->pages_y >> level, 1u));
+}
+
+const unsigned char* VirtualTextureFile::tile_data(int level, int x, int y) const {
+    uint64_t index = level_first_tile[level] + static_cast<uint64_t>(y) * tiles_x(level) + x;
+    return reinterpret_cast<const unsigned char*>(file.data()) + header->tile_offset + index * tile_bytes();
+}
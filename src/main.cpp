@@ -7,10 +7,29 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "AssetPack.h"
 #include "Camera.h"
+#include "EnvironmentMap.h"
+#include "FrameUniforms.h"
+#include "GltfModel.h"
 #include "Shader.h"
-
+#include "ShaderVariants.h"
+#include "Mesh.h"
+#include "MeshBuilder.h"
+#include "MeshCache.h"
+#include "MipGenerator.h"
+#include "ModelLoader.h"
+#include "NormalGenerator.h"
+#include "ProceduralTexture.h"
+#include "TextureCache.h"
+#include "UniformRing.h"
+#include "VirtualTexture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -19,6 +38,10 @@
 // Settings
 const unsigned int SCR_WIDTH = 1200;
 const unsigned int SCR_HEIGHT = 800;
+// Vertex layout meshes are uploaded with (Compact halves vertex memory)
+const VertexFormat MESH_VERTEX_FORMAT = VertexFormat::Compact;
+// Texture unit of the environment cubemap, after the basic shader's units
+const GLuint ENVIRONMENT_UNIT = 4;
 
 // Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -33,13 +56,24 @@ float last_frame = 0.0f;
 
 // UI state
 bool show_wireframe = false;
-int current_object = 0;  // 0 = cube, 1 = pyramid
+int current_object = 0;  // 0 = cube, 1 = pyramid, then models from assets/models
 int current_shader = 0;  // 0 = basic lighting, 1 = simple color
+int current_texture = 0;  // image file if there is one, then the procedural patterns
+bool auto_lod = true;
+float lod_pixel_error = 1.0f;
+int current_lod = 0;
+bool cluster_culling = true;
+bool backface_culling = false;
+MeshletCullStats cull_stats;
 glm::vec3 object_color(0.8f, 0.3f, 0.3f);
 glm::vec3 light_color(2.0f, 2.0f, 2.0f);
 glm::vec3 light_position(1.2f, 1.0f, 2.0f);
 glm::vec3 object_rotation(0.0f, 0.0f, 0.0f);
 bool auto_rotate = false;
+bool use_virtual_texture = true;
+bool use_environment = true;
+float environment_intensity = 1.0f;
+float roughness = 0.5f;
 float rotation_speed = 1.0f;  // Degrees per second
 
 
@@ -88,104 +122,113 @@ void process_input(GLFWwindow* window) {
         camera.process_keyboard(RIGHT, delta_time);
 }
 
-unsigned int load_texture(const std::string& path);
+// Image textures are shared by path and contents, decode on the thread pool and
+// upload in the background; unused ones are evicted past the budget
+TextureCache texture_cache;
+
+// Returns at once; the handle shows a placeholder until the image is ready
+TextureHandle load_texture(const std::string& path) {
+    return texture_cache.acquire(path);
+}
 
-// Cube vertices with positions, normals, and texture coordinates
+// Cube vertices with positions and texture coordinates (normals are generated and the
+// result welded into an indexed mesh at startup)
 float cube_vertices[] = {
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
+        // positions          // texture coords
+        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+
+        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
+        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
+
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
+        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f
 };
 
-// Pyramid vertices
+// Pyramid vertices, same layout as the cube
 float pyramid_vertices[] = {
         // Base (y = -0.5)
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,  // front left
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,  // front right
-        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,  // back right
-        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,  // back right
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,  // back left
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,  // front left
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  // front left
+        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,  // back right
+        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,  // front right
+        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,  // back right
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,  // front left
+        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,  // back left
 
         // Front face
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.4472f,  0.8944f,  0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f,  0.4472f,  0.8944f,  1.0f, 0.0f,
-        0.0f,  0.5f,  0.0f,  0.0f,  0.4472f,  0.8944f,  0.5f, 1.0f,
+        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+        0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
         // Right face
-        0.5f, -0.5f,  0.5f,  0.8944f,  0.4472f,  0.0f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.8944f,  0.4472f,  0.0f,  1.0f, 0.0f,
-        0.0f,  0.5f,  0.0f,  0.8944f,  0.4472f,  0.0f,  0.5f, 1.0f,
+        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
+        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+        0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
         // Back face
-        0.5f, -0.5f, -0.5f,  0.0f,  0.4472f, -0.8944f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.4472f, -0.8944f,  1.0f, 0.0f,
-        0.0f,  0.5f,  0.0f,  0.0f,  0.4472f, -0.8944f,  0.5f, 1.0f,
+        0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
+        0.0f,  0.5f,  0.0f,  0.5f, 1.0f,
 
         // Left face
-        -0.5f, -0.5f, -0.5f, -0.8944f,  0.4472f,  0.0f,  0.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f, -0.8944f,  0.4472f,  0.0f,  1.0f, 0.0f,
-        0.0f,  0.5f,  0.0f, -0.8944f,  0.4472f,  0.0f,  0.5f, 1.0f
+        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
+        0.0f,  0.5f,  0.0f,  0.5f, 1.0f
 };
 
-unsigned int create_test_texture() {
+// Procedural patterns are generated at this size on every start
+constexpr int PROCEDURAL_TEXTURE_SIZE = 1024;
+
+unsigned int create_procedural_texture(ProceduralPattern pattern, int size) {
     unsigned int texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
-    // Create a simple 2x2 checkered pattern
-    unsigned char data[] = {
-            255, 0, 0, 255,    // Red
-            0, 255, 0, 255,    // Green
-            0, 0, 255, 255,    // Blue
-            255, 255, 0, 255   // Yellow
-    };
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    std::vector<unsigned char> pixels = ProceduralTexture::generate(pattern, size, size);
+    MipChain mips = MipGenerator::generate(pixels.data(), size, size, MipFilter::Kaiser, true);
+    for (size_t level = 0; level < mips.levels.size(); ++level) {
+        const MipLevel& mip = mips.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA8, mip.width, mip.height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, mips.pixels.data() + mip.offset);
+    }
 
+    // The patterns tile
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     return texture;
@@ -247,50 +290,151 @@ int main() {
 
     // Configure OpenGL
     glEnable(GL_DEPTH_TEST);
+    // Filter across cube face edges, which the blurry specular levels need
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // Read assets from the pack built next to the binary when there is one,
+    // anything it lacks still comes from the assets directory
+    const std::string asset_pack_path = "assets.pack";
+    if (std::filesystem::exists(asset_pack_path) && AssetPack::mount(asset_pack_path)) {
+        std::cout << "Mounted " << asset_pack_path << ": " << AssetPack::mounted().entry_count() << " files"
+                  << std::endl;
+    }
+
+    // Load shaders. Material and lighting options are variant keywords, and
+    // each combination compiles the first time something draws with it
+    auto setup_samplers = [](const Shader& shader) {
+        // Array and cube samplers may not share a unit with the 2D samplers
+        if (shader.has_uniform("material.diffuse_array")) {
+            shader.set_int("material.diffuse_array", GltfModel::TEXTURE_ARRAY_UNIT);
+        }
+        if (shader.has_uniform("environment.specular")) {
+            shader.set_int("environment.specular", ENVIRONMENT_UNIT);
+        }
+    };
+    ShaderVariants basic_shaders("assets/shaders/basic.vert", "assets/shaders/basic.frag",
+                                 {"USE_TEXTURE", "USE_TEXTURE_ARRAY", "USE_VIRTUAL_TEXTURE"}, setup_samplers);
+    // ToDo create a proper lighting shader
+    ShaderVariants lighting_shaders("assets/shaders/lighting.vert", "assets/shaders/lighting.frag",
+                                    {"USE_ENVIRONMENT"}, setup_samplers);
+    // Submit every variant the viewer draws with up front, so the driver
+    // compiles them while the models load instead of one by one
+    basic_shaders.prepare(0);
+    basic_shaders.prepare(basic_shaders.keyword("USE_TEXTURE_ARRAY"));
+    basic_shaders.prepare(basic_shaders.keyword("USE_VIRTUAL_TEXTURE"));
+    lighting_shaders.prepare(0);
+    lighting_shaders.prepare(lighting_shaders.keyword("USE_ENVIRONMENT"));
+
+    // View, projection, camera and light go to every program through one
+    // uniform block, written once per frame
+    UniformRing frame_uniforms(FrameUniforms::BINDING, sizeof(FrameUniforms));
+
+    // Set up the built-in objects
+    std::vector<Mesh> meshes;
+    std::vector<std::string> mesh_names;
+    // Normals come from the soup, so every face keeps its own flat normal
+    auto build_primitive = [](const float* data, size_t float_count) {
+        MeshData soup = MeshData::from_interleaved(data, float_count, false);
+        NormalGenerator::compute_normals(soup);
+        return MeshBuilder::weld(soup);
+    };
+    meshes.emplace_back(build_primitive(cube_vertices, sizeof(cube_vertices) / sizeof(float)), MESH_VERTEX_FORMAT);
+    mesh_names.push_back("Cube");
+    meshes.emplace_back(build_primitive(pyramid_vertices, sizeof(pyramid_vertices) / sizeof(float)), MESH_VERTEX_FORMAT);
+    mesh_names.push_back("Pyramid");
+
+    // Load every OBJ, STL, PLY and GLB model shipped in assets/models. GLB models keep
+    // their own primitives and materials and come after the meshes.
+    std::vector<GltfModel> gltf_models;
+    std::vector<std::string> gltf_names;
+    std::vector<std::filesystem::path> model_paths;
+    for (const std::string& file : AssetFile::list("assets/models")) {
+        std::filesystem::path extension = std::filesystem::path(file).extension();
+        if (extension == ".obj" || extension == ".stl" || extension == ".ply" || extension == ".glb") {
+            model_paths.push_back(file);
+        }
+    }
+
+    for (const auto& model_path : model_paths) {
+        std::string path = model_path.string();
+        if (model_path.extension() == ".glb") {
+            GltfModel gltf(path);
+            if (gltf.is_valid()) {
+                gltf_models.push_back(std::move(gltf));
+                gltf_names.push_back(model_path.stem().string());
+            }
+            continue;
+        }
+
+        std::string cache_path = MeshCache::cache_path_for(path);
+
+        // Upload straight from the binary cache when the model is unchanged since the last run
+        MeshCache cache(cache_path);
+        if (cache.is_up_to_date(path) && cache.vertex_format() == MESH_VERTEX_FORMAT) {
+            meshes.emplace_back(cache);
+            mesh_names.push_back(model_path.stem().string());
+            continue;
+        }
+
+        MeshData model = ModelLoader::load(path);
+        if (!model.vertices.empty()) {
+            MeshCache::write(cache_path, model, path, MESH_VERTEX_FORMAT);
+            meshes.emplace_back(model, MESH_VERTEX_FORMAT);
+            mesh_names.push_back(model_path.stem().string());
+        }
+    }
+
+    std::vector<const char*> mesh_name_items;
+    for (const std::string& name : mesh_names) {
+        mesh_name_items.push_back(name.c_str());
+    }
+    for (const std::string& name : gltf_names) {
+        mesh_name_items.push_back(name.c_str());
+    }
+
+    // Image from assets/textures/simple_textures.py if it was run, and the
+    // same patterns generated in engine
+    const std::string texture_path = "assets/textures/checkerboard.png";
+    TextureHandle texture_handle;
+    std::vector<const char*> texture_name_items;
+    if (AssetFile::exists(texture_path)) {
+        texture_handle = load_texture(texture_path);
+        texture_name_items.push_back("checkerboard.png");
+    }
+    auto generate_start = std::chrono::steady_clock::now();
+    std::vector<unsigned int> procedural_textures;
+    for (int i = 0; i < ProceduralTexture::PATTERN_COUNT; ++i) {
+        auto pattern = static_cast<ProceduralPattern>(i);
+        procedural_textures.push_back(create_procedural_texture(pattern, PROCEDURAL_TEXTURE_SIZE));
+        texture_name_items.push_back(ProceduralTexture::name(pattern));
+    }
+    auto generate_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - generate_start);
+    std::cout << "Generated " << procedural_textures.size() << " procedural textures at " << PROCEDURAL_TEXTURE_SIZE
+              << "x" << PROCEDURAL_TEXTURE_SIZE << " in " << static_cast<int>(generate_time.count()) << " ms"
+              << std::endl;
+
+    // Gigapixel image baked with texbake --virtual, streamed tile by tile
+    const std::string virtual_texture_path = "assets/textures/virtual.vtex";
+    VirtualTexture virtual_texture;
+    Shader feedback_shader;
+    if (AssetFile::exists(virtual_texture_path)) {
+        virtual_texture = VirtualTexture(virtual_texture_path);
+        feedback_shader = Shader("assets/shaders/basic.vert", "assets/shaders/vt_feedback.frag", {},
+                                 Shader::Compile::Background);
+    }
 
-    // Load shaders
-    Shader basic_shader("assets/shaders/basic.vert", "assets/shaders/basic.frag");
-    Shader lighting_shader("assets/shaders/lighting.vert", "assets/shaders/lighting.frag"); // ToDo create a proper lighting shader
-
-    // Set up vertex data for cube
-    unsigned int cube_VAO, cube_VBO;
-    glGenVertexArrays(1, &cube_VAO);
-    glGenBuffers(1, &cube_VBO);
-
-    glBindVertexArray(cube_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cube_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // Texture attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    // Set up vertex data for pyramid
-    unsigned int pyramid_VAO, pyramid_VBO;
-    glGenVertexArrays(1, &pyramid_VAO);
-    glGenBuffers(1, &pyramid_VBO);
-
-    glBindVertexArray(pyramid_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, pyramid_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pyramid_vertices), pyramid_vertices, GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // Texture attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    unsigned int texture1 = create_test_texture();
+    // HDR environment for image based lighting and the sky, baked on the
+    // thread pool on first load and cached next to the image
+    const std::string environment_path = "assets/textures/environment.hdr";
+    EnvironmentMap environment_map;
+    Shader skybox_shader;
+    unsigned int skybox_vao = 0;
+    if (AssetFile::exists(environment_path)) {
+        environment_map = EnvironmentMap(environment_path);
+        skybox_shader = Shader("assets/shaders/skybox.vert", "assets/shaders/skybox.frag", {},
+                               Shader::Compile::Background);
+        glGenVertexArrays(1, &skybox_vao);
+    }
 
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
 
@@ -308,6 +452,16 @@ int main() {
         // Input
         process_input(window);
 
+        // Finish buffer and texture uploads that completed in the background
+        for (GltfModel& gltf : gltf_models) {
+            gltf.update();
+        }
+        texture_cache.update();
+        virtual_texture.update();
+        bool environment_ready = environment_map.update();
+        basic_shaders.update();
+        lighting_shaders.update();
+
         // Clear the screen
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -321,10 +475,29 @@ int main() {
         ImGui::Begin("3D Controls");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                     1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("Textures %zu, %.1f / %.0f MB", texture_cache.texture_count(),
+                    texture_cache.gpu_bytes() / 1048576.0, texture_cache.budget() / 1048576.0);
+        if (texture_cache.pending() > 0) {
+            ImGui::Text("Loading %zu textures...", texture_cache.pending());
+        }
+        if (virtual_texture.is_valid()) {
+            ImGui::Checkbox("Virtual Texture", &use_virtual_texture);
+            ImGui::Text("Tiles %zu resident, %zu loading", virtual_texture.resident_tiles(),
+                        virtual_texture.pending_tiles());
+        }
 
+        if (environment_ready) {
+            ImGui::Checkbox("Environment Lighting", &use_environment);
+            if (use_environment) {
+                ImGui::SliderFloat("Environment Intensity", &environment_intensity, 0.0f, 4.0f);
+                ImGui::SliderFloat("Roughness", &roughness, 0.0f, 1.0f);
+            }
+        }
         ImGui::Checkbox("Wireframe", &show_wireframe);
-        ImGui::Combo("Object", &current_object, "Cube\0Pyramid\0");
+        ImGui::Combo("Object", &current_object, mesh_name_items.data(), static_cast<int>(mesh_name_items.size()));
         ImGui::Combo("Shader", &current_shader, "Basic\0Lighting\0");
+        ImGui::Combo("Texture", &current_texture, texture_name_items.data(),
+                     static_cast<int>(texture_name_items.size()));
 
         ImGui::ColorEdit3("Object Color", &object_color.x);
         ImGui::ColorEdit3("Light Color", &light_color.x);
@@ -339,6 +512,33 @@ int main() {
             ImGui::SliderFloat("Rotation Speed", &rotation_speed, 10.0f, 200.0f);
         }
 
+        // Level of detail controls
+        bool showing_gltf = current_object >= static_cast<int>(meshes.size());
+        const Mesh& shown_mesh = meshes[showing_gltf ? 0 : current_object];
+        int lod_count = static_cast<int>(std::max<size_t>(shown_mesh.lods.size(), 1));
+        if (!showing_gltf) {
+            ImGui::Separator();
+            ImGui::Text("Level of Detail");
+            ImGui::Checkbox("Auto LOD", &auto_lod);
+            if (auto_lod) {
+                ImGui::SliderFloat("Max Pixel Error", &lod_pixel_error, 0.25f, 8.0f);
+            } else {
+                ImGui::SliderInt("LOD", &current_lod, 0, lod_count - 1);
+            }
+            current_lod = std::min(current_lod, lod_count - 1);
+            ImGui::Text("LOD %d of %d, %d triangles", current_lod, lod_count,
+                        shown_mesh.lods.empty() ? shown_mesh.vertex_count / 3
+                                                : static_cast<int>(shown_mesh.lods[current_lod].index_count / 3));
+            ImGui::Checkbox("Back-face Culling", &backface_culling);
+            ImGui::Checkbox("Cluster Culling", &cluster_culling);
+            if (cluster_culling && cull_stats.meshlets_total > 0) {
+                ImGui::Text("Meshlets %zu / %zu, triangles %zu / %zu", cull_stats.meshlets_drawn,
+                            cull_stats.meshlets_total, cull_stats.triangles_drawn, cull_stats.triangles_total);
+            }
+        } else if (!gltf_models[current_object - meshes.size()].is_ready()) {
+            ImGui::Text("Streaming...");
+        }
+
         ImGui::End();
 
         // Set wireframe mode
@@ -347,8 +547,34 @@ int main() {
         else
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-        // Choose shader
-        Shader* current_shader_ptr = (current_shader == 0) ? &basic_shader : &lighting_shader;
+        // Choose shader, and the variant of it for what this frame draws
+        bool environment_lit = environment_ready && use_environment;
+        // Built-in objects and models can take their base color from the
+        // virtual texture; only the basic shader knows how to sample it
+        bool virtual_textured = use_virtual_texture && virtual_texture.is_valid() && current_shader == 0 &&
+                                !showing_gltf;
+        ShaderVariants& shaders = (current_shader == 0) ? basic_shaders : lighting_shaders;
+        uint32_t keywords = 0;
+        if (virtual_textured) {
+            keywords |= shaders.keyword("USE_VIRTUAL_TEXTURE");
+        }
+        if (environment_lit) {
+            keywords |= shaders.keyword("USE_ENVIRONMENT");
+        }
+        const Shader* current_shader_ptr = shaders.find_ready(keywords);
+        if (current_shader_ptr == nullptr) {
+            // Draw with the closest variant that has already linked, without
+            // the keywords it lacks, until that one has compiled
+            current_shader_ptr = shaders.find_ready_subset(keywords, keywords);
+            if (current_shader_ptr == nullptr) {
+                // Last resort, only in the first frames before even the plain
+                // variant has linked: wait for it rather than draw nothing
+                keywords = 0;
+                current_shader_ptr = &shaders.variant(0);
+            }
+            environment_lit = environment_lit && (keywords & shaders.keyword("USE_ENVIRONMENT")) != 0;
+            virtual_textured = virtual_textured && (keywords & shaders.keyword("USE_VIRTUAL_TEXTURE")) != 0;
+        }
         current_shader_ptr->use();
         // Debug: Print which shader and try to get uniform locations
         // std::cout << "Using shader: " << (current_shader == 0 ? "basic" : "lighting") << std::endl;
@@ -369,48 +595,110 @@ int main() {
         model = glm::rotate(model, glm::radians(object_rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::rotate(model, glm::radians(object_rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
 
+        FrameUniforms frame;
+        frame.view = view;
+        frame.projection = projection;
+        frame.camera_position = glm::vec4(camera.position, 1.0f);
+        frame.light_position = glm::vec4(light_position, 1.0f);
+        frame.light_color = glm::vec4(light_color, 1.0f);
+        frame_uniforms.update(&frame);
 
         // Only set uniforms that exist in the current shader
         if (current_shader == 0) {  // Basic shader
             current_shader_ptr->set_vec3("objectColor", object_color);
         } else {  // Lighting shader
             current_shader_ptr->set_vec3("objectColor", object_color);
-            current_shader_ptr->set_vec3("lightColor", light_color);
-            current_shader_ptr->set_vec3("lightPos", light_position);
-            current_shader_ptr->set_vec3("viewPos", camera.position);
+            if (environment_lit) {
+                environment_map.bind(*current_shader_ptr, ENVIRONMENT_UNIT);
+                current_shader_ptr->set_float("environment.intensity", environment_intensity);
+                current_shader_ptr->set_float("roughness", roughness);
+            }
         }
 
 
 
-        current_shader_ptr->set_mat4("projection", projection);
-        current_shader_ptr->set_mat4("view", view);
-
-        current_shader_ptr->set_mat4("model", model);
-
-
-
-
-        current_shader_ptr->set_mat4("projection", projection);
-        current_shader_ptr->set_mat4("view", view);
         current_shader_ptr->set_mat4("model", model);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
+        if (texture_handle.is_valid() && current_texture == 0) {
+            glBindTexture(GL_TEXTURE_2D, texture_handle.id());
+        } else {
+            glBindTexture(GL_TEXTURE_2D, procedural_textures[current_texture - (texture_handle.is_valid() ? 1 : 0)]);
+        }
         current_shader_ptr->set_int("texture1", 0);
 
+        if (virtual_textured) {
+            virtual_texture.bind(*current_shader_ptr, 1);
+        }
+
 
-        // Render the chosen object
-        if (current_object == 0) {
-            glBindVertexArray(cube_VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (showing_gltf) {
+            // GLB models draw their own primitives and materials
+            gltf_models[current_object - meshes.size()].draw(shaders, keywords, model);
         } else {
-            glBindVertexArray(pyramid_VAO);
-            glDrawArrays(GL_TRIANGLES, 0, 18);
+            // Pick the coarsest level that stays under the pixel error at the
+            // object's distance, measured to its bounding sphere
+            Mesh& mesh = meshes[current_object];
+            int framebuffer_width = 0, framebuffer_height = 0;
+            glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+            if (auto_lod) {
+                glm::vec3 center = glm::vec3(model * glm::vec4((mesh.bounds.min + mesh.bounds.max) * 0.5f, 1.0f));
+                float radius = glm::length(mesh.bounds.max - mesh.bounds.min) * 0.5f;
+                float distance = std::max(glm::length(camera.position - center) - radius, 0.1f);
+                current_lod = static_cast<int>(mesh.select_lod(distance, camera.fov,
+                                                               static_cast<float>(framebuffer_height),
+                                                               lod_pixel_error));
+            }
+
+            // Record the tiles the object needs at a fraction of the resolution,
+            // read back asynchronously by virtual_texture.update()
+            if (virtual_textured && feedback_shader.update() &&
+                virtual_texture.begin_feedback(framebuffer_width, framebuffer_height)) {
+                feedback_shader.use();
+                feedback_shader.set_mat4("model", model);
+                virtual_texture.bind_feedback(feedback_shader);
+                mesh.apply_vertex_decode(feedback_shader);
+                mesh.draw(current_lod);
+                virtual_texture.end_feedback(framebuffer_width, framebuffer_height);
+                current_shader_ptr->use();
+            }
+
+            // Render the chosen object
+            if (backface_culling) {
+                glEnable(GL_CULL_FACE);
+                glCullFace(GL_BACK);
+            }
+            mesh.apply_vertex_decode(*current_shader_ptr);
+            if (cluster_culling) {
+                // Cull in object space: the camera moves into the model's frame.
+                // Back facing meshlets are only dropped while GL drops their
+                // triangles anyway, so the image stays the same
+                glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(camera.position, 1.0f));
+                cull_stats = mesh.draw_culled(current_lod, projection * view * model, eye, backface_culling);
+            } else {
+                mesh.draw(current_lod);
+            }
+            glDisable(GL_CULL_FACE);
+        }
+
+        // Sky last, so it only shades pixels nothing else covered
+        if (environment_ready && use_environment && skybox_shader.update()) {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glDepthFunc(GL_LEQUAL);
+            skybox_shader.use();
+            skybox_shader.set_float("intensity", environment_intensity);
+            skybox_shader.set_int("environmentMap", ENVIRONMENT_UNIT);
+            environment_map.bind_cubemap(ENVIRONMENT_UNIT);
+            glBindVertexArray(skybox_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glDepthFunc(GL_LESS);
         }
 
         // Render ImGui
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        frame_uniforms.end_frame();
 
         // Swap buffers and poll events
         glfwSwapBuffers(window);
@@ -418,10 +706,15 @@ int main() {
     }
 
     // Cleanup
-    glDeleteVertexArrays(1, &cube_VAO);
-    glDeleteBuffers(1, &cube_VBO);
-    glDeleteVertexArrays(1, &pyramid_VAO);
-    glDeleteBuffers(1, &pyramid_VBO);
+    meshes.clear();
+    gltf_models.clear();
+    texture_handle = {};
+    virtual_texture = {};
+    environment_map = {};
+    frame_uniforms = {};
+    glDeleteVertexArrays(1, &skybox_vao);
+    glDeleteTextures(static_cast<GLsizei>(procedural_textures.size()), procedural_textures.data());
+    texture_cache.clear();
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
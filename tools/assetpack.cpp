@@ -0,0 +1,94 @@
+// Packs asset directories into one AssetPack the viewer maps at startup
+// instead of opening every file on its own.
+//
+//   assetpack [--compress] [--block-size KiB] [--output file] directory...
+//
+// Files are named by the directory as given plus their path inside it, so
+// run it from where the viewer runs: assetpack assets packs
+// assets/shaders/basic.vert under that name. The output defaults to
+// assets.pack. With --compress, files that shrink are stored as LZ4 blocks
+// the viewer decompresses in parallel; baked .vtex and .ktx2 textures stay
+// uncompressed so the viewer reads their tiles and levels in place.
+
+#include "AssetPack.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string output = "assets.pack";
+    // 0 stores files as they are
+    uint32_t block_size = 0;
+    std::vector<std::string> directories;
+};
+
+void print_usage() {
+    std::cerr << "Usage: assetpack [--compress] [--block-size KiB] [--output file] directory...\n"
+              << "  --compress    store files that shrink as LZ4 blocks\n"
+              << "  --block-size  compressed block size, 64 to 256 KiB, 128 by default; implies --compress\n"
+              << "  --output      pack to write, assets.pack by default" << std::endl;
+}
+
+bool parse_arguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (argument == "--compress") {
+            if (options.block_size == 0) {
+                options.block_size = AssetPack::DEFAULT_BLOCK_SIZE;
+            }
+        } else if (argument == "--block-size" && i + 1 < argc) {
+            options.block_size = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10) * 1024);
+            if (options.block_size < AssetPack::MIN_BLOCK_SIZE || options.block_size > AssetPack::MAX_BLOCK_SIZE) {
+                std::cerr << "ERROR::ASSETPACK::INVALID_BLOCK_SIZE: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (argument.compare(0, 2, "--") == 0) {
+            std::cerr << "ERROR::ASSETPACK::UNKNOWN_OPTION: " << argument << std::endl;
+            return false;
+        } else {
+            options.directories.push_back(argument);
+        }
+    }
+    return !options.directories.empty();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_arguments(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!AssetPack::write(options.output, options.directories, options.block_size)) {
+        return 1;
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+    AssetPack pack(options.output);
+    if (!pack.is_valid()) {
+        return 1;
+    }
+    size_t compressed = 0;
+    uint64_t stored_size = 0;
+    uint64_t size = 0;
+    for (size_t i = 0; i < pack.entry_count(); ++i) {
+        const AssetPackEntry& entry = pack.entry(i);
+        compressed += entry.block_size != 0 ? 1 : 0;
+        stored_size += entry.stored_size;
+        size += entry.size;
+    }
+    std::cout << options.output << ": " << pack.entry_count() << " files, " << compressed << " compressed, "
+              << stored_size / 1024 << " of " << size / 1024 << " KiB (" << static_cast<int>(elapsed.count())
+              << " ms)" << std::endl;
+    return 0;
+}
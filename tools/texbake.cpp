@@ -0,0 +1,218 @@
+// Offline texture baker: decodes images, builds their mip chains and writes
+// them block compressed to KTX2 files the viewer uploads without decoding,
+// or with --virtual cuts them into the tiles VirtualTexture streams.
+//
+//   texbake [--format auto|bc1|bc3|bc5|bc7] [--virtual] [--linear]
+//           [--filter box|kaiser] [--output file] image...
+//
+// By default every image is written next to itself with a .ktx2 extension,
+// which is where TextureLoader looks for it, or .vtex for --virtual.
+
+#include "BlockCompressor.h"
+#include "Ktx2File.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+#include "VirtualTextureFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace {
+
+struct Options {
+    // Empty picks BC1 for opaque images and BC7 otherwise
+    std::optional<BlockFormat> format;
+    // Write a VirtualTextureFile instead of a KTX2 file
+    bool virtual_texture = false;
+    bool srgb = true;
+    MipFilter filter = MipFilter::Kaiser;
+    std::string output;
+    std::vector<std::string> inputs;
+};
+
+void print_usage() {
+    std::cerr << "Usage: texbake [--format auto|bc1|bc3|bc5|bc7] [--virtual] [--linear] [--filter box|kaiser]\n"
+              << "               [--output file] image...\n"
+              << "  --format   block format, auto picks bc1 for opaque images and bc7 otherwise\n"
+              << "  --virtual  write RGBA8 tiles for VirtualTexture to image.vtex instead\n"
+              << "  --linear   the image holds data rather than sRGB color (implied by bc5)\n"
+              << "  --filter   mip downsampling kernel, kaiser by default\n"
+              << "  --output   output file, only with a single image; defaults to image.ktx2 or image.vtex"
+              << std::endl;
+}
+
+bool parse_arguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--format" && has_value) {
+            std::string value = argv[++i];
+            if (value == "auto") {
+                options.format.reset();
+            } else if (value == "bc1") {
+                options.format = BlockFormat::BC1;
+            } else if (value == "bc3") {
+                options.format = BlockFormat::BC3;
+            } else if (value == "bc5") {
+                options.format = BlockFormat::BC5;
+            } else if (value == "bc7") {
+                options.format = BlockFormat::BC7;
+            } else {
+                std::cerr << "ERROR::TEXBAKE::UNKNOWN_FORMAT: " << value << std::endl;
+                return false;
+            }
+        } else if (argument == "--filter" && has_value) {
+            std::string value = argv[++i];
+            if (value == "box") {
+                options.filter = MipFilter::Box;
+            } else if (value == "kaiser") {
+                options.filter = MipFilter::Kaiser;
+            } else {
+                std::cerr << "ERROR::TEXBAKE::UNKNOWN_FILTER: " << value << std::endl;
+                return false;
+            }
+        } else if (argument == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (argument == "--virtual") {
+            options.virtual_texture = true;
+        } else if (argument == "--linear") {
+            options.srgb = false;
+        } else if (argument.starts_with("--")) {
+            std::cerr << "ERROR::TEXBAKE::UNKNOWN_OPTION: " << argument << std::endl;
+            return false;
+        } else {
+            options.inputs.push_back(argument);
+        }
+    }
+    if (options.inputs.empty() || (!options.output.empty() && options.inputs.size() > 1)) {
+        return false;
+    }
+    // Two data channels have no sRGB variant
+    if (options.format == BlockFormat::BC5) {
+        options.srgb = false;
+    }
+    return true;
+}
+
+const char* format_name(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1:
+            return "BC1";
+        case BlockFormat::BC3:
+            return "BC3";
+        case BlockFormat::BC5:
+            return "BC5";
+        case BlockFormat::BC7:
+            return "BC7";
+    }
+    return "?";
+}
+
+bool is_opaque(const unsigned char* rgba, size_t texel_count) {
+    for (size_t i = 0; i < texel_count; ++i) {
+        if (rgba[i * 4 + 3] != 255) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bake(const std::string& input, const Options& options) {
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(input);
+    if (!file.is_open()) {
+        return false;
+    }
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<stbi_uc, void (*)(void*)> image(
+            stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), static_cast<int>(file.size()),
+                                  &width, &height, &channels, 4),
+            stbi_image_free);
+    if (!image) {
+        std::cerr << "ERROR::TEXBAKE::FAILED_TO_DECODE: " << input << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    // Bottom row first, as glCompressedTexImage2D expects; the file is marked
+    // with KTXorientation "ru" so other tools read it the right way up
+    size_t row_bytes = static_cast<size_t>(width) * 4;
+    std::vector<unsigned char> row(row_bytes);
+    for (int top = 0, bottom = height - 1; top < bottom; ++top, --bottom) {
+        unsigned char* a = image.get() + top * row_bytes;
+        unsigned char* b = image.get() + bottom * row_bytes;
+        std::memcpy(row.data(), a, row_bytes);
+        std::memcpy(a, b, row_bytes);
+        std::memcpy(b, row.data(), row_bytes);
+    }
+
+    if (options.virtual_texture) {
+        std::string output = options.output.empty() ? VirtualTextureFile::baked_path_for(input) : options.output;
+        if (!VirtualTextureFile::write(output, image.get(), width, height, options.filter, options.srgb)) {
+            return false;
+        }
+        VirtualTextureFile baked(output);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        if (!baked.is_valid()) {
+            return false;
+        }
+        std::cout << input << " -> " << output << ": " << width << "x" << height << " virtual, "
+                  << baked.level_count() << " levels, " << baked.tiles_x(0) << "x" << baked.tiles_y(0)
+                  << " tiles at level 0 in " << static_cast<int>(elapsed.count()) << " ms" << std::endl;
+        return true;
+    }
+
+    BlockFormat format = options.format.value_or(
+            is_opaque(image.get(), static_cast<size_t>(width) * height) ? BlockFormat::BC1 : BlockFormat::BC7);
+    MipChain chain = MipGenerator::generate(image.get(), width, height, options.filter, options.srgb);
+    image.reset();
+
+    std::vector<std::vector<unsigned char>> levels;
+    size_t compressed_bytes = 0;
+    for (const MipLevel& level : chain.levels) {
+        levels.push_back(BlockCompressor::compress(chain.pixels.data() + level.offset, level.width, level.height,
+                                                   format));
+        compressed_bytes += levels.back().size();
+    }
+
+    std::string output = options.output.empty() ? Ktx2File::baked_path_for(input) : options.output;
+    if (!Ktx2File::write(output, format, options.srgb, width, height, levels)) {
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << input << " -> " << output << ": " << width << "x" << height << " " << format_name(format)
+              << (options.srgb ? " sRGB" : " linear") << ", " << levels.size() << " levels, "
+              << chain.pixels.size() / 1024 << " KiB -> " << compressed_bytes / 1024 << " KiB in "
+              << static_cast<int>(elapsed.count()) << " ms" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_arguments(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    int failures = 0;
+    for (const std::string& input : options.inputs) {
+        if (!bake(input, options)) {
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}